@@ -124,3 +124,6 @@ print (r)
 
 numpy.testing.assert_almost_equal (r.value, [0.], 5)
 numpy.testing.assert_almost_equal (r.x, numpy.array([1., 1.] * n).flatten(), 5)
+
+# Engine evaluations saved by the pool (same x requested several times)
+print ("skipped engine calls: %s" % pool.skippedEngineCalls)
@@ -18,6 +18,8 @@
 #ifndef ROBOPTIM_CORE_PYTHON_TO_PYTHON_HH
 # define ROBOPTIM_CORE_PYTHON_TO_PYTHON_HH
 
+# include <cstddef>
+# include <ostream>
 # include <string>
 
 namespace roboptim
@@ -25,7 +27,16 @@ namespace roboptim
   namespace python
   {
     /// \brief Helper to run Python commands in the Python interpreter.
-    /// WARNING: this is not thread-safe for now (GIL etc.).
+    ///
+    /// Instances can be used from several C++ threads: the GIL is taken
+    /// for each command (it is released when the interpreter is
+    /// initialized). The interpreter is finalized with the last instance,
+    /// preferably by the thread that created the first one: another
+    /// thread takes the GIL with its own thread state to finalize it.
+    ///
+    /// Commands are compiled once and cached. Data should be passed with
+    /// set () rather than formatted in the commands, so that the cache
+    /// stays small and no text conversion is needed.
     class ToPython
     {
     public:
@@ -46,20 +57,36 @@ namespace roboptim
       /// \param cmd command to run.
       const ToPython& operator << (const std::string& cmd) const;
 
+      /// \brief Bind a read-only NumPy view of a vector to a global Python
+      /// variable, without copy. The data must stay valid while the
+      /// variable is used.
+      /// \param name variable name.
+      /// \param data vector data.
+      /// \param size vector size.
+      const ToPython& set (const std::string& name,
+                           const double* data, std::size_t size) const;
+
+      /// \brief Bind a read-only NumPy view of a contiguous vector (e.g. an
+      /// Eigen::VectorXd) to a global Python variable, without copy.
+      /// \param name variable name.
+      /// \param v vector.
+      template <typename V>
+      const ToPython& set (const std::string& name, const V& v) const
+      {
+        return set (name, v.data (), static_cast<std::size_t> (v.size ()));
+      }
+
       /// \brief Flush the output of the Python interpreter.
       /// \param o output stream.
       void operator >> (std::ostream& o);
 
+      /// \brief Set the maximum number of characters of output kept until
+      /// the next flush (the oldest ones are dropped first).
+      static void setBufferCapacity (std::size_t capacity);
+
     private:
       /// \brief Number of instances.
       static int instances_;
-
-      /// \brief Buffering callback.
-      /// \param s string added to the buffer.
-      void buffering (const std::string& s);
-
-      /// \brief Buffer.
-      std::string buffer_;
     };
   } // end of namespace python
 } // end of namespace roboptim
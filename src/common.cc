@@ -19,6 +19,7 @@
 #include <stdexcept>
 
 #include <boost/format.hpp>
+#include <boost/thread/tss.hpp>
 
 #include "common.hh"
 
@@ -38,50 +39,256 @@ namespace roboptim
       // unicode string
       else if (PyUnicode_Check (obj))
       {
-        return PyString_AsString (PyUnicode_AsUTF8String (obj));
+        PyObject* utf8 = PyUnicode_AsUTF8String (obj);
+        if (!utf8)
+        {
+          PyErr_Clear ();
+          return std::string ();
+        }
+        std::string str = PyString_AsString (utf8);
+        Py_DECREF (utf8);
+        return str;
       }
       // object
       else
       {
         PyObject* pyStr = PyObject_Str (obj);
-        std::string str = PyString_AsString (pyStr);
+        if (!pyStr)
+        {
+          PyErr_Clear ();
+          return std::string ();
+        }
+        // Unicode with Python 3.
+        std::string str = toString (pyStr);
         Py_DECREF (pyStr);
         return str;
       }
     }
 
+    namespace
+    {
+      /// \brief New reference to the code object of a frame. Frames are
+      /// opaque from Python 3.11.
+      PyCodeObject* frameCode (PyFrameObject* frame)
+      {
+#if PY_VERSION_HEX >= 0x03090000
+        return PyFrame_GetCode (frame);
+#else
+        Py_INCREF (frame->f_code);
+        return frame->f_code;
+#endif //! PY_VERSION_HEX
+      }
+    } // end of anonymous namespace
+
     void checkPythonError ()
     {
       // Catch error (if any)
-      // TODO: improve the trace
       PyObject *ptype, *pvalue, *ptraceback;
       PyErr_Fetch (&ptype, &pvalue, &ptraceback);
-      if (ptype)
-      {
-        std::string strErrorMessage = toString (pvalue);
-        std::string strTraceback = "";
+      if (!ptype)
+        return;
+
+      PyErr_NormalizeException (&ptype, &pvalue, &ptraceback);
+      std::string strErrorMessage = pvalue ? toString (pvalue) : "";
+      std::string strTraceback = "";
 
-        PyThreadState* tstate = PyThreadState_GET ();
-        if (tstate && tstate->frame)
+      // Frames of the exception traceback, most recent call last.
+      if (ptraceback && PyTraceBack_Check (ptraceback))
+      {
+        strTraceback += "Python stack trace:\n";
+        for (PyTracebackObject* tb =
+               reinterpret_cast<PyTracebackObject*> (ptraceback);
+             tb; tb = tb->tb_next)
         {
-          PyFrameObject* frame = tstate->frame;
-
-          strTraceback += "Python stack trace:\n";
-          while (frame)
-          {
-            int line = frame->f_lineno;
-            const char* filename = PyString_AsString (frame->f_code->co_filename);
-            const char* funcname = PyString_AsString (frame->f_code->co_name);
-            strTraceback += (boost::format ("    %1%(%2%): %3%\n")
-                             % filename % line % funcname).str ();
-            frame = frame->f_back;
-          }
+          PyCodeObject* code = frameCode (tb->tb_frame);
+          int line = PyFrame_GetLineNumber (tb->tb_frame);
+          strTraceback += (boost::format ("    %1%(%2%): %3%\n")
+                           % toString (code->co_filename) % line
+                           % toString (code->co_name)).str ();
+          Py_DECREF (code);
         }
+      }
+
+      Py_DECREF (ptype);
+      Py_XDECREF (pvalue);
+      Py_XDECREF (ptraceback);
+
+      throw std::runtime_error
+        ((boost::format ("Error occurred in Python code: %1%\n%2%")
+          % strErrorMessage % strTraceback).str ());
+    }
 
-        throw std::runtime_error
-          ((boost::format ("Error occurred in Python code: %1%\n%2%")
-            % strErrorMessage % strTraceback).str ());
+    PythonError::PythonError ()
+      : std::runtime_error ("error raised by a Python callback")
+    {
+    }
+
+    namespace
+    {
+      // Scopes are owned by the stack of their thread.
+      void noCleanup (ErrorScope*)
+      {
       }
+
+      boost::thread_specific_ptr<ErrorScope> currentScope (&noCleanup);
+    } // end of anonymous namespace
+
+    ErrorScope::ErrorScope (bool raiseRecoverable)
+      : type_ (0),
+        value_ (0),
+        traceback_ (0),
+        recoverable_ (true),
+        raiseRecoverable_ (raiseRecoverable),
+        failures_ (0),
+        previous_ (currentScope.get ())
+    {
+      currentScope.reset (this);
+    }
+
+    ErrorScope::~ErrorScope ()
+    {
+      currentScope.reset (previous_);
+
+      if (type_)
+      {
+        GILState gil;
+        clear ();
+      }
+    }
+
+    ErrorScope* ErrorScope::current ()
+    {
+      return currentScope.get ();
+    }
+
+    void ErrorScope::fetch (bool recoverable)
+    {
+      PyObject *type, *value, *traceback;
+      PyErr_Fetch (&type, &value, &traceback);
+      if (!type)
+        return;
+
+      ++failures_;
+      if (!type_ || (recoverable_ && !recoverable))
+      {
+        clear ();
+        type_ = type;
+        value_ = value;
+        traceback_ = traceback;
+        recoverable_ = recoverable;
+        return;
+      }
+
+      Py_DECREF (type);
+      Py_XDECREF (value);
+      Py_XDECREF (traceback);
+    }
+
+    bool ErrorScope::restore ()
+    {
+      if (!type_ || (recoverable_ && !raiseRecoverable_))
+        return false;
+
+      // Steal the references.
+      PyErr_Restore (type_, value_, traceback_);
+      type_ = value_ = traceback_ = 0;
+      recoverable_ = true;
+      return true;
+    }
+
+    PyObject* ErrorScope::exception ()
+    {
+      if (type_)
+        PyErr_NormalizeException (&type_, &value_, &traceback_);
+
+      if (!value_)
+      {
+        Py_INCREF (Py_None);
+        return Py_None;
+      }
+
+#if PY_MAJOR_VERSION >= 3
+      if (traceback_)
+        PyException_SetTraceback (value_, traceback_);
+#endif //! PY_MAJOR_VERSION
+
+      Py_INCREF (value_);
+      return value_;
+    }
+
+    std::string ErrorScope::message () const
+    {
+      if (!type_)
+        return "";
+
+      std::string str = PyExceptionClass_Check (type_)
+        ? PyExceptionClass_Name (type_) : "error";
+      if (value_)
+        str += ": " + toString (value_);
+      return str;
+    }
+
+    void ErrorScope::clear ()
+    {
+      Py_XDECREF (type_);
+      Py_XDECREF (value_);
+      Py_XDECREF (traceback_);
+      type_ = value_ = traceback_ = 0;
+      recoverable_ = true;
+    }
+
+    bool errorOccurred ()
+    {
+      GILState gil;
+      return PyErr_Occurred () != 0;
+    }
+
+    PyObject* call (PyObject* callable, PyObject* a0, PyObject* a1,
+                    PyObject* a2, PyObject* a3)
+    {
+      size_t nargs = a3 ? 4 : (a2 ? 3 : 2);
+
+#if PY_VERSION_HEX >= 0x03090000
+      // The first slot is left empty so that bound methods can prepend self
+      // without copying the arguments (PY_VECTORCALL_ARGUMENTS_OFFSET).
+      PyObject* args[5] = {0, a0, a1, a2, a3};
+      return PyObject_Vectorcall
+        (callable, args + 1, nargs | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+#else
+      if (nargs == 2)
+        return PyObject_CallFunctionObjArgs (callable, a0, a1, NULL);
+      else if (nargs == 3)
+        return PyObject_CallFunctionObjArgs (callable, a0, a1, a2, NULL);
+      return PyObject_CallFunctionObjArgs (callable, a0, a1, a2, a3, NULL);
+#endif //! PY_VERSION_HEX
+    }
+
+    GILState::GILState ()
+      : state_ (PyGILState_Ensure ()),
+        acquired_ (true)
+    {
+    }
+
+    GILState::GILState (bool acquire)
+      : state_ (acquire ? PyGILState_Ensure () : PyGILState_UNLOCKED),
+        acquired_ (acquire)
+    {
+    }
+
+    GILState::~GILState ()
+    {
+      if (acquired_)
+        PyGILState_Release (state_);
+    }
+
+    GILRelease::GILRelease ()
+      : state_ (PyEval_SaveThread ())
+    {
+    }
+
+    GILRelease::~GILRelease ()
+    {
+      PyEval_RestoreThread (state_);
     }
   } // end of namespace python
 } // end of namespace roboptim
@@ -15,6 +15,12 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
 
+#ifndef ROBOPTIM_CORE_PYTHON_COMMON_HH
+# define ROBOPTIM_CORE_PYTHON_COMMON_HH
+
+#include <stdexcept>
+#include <string>
+
 #include <Python.h>
 
 // Python 3 support
@@ -27,12 +33,150 @@
 # define PyString_AsString   PyBytes_AsString
 #endif //! PY_MAJOR_VERSION
 
+// METH_FASTCALL is part of the stable calling conventions from Python 3.7.
+#if PY_VERSION_HEX >= 0x03070000
+# define ROBOPTIM_CORE_PYTHON_FASTCALL
+#endif //! PY_VERSION_HEX
+
 namespace roboptim
 {
   namespace python
   {
     std::string toString (PyObject* obj);
 
+    /// \brief Throw a std::runtime_error describing the pending Python
+    /// error (if any), with its traceback.
     void checkPythonError ();
+
+    /// \brief Exception thrown through the solvers when a Python callback
+    /// failed. It carries no Python object: the exception itself is kept by
+    /// the current ErrorScope, to be raised again by the caller.
+    class PythonError : public std::runtime_error
+    {
+    public:
+      PythonError ();
+    };
+
+    /// \brief Collect the Python exceptions raised by the callbacks
+    /// evaluated in the calling thread during the lifetime of the object
+    /// (e.g. during a solve). Scopes can be nested, the innermost one
+    /// collecting the errors.
+    ///
+    /// Only the first exception is kept, with its original traceback
+    /// object, the following ones being counted. An unrecoverable error
+    /// replaces a recoverable one.
+    class ErrorScope
+    {
+    public:
+      /// \brief Open a scope (the GIL is not required).
+      /// \param raiseRecoverable whether restore also raises recoverable
+      /// errors, e.g. for evaluations outside of a solve.
+      explicit ErrorScope (bool raiseRecoverable = false);
+
+      /// \brief Close the scope, dropping the error not restored.
+      ~ErrorScope ();
+
+      /// \brief Innermost scope of the calling thread (null if none).
+      static ErrorScope* current ();
+
+      /// \brief Move the pending Python error (if any) to the scope.
+      /// The GIL must be held.
+      /// \param recoverable whether the callback reported the failure to
+      /// the solver (e.g. with NaN) instead of aborting the solve.
+      void fetch (bool recoverable);
+
+      /// \brief Whether an unrecoverable error was collected.
+      bool raised () const
+      {
+        return type_ && !recoverable_;
+      }
+
+      /// \brief Number of failed callbacks.
+      unsigned long failures () const
+      {
+        return failures_;
+      }
+
+      /// \brief Raise the unrecoverable error again, or the recoverable
+      /// one if the scope raises them (GIL held).
+      /// \return whether an error was raised.
+      bool restore ();
+
+      /// \brief New reference to the collected exception (None if none),
+      /// its traceback being attached to it (GIL held).
+      PyObject* exception ();
+
+      /// \brief Type and message of the collected exception (GIL held).
+      std::string message () const;
+
+    private:
+      ErrorScope (const ErrorScope&);
+      ErrorScope& operator= (const ErrorScope&);
+
+      void clear ();
+
+      PyObject* type_;
+      PyObject* value_;
+      PyObject* traceback_;
+      bool recoverable_;
+      bool raiseRecoverable_;
+      unsigned long failures_;
+      ErrorScope* previous_;
+    };
+
+    /// \brief Check whether a Python error is pending, whether the calling
+    /// thread holds the GIL or not.
+    bool errorOccurred ();
+
+    /// \brief Call a Python callable with positional arguments.
+    /// When available, the vectorcall protocol is used so that no argument
+    /// tuple has to be allocated.
+    /// \param callable Python callable.
+    /// \param a0 first argument.
+    /// \param a1 second argument.
+    /// \param a2 optional third argument.
+    /// \param a3 optional fourth argument (requires a2).
+    /// \return new reference to the result (null on failure).
+    PyObject* call (PyObject* callable, PyObject* a0, PyObject* a1,
+                    PyObject* a2 = 0, PyObject* a3 = 0);
+
+    /// \brief Hold the GIL for the lifetime of the object.
+    /// This can be used from any thread, whether it already holds the GIL
+    /// or not.
+    class GILState
+    {
+    public:
+      GILState ();
+
+      /// \param acquire whether the GIL is taken (e.g. not for native
+      /// callbacks, that run without it).
+      explicit GILState (bool acquire);
+
+      ~GILState ();
+
+    private:
+      GILState (const GILState&);
+      GILState& operator= (const GILState&);
+
+      PyGILState_STATE state_;
+      bool acquired_;
+    };
+
+    /// \brief Release the GIL for the lifetime of the object.
+    /// The calling thread must hold the GIL.
+    class GILRelease
+    {
+    public:
+      GILRelease ();
+      ~GILRelease ();
+
+    private:
+      GILRelease (const GILRelease&);
+      GILRelease& operator= (const GILRelease&);
+
+      PyThreadState* state_;
+    };
   } // end of namespace python
 } // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_PYTHON_COMMON_HH
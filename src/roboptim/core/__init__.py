@@ -2,12 +2,14 @@ from __future__ import \
     print_function, unicode_literals, absolute_import, division
 
 import abc
+import concurrent.futures
 import inspect
+import multiprocessing
+import multiprocessing.sharedctypes
 import os
+import threading
 import numpy
 
-from concurrent.futures import ProcessPoolExecutor, as_completed
-
 # Here, we use RTLD_GLOBAL to link with roboptim-core since the Python module
 # is a plugin, itself calling RobOptim solver plugins. Without this, the Python
 # plugin cannot access local symbols of roboptim-core. This is not ideal, but
@@ -16,13 +18,52 @@ from concurrent.futures import ProcessPoolExecutor, as_completed
 from ctypes import CDLL, RTLD_GLOBAL
 CDLL("libroboptim-core.so", RTLD_GLOBAL)
 
+import ctypes
+
 from .wrap import *
 
-def parallel_pool_jac_eval(data):
-    f = data[0]
-    x = data[1]
-    i = data[2]
-    return i, f.jacobian (x)
+# Signature of the native callbacks accepted by bindCompute, bindGradient
+# and bindJacobian: void (double* out, const double* x, int n, int m,
+# void* userdata), with n the input size and m the output size (the output
+# index for gradients).
+NativeCallback = ctypes.CFUNCTYPE (None, ctypes.POINTER (ctypes.c_double),
+                                   ctypes.POINTER (ctypes.c_double),
+                                   ctypes.c_int, ctypes.c_int,
+                                   ctypes.c_void_p)
+
+# State of a PyFunctionPool worker process, set once by _poolWorkerInit.
+_poolWorker = dict()
+
+def _poolWorkerInit (callback, functions, ranges, x, values, jac):
+    _poolWorker["callback"] = callback
+    _poolWorker["functions"] = functions
+    _poolWorker["ranges"] = ranges
+    # Views of the shared memory buffers
+    _poolWorker["x"] = numpy.frombuffer (x)
+    _poolWorker["values"] = numpy.frombuffer (values)
+    _poolWorker["jac"] = numpy.frombuffer (jac).reshape ((len (values), len (x)))
+
+def _poolWorkerRun (task):
+    """
+    Evaluate a chunk of the pool functions at the shared x, and write the
+    results in place in the shared buffers.
+    """
+    (mode, indices) = task
+    w = _poolWorker
+    x = w["x"]
+    # Each worker has its own copy of the callback (engine), which has to
+    # be updated before the functions that depend on it.
+    if mode == "compute":
+        w["callback"] (x)
+        for i in indices:
+            (start, end) = w["ranges"][i]
+            w["values"][start:end] = w["functions"][i] (x)
+    else:
+        w["callback"].jacobian (x)
+        for i in indices:
+            (start, end) = w["ranges"][i]
+            w["jac"][start:end,:] = w["functions"][i].jacobian (x)
+    return len (indices)
 
 class PyFunction(object):
     __metaclass__ = abc.ABCMeta
@@ -33,8 +74,32 @@ class PyFunction(object):
         self._setCallbacks()
 
     def _setCallbacks (self):
-        bindCompute (self._function,
-                     lambda result, x: self.impl_compute (result, x))
+        # Bound methods are given directly to avoid an extra Python frame
+        # per evaluation.
+        bindCompute (self._function, self.impl_compute)
+
+        # Optional vectorized implementation
+        if self._isOverriden ("impl_compute_batch"):
+            bindComputeBatch (self._function, self.impl_compute_batch)
+
+    def bindNative (self, compute, userdata = None):
+        """
+        Evaluate the function with a native function pointer (numba.cfunc,
+        ctypes NativeCallback, or integer address e.g. from cffi), called
+        without the GIL and without NumPy views. userdata may be an integer
+        address or a buffer (e.g. a NumPy array of parameters), which is
+        kept alive. Native callbacks cannot raise exceptions.
+        """
+        bindCompute (self._function, compute, userdata)
+
+    def _isOverriden (self, name):
+        """
+        Check whether an optional callback was reimplemented by a subclass.
+        """
+        for B in type(self).__mro__:
+            if name in B.__dict__:
+                return B not in (PyFunction, PyDifferentiableFunction)
+        return False
 
     def inputSize (self):
         return inputSize (self._function)
@@ -72,14 +137,117 @@ class PyFunction(object):
     def impl_compute (self, result, x):
         return
 
-    def __call__(self, x):
-        result = numpy.zeros (self.outputSize (), order=self.order())
-        compute (self._function, result, x)
+    def impl_compute_batch (self, result, X):
+        """
+        Optional vectorized evaluation: X stores one point per row, and
+        result receives one value per row.
+        """
+        raise NotImplementedError
+
+    # Whether evaluations without out= reuse per-function buffers.
+    _reuseBuffers = False
+
+    def _evaluate (self, evaluate, key, out, *args):
+        """
+        Evaluate into out if given, else into the reusable buffer of key
+        if enabled, else into a new array allocated by the binding.
+        """
+        if out is None and self._reuseBuffers:
+            out = self._buffers.get (key)
+            if out is None:
+                out = evaluate (self._function, None, *args)
+                self._buffers[key] = out
+                return out
+        if out is None:
+            return evaluate (self._function, None, *args)
+        evaluate (self._function, out, *args)
+        return out
+
+    def reuseBuffers (self, enabled = True):
+        """
+        Reuse one output buffer per kind of evaluation (compute, gradient,
+        jacobian) instead of allocating a new array per call. The returned
+        arrays are then overwritten by the next evaluation of the same kind.
+        """
+        self._reuseBuffers = enabled
+        self._buffers = dict ()
+
+    @property
+    def strict (self):
+        """
+        Strict array mode: NumPy arrays given to evaluations (x or out)
+        must be float64, aligned and in the storage order (see order ()),
+        otherwise a ValueError is raised instead of silently copying them.
+        The number of such copies is given by stats["copies"].
+        """
+        return getStrictArrays (self._function)
+
+    @strict.setter
+    def strict (self, enabled):
+        setStrictArrays (self._function, enabled)
+
+    def __call__(self, x, out = None):
+        # f(g) builds the native composition.
+        if isinstance (x, PyFunction):
+            return PyChain (self, x)
+        if out is None and not self._reuseBuffers:
+            # Method of the native function object: a single C call.
+            return self._function.compute (None, x)
+        return self._evaluate (compute, "compute", out, x)
+
+    def computeBatch (self, X):
+        """
+        Evaluate the function over a (N x inputSize) array of points.
+        """
+        X = numpy.asarray (X, dtype=numpy.float64)
+        result = numpy.zeros ((X.shape[0], self.outputSize ()))
+        computeBatch (self._function, result, X)
         return result
 
     def __str__ (self):
         return strFunction (self._function)
 
+    @property
+    def stats (self):
+        """
+        Evaluation statistics: number of calls, total/maximum wall time, and
+        time spent in Python versus in the bridge (in seconds), for compute,
+        gradient and jacobian. A Jacobian built from the gradients is only
+        counted as gradient calls. "copies" counts the arrays that had to be
+        copied because of their dtype or storage order, and "failures" the
+        callbacks that raised (both always counted).
+        """
+        return getStats (self._function)
+
+    @property
+    def errorMode (self):
+        """
+        How the exceptions raised by the callbacks during a solve are
+        reported to the solver:
+
+        - "raise" (default): the solve is aborted, and the exception is
+          raised again by PySolver.solve, with its original traceback.
+        - "nan": the output is filled with NaN, a recoverable evaluation
+          failure for solvers such as Ipopt (which backtrack). The solve
+          goes on; the failures are counted by PySolver.evaluationFailures.
+
+        Outside of a solve, evaluations always raise.
+        """
+        return getErrorMode (self._function)
+
+    @errorMode.setter
+    def errorMode (self, mode):
+        setErrorMode (self._function, mode)
+
+    def enableStats (self, enabled = True):
+        """
+        Enable the evaluation statistics (disabled by default).
+        """
+        enableStats (self._function, enabled)
+
+    def resetStats (self):
+        resetStats (self._function)
+
     def _getStateImpl(self, odict):
         # Remove PyCapsule object
         del odict["_function"]
@@ -87,6 +255,9 @@ class PyFunction(object):
     def __getstate__(self):
         odict = self.__dict__.copy()
         self._getStateImpl(odict)
+        # Buffers are reallocated on demand
+        odict.pop ("_buffers", None)
+        odict["strict"] = self.strict
         odict["inSize"] = self.inputSize ()
         odict["outSize"] = self.outputSize ()
         odict["name"] = self.name ()
@@ -101,7 +272,11 @@ class PyFunction(object):
         del idict["inSize"]
         del idict["outSize"]
         del idict["name"]
+        strict = idict.pop ("strict", False)
         self.__dict__.update(idict)
+        if self._reuseBuffers:
+            self._buffers = dict ()
+        self.strict = strict
         self._setCallbacks ()
 
     @classmethod
@@ -117,42 +292,168 @@ class PyFunction(object):
 class PyDifferentiableFunction(PyFunction):
     __metaclass__ = abc.ABCMeta
 
+    # Layout written by impl_jacobian and native Jacobian callbacks: "C"
+    # (row-major), "F" (column-major), or None for the storage order (see
+    # order ()). In the storage order, impl_jacobian writes the solver
+    # buffer directly; in the other layout, it receives a contiguous buffer
+    # in that layout, assigned natively to the solver buffer.
+    jacobianLayout = None
+
     def __init__ (self, inSize, outSize, name):
         self._function = DifferentiableFunction (inSize, outSize,
                                                  self._formatName(name))
         self._setCallbacks()
 
     def _setCallbacks (self):
-        bindCompute (self._function,
-                     lambda result, x: self.impl_compute (result, x))
-        gradientCb = lambda result, x, fid: self.impl_gradient (result, x, fid)
-        bindGradient (self._function, gradientCb)
+        bindCompute (self._function, self.impl_compute)
+        bindGradient (self._function, self.impl_gradient)
 
         # If the user reimplemented impl_jacobian
         if self._impl_jacobian_overriden():
-            jacobianCb = lambda result, x: self.impl_jacobian (result, x)
-            bindJacobian (self._function, jacobianCb)
+            bindJacobian (self._function, self.impl_jacobian)
         # Else we will rely on RobOptim's default C++ implementation
+        if self.jacobianLayout is not None:
+            setJacobianLayout (self._function, self.jacobianLayout)
+
+        # Optional vectorized implementations
+        if self._isOverriden ("impl_compute_batch"):
+            bindComputeBatch (self._function, self.impl_compute_batch)
+        if self._isOverriden ("impl_gradient_batch"):
+            bindGradientBatch (self._function, self.impl_gradient_batch)
+        if self._isOverriden ("impl_jacobian_batch"):
+            bindJacobianBatch (self._function, self.impl_jacobian_batch)
+        if self._isOverriden ("impl_value_jacobian"):
+            bindValueJacobian (self._function, self.impl_value_jacobian)
+
+    def bindNative (self, compute = None, gradient = None, jacobian = None,
+                    userdata = None):
+        """
+        Bind native function pointers (see PyFunction.bindNative). The
+        gradient callback receives the output index as m, and the Jacobian
+        callback writes the (m x n) Jacobian contiguously in jacobianLayout
+        (by default, the storage order). Without native Jacobian, it is
+        built from the gradients. Functions whose callbacks are all native
+        can be evaluated concurrently by several threads (e.g. by finite
+        differences).
+        """
+        if compute is not None:
+            bindCompute (self._function, compute, userdata)
+        if gradient is not None:
+            bindGradient (self._function, gradient, userdata)
+        if jacobian is not None:
+            bindJacobian (self._function, jacobian, userdata)
 
     def _impl_jacobian_overriden(self):
         return id(PyDifferentiableFunction.__dict__['impl_jacobian']) \
                != id(self.impl_jacobian.__func__)
 
+    # Arithmetic operators build native expressions (see PyPlus, PyScalar,
+    # PySelection...), evaluated without Python glue between the
+    # functions. NumPy scalars defer to these operators.
+    __array_ufunc__ = None
+
+    def __add__ (self, other):
+        if isinstance (other, PyFunction):
+            return PyPlus (self, other)
+        return PyScalar (self, 1., other)
+
+    def __radd__ (self, other):
+        return PyScalar (self, 1., other)
+
+    def __sub__ (self, other):
+        if isinstance (other, PyFunction):
+            return PyMinus (self, other)
+        return PyScalar (self, 1., -numpy.asarray (other, dtype=float))
+
+    def __rsub__ (self, other):
+        return PyScalar (self, -1., other)
+
+    def __neg__ (self):
+        return PyScalar (self, -1.)
+
+    def __mul__ (self, other):
+        if isinstance (other, PyFunction):
+            return NotImplemented
+        return PyScalar (self, other)
+
+    __rmul__ = __mul__
+
+    def __truediv__ (self, other):
+        if isinstance (other, PyFunction):
+            return NotImplemented
+        return PyScalar (self, 1. / other)
+
+    __div__ = __truediv__
+
+    def __getitem__ (self, key):
+        """
+        f[i] selects one output, f[i:j] a range of outputs.
+        """
+        if isinstance (key, slice):
+            start, stop, step = key.indices (self.outputSize ())
+            if step != 1:
+                raise ValueError ("only contiguous outputs can be selected")
+            return PySelection (self, start, stop - start)
+        key = int (key)
+        if key < 0:
+            key += self.outputSize ()
+        return PySplit (self, key)
+
     @abc.abstractmethod
     def impl_gradient (self, result, x, functionId):
         return
 
-    def gradient (self, x, functionId):
-        g = numpy.zeros (self.inputSize (), order=self.order())
-        gradient (self._function, g, x, functionId)
-        return g
+    def gradient (self, x, functionId, out = None):
+        if out is None and not self._reuseBuffers:
+            return self._function.gradient (None, x, functionId)
+        return self._evaluate (gradient, "gradient", out, x, functionId)
 
     def impl_jacobian (self, result, x):
         return NotImplementedError
 
-    def jacobian (self, x):
-        jac = numpy.zeros ((self.outputSize (), self.inputSize ()), order=self.order())
-        jacobian (self._function, jac, x)
+    def jacobian (self, x, out = None):
+        if out is None and not self._reuseBuffers:
+            return self._function.jacobian (None, x)
+        return self._evaluate (jacobian, "jacobian", out, x)
+
+    def impl_gradient_batch (self, result, X, functionId):
+        """
+        Optional vectorized gradient: result receives one gradient per row.
+        """
+        raise NotImplementedError
+
+    def impl_jacobian_batch (self, result, X):
+        """
+        Optional vectorized Jacobian: result is a C-ordered
+        (N x outputSize x inputSize) array.
+        """
+        raise NotImplementedError
+
+    def impl_value_jacobian (self, result, jacobian, x):
+        """
+        Optional joint evaluation of the value and the Jacobian at x, used
+        by PyCachedFunction in joint mode. It is counted as a Jacobian
+        call in the statistics.
+        """
+        raise NotImplementedError
+
+    def gradientBatch (self, X, functionId):
+        """
+        Evaluate a gradient over a (N x inputSize) array of points.
+        """
+        X = numpy.asarray (X, dtype=numpy.float64)
+        g = numpy.zeros ((X.shape[0], self.inputSize ()))
+        gradientBatch (self._function, g, X, functionId)
+        return g
+
+    def jacobianBatch (self, X):
+        """
+        Evaluate the Jacobian over a (N x inputSize) array of points. The
+        result is a C-ordered (N x outputSize x inputSize) array.
+        """
+        X = numpy.asarray (X, dtype=numpy.float64)
+        jac = numpy.zeros ((X.shape[0], self.outputSize (), self.inputSize ()))
+        jacobianBatch (self._function, jac, X)
         return jac
 
     def _setStateImpl(self, idict):
@@ -169,19 +470,147 @@ class PyDifferentiableFunction(PyFunction):
         return NotImplemented
 
 
+class PyTwiceDifferentiableFunction(PyDifferentiableFunction):
+    """
+    Differentiable function with an exact Hessian. impl_hessian receives a
+    (inputSize x inputSize) view of the solver buffer, following RobOptim's
+    storage order, for the output functionId.
+    """
+    __metaclass__ = abc.ABCMeta
+
+    def __init__ (self, inSize, outSize, name):
+        self._function = TwiceDifferentiableFunction (inSize, outSize,
+                                                      self._formatName(name))
+        self._setCallbacks()
+
+    def _setCallbacks (self):
+        PyDifferentiableFunction._setCallbacks (self)
+        bindHessian (self._function, self.impl_hessian)
+
+    @abc.abstractmethod
+    def impl_hessian (self, result, x, functionId):
+        return
+
+    def hessian (self, x, functionId = 0, out = None):
+        return self._evaluate (hessian, "hessian", out, x, functionId)
+
+    def _setStateImpl(self, idict):
+        self._function = TwiceDifferentiableFunction (idict["inSize"], idict["outSize"],
+                                                      self._formatName(idict["name"]))
+
+
+class PySparseDifferentiableFunction(PyFunction):
+    """
+    Differentiable function with a sparse Jacobian.
+
+    The sparsity pattern (a SciPy sparse matrix, or any array whose
+    non-zero entries are the structural non-zeros) is fixed at
+    construction. impl_jacobian receives a SciPy compressed matrix (CSC,
+    or CSR for a row-major storage order) sharing the solver buffers: its
+    data can be filled in place. A sparse matrix may also be returned, in
+    which case its entries are copied over the sparsity pattern.
+    """
+    __metaclass__ = abc.ABCMeta
+
+    def __init__ (self, inSize, outSize, name, pattern):
+        import scipy.sparse
+        self._function = SparseDifferentiableFunction (inSize, outSize,
+                                                       self._formatName(name))
+        coo = scipy.sparse.coo_matrix (pattern)
+        setSparsityPattern (self._function, coo.row, coo.col)
+        self._setCoordinates ()
+        self._setCallbacks()
+
+    def _setCoordinates (self):
+        # Coordinates of the structural non-zeros, in storage order
+        (indices, indptr) = getSparsityPattern (self._function)
+        outer = numpy.repeat (numpy.arange (len (indptr) - 1),
+                              numpy.diff (indptr))
+        if self.order () == 'F':
+            self._rows, self._cols = indices, outer
+        else:
+            self._rows, self._cols = outer, indices
+
+    def _setCallbacks (self):
+        bindCompute (self._function, self.impl_compute)
+        bindJacobian (self._function, self._jacobianCallback)
+
+    def _matrix (self, data, indices, indptr):
+        import scipy.sparse
+        matrixType = scipy.sparse.csc_matrix if self.order () == 'F' \
+                     else scipy.sparse.csr_matrix
+        return matrixType ((data, indices, indptr), copy=False,
+                           shape=(self.outputSize (), self.inputSize ()))
+
+    def _jacobianCallback (self, data, indices, indptr, x):
+        import scipy.sparse
+        result = self._matrix (data, indices, indptr)
+        value = self.impl_jacobian (result, x)
+        if value is not None and value is not result:
+            value = scipy.sparse.csr_matrix (value)
+            data[:] = numpy.asarray (value[self._rows, self._cols]).ravel ()
+
+    @abc.abstractmethod
+    def impl_jacobian (self, result, x):
+        return
+
+    def jacobian (self, x):
+        return self._matrix (*sparseJacobian (self._function, x))
+
+    def gradient (self, x, functionId):
+        return self.jacobian (x)[functionId].toarray ().ravel ()
+
+    def gradientBatch (self, X, functionId):
+        raise NotImplementedError ("batch derivatives are not supported for"
+                                   " sparse functions")
+
+    def jacobianBatch (self, X):
+        raise NotImplementedError ("batch derivatives are not supported for"
+                                   " sparse functions")
+
+    def _setStateImpl(self, idict):
+        self._function = SparseDifferentiableFunction (idict["inSize"],
+                                                       idict["outSize"],
+                                                       self._formatName(idict["name"]))
+        setSparsityPattern (self._function, idict["_rows"], idict["_cols"])
+
+
 class PyFunctionPool(PyDifferentiableFunction):
+    """
+    Pool of functions sharing a callback (engine) that is evaluated first.
+
+    In the serial case, the native RobOptim pool is used: each function
+    writes directly into its row block of the result (or Jacobian) buffer.
+
+    With n_proc > 1, the functions are evaluated by a persistent pool of
+    worker processes, started on the first evaluation. x, the values and
+    the Jacobian are exchanged through shared memory: each worker runs its
+    copy of the callback, then writes the row blocks of its functions in
+    place. The callback of the master process is not evaluated. Call
+    close () to stop the workers.
+
+    The callback is only evaluated again when x changes (tracked separately
+    for the values and the Jacobian), see skippedEngineCalls. Call
+    invalidateEngine () if the state of the callback is modified from
+    outside of the pool.
+    """
     def __init__ (self, callback, functions, name = "", n_proc = 0):
         self._callback = callback
         self._functions = functions
         inSize = callback.inputSize ()
         outSize = sum([f.outputSize() for f in functions])
-        self._function = DifferentiableFunction (inSize, outSize,
-                                                 self._formatName(name))
-        bindCompute (self._function,
-                     lambda result, x: self.impl_compute (result, x))
-
-        bindJacobian (self._function,
-                      lambda result, x: self.impl_jacobian (result, x))
+        if n_proc > 1:
+            self._function = DifferentiableFunction (inSize, outSize,
+                                                     self._formatName(name))
+            bindCompute (self._function,
+                         lambda result, x: self.impl_compute (result, x))
+
+            bindJacobian (self._function,
+                          lambda result, x: self.impl_jacobian (result, x))
+        else:
+            self._function = FunctionPool (callback._function,
+                                           [f._function for f in functions],
+                                           self._formatName(name))
 
         # Can be used as a row index for parallel Jacobian filling process
         self._ranges = list()
@@ -193,50 +622,124 @@ class PyFunctionPool(PyDifferentiableFunction):
 
         # Multiprocessing support
         self._n_proc = n_proc
+        self._workers = None
+
+        # Last x of the parallel evaluations (the native pool tracks them
+        # in the serial case).
+        self._valueX = None
+        self._jacobianX = None
+        self._skipped = dict (compute = 0, jacobian = 0)
+
+    @property
+    def skippedEngineCalls (self):
+        """
+        Number of callback evaluations skipped because x did not change,
+        for "compute" and "jacobian".
+        """
+        if self._n_proc <= 1:
+            return getSkippedEngineCalls (self._function)
+        return dict (self._skipped)
+
+    def resetSkippedEngineCalls (self):
+        if self._n_proc <= 1:
+            resetSkippedEngineCalls (self._function)
+        else:
+            self._skipped = dict (compute = 0, jacobian = 0)
+
+    def invalidateEngine (self):
+        """
+        Evaluate the callback again on the next evaluations.
+        """
+        if self._n_proc <= 1:
+            invalidateEngine (self._function)
+        self._valueX = None
+        self._jacobianX = None
+
+    def _startWorkers (self):
+        inSize = self.inputSize ()
+        outSize = self.outputSize ()
+        RawArray = multiprocessing.sharedctypes.RawArray
+        self._sharedX = RawArray ('d', inSize)
+        self._sharedValues = RawArray ('d', outSize)
+        self._sharedJac = RawArray ('d', outSize * inSize)
+        # New shared buffers: nothing is evaluated yet.
+        self._valueX = None
+        self._jacobianX = None
+
+        # One task (contiguous chunk of functions) per worker and request
+        chunks = numpy.array_split (numpy.arange (len (self._functions)),
+                                    self._n_proc)
+        self._chunks = [[int (i) for i in c] for c in chunks if len (c) > 0]
+
+        self._workers = multiprocessing.Pool \
+            (processes = self._n_proc, initializer = _poolWorkerInit,
+             initargs = (self._callback, self._functions, self._ranges,
+                         self._sharedX, self._sharedValues, self._sharedJac))
+
+    def _parallelEval (self, mode, x):
+        if self._workers is None:
+            self._startWorkers ()
+        numpy.frombuffer (self._sharedX)[:] = x
+        self._workers.map (_poolWorkerRun,
+                           [(mode, c) for c in self._chunks])
+
+    def close (self):
+        """
+        Stop the worker processes (if any).
+        """
+        if getattr (self, "_workers", None) is not None:
+            self._workers.terminate ()
+            self._workers.join ()
+            self._workers = None
+
+    def __del__ (self):
+        self.close ()
 
     def impl_compute (self, result, x):
-        # Run callback
-        self._callback (x)
+        if self._n_proc <= 1:
+            compute (self._function, result, x)
+            return
 
-        # Fill result
-        for i,f in enumerate(self._functions):
-            start = self._ranges[i][0]
-            end = self._ranges[i][1]
-            result[start:end] = f(x)
+        # The shared values are still valid if x did not change.
+        if self._valueX is not None and numpy.array_equal (x, self._valueX):
+            self._skipped["compute"] += 1
+        else:
+            self._valueX = None
+            # Each worker runs its own copy of the callback: the one of
+            # the master process is not evaluated.
+            self._parallelEval ("compute", x)
+            self._valueX = numpy.array (x)
+        result[:] = numpy.frombuffer (self._sharedValues)
 
     def impl_gradient (self, result, x, functionId):
         raise NotImplementedError
 
     def impl_jacobian (self, result, x):
-        # FIXME: find why this fails (callback not called)
-        #        In the meantime, we implement this in Python
-        #jacobian (self._function, result, x)
-
-        # Run callback
-        self._callback.jacobian (x)
-
-        def parallel_pool_jac_fill(future):
-            idx, value = future.result()
-            result[self._ranges[idx][0]:self._ranges[idx][1]] = value
-
-        # Fill Jacobian
-        # Parallel implementation
-        if self._n_proc > 1:
-            with ProcessPoolExecutor(max_workers=self._n_proc) as executor:
-                jobs = [executor.submit(parallel_pool_jac_eval, (f, x, i)) \
-                        .add_done_callback(parallel_pool_jac_fill)
-                        for i,f in enumerate(self._functions)]
-        # Serial implementation
+        # Serial implementation: native pool
+        if self._n_proc <= 1:
+            jacobian (self._function, result, x)
+            return
+
+        if self._jacobianX is not None \
+           and numpy.array_equal (x, self._jacobianX):
+            self._skipped["jacobian"] += 1
         else:
-            for i,f in enumerate(self._functions):
-                start = self._ranges[i][0]
-                end = self._ranges[i][1]
-                result[start:end,:] = f.jacobian (x)
-
-    def jacobian (self, x):
-        jac = numpy.zeros ((self.outputSize (), self.inputSize ()), order=self.order())
-        self.impl_jacobian (jac, x)
-        return jac
+            self._jacobianX = None
+            # Each worker runs its own copy of the callback: the one of
+            # the master process is not evaluated.
+            self._parallelEval ("jacobian", x)
+            self._jacobianX = numpy.array (x)
+        result[:] = numpy.frombuffer (self._sharedJac) \
+                         .reshape ((self.outputSize (), self.inputSize ()))
+
+    def jacobian (self, x, out = None):
+        if self._n_proc <= 1:
+            return PyDifferentiableFunction.jacobian (self, x, out)
+        if out is None:
+            out = numpy.zeros ((self.outputSize (), self.inputSize ()),
+                               order=self.order())
+        self.impl_jacobian (out, x)
+        return out
 
 
 class FiniteDifferenceRule:
@@ -244,17 +747,52 @@ class FiniteDifferenceRule:
     FIVE_POINTS = 2
 
 
+def _sparsityCoordinates (pattern):
+    """
+    Coordinates (rows, cols) of the structural non-zeros of a pattern, given
+    as a SciPy sparse matrix or as a (boolean) array.
+    """
+    if hasattr (pattern, "tocoo"):
+        coo = pattern.tocoo ()
+        return coo.row, coo.col
+    return numpy.nonzero (numpy.asarray (pattern))
+
 class PyFiniteDifference(PyDifferentiableFunction):
-    def __init__ (self, f, epsilon = 1e-8, rule = FiniteDifferenceRule.SIMPLE):
+    """
+    Finite-difference gradient of f. If f implements impl_compute_batch, all
+    the perturbed points of a gradient/Jacobian are evaluated in a single
+    call. Native (thread-safe) functions are evaluated on n_threads threads
+    (0: hardware concurrency).
+
+    If the Jacobian sparsity pattern of f is given (SciPy sparse matrix or
+    boolean array), structurally independent columns are perturbed together.
+    """
+    def __init__ (self, f, epsilon = 1e-8, rule = FiniteDifferenceRule.SIMPLE,
+                  n_threads = 1, pattern = None):
+        if isinstance (f, PySparseDifferentiableFunction):
+            raise NotImplementedError ("finite differences are not supported"
+                                       " for sparse functions")
         PyDifferentiableFunction.__init__ \
             (self, f.inputSize (), f.outputSize (), \
              self._decodeName (f.name ()))
         if rule == FiniteDifferenceRule.SIMPLE:
-            self._fd = SimpleFiniteDifferenceGradient (f._function, epsilon)
+            self._fd = SimpleFiniteDifferenceGradient (f._function, epsilon,
+                                                       n_threads)
         elif rule == FiniteDifferenceRule.FIVE_POINTS:
-            self._fd = FivePointsFiniteDifferenceGradient (f._function, epsilon)
+            self._fd = FivePointsFiniteDifferenceGradient (f._function, epsilon,
+                                                           n_threads)
         else:
             raise ValueError("Unknown finite-difference rule.")
+        if pattern is not None:
+            (rows, cols) = _sparsityCoordinates (pattern)
+            setSparsityPattern (self._fd, rows, cols)
+
+    @property
+    def directions (self):
+        """
+        Number of perturbation directions (column groups) per Jacobian.
+        """
+        return finiteDifferenceDirections (self._fd)
 
     def impl_compute (self, result, x):
         compute (self._fd, result, x)
@@ -265,13 +803,53 @@ class PyFiniteDifference(PyDifferentiableFunction):
     def impl_jacobian (self, result, x):
         jacobian (self._fd, result, x)
 
+    def impl_compute_batch (self, result, X):
+        computeBatch (self._fd, result, X)
+
+    def impl_gradient_batch (self, result, X, functionId):
+        gradientBatch (self._fd, result, X, functionId)
+
+    def impl_jacobian_batch (self, result, X):
+        jacobianBatch (self._fd, result, X)
+
 
 class PyCachedFunction(PyDifferentiableFunction):
-    def __init__ (self, f, size):
+    def __init__ (self, f, size, tolerance = 0., joint = False):
+        """
+        Cache the evaluations of f at the last size points.
+
+        If tolerance is positive, the arguments are quantized with this
+        step, so that points that only differ by floating-point noise share
+        the same entry. Coordinates are rounded to the nearest multiple of
+        tolerance, so two nearby points on both sides of a rounding
+        boundary still get different entries.
+
+        If joint is True and f implements impl_value_jacobian, a miss on
+        the value, a gradient or the Jacobian fills the value and the
+        Jacobian with this single call, since solvers usually request both
+        at the same point. Otherwise, each part is only evaluated on its
+        own miss.
+        """
         PyDifferentiableFunction.__init__ \
             (self, f.inputSize (), f.outputSize (), \
              self._decodeName (f.name ()))
-        self._cachedFunction = CachedFunction (f._function, size)
+        self._cachedFunction = CachedFunction (f._function, size,
+                                               tolerance, joint)
+
+    @property
+    def cacheStats (self):
+        """
+        Cache counters: "hits", "misses" (evaluations forwarded to the
+        wrapped function), "evictions", and the number of cached points
+        ("size").
+        """
+        return getCacheStats (self._cachedFunction)
+
+    def resetCacheStats (self):
+        resetCacheStats (self._cachedFunction)
+
+    def clearCache (self):
+        clearCache (self._cachedFunction)
 
     def impl_compute (self, result, x):
         compute (self._cachedFunction, result, x)
@@ -282,16 +860,231 @@ class PyCachedFunction(PyDifferentiableFunction):
     def impl_jacobian (self, result, x):
         jacobian (self._cachedFunction, result, x)
 
+    def impl_compute_batch (self, result, X):
+        computeBatch (self._cachedFunction, result, X)
+
+    def impl_gradient_batch (self, result, X, functionId):
+        gradientBatch (self._cachedFunction, result, X, functionId)
+
+    def impl_jacobian_batch (self, result, X):
+        jacobianBatch (self._cachedFunction, result, X)
+
+
+class PyNativeFunction(PyDifferentiableFunction):
+    """
+    Function implemented by RobOptim: evaluations never enter Python, and
+    problems are given the native function itself, so that solvers can use
+    its linear or quadratic structure. Subclasses set _create, which builds
+    the function from the constructor arguments (kept for pickling).
+    """
+    def __init__ (self, *args):
+        self._args = args
+        self._function = self._create (*args)
+
+    def _setCallbacks (self):
+        pass
+
+    def _setStateImpl (self, idict):
+        self._function = self._create (*idict["_args"])
+
+    def impl_compute (self, result, x):
+        compute (self._function, result, x)
+
+    def impl_gradient (self, result, x, functionId):
+        gradient (self._function, result, x, functionId)
+
+    def impl_jacobian (self, result, x):
+        jacobian (self._function, result, x)
+
+
+class PyLinearFunction(PyNativeFunction):
+    """
+    Linear function f(x) = A x + b, with A a (m x n) matrix (b: zero by
+    default).
+    """
+    _create = staticmethod (LinearFunction)
+
+    def __init__ (self, A, b = None):
+        PyNativeFunction.__init__ (self, A, b)
+
+
+class PyQuadraticFunction(PyNativeFunction):
+    """
+    Quadratic function f(x) = 1/2 x^T A x + b^T x + c, with A a symmetric
+    (n x n) matrix (b and c: zero by default).
+    """
+    _create = staticmethod (QuadraticFunction)
+
+    def __init__ (self, A, b = None, c = None):
+        PyNativeFunction.__init__ (self, A, b, c)
+
+
+class PyConstantFunction(PyNativeFunction):
+    """
+    Constant function f(x) = offset, with x of size inputSize.
+    """
+    _create = staticmethod (ConstantFunction)
+
+    def __init__ (self, inputSize, offset):
+        PyNativeFunction.__init__ (self, inputSize, offset)
+
+
+class PyIdentityFunction(PyNativeFunction):
+    """
+    Identity function f(x) = x + offset.
+    """
+    _create = staticmethod (IdentityFunction)
+
+    def __init__ (self, offset):
+        PyNativeFunction.__init__ (self, offset)
+
+
+class PyChain(PyNativeFunction):
+    """
+    Composition f(g(x)), with the chain rule applied natively.
+    """
+    def __init__ (self, f, g):
+        PyNativeFunction.__init__ (self, f, g)
+
+    def _create (self, f, g):
+        return Chain (f._function, g._function)
+
+
+class PyPlus(PyNativeFunction):
+    """
+    Sum f(x) + g(x).
+    """
+    def __init__ (self, f, g):
+        PyNativeFunction.__init__ (self, f, g)
+
+    def _create (self, f, g):
+        return Plus (f._function, g._function)
+
+
+class PyMinus(PyNativeFunction):
+    """
+    Difference f(x) - g(x).
+    """
+    def __init__ (self, f, g):
+        PyNativeFunction.__init__ (self, f, g)
+
+    def _create (self, f, g):
+        return Minus (f._function, g._function)
+
+
+class PyScalar(PyNativeFunction):
+    """
+    Affine transformation scalar * f(x) + offset (offset: scalar or vector
+    of size f.outputSize (), zero by default).
+    """
+    def __init__ (self, f, scalar = 1., offset = None):
+        PyNativeFunction.__init__ (self, f, scalar, offset)
+
+    def _create (self, f, scalar, offset):
+        if offset is not None:
+            offset = numpy.broadcast_to (numpy.asarray (offset, dtype=float),
+                                         (f.outputSize (),))
+        return Scalar (f._function, float (scalar), offset)
+
+
+class PySelection(PyNativeFunction):
+    """
+    Outputs [start, start + size) of f.
+    """
+    def __init__ (self, f, start, size):
+        PyNativeFunction.__init__ (self, f, start, size)
+
+    def _create (self, f, start, size):
+        return Selection (f._function, start, size)
+
+
+class PySplit(PyNativeFunction):
+    """
+    Output functionId of f.
+    """
+    def __init__ (self, f, functionId):
+        PyNativeFunction.__init__ (self, f, functionId)
+
+    def _create (self, f, functionId):
+        return Split (f._function, functionId)
+
+
+class PyConcatenation(PyNativeFunction):
+    """
+    Outputs of f stacked over the outputs of g (same input size).
+    """
+    def __init__ (self, f, g):
+        PyNativeFunction.__init__ (self, f, g)
+
+    def _create (self, f, g):
+        return Concatenation (f._function, g._function)
+
+
+class PyBind(PyNativeFunction):
+    """
+    f with some inputs bound: values gives one float (bound input) or None
+    (free input) per input of f.
+    """
+    def __init__ (self, f, values):
+        PyNativeFunction.__init__ (self, f, list (values))
+
+    def _create (self, f, values):
+        return Bind (f._function, values)
+
+
+def concatenate (*functions):
+    """
+    Native function stacking the outputs of the given functions.
+    """
+    result = functions[0]
+    for f in functions[1:]:
+        result = PyConcatenation (result, f)
+    return result
+
+
+def _constraintBounds (bounds, scaling):
+    """
+    Copy of the bounds and scaling of constraints, as given to addConstraint.
+    """
+    bounds = numpy.array (bounds, dtype = float).reshape (-1, 2)
+    if scaling is not None:
+        scaling = numpy.array (scaling, dtype = float).reshape (-1)
+    return bounds, scaling
+
 
 class PyProblem(object):
-    def __init__(self, cost):
+    def __init__(self, cost, sparse = None):
+        """
+        The problem is sparse if sparse is True, or if it is None and the
+        cost is a PySparseDifferentiableFunction. Sparse problems accept
+        both sparse and dense costs and constraints (dense functions are
+        adapted), dense problems only dense ones.
+        """
         self.cost = cost
-        self._problem = Problem (cost._function)
+        sparseCost = isinstance (cost, PySparseDifferentiableFunction)
+        if sparse is None:
+            sparse = sparseCost
+        elif sparseCost and not sparse:
+            raise ValueError ("a sparse cost needs a sparse problem")
+        self.sparse = bool (sparse)
+        self._problem = Problem (cost._function, self.sparse)
         self._constraints = list()
+        # (bounds, scaling) of each constraint, kept for serialization.
+        self._constraintBounds = list()
 
     def __str__ (self):
         return strProblem (self._problem)
 
+    @property
+    def hasHessian(self):
+        """
+        Whether the cost and all the constraints are twice differentiable
+        (e.g. PyTwiceDifferentiableFunction). Solvers can only use exact
+        Hessians in that case (and if they support them); dense functions
+        adapted to sparse problems lose their Hessian.
+        """
+        return problemHasHessian (self._problem)
+
     @property
     def startingPoint(self):
         return getStartingPoint (self._problem)
@@ -319,38 +1112,280 @@ class PyProblem(object):
     def addConstraint (self, constraint, bounds, scaling = None):
         addConstraint (self._problem, constraint._function, bounds, scaling)
         self._constraints.append (constraint)
+        self._constraintBounds.append (_constraintBounds (bounds, scaling))
+
+    def addConstraints (self, constraints, bounds, scaling = None):
+        """
+        Add several constraints at once. The bounds of all their outputs
+        are stacked in a (m x 2) array, and the scaling (if any) in an
+        array of size m, with m the sum of the output sizes.
+        """
+        constraints = list (constraints)
+        addConstraints (self._problem, [c._function for c in constraints],
+                        bounds, scaling)
+        self._constraints.extend (constraints)
+        bounds, scaling = _constraintBounds (bounds, scaling)
+        row = 0
+        for c in constraints:
+            rows = slice (row, row + c.outputSize ())
+            self._constraintBounds.append \
+                ((bounds[rows], None if scaling is None else scaling[rows]))
+            row = rows.stop
+
+    @property
+    def constraintBounds(self):
+        """
+        Bounds ((m x 2) array) and scaling (array of size m, or None) of
+        each constraint.
+        """
+        return self._constraintBounds
+
+    def __reduce__ (self):
+        from . import serialization
+        return (serialization.loadProblem,
+                (serialization.dumpProblem (self),))
 
     @property
     def constraints(self):
         return self._constraints
 
+    def enableStats (self, enabled = True):
+        """
+        Enable the evaluation statistics of the cost and constraints.
+        """
+        for f in [self.cost] + self._constraints:
+            f.enableStats (enabled)
+
+    @property
+    def stats (self):
+        """
+        Evaluation statistics of the cost ("cost") and constraints
+        ("constraint i") with statistics enabled, and their sum ("total").
+        """
+        kinds = ("compute", "gradient", "jacobian")
+        stats = dict ()
+        total = dict ((kind, dict (calls = 0, total = 0., max = 0.,
+                                   python = 0., bridge = 0.))
+                      for kind in kinds)
+        functions = [("cost", self.cost)] \
+                    + [("constraint %i" % i, c)
+                       for i, c in enumerate (self._constraints)]
+        for key, f in functions:
+            s = f.stats
+            if not s["enabled"]:
+                continue
+            stats[key] = s
+            for kind in kinds:
+                for field in ("calls", "total", "python", "bridge"):
+                    total[kind][field] += s[kind][field]
+                total[kind]["max"] = max (total[kind]["max"], s[kind]["max"])
+            for field in ("copies", "failures"):
+                total[field] = total.get (field, 0) + s[field]
+        stats["total"] = total
+        return stats
+
 
 class PySolver(object):
-    def __init__(self, solverName, problem, log_dir = None):
+    def __init__(self, solverName, problem, log_dir = None,
+                 history_dir = None, history_parameters = ()):
+        """
+        If log_dir is given, the text OptimizationLogger of RobOptim writes
+        the iterations of each solve in that directory.
+
+        If history_dir is given, x, the cost, the constraint violation and
+        the numerical state parameters named in history_parameters are
+        appended at each iteration (of all the solves) to .npy files in that
+        directory, see history.
+        """
+        self._solverName = solverName
+        self._problem = problem
         self._solver = Solver (solverName, problem._problem)
         self._callbacks = list()
-        self._multiplexer = Multiplexer (self._solver)
+        self.stats = None
+        # Callbacks that failed during the last solve with the "nan" error
+        # mode, and the first exception they raised.
+        self.evaluationFailures = 0
+        self.evaluationError = None
+        # Callback multiplexers are only available for dense problems
+        self._multiplexer = None if problem.sparse \
+                            else Multiplexer (self._solver)
+        if problem.sparse and log_dir is not None:
+            raise NotImplementedError ("loggers are not supported for sparse"
+                                       " problems")
         self._logDir = log_dir
+        # Native stop callback of the asynchronous solves (created on
+        # demand), and future of the running solve.
+        self._stop = None
+        self._future = None
+        self._history = None
+        if history_dir is not None:
+            if self._multiplexer is None:
+                raise NotImplementedError ("iteration history is not"
+                                           " supported for sparse problems")
+            if not os.path.isdir (history_dir):
+                os.makedirs (history_dir)
+            self._history = addBinaryLogger (self._solver, self._multiplexer,
+                                             history_dir,
+                                             list (history_parameters))
+
+    @property
+    def history (self):
+        """
+        Iteration history recorded in history_dir, as a dict of read-only
+        numpy.memmap arrays (no copy): "x" (iterations x inputSize),
+        "cost", "constraint_violation" and one entry per logged state
+        parameter (NaN when unknown). None if no history is recorded.
+        """
+        if self._history is None:
+            return None
+        history = dict ()
+        for name, path in flushBinaryLogger (self._history[1]):
+            try:
+                history[name] = numpy.load (path, mmap_mode = "r")
+            except ValueError:
+                # Empty files cannot be memory-mapped.
+                history[name] = numpy.load (path)
+        return history
 
     def __str__ (self):
         return strSolver (self._solver)
 
+    def __reduce__ (self):
+        from . import serialization
+        return (serialization.loadJob, (serialization.dumpJob (self),))
+
     def solve (self):
         """
         Solve the RobOptim problem. If a log directory was provided, the
         optimization logger callback will be added to the callback multiplexer.
+
+        An exception raised by a callback (see PyFunction.errorMode) is
+        raised again once the solver returned, with its original traceback.
+        """
+        self._checkIdle ()
+        if self._stop is not None:
+            resetStopCallback (self._stop)
+            setStopDeadline (self._stop, 0.)
+        self._solve ()
+
+    def solveAsync (self, deadline = None):
         """
+        Solve the problem on a background thread, the GIL being released by
+        the solver, and return a SolveFuture of the result (a
+        concurrent.futures.Future: use asyncio.wrap_future in coroutines).
+
+        If deadline is given (in seconds), the solver is stopped at the
+        first iteration after it, and the future gets the result reached
+        at this iteration. The stop goes through the "<solver>.stop" state
+        parameter, so it needs a solver exposing one (e.g. Ipopt).
+        """
+        if self._multiplexer is None:
+            raise NotImplementedError ("asynchronous solves are not supported"
+                                       " for sparse problems")
+        self._checkIdle ()
+
+        if self._stop is None:
+            self._stop = addStopCallback (self._multiplexer)
+        resetStopCallback (self._stop)
+        setStopDeadline (self._stop, 0. if deadline is None else deadline)
+
+        future = SolveFuture (self._stop)
+        self._future = future
+        thread = threading.Thread (target = self._solveAsync, args = (future,))
+        thread.start ()
+        return future
+
+    def _checkIdle (self):
+        if self._future is not None and not self._future.done ():
+            raise RuntimeError ("a solve is already running")
+
+    def _solveAsync (self, future):
+        if not future.set_running_or_notify_cancel ():
+            return
+        result = error = None
+        try:
+            self._solve ()
+            result = self.minimum ()
+        except BaseException as e:
+            error = e
+        setStopDeadline (self._stop, 0.)
+        if future._finish ():
+            future.set_exception (concurrent.futures.CancelledError ())
+        elif error is not None:
+            future.set_exception (error)
+        else:
+            future.set_result (result)
+
+    def _solve (self):
         logger = None
-        if self._logDir is not None \
+        if self._logDir is not None and self._multiplexer is not None \
            and os.access(os.path.dirname(self._logDir), os.W_OK):
             logger = addOptimizationLogger (self._solver, self._multiplexer, self._logDir)
-        solve (self._solver)
+        self.evaluationFailures, self.evaluationError = 0, None
+        try:
+            (self.evaluationFailures, self.evaluationError) = \
+                solve (self._solver)
+        finally:
+            # Delete the logger to end logging: it is bound to this solver.
+            if logger is not None:
+                removeOptimizationLoggers (self._multiplexer)
+                del logger
+
+        # Evaluation statistics of the problem functions (if enabled)
+        self.stats = self._problem.stats
+
+    def solveMultiStart (self, startingPoints, nThreads = 0):
+        """
+        Solve the problem from several starting points (one per row) on a
+        pool of native threads. Each start has its own solver, configured
+        with the parameters of this solver. Iteration callbacks and loggers
+        are not used.
 
-        # Force deletion of logger to end logging
-        del logger
+        Return the list of results, and the index of the best result (-1 if
+        no start succeeded).
+        """
+        if self._problem.sparse:
+            raise NotImplementedError ("multi-start solves are not supported"
+                                       " for sparse problems")
+        (results, best) = solveMultiStart (self._solverName,
+                                           self._problem._problem,
+                                           startingPoints, nThreads,
+                                           self._solver)
+        return [self._toResult (*r) for r in results], best
+
+    def resolve (self, startingPoint = None, argumentBounds = None):
+        """
+        Solve the problem again with a new starting point and/or new
+        argument bounds, and return the result.
+
+        The solver is rebuilt on the updated problem from the cached plugin
+        (the plugin library is not loaded again). Its parameters, iteration
+        callbacks and history are kept. If no starting point is given, the
+        solve is warm-started from the last solution (if any).
+        """
+        self._checkIdle ()
+        # If not solved yet, the problem starting point is kept.
+        if startingPoint is None and isSolved (self._solver):
+            last = self.minimum ()
+            if isinstance (last, PyResult):
+                startingPoint = last.x
+        if startingPoint is not None:
+            self._problem.startingPoint = startingPoint
+        if argumentBounds is not None:
+            self._problem.argumentBounds = argumentBounds
+
+        solver = Solver (self._solverName, self._problem._problem,
+                         self._solver)
+        if self._multiplexer is not None:
+            setMultiplexerSolver (self._multiplexer, solver)
+        self._solver = solver
+        self.solve ()
+        return self.minimum ()
 
     def minimum (self):
-        (objType, obj) = minimum (self._solver)
+        return self._toResult (*minimum (self._solver))
+
+    def _toResult (self, objType, obj):
         if objType == "roboptim_core_result":
             return PyResult (obj)
         elif objType == "roboptim_core_solver_error":
@@ -358,12 +1393,24 @@ class PySolver(object):
         else:
             raise TypeError ("unhandled case")
 
-    def addIterationCallback (self, callback):
+    def addIterationCallback (self, callback, every = 1,
+                              onImprovement = False, interval = 0.):
         """
         Add an iteration callback to the callback multiplexer.
+
+        The filters are applied natively, without entering Python on the
+        skipped iterations:
+          every          call the callback every k iterations,
+          onImprovement  only call it when the cost is lower than at the
+                         previous call,
+          interval       wait at least interval seconds between two calls.
         """
+        if self._multiplexer is None:
+            raise NotImplementedError ("iteration callbacks are not supported"
+                                       " for sparse problems")
+        addIterationCallback (self._multiplexer, callback._callback,
+                              every, onImprovement, interval)
         self._callbacks.append (callback)
-        addIterationCallback (self._multiplexer, callback._callback)
 
     def removeIterationCallback (self, index):
         """
@@ -387,7 +1434,63 @@ class PySolver(object):
         setSolverParameters (self._solver, value)
 
 
+class SolveFuture(concurrent.futures.Future):
+    """
+    Future of an asynchronous solve (see PySolver.solveAsync).
+
+    cancel () also works on a running solve: the solver is stopped at the
+    next iteration boundary, then the future gets a CancelledError as
+    exception (result () raises it). Since a running future cannot be
+    cancelled, cancelled () stays False in that case: it is only True if
+    the solve was cancelled before it started. If the solver returns
+    before reaching this boundary, the stop is not seen and the future
+    gets the result instead. Once the solver returned, cancel () returns
+    False. The progress of the solve can be read at any time.
+    """
+    def __init__ (self, stop):
+        concurrent.futures.Future.__init__ (self)
+        self._stop = stop
+        self._lock = threading.Lock ()
+        self._cancelRequested = False
+        self._finished = False
+
+    def cancel (self):
+        with self._lock:
+            if self._finished or self.done ():
+                return False
+            if concurrent.futures.Future.cancel (self):
+                return True
+            self._cancelRequested = True
+            requestStop (self._stop)
+            return True
+
+    def _finish (self):
+        """
+        Called by the solve thread once the solver returned: return whether
+        the solver was stopped by cancel ().
+        """
+        with self._lock:
+            self._finished = True
+            return self._cancelRequested \
+                and getStopProgress (self._stop)["stopped"]
+
+    @property
+    def progress (self):
+        """
+        Progress of the solve: number of "iterations", "cost" and
+        "constraintViolation" of the last iteration (NaN when unknown), and
+        whether the solver was "stopped" (cancel or deadline).
+        """
+        return getStopProgress (self._stop)
+
+
 class PySolverState(object):
+    """
+    Solver state given to the iteration callbacks. x and the vector
+    parameters are views on the state, valid during the callback (no copy
+    is made): views still referenced when the callback returns keep the
+    values of their iteration, and become read-only.
+    """
     def __init__(self, state):
         self._solverState = state
 
@@ -427,58 +1530,92 @@ class PySolverState(object):
         setSolverStateParameters (self._solverState, value)
 
 class PyResult(object):
+    """
+    Result of a solve. Attributes are converted on first access only, and
+    arrays are views on the native result (which they keep alive).
+    """
+    # Attributes of the native result.
+    attributes = ("inputSize", "outputSize", "x", "value", "constraints",
+                  "constraint_violation", "lambda", "warnings")
+
     def __init__(self, _result):
         self._result = _result
-        self._dict = resultToDict (_result)
+        self._attributes = dict ()
+
+    def _attribute (self, name):
+        try:
+            return self._attributes[name]
+        except KeyError:
+            value = getResultAttribute (self._result, name)
+            self._attributes[name] = value
+            return value
 
     def __str__ (self):
         return strResult (self._result)
 
     @property
     def inputSize(self):
-        return int(self._dict["inputSize"])
+        return int(self._attribute ("inputSize"))
 
     @property
     def outputSize(self):
-        return int(self._dict["outputSize"])
+        return int(self._attribute ("outputSize"))
 
     @property
     def x(self):
-        return self._dict["x"]
+        return self._attribute ("x")
 
     @property
     def value(self):
-        return self._dict["value"]
+        return self._attribute ("value")
 
     @property
     def constraints(self):
-        return self._dict["constraints"]
+        return self._attribute ("constraints")
+
+    @property
+    def constraintViolation(self):
+        return self._attribute ("constraint_violation")
 
     @property
     def lagrange(self):
-        return self._dict["lambda"]
+        return self._attribute ("lambda")
 
     @property
     def warnings(self):
-        return self._dict["warnings"]
+        return self._attribute ("warnings")
 
 
 class PySolverError(object):
+    """
+    Solver error. Its attributes are converted on first access, like the
+    ones of PyResult.
+    """
     def __init__(self, _error):
         self._error = _error
-        self._dict = solverErrorToDict (_error)
+        self._attributes = dict ()
+
+    def _attribute (self, name):
+        try:
+            return self._attributes[name]
+        except KeyError:
+            value = getResultAttribute (self._error, name)
+            self._attributes[name] = value
+            return value
 
     def __str__ (self):
         return strSolverError (self._error)
 
     @property
     def error(self):
-        return self._dict["error"]
+        return self._attribute ("error")
 
     @property
     def lastState(self):
-        if self._dict["lastState"]:
-            return self._dict["lastState"]
+        """
+        Attributes of the last result (dict), or None.
+        """
+        return self._attribute ("lastState")
 
 
 class PySolverCallback(object):
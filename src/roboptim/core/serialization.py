@@ -0,0 +1,427 @@
+"""
+Compact binary serialization of problems, solver jobs and results, for
+distributed batch solving.
+
+A problem blob contains the sizes, the starting point, the argument bounds
+and scaling, and the constraints with their bounds and scaling. A job blob
+adds the solver name and parameters. Functions are stored in a table (so
+that functions shared by several constraints or expressions are rebuilt
+once):
+
+  - native functions (PyLinearFunction, PyQuadraticFunction, PyChain...)
+    are stored with their constructor arguments, and rebuilt natively,
+  - Python-backed functions are referenced by their importable class name
+    ("module:QualifiedName") and rebuilt on load by calling the class with
+    the arguments returned by their serializationArguments () method (no
+    arguments if it is not defined). The class must therefore be importable
+    by the workers.
+
+Iteration callbacks, loggers and the evaluation statistics are not
+serialized.
+
+Values are encoded with a one-byte tag followed by their little-endian
+payload; arrays are stored as raw float64, int64 or bool buffers.
+"""
+from __future__ import \
+    print_function, unicode_literals, absolute_import, division
+
+import concurrent.futures
+import importlib
+import struct
+
+import numpy
+
+from .. import core
+
+_MAGIC = b"RCPB"
+_VERSION = 1
+
+try:
+    _text = unicode
+except NameError:
+    _text = str
+
+_arrayTypes = {b"d": numpy.dtype ("<f8"),
+               b"q": numpy.dtype ("<i8"),
+               b"?": numpy.dtype ("|b1")}
+
+
+class _Reference (int):
+    """
+    Index of a function in the function table of a blob.
+    """
+    pass
+
+
+def _pack (value, out):
+    if value is None:
+        out.append (b"N")
+    elif value is True or value is numpy.True_:
+        out.append (b"T")
+    elif value is False or value is numpy.False_:
+        out.append (b"F")
+    elif isinstance (value, _Reference):
+        out.append (b"r" + struct.pack ("<I", value))
+    elif isinstance (value, numpy.ndarray):
+        if value.dtype.kind == "f":
+            code = b"d"
+        elif value.dtype.kind in "iu":
+            code = b"q"
+        elif value.dtype.kind == "b":
+            code = b"?"
+        else:
+            raise TypeError ("cannot serialize arrays of %s" % value.dtype)
+        array = numpy.ascontiguousarray (value, dtype = _arrayTypes[code])
+        out.append (b"a" + code + struct.pack ("<B", array.ndim)
+                    + struct.pack ("<%iQ" % array.ndim, *array.shape))
+        out.append (array.tobytes ())
+    elif isinstance (value, (int, numpy.integer)):
+        out.append (b"i" + struct.pack ("<q", int (value)))
+    elif isinstance (value, (float, numpy.floating)):
+        out.append (b"d" + struct.pack ("<d", float (value)))
+    elif isinstance (value, bytes):
+        out.append (b"b" + struct.pack ("<I", len (value)) + value)
+    elif isinstance (value, _text):
+        data = value.encode ("utf-8")
+        out.append (b"s" + struct.pack ("<I", len (data)) + data)
+    elif isinstance (value, (list, tuple)):
+        out.append ((b"l" if isinstance (value, list) else b"t")
+                    + struct.pack ("<I", len (value)))
+        for item in value:
+            _pack (item, out)
+    elif isinstance (value, dict):
+        out.append (b"m" + struct.pack ("<I", len (value)))
+        for key, item in value.items ():
+            _pack (key, out)
+            _pack (item, out)
+    else:
+        raise TypeError ("cannot serialize %s" % type (value).__name__)
+
+
+class _Reader (object):
+    def __init__ (self, blob, offset):
+        self.blob = blob
+        self.offset = offset
+
+    def read (self, size):
+        if self.offset + size > len (self.blob):
+            raise ValueError ("truncated blob")
+        data = self.blob[self.offset:self.offset + size]
+        self.offset += size
+        return data
+
+    def unpack (self, fmt):
+        return struct.unpack (fmt, self.read (struct.calcsize (fmt)))
+
+    def value (self):
+        tag = self.read (1)
+        if tag == b"N":
+            return None
+        elif tag == b"T":
+            return True
+        elif tag == b"F":
+            return False
+        elif tag == b"r":
+            return _Reference (self.unpack ("<I")[0])
+        elif tag == b"a":
+            dtype = _arrayTypes[self.read (1)]
+            ndim = self.unpack ("<B")[0]
+            shape = self.unpack ("<%iQ" % ndim)
+            count = int (numpy.prod (shape))
+            data = self.read (count * dtype.itemsize)
+            return numpy.frombuffer (data, dtype = dtype) \
+                        .reshape (shape).astype (dtype.newbyteorder ("="))
+        elif tag == b"i":
+            return self.unpack ("<q")[0]
+        elif tag == b"d":
+            return self.unpack ("<d")[0]
+        elif tag == b"b":
+            return self.read (self.unpack ("<I")[0])
+        elif tag == b"s":
+            return self.read (self.unpack ("<I")[0]).decode ("utf-8")
+        elif tag in (b"l", b"t"):
+            items = [self.value () for i in range (self.unpack ("<I")[0])]
+            return items if tag == b"l" else tuple (items)
+        elif tag == b"m":
+            d = dict ()
+            for i in range (self.unpack ("<I")[0]):
+                key = self.value ()
+                d[key] = self.value ()
+            return d
+        raise ValueError ("invalid tag %r" % tag)
+
+
+def dumps (value):
+    """
+    Encode a value (None, bool, int, float, str, bytes, numpy array, or
+    list, tuple and dict of those) in the binary format.
+    """
+    out = [_MAGIC, struct.pack ("<H", _VERSION)]
+    _pack (value, out)
+    return b"".join (out)
+
+
+def loads (blob):
+    """
+    Decode a value encoded by dumps.
+    """
+    blob = bytes (blob)
+    if blob[:len (_MAGIC)] != _MAGIC:
+        raise ValueError ("not a roboptim blob")
+    reader = _Reader (blob, len (_MAGIC))
+    version = reader.unpack ("<H")[0]
+    if version != _VERSION:
+        raise ValueError ("unsupported blob version %i" % version)
+    value = reader.value ()
+    if reader.offset != len (blob):
+        raise ValueError ("trailing data in blob")
+    return value
+
+
+def _qualifiedName (cls):
+    return "%s:%s" % (cls.__module__,
+                      getattr (cls, "__qualname__", cls.__name__))
+
+
+def _importName (name):
+    module, _, qualname = name.partition (":")
+    obj = importlib.import_module (module)
+    for attr in qualname.split ("."):
+        obj = getattr (obj, attr)
+    return obj
+
+
+class _FunctionTable (object):
+    """
+    Functions of a blob, stored after the functions they depend on.
+    """
+    def __init__ (self):
+        self.specs = list ()
+        self._indices = dict ()
+
+    def add (self, f):
+        entry = self._indices.get (id (f))
+        if entry is not None:
+            return entry[0]
+        if isinstance (f, core.PyNativeFunction):
+            name = type (f).__name__
+            if getattr (core, name, None) is not type (f):
+                raise TypeError ("cannot serialize native function %s"
+                                 % _qualifiedName (type (f)))
+            spec = dict (native = name, args = self._arguments (f._args))
+        elif isinstance (f, core.PyFunction) and hasattr (f, "_function"):
+            arguments = getattr (f, "serializationArguments", None)
+            spec = dict (python = _qualifiedName (type (f)),
+                         args = self._arguments (arguments ()
+                                                 if arguments else ()))
+            # The default mode is implied.
+            if f.errorMode != "raise":
+                spec["errorMode"] = f.errorMode
+        else:
+            raise TypeError ("cannot serialize %s" % type (f).__name__)
+        ref = _Reference (len (self.specs))
+        self.specs.append (spec)
+        # Keep f alive so that its id is not reused.
+        self._indices[id (f)] = (ref, f)
+        return ref
+
+    def _arguments (self, value):
+        if isinstance (value, core.PyFunction) and hasattr (value, "_function"):
+            return self.add (value)
+        if isinstance (value, (list, tuple)):
+            return type (value) (self._arguments (v) for v in value)
+        return value
+
+
+def _resolve (value, functions):
+    if isinstance (value, _Reference):
+        return functions[value]
+    if isinstance (value, (list, tuple)):
+        return type (value) (_resolve (v, functions) for v in value)
+    return value
+
+
+def _loadFunctions (specs):
+    functions = list ()
+    for spec in specs:
+        args = _resolve (spec["args"], functions)
+        if "native" in spec:
+            cls = getattr (core, spec["native"], None)
+            if not (isinstance (cls, type)
+                    and issubclass (cls, core.PyNativeFunction)):
+                raise ValueError ("unknown native function %s"
+                                  % spec["native"])
+        else:
+            cls = _importName (spec["python"])
+        f = cls (*args)
+        if "errorMode" in spec:
+            f.errorMode = spec["errorMode"]
+        functions.append (f)
+    return functions
+
+
+def _problemData (problem, table):
+    return dict (inputSize = problem.cost.inputSize (),
+                 outputSize = problem.cost.outputSize (),
+                 sparse = problem.sparse,
+                 cost = table.add (problem.cost),
+                 startingPoint = problem.startingPoint,
+                 argumentBounds = problem.argumentBounds,
+                 argumentScaling = problem.argumentScaling,
+                 constraints = [dict (function = table.add (c),
+                                      bounds = bounds, scaling = scaling)
+                                for c, (bounds, scaling)
+                                in zip (problem.constraints,
+                                        problem.constraintBounds)])
+
+
+def _loadProblem (data, functions):
+    problem = core.PyProblem (functions[data["cost"]],
+                              data.get ("sparse"))
+    if problem.cost.inputSize () != data["inputSize"] \
+       or problem.cost.outputSize () != data["outputSize"]:
+        raise ValueError ("the cost function does not match the serialized"
+                          " sizes")
+    if data["startingPoint"] is not None:
+        problem.startingPoint = data["startingPoint"]
+    problem.argumentBounds = data["argumentBounds"]
+    problem.argumentScaling = data["argumentScaling"]
+    for c in data["constraints"]:
+        problem.addConstraint (functions[c["function"]], c["bounds"],
+                               c["scaling"])
+    return problem
+
+
+def dumpProblem (problem):
+    """
+    Serialize a PyProblem.
+    """
+    table = _FunctionTable ()
+    data = _problemData (problem, table)
+    return dumps (dict (type = "problem", functions = table.specs,
+                        problem = data))
+
+
+def loadProblem (blob):
+    """
+    Rebuild a PyProblem serialized by dumpProblem.
+    """
+    data = _load (blob, "problem")
+    return _loadProblem (data["problem"], _loadFunctions (data["functions"]))
+
+
+def dumpJob (solver):
+    """
+    Serialize a PySolver: its problem, solver name and parameters.
+    """
+    table = _FunctionTable ()
+    data = _problemData (solver._problem, table)
+    parameters = dict ((key, list (parameter))
+                       for key, parameter in solver.parameters.items ())
+    return dumps (dict (type = "job", functions = table.specs,
+                        problem = data, solver = solver._solverName,
+                        parameters = parameters))
+
+
+def loadJob (blob):
+    """
+    Rebuild a PySolver serialized by dumpJob (ready to be solved).
+    """
+    data = _load (blob, "job")
+    problem = _loadProblem (data["problem"],
+                            _loadFunctions (data["functions"]))
+    solver = core.PySolver (data["solver"], problem)
+    for key, (description, value) in data["parameters"].items ():
+        if isinstance (description, bytes):
+            description = description.decode ("utf-8")
+        if isinstance (value, bytes):
+            value = value.decode ("utf-8")
+        solver.setParameter (key, value, description)
+    return solver
+
+
+class RemoteResult(core.PyResult):
+    """
+    PyResult decoded from a blob (no native result is attached).
+    """
+    def __init__ (self, data):
+        self._result = None
+        self._attributes = data
+
+    def __str__ (self):
+        return "Result (x = %s, value = %s)" % (self.x, self.value)
+
+
+class RemoteSolverError(core.PySolverError):
+    """
+    PySolverError decoded from a blob (no native error is attached).
+    """
+    def __init__ (self, data):
+        self._error = None
+        self._attributes = data
+        self._attributes.setdefault ("lastState", None)
+
+    def __str__ (self):
+        return "Solver error: %s" % self.error
+
+
+def dumpResult (result):
+    """
+    Serialize a PyResult or PySolverError (as returned by minimum ()).
+    """
+    if isinstance (result, core.PyResult):
+        data = dict ((name, result._attribute (name))
+                     for name in core.PyResult.attributes)
+        return dumps (dict (type = "result", result = data))
+    elif isinstance (result, core.PySolverError):
+        data = dict (error = result.error, lastState = result.lastState)
+        return dumps (dict (type = "error", result = data))
+    raise TypeError ("cannot serialize %s" % type (result).__name__)
+
+
+def loadResult (blob):
+    """
+    Decode a blob of dumpResult, as RemoteResult or RemoteSolverError.
+    """
+    data = loads (blob)
+    if not isinstance (data, dict) or data.get ("type") not in ("result",
+                                                                "error"):
+        raise ValueError ("not a result blob")
+    if data["type"] == "result":
+        return RemoteResult (data["result"])
+    return RemoteSolverError (data["result"])
+
+
+def _load (blob, kind):
+    data = loads (blob)
+    if not isinstance (data, dict) or data.get ("type") != kind:
+        raise ValueError ("not a %s blob" % kind)
+    return data
+
+
+def solveJob (blob):
+    """
+    Solve a job blob and return the result blob (run by the workers).
+    """
+    solver = loadJob (blob)
+    solver.solve ()
+    return dumpResult (solver.minimum ())
+
+
+def dispatch (jobs, executor = None, max_workers = None):
+    """
+    Solve jobs (PySolver or job blobs) on the workers of a
+    concurrent.futures executor, and return their results (in the order
+    of jobs). Only blobs are exchanged with the workers.
+
+    By default, a ProcessPoolExecutor with max_workers processes is used.
+    Any executor with the same interface (e.g. MPIPoolExecutor of
+    mpi4py.futures, or the executor of a dask.distributed client) spreads
+    the jobs across nodes.
+    """
+    blobs = [job if isinstance (job, bytes) else dumpJob (job)
+             for job in jobs]
+    if executor is None:
+        with concurrent.futures.ProcessPoolExecutor (max_workers) as executor:
+            return [loadResult (r) for r in executor.map (solveJob, blobs)]
+    return [loadResult (r) for r in executor.map (solveJob, blobs)]
@@ -1,4 +1,6 @@
 from abc import ABCMeta, abstractproperty, abstractmethod
+import multiprocessing
+import threading
 
 from mpl_toolkits.mplot3d import Axes3D
 from matplotlib import cm
@@ -11,21 +13,55 @@ class PlotStyle2D(object):
 class PlotStyle3D(object):
     Contour, Contourf, Wireframe, Triangle = range(4)
 
+def _computeBatch(task):
+    """
+    Evaluate a function over a chunk of points (worker process).
+    """
+    (f, points) = task
+    return _evaluate(f, points)
+
+def _evaluate(f, points):
+    """
+    Evaluate a function over points (one per row), with a single batch
+    call if it supports it.
+    """
+    if hasattr(f, "computeBatch"):
+        return np.asarray(f.computeBatch(points))
+    return np.array([np.atleast_1d(f(p)) for p in points])
+
 class Plotter(object):
     """
     Plotter abstract class.
+
+    The grid is evaluated with a single batch call (computeBatch) when the
+    function supports it. Functions of more than two variables are sliced:
+    the plotted coordinates are given by axes, and the other coordinates
+    are fixed to those of point (zero by default). output selects the
+    plotted output of vector-valued functions.
+
+    With n_jobs > 1, the grid is split in chunks, evaluated by worker
+    processes (backend="processes", the function is pickled), or by threads
+    (backend="threads", only useful for functions that do not hold the GIL,
+    e.g. with native callbacks).
     """
     __metaclass__ = ABCMeta
 
-    def __init__(self, x_range, y_range, x_res=10, y_res=10):
+    def __init__(self, x_range, y_range, x_res=10, y_res=10,
+                 point=None, axes=(0, 1), output=0, n_jobs=1,
+                 backend="processes"):
         self.x_range = x_range
         self.y_range = y_range
         self.x_res = x_res
         self.y_res = y_res
+        self.point = point
+        self.axes = axes
+        self.output = output
+        self.n_jobs = n_jobs
+        self.backend = backend
         self.fig = plt.figure()
         self.ax = self.fig.add_subplot(111, projection=self.projection())
-        self.ax.set_xlabel('x[0]')
-        self.ax.set_ylabel('x[1]')
+        self.ax.set_xlabel('x[%i]' % axes[0])
+        self.ax.set_ylabel('x[%i]' % axes[1])
 
     @abstractmethod
     def plot(self, f, plot_style, cmap=None, *args, **kwargs):
@@ -41,12 +77,56 @@ class Plotter(object):
     def show(self):
         plt.show()
 
+    def grid_points(self, f, X, Y):
+        """
+        Points of the grid (one per row), in the input space of f.
+        """
+        if self.point is not None:
+            base = np.array(self.point, dtype=np.float64)
+        elif hasattr(f, "inputSize"):
+            base = np.zeros(f.inputSize())
+        else:
+            base = np.zeros(max(self.axes) + 1)
+        points = np.tile(base, (X.size, 1))
+        points[:, self.axes[0]] = X.ravel()
+        points[:, self.axes[1]] = Y.ravel()
+        return points
+
     def compute_z(self,f,X,Y):
-        z = np.zeros(X.shape)
-        for i in range(X.shape[0]):
-            for j in range(X.shape[1]):
-                z[i,j] = f([X[i,j],Y[i,j]])
-        return z
+        points = self.grid_points(f, X, Y)
+
+        n_jobs = min(self.n_jobs, len(points))
+        if n_jobs <= 1:
+            values = _evaluate(f, points)
+        else:
+            chunks = np.array_split(points, n_jobs)
+            if self.backend == "threads":
+                results = [None] * n_jobs
+                errors = list()
+                def run(i):
+                    try:
+                        results[i] = _evaluate(f, chunks[i])
+                    except Exception as e:
+                        errors.append(e)
+                threads = [threading.Thread(target=run, args=(i,))
+                           for i in range(n_jobs)]
+                for t in threads:
+                    t.start()
+                for t in threads:
+                    t.join()
+                if errors:
+                    raise errors[0]
+            else:
+                pool = multiprocessing.Pool(processes=n_jobs)
+                try:
+                    results = pool.map(_computeBatch,
+                                       [(f, c) for c in chunks])
+                finally:
+                    pool.terminate()
+                    pool.join()
+            values = np.concatenate(results)
+
+        return values[:, self.output].reshape(X.shape)
 
     try:
         basestring  # attempt to evaluate basestring
@@ -61,8 +141,8 @@ class Plotter2D(Plotter):
     """
     2D plotter class for RobOptim functions.
     """
-    def __init__(self, x_range, y_range):
-        super(Plotter2D, self).__init__(x_range, y_range)
+    def __init__(self, x_range, y_range, **kwargs):
+        super(Plotter2D, self).__init__(x_range, y_range, **kwargs)
 
     def projection(self):
         return None
@@ -104,8 +184,8 @@ class Plotter3D(Plotter):
     """
     3D plotter class for RobOptim functions.
     """
-    def __init__(self, x_range, y_range):
-        super(Plotter3D, self).__init__(x_range, y_range)
+    def __init__(self, x_range, y_range, **kwargs):
+        super(Plotter3D, self).__init__(x_range, y_range, **kwargs)
 
     def projection(self):
         return "3d"
@@ -18,14 +18,20 @@
 #include <roboptim/core/python/to-python.hh>
 
 #include <iostream>
+#include <map>
+#include <stdexcept>
 #include <string>
 
+#include <boost/circular_buffer.hpp>
 #include <boost/format.hpp>
 #include <boost/function.hpp>
-#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <Python.h>
 
+#include <numpy/arrayobject.h>
+
 #include "common.hh"
 
 namespace roboptim
@@ -189,20 +195,154 @@ namespace roboptim
     /********************************
      *  Implementation of ToPython  *
      ********************************/
+    namespace
+    {
+      typedef std::map<std::string, PyObject*> codeCache_t;
+
+      /// \brief Commands beyond this number are compiled at each call.
+      const std::size_t maxCachedCommands = 1024;
+
+      /// \brief Default capacity of the output buffer.
+      const std::size_t defaultBufferCapacity = 1 << 20;
+
+      /// \brief Compiled commands (protected by the GIL).
+      codeCache_t& codeCache ()
+      {
+        static codeCache_t cache;
+        return cache;
+      }
+
+      /// \brief Redirected output, shared by the instances since
+      /// sys.stdout is global (protected by the GIL).
+      boost::circular_buffer<char>& outputBuffer ()
+      {
+        static boost::circular_buffer<char> buffer (defaultBufferCapacity);
+        return buffer;
+      }
+
+      /// \brief Protect the instance counter.
+      boost::mutex& instancesMutex ()
+      {
+        static boost::mutex mutex;
+        return mutex;
+      }
+
+      /// \brief Thread state of the thread that initialized the
+      /// interpreter, saved while the GIL is released.
+      PyThreadState* mainThreadState = 0;
+
+      /// \brief Thread that initialized the interpreter.
+      boost::thread::id mainThreadId;
+
+      /// \brief Whether the NumPy C API was imported.
+      bool numpyImported = false;
+
+      void buffering (const std::string& s)
+      {
+        boost::circular_buffer<char>& buffer = outputBuffer ();
+        buffer.insert (buffer.end (), s.begin (), s.end ());
+      }
+
+      /// \brief Compile a command, or retrieve it from the cache.
+      /// \return new reference (null on failure).
+      PyObject* compile (const char* cmd)
+      {
+        codeCache_t& cache = codeCache ();
+        codeCache_t::const_iterator it = cache.find (cmd);
+        if (it != cache.end ())
+          {
+            Py_INCREF (it->second);
+            return it->second;
+          }
+
+        PyObject* code = Py_CompileString (cmd, "<roboptim>", Py_file_input);
+        if (code && cache.size () < maxCachedCommands)
+          {
+            Py_INCREF (code);
+            cache[cmd] = code;
+          }
+        return code;
+      }
+
+      void clearCodeCache ()
+      {
+        codeCache_t& cache = codeCache ();
+        for (codeCache_t::iterator it = cache.begin ();
+             it != cache.end (); ++it)
+          Py_DECREF (it->second);
+        cache.clear ();
+      }
+
+      /// \brief Run a command in the __main__ module, like
+      /// PyRun_SimpleString.
+      void run (const char* cmd)
+      {
+        GILState gil;
+
+        bool ok = false;
+        PyObject* code = compile (cmd);
+        PyObject* main = PyImport_AddModule ("__main__"); // borrowed
+        if (code && main)
+          {
+            PyObject* globals = PyModule_GetDict (main); // borrowed
+#if PY_MAJOR_VERSION >= 3
+            PyObject* result = PyEval_EvalCode (code, globals, globals);
+#else
+            PyObject* result = PyEval_EvalCode
+              (reinterpret_cast<PyCodeObject*> (code), globals, globals);
+#endif //! PY_MAJOR_VERSION
+            ok = result != 0;
+            Py_XDECREF (result);
+          }
+        Py_XDECREF (code);
+
+        if (!ok)
+          {
+            PyErr_Print ();
+            throw std::runtime_error
+              ((boost::format
+                ("error occurred in Python code with command:\n%1%")
+                % cmd).str ());
+          }
+      }
+
+      /// \brief Import the NumPy C API (requires the GIL).
+      void importNumpy ()
+      {
+        if (numpyImported)
+          return;
+
+        if (_import_array () < 0)
+          {
+            PyErr_Print ();
+            throw std::runtime_error ("cannot import numpy");
+          }
+        numpyImported = true;
+      }
+    } // end of unnamed namespace
+
     int ToPython::instances_ = 0;
 
-    ToPython::ToPython () : buffer_ ()
+    ToPython::ToPython ()
     {
+      boost::mutex::scoped_lock lock (instancesMutex ());
+
       if (!instances_)
       {
         PyImport_AppendInittab ("redir", PyInit_redir);
         Py_Initialize ();
-        PyImport_ImportModule ("redir");
+#if PY_VERSION_HEX < 0x03070000
+        PyEval_InitThreads ();
+#endif //! PY_VERSION_HEX
+        PyObject* redir = PyImport_ImportModule ("redir");
+        Py_XDECREF (redir);
 
         // Switch sys.stdout to custom handler
-        stdout_write_type write = boost::bind (&ToPython::buffering,
-                                               this, _1);
-        set_stdout (write);
+        set_stdout (&buffering);
+
+        // Let other threads take the GIL.
+        mainThreadState = PyEval_SaveThread ();
+        mainThreadId = boost::this_thread::get_id ();
       }
 
       // Increment the instance counter
@@ -211,46 +351,95 @@ namespace roboptim
 
     ToPython::~ToPython ()
     {
+      boost::mutex::scoped_lock lock (instancesMutex ());
+
       // Decrement the instance counter
       instances_--;
 
-      if (!instances_) Py_Finalize ();
+      if (!instances_)
+      {
+        // A thread state can only be restored by its own thread: other
+        // threads take the GIL with a state of their own, which is
+        // released by Py_Finalize.
+        if (boost::this_thread::get_id () == mainThreadId)
+          PyEval_RestoreThread (mainThreadState);
+        else
+          PyGILState_Ensure ();
+        mainThreadState = 0;
+        mainThreadId = boost::thread::id ();
+
+        clearCodeCache ();
+        reset_stdout ();
+        numpyImported = false;
+        Py_Finalize ();
+      }
     }
 
     const ToPython& ToPython::operator << (const char* cmd) const
     {
-      if (PyRun_SimpleString (cmd) == -1)
-      {
-        throw std::runtime_error
-          ((boost::format ("error occurred in Python code with command:\n%1%")
-            % cmd).str ());
-      }
-
+      run (cmd);
       return *this;
     }
 
     const ToPython& ToPython::operator << (const std::string& cmd) const
     {
-      if (PyRun_SimpleString (cmd.c_str ()) == -1)
-      {
-        throw std::runtime_error
-          ((boost::format ("error occurred in Python code with command:\n%1%")
-            % cmd.c_str ()).str ());
-      }
+      run (cmd.c_str ());
+      return *this;
+    }
+
+    const ToPython& ToPython::set (const std::string& name,
+                                   const double* data,
+                                   std::size_t size) const
+    {
+      GILState gil;
+      importNumpy ();
+
+      npy_intp dims[1] = {static_cast<npy_intp> (size)};
+      // Read-only view: NPY_WRITEABLE is not set.
+      PyObject* array = PyArray_New
+        (&PyArray_Type, 1, dims, NPY_DOUBLE, NULL,
+         const_cast<double*> (data), 0, NPY_ALIGNED, NULL);
+
+      PyObject* main = PyImport_AddModule ("__main__"); // borrowed
+      bool ok = array && main
+        && PyObject_SetAttrString (main, name.c_str (), array) == 0;
+      Py_XDECREF (array);
+
+      if (!ok)
+        {
+          PyErr_Print ();
+          throw std::runtime_error
+            ((boost::format ("cannot set Python variable %1%")
+              % name).str ());
+        }
 
       return *this;
     }
 
     void ToPython::operator >> (std::ostream& o)
     {
-      o << buffer_;
+      std::string output;
+      {
+        GILState gil;
+        boost::circular_buffer<char>& buffer = outputBuffer ();
+        output.assign (buffer.begin (), buffer.end ());
+        buffer.clear ();
+      }
 
-      buffer_.clear();
+      o << output;
     }
 
-    void ToPython::buffering (const std::string& s)
+    void ToPython::setBufferCapacity (std::size_t capacity)
     {
-      buffer_ += s;
+      boost::mutex::scoped_lock lock (instancesMutex ());
+
+      if (instances_)
+        {
+          GILState gil;
+          outputBuffer ().set_capacity (capacity);
+        }
+      else
+        outputBuffer ().set_capacity (capacity);
     }
   } // end of namespace python
 } // end of namespace roboptim
@@ -1,7 +1,29 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <sstream>
 #include <stdexcept>
 
+#include <dlfcn.h>
+
 #include <boost/variant/static_visitor.hpp>
 #include <boost/variant/apply_visitor.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/throw_exception.hpp>
+
+#include <roboptim/core/numeric-linear-function.hh>
+#include <roboptim/core/numeric-quadratic-function.hh>
+#include <roboptim/core/function/constant.hh>
+#include <roboptim/core/function/identity.hh>
+#include <roboptim/core/operator/bind.hh>
+#include <roboptim/core/operator/chain.hh>
+#include <roboptim/core/operator/concatenation.hh>
+#include <roboptim/core/operator/minus.hh>
+#include <roboptim/core/operator/plus.hh>
+#include <roboptim/core/operator/scalar.hh>
+#include <roboptim/core/operator/selection.hh>
+#include <roboptim/core/operator/split.hh>
 
 #include "wrap.hh"
 
@@ -15,11 +37,112 @@ namespace roboptim
     {
       static const int NPY_STORAGE_ORDER = (::roboptim::StorageOrder == Eigen::RowMajor)? NPY_C_CONTIGUOUS:NPY_F_CONTIGUOUS;
 
+      NumpyView::NumpyView (bool writable)
+        : array_ (0),
+          writable_ (writable)
+      {
+      }
+
+      NumpyView::~NumpyView ()
+      {
+        reset ();
+      }
+
+      void NumpyView::reset ()
+      {
+        Py_XDECREF (array_);
+        array_ = 0;
+      }
+
+      PyObject* NumpyView::vector (double* data, npy_intp size)
+      {
+        npy_intp strides[1] = {static_cast<npy_intp> (sizeof (double))};
+        return update (data, NPY_DOUBLE, 1, &size, strides);
+      }
+
+      PyObject* NumpyView::vector (int* data, npy_intp size)
+      {
+        npy_intp strides[1] = {static_cast<npy_intp> (sizeof (int))};
+        return update (data, NPY_INT, 1, &size, strides);
+      }
+
+      PyObject* NumpyView::matrix (double* data, npy_intp rows, npy_intp cols,
+                                   npy_intp outerStride, bool rowMajor)
+      {
+        npy_intp dims[2] = {rows, cols};
+        npy_intp strides[2];
+
+        if (rowMajor)
+          {
+            strides[0] = outerStride * static_cast<npy_intp> (sizeof (double));
+            strides[1] = static_cast<npy_intp> (sizeof (double));
+          }
+        else
+          {
+            strides[0] = static_cast<npy_intp> (sizeof (double));
+            strides[1] = outerStride * static_cast<npy_intp> (sizeof (double));
+          }
+
+        return update (data, NPY_DOUBLE, 2, dims, strides);
+      }
+
+      PyObject* NumpyView::array (double* data, int nd, npy_intp* dims)
+      {
+        std::vector<npy_intp> strides (static_cast<size_t> (nd));
+
+        npy_intp stride = static_cast<npy_intp> (sizeof (double));
+        for (int i = nd - 1; i >= 0; --i)
+          {
+            strides[i] = stride;
+            stride *= dims[i];
+          }
+
+        return update (data, NPY_DOUBLE, nd, dims, &strides[0]);
+      }
+
+      PyObject* NumpyView::update (void* data, int type, int nd,
+                                   npy_intp* dims, npy_intp* strides)
+      {
+        // Reuse the cached view if it still matches the buffer. Note that
+        // the shape is checked as well since it can be modified in place
+        // from Python.
+        if (array_
+            && PyArray_DATA (array_) == data
+            && PyArray_TYPE (array_) == type
+            && PyArray_NDIM (array_) == nd
+            && bool (PyArray_ISWRITEABLE (array_)) == writable_)
+          {
+            bool match = true;
+            for (int i = 0; i < nd && match; ++i)
+              match = (PyArray_DIMS (array_)[i] == dims[i])
+                && (PyArray_STRIDES (array_)[i] == strides[i]);
+
+            if (match)
+              return array_;
+          }
+
+        reset ();
+        array_ = PyArray_New (&PyArray_Type, nd, dims, type, strides,
+                              data, 0, writable_ ? NPY_WRITEABLE : 0, NULL);
+        return array_;
+      }
+
+
       Function::Function (size_type inputSize,
                           size_type outputSize,
                           const std::string& name)
         : roboptim::Function (inputSize, outputSize, name),
-          computeCallback_ (0)
+          kind_ (KIND_FUNCTION),
+          stats_ (),
+          strictArrays_ (false),
+          errorMode_ (ERROR_RAISE),
+          computeCallback_ (0),
+          computeBatchCallback_ (0),
+          nativeCompute_ (),
+          resultView_ (),
+          argumentView_ (false),
+          batchResultView_ (),
+          batchArgumentView_ (false)
       {
       }
 
@@ -30,11 +153,31 @@ namespace roboptim
 	    Py_DECREF (computeCallback_);
 	    computeCallback_ = 0;
 	  }
+        if (computeBatchCallback_)
+	  {
+	    Py_DECREF (computeBatchCallback_);
+	    computeBatchCallback_ = 0;
+	  }
+        nativeCompute_.reset ();
       }
 
       void Function::impl_compute (result_ref result, const_argument_ref argument)
 	const
       {
+        StatsTimer timer (stats_.compute, stats_.enabled);
+
+        // Native callback: no GIL and no NumPy view.
+        if (nativeCompute_.bound ())
+          {
+            nativeCompute_ (result.data (), argument.data (),
+                            static_cast<int> (this->inputSize ()),
+                            static_cast<int> (this->outputSize ()));
+            return;
+          }
+
+        // The solver may run without the GIL.
+        ::roboptim::python::GILState gil;
+
         if (!computeCallback_)
 	  {
 	    PyErr_SetString
@@ -42,49 +185,33 @@ namespace roboptim
 	       "compute callback not set");
 	    return;
 	  }
-        if (!PyFunction_Check (computeCallback_))
-	  {
-	    PyErr_SetString
-	      (PyExc_TypeError,
-	       "compute callback is not a function");
-	    return;
-	  }
 
         npy_intp inputSize = static_cast<npy_intp> (this->inputSize ());
         npy_intp outputSize = static_cast<npy_intp> (this->outputSize ());
 
-        PyObject* resultNumpy =
-          PyArray_SimpleNewFromData (1, &outputSize, NPY_DOUBLE, result.data ());
+        PyObject* resultNumpy = resultView_.vector (result.data (), outputSize);
         if (!resultNumpy)
 	  {
 	    PyErr_SetString (PyExc_TypeError, "cannot convert result");
 	    return;
 	  }
 
-        PyObject* argNumpy =
-          PyArray_SimpleNewFromData
-          (1, &inputSize, NPY_DOUBLE, const_cast<double*> (argument.data ()));
+        PyObject* argNumpy = argumentView_.vector
+          (const_cast<double*> (argument.data ()), inputSize);
         if (!argNumpy)
 	  {
 	    PyErr_SetString (PyExc_TypeError, "cannot convert argument");
 	    return;
 	  }
 
-        PyObject* arglist = Py_BuildValue ("(OO)", resultNumpy, argNumpy);
-        if (!arglist)
-	  {
-	    Py_DECREF (arglist);
-	    PyErr_SetString
-	      (PyExc_TypeError, "failed to build argument list");
-	    return;
-	  }
-
-        PyObject* resultPy = PyEval_CallObject (computeCallback_, arglist);
+        timer.beginPython ();
+        PyObject* resultPy =
+          ::roboptim::python::call (computeCallback_, resultNumpy, argNumpy);
+        timer.endPython ();
+        Py_XDECREF (resultPy);
 
-        ::roboptim::python::checkPythonError ();
-
-        Py_DECREF (arglist);
-        Py_XDECREF(resultPy);
+        if (checkCallbackError ())
+          result.setConstant (std::numeric_limits<double>::quiet_NaN ());
       }
 
       void Function::setComputeCallback (PyObject* callback)
@@ -97,16 +224,123 @@ namespace roboptim
 	    Py_DECREF (computeCallback_);
 	    computeCallback_ = 0;
 	  }
+        nativeCompute_.reset ();
 
         Py_XINCREF (callback);
         computeCallback_ = callback;
       }
 
+      void Function::setNativeComputeCallback (const NativeCallback& callback)
+      {
+        nativeCompute_.set (callback.function, callback.userdata,
+                            callback.owner, callback.userdataOwner);
+
+        if (computeCallback_)
+	  {
+	    Py_DECREF (computeCallback_);
+	    computeCallback_ = 0;
+	  }
+      }
+
       PyObject* Function::getComputeCallback () const
       {
         return computeCallback_;
       }
 
+      bool Function::checkCallbackError () const
+      {
+        if (!PyErr_Occurred ())
+          return false;
+
+        stats_.recordFailure ();
+
+        // Without scope, the error is left pending and the evaluation is
+        // stopped, so that no other callback is called with it.
+        ::roboptim::python::ErrorScope* scope =
+          ::roboptim::python::ErrorScope::current ();
+        if (!scope)
+          boost::throw_exception (::roboptim::python::PythonError ());
+
+        scope->fetch (errorMode_ == ERROR_NAN);
+        // Thrown so that it can be moved between threads with its type.
+        if (errorMode_ == ERROR_RAISE)
+          boost::throw_exception (::roboptim::python::PythonError ());
+        return true;
+      }
+
+      bool Function::computeBatch (batch_ref values, const_batch_ref X) const
+      {
+        // No batch callback: evaluate the points one by one.
+        if (!computeBatchCallback_)
+          {
+            // Python callbacks get the GIL once for the whole batch, so
+            // that their errors are checked with it. Native callbacks
+            // cannot raise, and run without it.
+            const bool python = !nativeCompute_.bound ();
+            ::roboptim::python::GILState gil (python);
+
+            for (batch_t::Index i = 0; i < X.rows (); ++i)
+              {
+                Eigen::Map<const argument_t> x (X.row (i).data (), X.cols ());
+                Eigen::Map<result_t> result (values.row (i).data (),
+                                             values.cols ());
+                (*this) (result, x);
+
+                if (python && PyErr_Occurred ())
+                  return false;
+              }
+            return true;
+          }
+
+        ::roboptim::python::GILState gil;
+
+        npy_intp valuesDims[2] = {values.rows (), values.cols ()};
+        PyObject* valuesNumpy = batchResultView_.array
+          (values.data (), 2, valuesDims);
+        if (!valuesNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert result");
+	    return false;
+	  }
+
+        npy_intp xDims[2] = {X.rows (), X.cols ()};
+        PyObject* xNumpy = batchArgumentView_.array
+          (const_cast<double*> (X.data ()), 2, xDims);
+        if (!xNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert argument");
+	    return false;
+	  }
+
+        PyObject* resultPy = ::roboptim::python::call
+          (computeBatchCallback_, valuesNumpy, xNumpy);
+        Py_XDECREF (resultPy);
+
+        if (checkCallbackError ())
+          values.setConstant (std::numeric_limits<double>::quiet_NaN ());
+        return !PyErr_Occurred ();
+      }
+
+      bool Function::hasComputeBatchCallback () const
+      {
+        return computeBatchCallback_ != 0;
+      }
+
+      void Function::setComputeBatchCallback (PyObject* callback)
+      {
+        if (callback == computeBatchCallback_)
+          return;
+
+        if (computeBatchCallback_)
+	  {
+	    Py_DECREF (computeBatchCallback_);
+	    computeBatchCallback_ = 0;
+	  }
+
+        Py_XINCREF (callback);
+        computeBatchCallback_ = callback;
+      }
+
 
 
       DifferentiableFunction::DifferentiableFunction (size_type inputSize,
@@ -115,8 +349,25 @@ namespace roboptim
         : roboptim::DifferentiableFunction (inputSize, outputSize, name),
 	  Function (inputSize, outputSize, name),
 	  gradientCallback_ (0),
-	  jacobianCallback_ (0)
+	  jacobianCallback_ (0),
+	  gradientBatchCallback_ (0),
+	  jacobianBatchCallback_ (0),
+	  valueJacobianCallback_ (0),
+	  nativeGradient_ (),
+	  nativeJacobian_ (),
+	  jacobianRowMajor_ (jacobian_t::IsRowMajor),
+	  jacobianOtherOrder_ (false),
+	  otherOrderJacobian_ (),
+	  gradientView_ (),
+	  gradientArgumentView_ (false),
+	  jacobianView_ (),
+	  jacobianArgumentView_ (false),
+	  valueJacobianResultView_ (),
+	  batchGradientView_ (),
+	  batchJacobianView_ (),
+	  batchDerivativeArgumentView_ (false)
       {
+        kind_ = KIND_DIFFERENTIABLE;
       }
 
       DifferentiableFunction::~DifferentiableFunction ()
@@ -131,6 +382,20 @@ namespace roboptim
 	    Py_DECREF (jacobianCallback_);
 	    jacobianCallback_ = 0;
 	  }
+        if (gradientBatchCallback_)
+	  {
+	    Py_DECREF (gradientBatchCallback_);
+	    gradientBatchCallback_ = 0;
+	  }
+        if (jacobianBatchCallback_)
+	  {
+	    Py_DECREF (jacobianBatchCallback_);
+	    jacobianBatchCallback_ = 0;
+	  }
+        Py_XDECREF (valueJacobianCallback_);
+        valueJacobianCallback_ = 0;
+        nativeGradient_.reset ();
+        nativeJacobian_.reset ();
       }
 
       DifferentiableFunction::size_type
@@ -157,6 +422,18 @@ namespace roboptim
                                                   size_type functionId)
 	const
       {
+	StatsTimer timer (stats_.gradient, stats_.enabled);
+
+	if (nativeGradient_.bound ())
+	  {
+	    nativeGradient_ (gradient.data (), argument.data (),
+			     static_cast<int> (inputSize ()),
+			     static_cast<int> (functionId));
+	    return;
+	  }
+
+	::roboptim::python::GILState gil;
+
 	if (!gradientCallback_)
           {
             PyErr_SetString
@@ -164,56 +441,75 @@ namespace roboptim
                "gradient callback not set");
             return;
           }
-	if (!PyFunction_Check (gradientCallback_))
-          {
-            PyErr_SetString
-              (PyExc_TypeError,
-               "gradient callback is not a function");
-            return;
-          }
 
 	npy_intp inputSize = static_cast<npy_intp>
 	  (::roboptim::core::python::Function::inputSize ());
 
 	PyObject* gradientNumpy =
-	  PyArray_SimpleNewFromData (1, &inputSize, NPY_DOUBLE, gradient.data ());
+	  gradientView_.vector (gradient.data (), inputSize);
 	if (!gradientNumpy)
           {
             PyErr_SetString (PyExc_TypeError, "cannot convert result");
             return;
           }
 
-	PyObject* argNumpy =
-	  PyArray_SimpleNewFromData
-	  (1, &inputSize, NPY_DOUBLE, const_cast<double*> (argument.data ()));
+	PyObject* argNumpy = gradientArgumentView_.vector
+	  (const_cast<double*> (argument.data ()), inputSize);
 	if (!argNumpy)
           {
             PyErr_SetString (PyExc_TypeError, "cannot convert argument");
             return;
           }
 
-	PyObject* arglist =
-	  Py_BuildValue ("(OOi)", gradientNumpy, argNumpy, functionId);
-	if (!arglist)
-          {
-            Py_DECREF (arglist);
-            PyErr_SetString
-              (PyExc_TypeError, "failed to build argument list");
-            return;
-          }
-
-	PyObject* resultPy = PyEval_CallObject (gradientCallback_, arglist);
-
-        ::roboptim::python::checkPythonError ();
-
-	Py_DECREF (arglist);
-	Py_XDECREF(resultPy);
+	// Small integers are cached by the interpreter.
+	PyObject* functionIdPy = PyInt_FromLong (functionId);
+	timer.beginPython ();
+	PyObject* resultPy = ::roboptim::python::call
+	  (gradientCallback_, gradientNumpy, argNumpy, functionIdPy);
+	timer.endPython ();
+	Py_XDECREF (functionIdPy);
+	Py_XDECREF (resultPy);
+
+        if (checkCallbackError ())
+          gradient.setConstant (std::numeric_limits<double>::quiet_NaN ());
       }
 
       void DifferentiableFunction::impl_jacobian (jacobian_ref jacobian,
                                                   const_argument_ref argument)
 	const
       {
+	// The Jacobian built from the gradients (parent implementation) is
+	// only recorded as gradient calls, not to count them twice.
+	StatsTimer timer (stats_.jacobian, stats_.enabled
+			  && (nativeJacobian_.bound () || jacobianCallback_));
+
+	if (nativeJacobian_.bound ())
+	  {
+	    int n = static_cast<int> (inputSize ());
+	    int m = static_cast<int> (outputSize ());
+
+	    // Native callbacks run without the GIL: the buffer in the other
+	    // storage order cannot be shared.
+	    if (jacobianOtherOrder_)
+	      {
+		otherOrderJacobian_t jac (m, n);
+		nativeJacobian_ (jac.data (), argument.data (), n, m);
+		jacobian = jac;
+	      }
+	    // The solver may give us a block of a larger matrix.
+	    else if (jacobian.outerStride ()
+		     == (jacobian_t::IsRowMajor
+			 ? jacobian.cols () : jacobian.rows ()))
+	      nativeJacobian_ (jacobian.data (), argument.data (), n, m);
+	    else
+	      {
+		jacobian_t jac (m, n);
+		nativeJacobian_ (jac.data (), argument.data (), n, m);
+		jacobian = jac;
+	      }
+	    return;
+	  }
+
 	// Jacobian callback not specified, we fallback on parent implementation
 	if (!jacobianCallback_)
 	  {
@@ -222,35 +518,30 @@ namespace roboptim
 	  }
 	else // Use Jacobian callback defined in Python
 	  {
-	    if (!PyFunction_Check (jacobianCallback_))
-	      {
-		PyErr_SetString
-		  (PyExc_TypeError,
-		   "jacobian callback is not a function");
-		return;
-	      }
+	    ::roboptim::python::GILState gil;
 
 	    npy_intp inputSize =
 	      static_cast<npy_intp> (::roboptim::core::python::Function::inputSize ());
 	    npy_intp outputSize =
 	      static_cast<npy_intp> (::roboptim::core::python::Function::outputSize ());
 
-	    // Check storage order and map memory accordingly (PyArray_SimpleNewFromData
-	    // expects a row-major matrix).
-	    PyObject* jacobianNumpy = NULL;
-	    npy_intp sizes[2] = {outputSize, inputSize};
-
-	    if (::roboptim::StorageOrder == Eigen::RowMajor)
+	    // The view follows the storage order, and the outer stride is kept
+	    // since the solver may give us a block of a larger matrix. If the
+	    // callback writes the other layout, it gets a contiguous buffer in
+	    // that layout, assigned to the solver buffer afterwards.
+	    PyObject* jacobianNumpy = 0;
+	    if (jacobianOtherOrder_)
 	      {
-		jacobianNumpy = PyArray_SimpleNewFromData (2, &sizes[0], NPY_DOUBLE,
-							   jacobian.data ());
+		otherOrderJacobian_.resize (outputSize, inputSize);
+		jacobianNumpy = jacobianView_.matrix
+		  (otherOrderJacobian_.data (), outputSize, inputSize,
+		   static_cast<npy_intp> (otherOrderJacobian_.outerStride ()),
+		   !jacobian_t::IsRowMajor);
 	      }
 	    else
-	      {
-		jacobianNumpy = PyArray_NewFromDescr (&PyArray_Type, PyArray_DescrFromType (PyArray_DOUBLE),
-						      2, sizes, NULL, jacobian.data (),
-						      NPY_WRITEABLE | NPY_F_CONTIGUOUS, NULL);
-	      }
+	      jacobianNumpy = jacobianView_.matrix
+		(jacobian.data (), outputSize, inputSize,
+		 static_cast<npy_intp> (jacobian.outerStride ()));
 
 	    if (!jacobianNumpy)
 	      {
@@ -258,31 +549,25 @@ namespace roboptim
 		return;
 	      }
 
-	    PyObject* argNumpy =
-	      PyArray_SimpleNewFromData
-	      (1, &inputSize, NPY_DOUBLE, const_cast<double*> (argument.data ()));
+	    PyObject* argNumpy = jacobianArgumentView_.vector
+	      (const_cast<double*> (argument.data ()), inputSize);
 	    if (!argNumpy)
 	      {
 		PyErr_SetString (PyExc_TypeError, "cannot convert argument");
 		return;
 	      }
 
-	    PyObject* arglist =
-	      Py_BuildValue ("(OO)", jacobianNumpy, argNumpy);
-	    if (!arglist)
-	      {
-		Py_DECREF (arglist);
-		PyErr_SetString
-		  (PyExc_TypeError, "failed to build argument list");
-		return;
-	      }
-
-	    PyObject* resultPy = PyEval_CallObject (jacobianCallback_, arglist);
+	    timer.beginPython ();
+	    PyObject* resultPy = ::roboptim::python::call
+	      (jacobianCallback_, jacobianNumpy, argNumpy);
+	    timer.endPython ();
+	    Py_XDECREF (resultPy);
 
-	    ::roboptim::python::checkPythonError ();
+	    if (jacobianOtherOrder_ && !PyErr_Occurred ())
+	      jacobian = otherOrderJacobian_;
 
-	    Py_DECREF (arglist);
-	    Py_XDECREF(resultPy);
+	    if (checkCallbackError ())
+	      jacobian.setConstant (std::numeric_limits<double>::quiet_NaN ());
 	  }
       }
 
@@ -299,1306 +584,5109 @@ namespace roboptim
 
       void DifferentiableFunction::setGradientCallback (PyObject* callback)
       {
+        Py_XINCREF (callback);
         if (gradientCallback_)
 	  {
 	    Py_DECREF (gradientCallback_);
 	    gradientCallback_ = 0;
 	  }
+        nativeGradient_.reset ();
 
-        Py_XINCREF (callback);
         gradientCallback_ = callback;
       }
 
       void DifferentiableFunction::setJacobianCallback (PyObject* callback)
       {
+        Py_XINCREF (callback);
         if (jacobianCallback_)
 	  {
 	    Py_DECREF (jacobianCallback_);
 	    jacobianCallback_ = 0;
 	  }
+        nativeJacobian_.reset ();
 
-        Py_XINCREF (callback);
         jacobianCallback_ = callback;
       }
 
-
-      TwiceDifferentiableFunction::TwiceDifferentiableFunction (size_type inputSize,
-								size_type outputSize,
-								const std::string& name)
-        : ::roboptim::TwiceDifferentiableFunction (inputSize, outputSize, name),
-	  ::roboptim::DifferentiableFunction
-	  (inputSize, outputSize, name),
-	  ::roboptim::core::python::DifferentiableFunction
-	  (inputSize, outputSize, name),
-	  hessianCallback_ (0)
+      void DifferentiableFunction::setNativeGradientCallback
+      (const NativeCallback& callback)
       {
+        nativeGradient_.set (callback.function, callback.userdata,
+			     callback.owner, callback.userdataOwner);
+
+        if (gradientCallback_)
+	  {
+	    Py_DECREF (gradientCallback_);
+	    gradientCallback_ = 0;
+	  }
       }
 
-      TwiceDifferentiableFunction::~TwiceDifferentiableFunction ()
+      void DifferentiableFunction::setNativeJacobianCallback
+      (const NativeCallback& callback)
       {
-        if (hessianCallback_)
+        nativeJacobian_.set (callback.function, callback.userdata,
+			     callback.owner, callback.userdataOwner);
+
+        if (jacobianCallback_)
 	  {
-	    Py_DECREF (hessianCallback_);
-	    hessianCallback_ = 0;
+	    Py_DECREF (jacobianCallback_);
+	    jacobianCallback_ = 0;
 	  }
       }
 
-      void TwiceDifferentiableFunction::impl_compute
-      (result_ref result, const_argument_ref argument)
-	const
+      void DifferentiableFunction::setJacobianRowMajor (bool rowMajor)
       {
-        ::roboptim::core::python::Function::impl_compute (result, argument);
+        jacobianRowMajor_ = rowMajor;
+        // Row and column vectors have the same layout in both orders.
+        jacobianOtherOrder_ = (rowMajor != bool (jacobian_t::IsRowMajor))
+	  && inputSize () > 1 && outputSize () > 1;
+        otherOrderJacobian_.resize (0, 0);
+        jacobianView_.reset ();
       }
 
-      void TwiceDifferentiableFunction::impl_gradient
-      (gradient_ref gradient, const_argument_ref argument, size_type functionId)
-	const
+      bool DifferentiableFunction::jacobianRowMajor () const
       {
-        ::roboptim::core::python::DifferentiableFunction::impl_gradient
-          (gradient, argument, functionId);
+        return jacobianRowMajor_;
       }
 
-      void TwiceDifferentiableFunction::impl_hessian (hessian_ref /*hessian*/,
-						      const_argument_ref /*argument*/,
-						      size_type /*functionId*/) const
+      bool DifferentiableFunction::threadSafe () const
       {
-        //FIXME: implement this.
+        // Without Jacobian callback, the Jacobian is built from the
+        // gradients.
+        return Function::threadSafe () && nativeGradient_.bound ()
+          && (nativeJacobian_.bound () || !jacobianCallback_);
       }
 
-
-      FunctionPool::FunctionPool (const callback_ptr callback,
-                                  const functionList_t& functions,
-                                  const std::string& name)
-        : ::roboptim::DifferentiableFunction (pool_t::listInputSize (functions),
-					      pool_t::listOutputSize (functions),
-					      name),
-	  pyFunction_t (pool_t::listInputSize (functions),
-			pool_t::listOutputSize (functions),
-			name),
-	  pool_ (callback, functions, name)
+      void DifferentiableFunction::gradientBatch (batch_ref gradients,
+                                                  const_batch_ref X,
+                                                  size_type functionId)
+	const
       {
-      }
+	// No batch callback: evaluate the points one by one.
+	if (!gradientBatchCallback_)
+	  {
+	    // Same as computeBatch: the GIL is only taken (once) for Python
+	    // callbacks.
+	    const bool python = !nativeGradient_.bound ();
+	    ::roboptim::python::GILState gil (python);
+
+	    for (batch_t::Index i = 0; i < X.rows (); ++i)
+	      {
+		Eigen::Map<const argument_t> x (X.row (i).data (), X.cols ());
+		Eigen::Map<gradient_t> g (gradients.row (i).data (),
+					  gradients.cols ());
+		gradient (g, x, functionId);
 
+		if (python && PyErr_Occurred ())
+		  return;
+	      }
+	    return;
+	  }
 
-      CachedFunction::CachedFunction (boost::shared_ptr<pyFunction_t> f, size_t cache_size)
-        : function_t (f->inputSize (), f->outputSize (), f->getName ()),
-	  pyFunction_t (f->inputSize (), f->outputSize (), f->getName ()),
-	  cached_f_ (boost::make_shared<cache_t> (f, cache_size))
-      {
-      }
+	::roboptim::python::GILState gil;
 
-      CachedFunction::~CachedFunction ()
-      {
+	npy_intp gradientsDims[2] = {gradients.rows (), gradients.cols ()};
+	PyObject* gradientsNumpy = batchGradientView_.array
+	  (gradients.data (), 2, gradientsDims);
+	if (!gradientsNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert result");
+	    return;
+	  }
+
+	npy_intp xDims[2] = {X.rows (), X.cols ()};
+	PyObject* xNumpy = batchDerivativeArgumentView_.array
+	  (const_cast<double*> (X.data ()), 2, xDims);
+	if (!xNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert argument");
+	    return;
+	  }
+
+	PyObject* functionIdPy = PyInt_FromLong (functionId);
+	PyObject* resultPy = ::roboptim::python::call
+	  (gradientBatchCallback_, gradientsNumpy, xNumpy, functionIdPy);
+	Py_XDECREF (functionIdPy);
+	Py_XDECREF (resultPy);
+
+	if (checkCallbackError ())
+	  gradients.setConstant (std::numeric_limits<double>::quiet_NaN ());
       }
 
-      void CachedFunction::impl_compute (result_ref result,
-					 const_argument_ref argument)
+      void DifferentiableFunction::jacobianBatch (batch_ref jacobians,
+                                                  const_batch_ref X)
 	const
       {
-	(*cached_f_) (result, argument);
+	npy_intp inputSize = static_cast<npy_intp>
+	  (::roboptim::core::python::Function::inputSize ());
+	npy_intp outputSize = static_cast<npy_intp>
+	  (::roboptim::core::python::Function::outputSize ());
+
+	// No batch callback: evaluate the points one by one. The Jacobian
+	// follows RobOptim's storage order, so it is evaluated in a buffer
+	// and copied to the row-major output.
+	if (!jacobianBatchCallback_)
+	  {
+	    jacobian_t jac (outputSize, inputSize);
+
+	    const bool python = !threadSafe ();
+	    ::roboptim::python::GILState gil (python);
+
+	    for (batch_t::Index i = 0; i < X.rows (); ++i)
+	      {
+		Eigen::Map<const argument_t> x (X.row (i).data (), X.cols ());
+		jac.setZero ();
+		jacobian (jac, x);
+
+		if (python && PyErr_Occurred ())
+		  return;
+
+		Eigen::Map<batch_t> jacobianRowMajor
+		  (jacobians.row (i).data (), outputSize, inputSize);
+		jacobianRowMajor = jac;
+	      }
+	    return;
+	  }
+
+	::roboptim::python::GILState gil;
+
+	npy_intp jacobiansDims[3] = {jacobians.rows (), outputSize, inputSize};
+	PyObject* jacobiansNumpy = batchJacobianView_.array
+	  (jacobians.data (), 3, jacobiansDims);
+	if (!jacobiansNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert result");
+	    return;
+	  }
+
+	npy_intp xDims[2] = {X.rows (), X.cols ()};
+	PyObject* xNumpy = batchDerivativeArgumentView_.array
+	  (const_cast<double*> (X.data ()), 2, xDims);
+	if (!xNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert argument");
+	    return;
+	  }
+
+	PyObject* resultPy = ::roboptim::python::call
+	  (jacobianBatchCallback_, jacobiansNumpy, xNumpy);
+	Py_XDECREF (resultPy);
+
+	if (checkCallbackError ())
+	  jacobians.setConstant (std::numeric_limits<double>::quiet_NaN ());
       }
 
-      void CachedFunction::impl_gradient (gradient_ref gradient,
-					  const_argument_ref argument,
-					  size_type functionId)
-	const
+      void DifferentiableFunction::setGradientBatchCallback (PyObject* callback)
       {
-	cached_f_->gradient (gradient, argument, functionId);
+        if (gradientBatchCallback_)
+	  {
+	    Py_DECREF (gradientBatchCallback_);
+	    gradientBatchCallback_ = 0;
+	  }
+
+        Py_XINCREF (callback);
+        gradientBatchCallback_ = callback;
       }
 
-      void CachedFunction::impl_jacobian (jacobian_ref jacobian,
-					  const_argument_ref argument)
-	const
+      void DifferentiableFunction::setJacobianBatchCallback (PyObject* callback)
       {
-	cached_f_->jacobian (jacobian, argument);
+        if (jacobianBatchCallback_)
+	  {
+	    Py_DECREF (jacobianBatchCallback_);
+	    jacobianBatchCallback_ = 0;
+	  }
+
+        Py_XINCREF (callback);
+        jacobianBatchCallback_ = callback;
       }
 
-      std::ostream& CachedFunction::print (std::ostream& o) const
+      void DifferentiableFunction::setValueJacobianCallback (PyObject* callback)
       {
-	return cached_f_->print (o);
+        Py_XINCREF (callback);
+        Py_XDECREF (valueJacobianCallback_);
+        valueJacobianCallback_ = callback;
       }
 
-      FunctionPool::~FunctionPool ()
+      void DifferentiableFunction::valueJacobian (result_ref result,
+						  jacobian_ref jacobian,
+						  const_argument_ref argument)
+	const
       {
+	if (!valueJacobianCallback_)
+	  {
+	    (*this) (result, argument);
+	    this->jacobian (jacobian, argument);
+	    return;
+	  }
+
+	StatsTimer timer (stats_.jacobian, stats_.enabled);
+	::roboptim::python::GILState gil;
+
+	npy_intp inputSize =
+	  static_cast<npy_intp> (::roboptim::core::python::Function::inputSize ());
+	npy_intp outputSize =
+	  static_cast<npy_intp> (::roboptim::core::python::Function::outputSize ());
+
+	// Same Jacobian views as impl_jacobian.
+	PyObject* jacobianNumpy = 0;
+	if (jacobianOtherOrder_)
+	  {
+	    otherOrderJacobian_.resize (outputSize, inputSize);
+	    jacobianNumpy = jacobianView_.matrix
+	      (otherOrderJacobian_.data (), outputSize, inputSize,
+	       static_cast<npy_intp> (otherOrderJacobian_.outerStride ()),
+	       !jacobian_t::IsRowMajor);
+	  }
+	else
+	  jacobianNumpy = jacobianView_.matrix
+	    (jacobian.data (), outputSize, inputSize,
+	     static_cast<npy_intp> (jacobian.outerStride ()));
+
+	PyObject* resultNumpy =
+	  valueJacobianResultView_.vector (result.data (), outputSize);
+	PyObject* argNumpy = jacobianArgumentView_.vector
+	  (const_cast<double*> (argument.data ()), inputSize);
+	if (!jacobianNumpy || !resultNumpy || !argNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert arguments");
+	    return;
+	  }
+
+	timer.beginPython ();
+	PyObject* resultPy = ::roboptim::python::call
+	  (valueJacobianCallback_, resultNumpy, jacobianNumpy, argNumpy);
+	timer.endPython ();
+	Py_XDECREF (resultPy);
+
+	if (jacobianOtherOrder_ && !PyErr_Occurred ())
+	  jacobian = otherOrderJacobian_;
+
+	if (checkCallbackError ())
+	  {
+	    result.setConstant (std::numeric_limits<double>::quiet_NaN ());
+	    jacobian.setConstant (std::numeric_limits<double>::quiet_NaN ());
+	  }
       }
 
-      void FunctionPool::impl_compute (result_ref result, const_argument_ref x) const
+
+      TwiceDifferentiableFunction::TwiceDifferentiableFunction (size_type inputSize,
+								size_type outputSize,
+								const std::string& name)
+        : ::roboptim::TwiceDifferentiableFunction (inputSize, outputSize, name),
+	  ::roboptim::DifferentiableFunction
+	  (inputSize, outputSize, name),
+	  ::roboptim::core::python::DifferentiableFunction
+	  (inputSize, outputSize, name),
+	  hessianCallback_ (0),
+	  hessianView_ (),
+	  hessianArgumentView_ (false)
       {
-        pool_.impl_compute (result, x);
+        kind_ = KIND_TWICE_DIFFERENTIABLE;
       }
 
-      void FunctionPool::impl_gradient (gradient_ref gradient,
-                                        const_argument_ref x,
-                                        size_type functionId) const
+      TwiceDifferentiableFunction::~TwiceDifferentiableFunction ()
       {
-        pool_.impl_gradient (gradient, x, functionId);
+        if (hessianCallback_)
+	  {
+	    Py_DECREF (hessianCallback_);
+	    hessianCallback_ = 0;
+	  }
       }
 
-      void FunctionPool::impl_jacobian (jacobian_ref jacobian,
-                                        const_argument_ref x) const
+      void TwiceDifferentiableFunction::impl_compute
+      (result_ref result, const_argument_ref argument)
+	const
       {
-        pool_.impl_jacobian (jacobian, x);
+        ::roboptim::core::python::Function::impl_compute (result, argument);
       }
 
-      std::ostream& FunctionPool::print (std::ostream& o) const
+      void TwiceDifferentiableFunction::impl_gradient
+      (gradient_ref gradient, const_argument_ref argument, size_type functionId)
+	const
       {
-        return pool_.print (o);
+        ::roboptim::core::python::DifferentiableFunction::impl_gradient
+          (gradient, argument, functionId);
       }
-    } // end of namespace python
-  } // end of namespace core
-} // end of namespace roboptim
-
-using roboptim::core::python::Function;
-using roboptim::core::python::DifferentiableFunction;
-using roboptim::core::python::TwiceDifferentiableFunction;
-using roboptim::core::python::FiniteDifferenceGradient;
-using roboptim::core::python::FunctionPool;
-using roboptim::core::python::CachedFunction;
 
-namespace detail
-{
-  // See: http://www.boost.org/doc/libs/1_55_0/libs/smart_ptr/sp_techniques.html#static
-  struct null_deleter
-  {
-    void operator () (void const *) const
-    {
-    }
-  };
-
-  struct pyobject_deleter
-  {
-  public:
+      void TwiceDifferentiableFunction::impl_hessian (hessian_ref hessian,
+						      const_argument_ref argument,
+						      size_type functionId) const
+      {
+	::roboptim::python::GILState gil;
 
-    pyobject_deleter (PyObject* p): p_ (p)
-    {
-    }
+	if (!hessianCallback_)
+	  {
+	    PyErr_SetString
+	      (PyExc_TypeError,
+	       "hessian callback not set");
+	    return;
+	  }
 
-    void operator () (void const *)
-    {
-      Py_DECREF (p_);
-    }
+	npy_intp inputSize =
+	  static_cast<npy_intp> (::roboptim::core::python::Function::inputSize ());
 
-  private:
-    PyObject* p_;
-  };
+	// Same as the Jacobian: the view follows the storage order and keeps
+	// the outer stride of the solver buffer.
+	PyObject* hessianNumpy = hessianView_.matrix
+	  (hessian.data (), inputSize, inputSize,
+	   static_cast<npy_intp> (hessian.outerStride ()));
 
-  template <typename T>
-  boost::shared_ptr<T> to_shared_ptr (T* o, PyObject* py_o)
-  {
-    Py_INCREF (py_o);
-    return boost::shared_ptr<T> (o, pyobject_deleter (py_o));
-  }
+	if (!hessianNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert result");
+	    return;
+	  }
 
-  template <>
-  void destructor<problem_t> (PyObject* obj)
-  {
-    problem_t* ptr = static_cast<problem_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_PROBLEM_CAPSULE_NAME));
-    assert (ptr && "failed to retrieve pointer from capsule");
-    if (ptr)
-      delete ptr;
-  }
+	PyObject* argNumpy = hessianArgumentView_.vector
+	  (const_cast<double*> (argument.data ()), inputSize);
+	if (!argNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert argument");
+	    return;
+	  }
 
-  template <>
-  void destructor<factory_t> (PyObject* obj)
-  {
-    factory_t* ptr = static_cast<factory_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_SOLVER_CAPSULE_NAME));
-    assert (ptr && "failed to retrieve pointer from capsule");
-    if (ptr)
-      delete ptr;
-  }
+	PyObject* functionIdPy = PyInt_FromLong (functionId);
+	PyObject* resultPy = ::roboptim::python::call
+	  (hessianCallback_, hessianNumpy, argNumpy, functionIdPy);
+	Py_XDECREF (resultPy);
+	Py_XDECREF (functionIdPy);
 
-  template <>
-  void destructor<rcp::Multiplexer<solver_t> > (PyObject* obj)
-  {
-    rcp::Multiplexer<solver_t>* ptr = static_cast<rcp::Multiplexer<solver_t>*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_CALLBACK_MULTIPLEXER_CAPSULE_NAME));
-    assert (ptr && "failed to retrieve pointer from capsule");
-    if (ptr)
-      delete ptr;
-  }
+	if (checkCallbackError ())
+	  hessian.setConstant (std::numeric_limits<double>::quiet_NaN ());
+      }
 
-  template <>
-  void destructor<solverState_t> (PyObject* obj)
-  {
-    solverState_t* ptr = static_cast<solverState_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_SOLVER_STATE_CAPSULE_NAME));
-    assert (ptr && "failed to retrieve pointer from capsule");
-    if (ptr)
-      delete ptr;
-  }
+      void TwiceDifferentiableFunction::setHessianCallback (PyObject* callback)
+      {
+        if (hessianCallback_)
+	  {
+	    Py_DECREF (hessianCallback_);
+	    hessianCallback_ = 0;
+	  }
 
-  template <>
-  void destructor<logger_t> (PyObject* obj)
-  {
-    logger_t* ptr = static_cast<logger_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_OPTIMIZATION_LOGGER_CAPSULE_NAME));
-    assert (ptr && "failed to retrieve pointer from capsule");
-    if (ptr)
-      delete ptr;
-  }
+        Py_XINCREF (callback);
+        hessianCallback_ = callback;
+      }
 
-  template <>
-  void destructor<result_t> (PyObject* obj)
-  {
-    result_t* ptr = static_cast<result_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_RESULT_CAPSULE_NAME));
-    assert (ptr && "failed to retrieve pointer from capsule");
-    if (ptr)
-      delete ptr;
-  }
 
-  template <>
-  void destructor<solverError_t> (PyObject* obj)
-  {
-    solverError_t* ptr = static_cast<solverError_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_SOLVER_ERROR_CAPSULE_NAME));
-    assert (ptr && "failed to retrieve pointer from capsule");
-    if (ptr)
-      delete ptr;
-  }
+      SparseDifferentiableFunction::SparseDifferentiableFunction
+      (size_type inputSize, size_type outputSize, const std::string& name)
+        : ::roboptim::DifferentiableSparseFunction (inputSize, outputSize, name),
+	  Function (inputSize, outputSize, name),
+	  jacobianCallback_ (0),
+	  pattern_ (outputSize, inputSize),
+	  gradientJacobian_ (outputSize, inputSize),
+	  gradientX_ (),
+	  hasGradientJacobian_ (false),
+	  gradientMutex_ (),
+	  dataView_ (),
+	  indicesView_ (false),
+	  indptrView_ (false),
+	  jacobianArgumentView_ (false)
+      {
+        kind_ = KIND_SPARSE_DIFFERENTIABLE;
+	pattern_.makeCompressed ();
+	gradientJacobian_.makeCompressed ();
+      }
 
-  template <typename T>
-  void destructor (PyObject* obj)
-  {
-    T* ptr = static_cast<T*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME));
-    assert (ptr && "failed to retrieve pointer from capsule");
-    if (ptr)
-      delete ptr;
-  }
+      SparseDifferentiableFunction::~SparseDifferentiableFunction ()
+      {
+        if (jacobianCallback_)
+	  {
+	    Py_DECREF (jacobianCallback_);
+	    jacobianCallback_ = 0;
+	  }
+      }
 
-  int
-  functionConverter (PyObject* obj, Function** address)
-  {
-    assert (address);
+      SparseDifferentiableFunction::size_type
+      SparseDifferentiableFunction::inputSize () const
+      {
+        return ::roboptim::DifferentiableSparseFunction::inputSize ();
+      }
 
-    if (!PyCapsule_CheckExact (obj))
+      SparseDifferentiableFunction::size_type
+      SparseDifferentiableFunction::outputSize () const
       {
-	PyErr_SetString (PyExc_TypeError, "Invalid Python Function given.");
-	return 0;
+        return ::roboptim::DifferentiableSparseFunction::outputSize ();
       }
 
-    Function* ptr = static_cast<Function*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME));
+      const std::string& SparseDifferentiableFunction::getName () const
+      {
+        return ::roboptim::DifferentiableSparseFunction::getName ();
+      }
 
-    if (!ptr)
+      void SparseDifferentiableFunction::impl_compute
+      (result_ref result, const_argument_ref argument)
+	const
       {
-	PyErr_SetString
-	  (PyExc_TypeError,
-	   "Function object expected but another type was passed");
-	return 0;
+        ::roboptim::core::python::Function::impl_compute (result, argument);
       }
 
-    *address = ptr;
+      void SparseDifferentiableFunction::impl_gradient
+      (gradient_ref gradient, const_argument_ref argument, size_type functionId)
+	const
+      {
+	// Gradients are extracted from the Jacobian, which is the only
+	// callback of sparse functions. It is only evaluated again for a new
+	// argument. The lock is not held during the evaluation, which takes
+	// the GIL.
+	{
+	  boost::mutex::scoped_lock lock (gradientMutex_);
+	  if (hasGradientJacobian_ && gradientX_ == argument)
+	    {
+	      gradient = gradientJacobian_.row (functionId);
+	      return;
+	    }
+	}
 
-    return 1;
-  }
+	jacobian_t jacobian (pattern_);
+	bool valid = evaluateJacobian (jacobian, argument);
+	gradient = jacobian.row (functionId);
 
-  int
-  functionListConverter (PyObject* obj, FunctionPool::functionList_t** v)
-  {
-    assert (v);
+	// Failed evaluations are not reused.
+	if (valid)
+	  {
+	    boost::mutex::scoped_lock lock (gradientMutex_);
+	    gradientJacobian_.swap (jacobian);
+	    gradientX_ = argument;
+	    hasGradientJacobian_ = true;
+	  }
+      }
 
-    if (!PyList_CheckExact (obj))
+      void SparseDifferentiableFunction::impl_jacobian
+      (jacobian_ref jacobian, const_argument_ref argument)
+	const
       {
-	PyErr_SetString (PyExc_TypeError, "Invalid Function list given.");
-	return 0;
+	evaluateJacobian (jacobian, argument);
       }
 
-    // For each function
-    for (int i = 0; i < PyList_Size (obj); ++i)
+      bool SparseDifferentiableFunction::evaluateJacobian
+      (jacobian_ref jacobian, const_argument_ref argument)
+	const
       {
-	PyObject* fPy = PyList_GetItem (obj, i);
+	StatsTimer timer (stats_.jacobian, stats_.enabled);
 
-	Function* f = static_cast<Function*>
-	  (PyCapsule_GetPointer
-	   (fPy, ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME));
+	::roboptim::python::GILState gil;
 
-	if (!f)
+	if (!jacobianCallback_)
 	  {
 	    PyErr_SetString
 	      (PyExc_TypeError,
-	       "Function object expected but another type was passed");
-	    return 0;
+	       "jacobian callback not set");
+	    return false;
 	  }
 
-	DifferentiableFunction* df = dynamic_cast<DifferentiableFunction*> (f);
+	// Make sure that the structure of the Jacobian is the sparsity
+	// pattern, so that Python only has to fill the values.
+	jacobian.makeCompressed ();
+	bool sameStructure = jacobian.rows () == pattern_.rows ()
+	  && jacobian.cols () == pattern_.cols ()
+	  && jacobian.nonZeros () == pattern_.nonZeros ()
+	  && std::equal (pattern_.outerIndexPtr (),
+			 pattern_.outerIndexPtr () + pattern_.outerSize () + 1,
+			 jacobian.outerIndexPtr ())
+	  && std::equal (pattern_.innerIndexPtr (),
+			 pattern_.innerIndexPtr () + pattern_.nonZeros (),
+			 jacobian.innerIndexPtr ());
+	if (!sameStructure)
+	  jacobian = pattern_;
+
+	npy_intp nnz = static_cast<npy_intp> (jacobian.nonZeros ());
+	npy_intp outerSize = static_cast<npy_intp> (jacobian.outerSize ());
+
+	PyObject* dataNumpy = dataView_.vector (jacobian.valuePtr (), nnz);
+	PyObject* indicesNumpy = indicesView_.vector
+	  (jacobian.innerIndexPtr (), nnz);
+	PyObject* indptrNumpy = indptrView_.vector
+	  (jacobian.outerIndexPtr (), outerSize + 1);
+	if (!dataNumpy || !indicesNumpy || !indptrNumpy)
+	  {
+	    PyErr_SetString (PyExc_TypeError, "cannot convert result");
+	    return false;
+	  }
 
-	if (!df)
+	PyObject* argNumpy = jacobianArgumentView_.vector
+	  (const_cast<double*> (argument.data ()),
+	   static_cast<npy_intp> (inputSize ()));
+	if (!argNumpy)
 	  {
-	    PyErr_SetString
-	      (PyExc_TypeError,
-	       "DifferentiableFunction object expected but another type was passed");
-	    return 0;
+	    PyErr_SetString (PyExc_TypeError, "cannot convert argument");
+	    return false;
 	  }
 
-	// Convert ptr to shared_ptr
-	(*v)->push_back (detail::to_shared_ptr<DifferentiableFunction> (df, fPy));
-      }
+	timer.beginPython ();
+	PyObject* resultPy = ::roboptim::python::call
+	  (jacobianCallback_, dataNumpy, indicesNumpy, indptrNumpy, argNumpy);
+	timer.endPython ();
+	Py_XDECREF (resultPy);
 
-    return 1;
-  }
+	if (!PyErr_Occurred ())
+	  return true;
 
-  int
-  problemConverter (PyObject* obj, problem_t** address)
-  {
-    assert (address);
-    problem_t* ptr = static_cast<problem_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_PROBLEM_CAPSULE_NAME));
-    if (!ptr)
+	if (checkCallbackError ())
+	  std::fill (jacobian.valuePtr (),
+		     jacobian.valuePtr () + jacobian.nonZeros (),
+		     std::numeric_limits<double>::quiet_NaN ());
+	return false;
+      }
+
+      std::ostream& SparseDifferentiableFunction::print (std::ostream& o) const
       {
-	PyErr_SetString
-	  (PyExc_TypeError,
-	   "Problem object expected but another type was passed");
-	return 0;
+        return ::roboptim::DifferentiableSparseFunction::print (o);
       }
-    *address = ptr;
-    return 1;
-  }
 
-  int
-  factoryConverter (PyObject* obj, factory_t** address)
-  {
-    assert (address);
-    factory_t* ptr = static_cast<factory_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_SOLVER_CAPSULE_NAME));
-    if (!ptr)
+      void SparseDifferentiableFunction::setSparsityPattern
+      (const jacobian_t& pattern)
       {
-	PyErr_SetString
-	  (PyExc_TypeError,
-	   "Solver object expected but another type was passed");
-	return 0;
+	pattern_ = pattern;
+	pattern_.makeCompressed ();
+	std::fill (pattern_.valuePtr (),
+		   pattern_.valuePtr () + pattern_.nonZeros (), 0.);
+
+	boost::mutex::scoped_lock lock (gradientMutex_);
+	gradientJacobian_ = pattern_;
+	hasGradientJacobian_ = false;
       }
-    *address = ptr;
-    return 1;
-  }
 
-  int
-  solverCallbackConverter (PyObject* obj, rcp::SolverCallback<solver_t>** address)
-  {
-    assert (address);
-    rcp::SolverCallback<solver_t>* ptr = static_cast<rcp::SolverCallback<solver_t>*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_SOLVER_CALLBACK_CAPSULE_NAME));
-    if (!ptr)
+      const SparseDifferentiableFunction::jacobian_t&
+      SparseDifferentiableFunction::sparsityPattern () const
       {
-	PyErr_SetString
-	  (PyExc_TypeError,
-	   "Solver callback object expected but another type was passed");
-	return 0;
+	return pattern_;
       }
-    *address = ptr;
-    return 1;
-  }
 
-  int
-  multiplexerConverter (PyObject* obj, rcp::Multiplexer<solver_t>** address)
-  {
-    assert (address);
-    rcp::Multiplexer<solver_t>* ptr = static_cast<rcp::Multiplexer<solver_t>*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_CALLBACK_MULTIPLEXER_CAPSULE_NAME));
-    if (!ptr)
+      void SparseDifferentiableFunction::setJacobianCallback (PyObject* callback)
       {
-	PyErr_SetString
-	  (PyExc_TypeError,
-	   "Callback multiplexer object expected but another type was passed");
-	return 0;
+        if (jacobianCallback_)
+	  {
+	    Py_DECREF (jacobianCallback_);
+	    jacobianCallback_ = 0;
+	  }
+
+        Py_XINCREF (callback);
+        jacobianCallback_ = callback;
       }
-    *address = ptr;
-    return 1;
-  }
 
-  int
-  solverStateConverter (PyObject* obj, solverState_t** address)
-  {
-    assert (address);
 
-    solverState_t* ptr = static_cast<solverState_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_SOLVER_STATE_CAPSULE_NAME));
+      SparseAdapter::SparseAdapter (const dense_ptr& function)
+        : ::roboptim::DifferentiableSparseFunction
+	  (function->inputSize (), function->outputSize (),
+	   function->getName ()),
+	  function_ (function),
+	  pattern_ (dense_t::jacobian_t::Ones
+		    (function->outputSize (), function->inputSize ())
+		    .sparseView ()),
+	  gradientPattern_ (dense_t::gradient_t::Ones
+			    (function->inputSize ()).sparseView ()),
+	  jacobian_ (),
+	  mutex_ ()
+      {
+	pattern_.makeCompressed ();
+	if (bool (dense_t::jacobian_t::IsRowMajor)
+	    != bool (jacobian_t::IsRowMajor))
+	  jacobian_.resize (outputSize (), inputSize ());
+      }
 
-    if (!ptr)
+      SparseAdapter::~SparseAdapter ()
       {
-	PyErr_SetString
-	  (PyExc_TypeError,
-	   "SolverState object expected but another type was passed");
-	return 0;
       }
-    *address = ptr;
-    return 1;
-  }
 
-  int
-  resultConverter (PyObject* obj, result_t** address)
-  {
-    assert (address);
+      void SparseAdapter::impl_compute (result_ref result,
+					const_argument_ref x) const
+      {
+	(*function_) (result, x);
+      }
 
-    const char* capsule_name = PyCapsule_GetName (obj);
+      void SparseAdapter::impl_gradient (gradient_ref gradient,
+					 const_argument_ref x,
+					 size_type functionId) const
+      {
+	if (gradient.nonZeros () != gradientPattern_.nonZeros ())
+	  gradient = gradientPattern_;
 
-    result_t* ptr = 0;
+	Eigen::Map<dense_t::gradient_t> values
+	  (gradient.valuePtr (), inputSize ());
+	function_->gradient (values, x, functionId);
+      }
 
-    if (std::strcmp (capsule_name,
-                     ROBOPTIM_CORE_RESULT_CAPSULE_NAME) == 0)
+      void SparseAdapter::impl_jacobian (jacobian_ref jacobian,
+					 const_argument_ref x) const
       {
-	ptr = static_cast<result_t*>
-	  (PyCapsule_GetPointer
-	   (obj, ROBOPTIM_CORE_RESULT_CAPSULE_NAME));
+	// A full structure is the only one with outputSize x inputSize
+	// compressed entries.
+	if (jacobian.nonZeros () != pattern_.nonZeros ()
+	    || !jacobian.isCompressed ())
+	  jacobian = pattern_;
+
+	if (bool (dense_t::jacobian_t::IsRowMajor)
+	    == bool (jacobian_t::IsRowMajor))
+	  {
+	    Eigen::Map<dense_t::jacobian_t> values
+	      (jacobian.valuePtr (), outputSize (), inputSize ());
+	    function_->jacobian (values, x);
+	    return;
+	  }
+
+	boost::mutex::scoped_lock lock (mutex_);
+	function_->jacobian (jacobian_, x);
+	Eigen::Map<values_t> (jacobian.valuePtr (),
+			      outputSize (), inputSize ()) = jacobian_;
       }
 
-    if (!ptr)
+
+      int colorColumns (const std::vector<std::vector<int> >& columnRows,
+                        int rows, std::vector<int>& colors)
       {
-	PyErr_SetString
-	  (PyExc_TypeError,
-	   "Result object expected but another type was passed");
-	return 0;
+        int cols = static_cast<int> (columnRows.size ());
+
+        // Colored columns of each row.
+        std::vector<std::vector<int> > rowColumns (static_cast<size_t> (rows));
+
+        // Last column for which a color was forbidden.
+        std::vector<int> forbidden;
+
+        int nColors = 0;
+        colors.assign (static_cast<size_t> (cols), -1);
+        for (int j = 0; j < cols; ++j)
+	  {
+	    const std::vector<int>& colRows = columnRows[j];
+	    for (size_t r = 0; r < colRows.size (); ++r)
+	      {
+		const std::vector<int>& neighbors = rowColumns[colRows[r]];
+		for (size_t c = 0; c < neighbors.size (); ++c)
+		  forbidden[colors[neighbors[c]]] = j;
+	      }
+
+	    // Smallest color not used by a column sharing a row with j.
+	    int color = 0;
+	    while (color < nColors && forbidden[color] == j)
+	      ++color;
+	    if (color == nColors)
+	      {
+		forbidden.push_back (-1);
+		++nColors;
+	      }
+	    colors[j] = color;
+
+	    for (size_t r = 0; r < colRows.size (); ++r)
+	      rowColumns[colRows[r]].push_back (j);
+	  }
+
+        return nColors;
       }
 
-    *address = ptr;
-    return 1;
-  }
 
-  int
-  solverErrorConverter (PyObject* obj, solverError_t** address)
-  {
-    assert (address);
-    solverError_t* ptr = static_cast<solverError_t*>
-      (PyCapsule_GetPointer
-       (obj, ROBOPTIM_CORE_SOLVER_ERROR_CAPSULE_NAME));
-    if (!ptr)
+      WorkerPool::WorkerPool (int nThreads)
+	: nThreads_ (std::max (1, nThreads)),
+	  threads_ (),
+	  mutex_ (),
+	  start_ (),
+	  done_ (),
+	  task_ (),
+	  size_ (0),
+	  generation_ (0),
+	  pending_ (0),
+	  stop_ (false),
+	  error_ ()
       {
-	PyErr_SetString
-	  (PyExc_TypeError,
-	   "SolverError object expected but another type was passed");
-	return 0;
+	for (int i = 0; i < nThreads_; ++i)
+	  threads_.create_thread (boost::bind (&WorkerPool::work, this, i));
       }
-    *address = ptr;
-    return 1;
-  }
 
-  struct ParameterValueVisitor : public boost::static_visitor<PyObject*>
-  {
-    PyObject* operator () (const roboptim::Function::value_type& p) const
-    {
-      return PyFloat_FromDouble (p);
-    }
+      WorkerPool::~WorkerPool ()
+      {
+	{
+	  boost::mutex::scoped_lock lock (mutex_);
+	  stop_ = true;
+	}
+	start_.notify_all ();
+	threads_.join_all ();
+      }
 
-    PyObject* operator () (const int& p) const
-    {
-      return PyInt_FromLong (p);
-    }
+      void WorkerPool::run (const task_t& task, int n)
+      {
+	boost::exception_ptr error;
+	{
+	  boost::mutex::scoped_lock lock (mutex_);
+	  task_ = task;
+	  size_ = n;
+	  pending_ = nThreads_;
+	  ++generation_;
+	  start_.notify_all ();
+
+	  while (pending_ > 0)
+	    done_.wait (lock);
+
+	  task_.clear ();
+	  error.swap (error_);
+	}
 
-    PyObject* operator () (const std::string& p) const
-    {
-      return PyString_FromString (p.c_str ());
-    }
+	if (error)
+	  boost::rethrow_exception (error);
+      }
 
-    PyObject* operator () (const char* p) const
-    {
-      return PyString_FromString (p);
-    }
+      void WorkerPool::work (int index)
+      {
+	unsigned long generation = 0;
+	for (;;)
+	  {
+	    int begin, end;
+	    {
+	      boost::mutex::scoped_lock lock (mutex_);
+	      while (!stop_ && generation_ == generation)
+		start_.wait (lock);
+	      if (stop_)
+		return;
 
-    PyObject* operator () (bool b) const
-    {
-      return PyBool_FromLong (b);
-    }
+	      generation = generation_;
+	      int chunk = (size_ + nThreads_ - 1) / nThreads_;
+	      begin = std::min (size_, index * chunk);
+	      end = std::min (size_, begin + chunk);
+	    }
 
-    PyObject* operator () (roboptim::Function::const_vector_ref v) const
-    {
-      npy_intp n = static_cast<npy_intp> (v.size ());
+	    // The task is not modified before all the chunks are done.
+	    boost::exception_ptr error;
+	    if (begin < end)
+	      {
+		try
+		  {
+		    task_ (begin, end);
+		  }
+		catch (...)
+		  {
+		    error = boost::current_exception ();
+		  }
+	      }
 
-      return PyArray_SimpleNewFromData
-        (1, &n, NPY_DOUBLE, const_cast<double*> (v.data ()));
-    }
-  };
+	    boost::mutex::scoped_lock lock (mutex_);
+	    if (error && !error_)
+	      error_ = error;
+	    if (--pending_ == 0)
+	      done_.notify_all ();
+	  }
+      }
 
-  parameter_t::parameterValues_t toParameterValue (PyObject* obj)
-  {
-    // Value can be: double, int, or std::string
 
-    // Bool
-    if (PyBool_Check (obj))
+      FunctionPool::FunctionPool (const boost::shared_ptr<pyFunction_t>& callback,
+                                  const functionList_t& functions,
+                                  const std::string& name)
+        : ::roboptim::DifferentiableFunction (pool_t::listInputSize (functions),
+					      pool_t::listOutputSize (functions),
+					      name),
+	  pyFunction_t (pool_t::listInputSize (functions),
+			pool_t::listOutputSize (functions),
+			name),
+	  engine_ (boost::make_shared<PoolEngine> (callback)),
+	  pool_ (engine_, functions, name)
       {
-        return bool (PyObject_RichCompareBool (obj, Py_True, Py_EQ) == 1);
       }
-    // String
-    else if (PyString_Check (obj))
+
+      PoolEngine::PoolEngine (const boost::shared_ptr<pyFunction_t>& engine)
+        : function_t (engine->inputSize (), engine->outputSize (),
+		      engine->getName ()),
+	  engine_ (engine),
+	  engineStats_ (engine->stats ()),
+	  hasValue_ (false),
+	  valueX_ (engine->inputSize ()),
+	  value_ (engine->outputSize ()),
+	  hasJacobian_ (false),
+	  jacobianX_ (engine->inputSize ()),
+	  jacobian_ (engine->outputSize (), engine->inputSize ()),
+	  skippedComputes_ (0),
+	  skippedJacobians_ (0),
+	  mutex_ ()
       {
-	return std::string (PyString_AsString (obj));
       }
-    // Unicode string
-    else if (PyUnicode_Check (obj))
+
+      PoolEngine::~PoolEngine ()
       {
-        PyObject* u = PyUnicode_AsUTF8String (obj);
-        parameter_t::parameterValues_t str = std::string (PyString_AsString (u));
-        Py_DECREF (u);
-        return str;
       }
-    // Integer
-    else if (PyInt_Check (obj))
+
+      void PoolEngine::invalidate ()
       {
-        return static_cast<int> (PyInt_AsLong (obj));
+	boost::mutex::scoped_lock lock (mutex_);
+	hasValue_ = hasJacobian_ = false;
       }
-    // Double
-    else if (PyFloat_Check (obj))
+
+      void PoolEngine::impl_compute (result_ref result,
+				     const_argument_ref x) const
       {
-        return PyFloat_AsDouble (obj);
+	{
+	  boost::mutex::scoped_lock lock (mutex_);
+	  if (hasValue_ && x == valueX_)
+	    {
+	      ++skippedComputes_;
+	      result = value_;
+	      return;
+	    }
+	  // Invalid until the engine succeeds.
+	  hasValue_ = false;
+	}
+
+	boost::uint64_t failures = engineStats_.failures.load ();
+	(*engine_) (result, x);
+	if (engineStats_.failures.load () != failures)
+	  return;
+
+	boost::mutex::scoped_lock lock (mutex_);
+	value_ = result;
+	valueX_ = x;
+	hasValue_ = true;
       }
-    // NumPy vector
-    else if (PyArray_Check (obj) && PyArray_ISFLOAT (obj)
-             && PyArray_ITEMSIZE (obj) == sizeof (double))
+
+      void PoolEngine::impl_gradient (gradient_ref gradient,
+				      const_argument_ref x,
+				      size_type functionId) const
       {
-	// Directly map Eigen vector to the numpy array data.
-	Eigen::Map<Function::vector_t> vecEigen
-	  (static_cast<double*> (PyArray_DATA (obj)), PyArray_SIZE (obj));
-	return vecEigen;
+	engine_->gradient (gradient, x, functionId);
       }
 
-    PyErr_SetString
-      (PyExc_TypeError,
-       "invalid parameter value (should be double, int, string, "
-       "bool or NumPy float vector).");
+      void PoolEngine::impl_jacobian (jacobian_ref jacobian,
+				      const_argument_ref x) const
+      {
+	{
+	  boost::mutex::scoped_lock lock (mutex_);
+	  if (hasJacobian_ && x == jacobianX_)
+	    {
+	      ++skippedJacobians_;
+	      jacobian = jacobian_;
+	      return;
+	    }
+	  hasJacobian_ = false;
+	}
 
-    return 0;
-  }
+	boost::uint64_t failures = engineStats_.failures.load ();
+	engine_->jacobian (jacobian, x);
+	if (engineStats_.failures.load () != failures)
+	  return;
 
-  struct StateParameterValueVisitor : public boost::static_visitor<PyObject*>
-  {
-    // TODO: inherit from ParameterValueVisitor instead
-    PyObject* operator () (const roboptim::Function::value_type& p) const
-    {
-      return PyFloat_FromDouble (p);
-    }
+	boost::mutex::scoped_lock lock (mutex_);
+	jacobian_ = jacobian;
+	jacobianX_ = x;
+	hasJacobian_ = true;
+      }
 
-    PyObject* operator () (const int& p) const
-    {
-      return PyInt_FromLong (p);
-    }
 
-    PyObject* operator () (const std::string& p) const
-    {
-      return PyString_FromString (p.c_str ());
+      CachedFunction::CachedFunction (boost::shared_ptr<pyFunction_t> f,
+                                      size_t cache_size,
+                                      value_type tolerance,
+                                      bool joint)
+        : function_t (f->inputSize (), f->outputSize (), f->getName ()),
+	  pyFunction_t (f->inputSize (), f->outputSize (), f->getName ()),
+	  f_ (f),
+	  cacheSize_ (std::max<size_t> (cache_size, 1)),
+	  tolerance_ (tolerance),
+	  joint_ (joint),
+	  entries_ (),
+	  index_ (),
+	  key_ (static_cast<size_t> (f->inputSize ())),
+	  cacheStats_ ()
+      {
+      }
+
+      CachedFunction::~CachedFunction ()
+      {
+      }
+
+      void CachedFunction::makeKey (cacheKey_t& key,
+				    const_argument_ref argument) const
+      {
+	static const value_type bound =
+	  static_cast<value_type> (std::numeric_limits<boost::int64_t>::max ());
+
+	for (size_type i = 0; i < argument.size (); ++i)
+	  {
+	    value_type x = argument[i];
+	    boost::int64_t& k = key[static_cast<size_t> (i)];
+	    if (tolerance_ > 0.)
+	      {
+		// Quantization (saturated, NaN mapped to 0). Points closer
+		// than the tolerance but on both sides of a cell boundary
+		// get different keys: they are distinct entries.
+		value_type q = std::floor (x / tolerance_ + .5);
+		k = q >= bound ? std::numeric_limits<boost::int64_t>::max ()
+		  : q <= -bound ? std::numeric_limits<boost::int64_t>::min ()
+		  : q == q ? static_cast<boost::int64_t> (q) : 0;
+	      }
+	    else
+	      {
+		// Bit pattern, +0 and -0 being the same point.
+		if (x == 0.)
+		  x = 0.;
+		std::memcpy (&k, &x, sizeof (k));
+	      }
+	  }
+      }
+
+      CachedFunction::Entry&
+      CachedFunction::lookup (const_argument_ref argument) const
+      {
+	makeKey (key_, argument);
+
+	index_t::iterator it = index_.find (key_);
+	if (it != index_.end ())
+	  {
+	    entries_.splice (entries_.begin (), entries_, it->second);
+	    return entries_.front ();
+	  }
+
+	// Reuse the storage of the least recently used entry.
+	if (entries_.size () >= cacheSize_)
+	  {
+	    index_.erase (entries_.back ().key);
+	    entries_.splice (entries_.begin (), entries_,
+			     --entries_.end ());
+	    ++cacheStats_.evictions;
+	  }
+	else
+	  {
+	    entries_.push_front (Entry ());
+	    Entry& entry = entries_.front ();
+	    entry.value.resize (outputSize ());
+	    entry.jacobian.resize (outputSize (), inputSize ());
+	  }
+
+	Entry& entry = entries_.front ();
+	entry.key = key_;
+	entry.hasValue = false;
+	entry.hasJacobian = false;
+	entry.gradients.clear ();
+	index_[entry.key] = entries_.begin ();
+	return entry;
+      }
+
+      // Failed evaluations ("nan" error mode) are not cached, so that they
+      // are evaluated again on the next call.
+      void CachedFunction::evaluateValue (Entry& entry,
+					  const_argument_ref argument) const
+      {
+	boost::uint64_t failures = f_->stats ().failures.load ();
+	(*f_) (entry.value, argument);
+	entry.hasValue = f_->stats ().failures.load () == failures;
+      }
+
+      void CachedFunction::evaluateJacobian (Entry& entry,
+					     const_argument_ref argument) const
+      {
+	boost::uint64_t failures = f_->stats ().failures.load ();
+	f_->jacobian (entry.jacobian, argument);
+	entry.hasJacobian = f_->stats ().failures.load () == failures;
+      }
+
+      bool CachedFunction::evaluateJoint (Entry& entry,
+					  const_argument_ref argument) const
+      {
+	if (!joint_ || !f_->hasValueJacobianCallback ())
+	  return false;
+
+	boost::uint64_t failures = f_->stats ().failures.load ();
+	f_->valueJacobian (entry.value, entry.jacobian, argument);
+	entry.hasValue = entry.hasJacobian =
+	  f_->stats ().failures.load () == failures;
+	return true;
+      }
+
+      void CachedFunction::impl_compute (result_ref result,
+					 const_argument_ref argument)
+	const
+      {
+	StatsTimer timer (stats_.compute, stats_.enabled);
+	boost::mutex::scoped_lock lock (mutex_);
+
+	Entry& entry = lookup (argument);
+	if (entry.hasValue)
+	  ++cacheStats_.hits;
+	else
+	  {
+	    ++cacheStats_.misses;
+	    if (!evaluateJoint (entry, argument))
+	      evaluateValue (entry, argument);
+	  }
+	result = entry.value;
+      }
+
+      void CachedFunction::impl_gradient (gradient_ref gradient,
+					  const_argument_ref argument,
+					  size_type functionId)
+	const
+      {
+	StatsTimer timer (stats_.gradient, stats_.enabled);
+	boost::mutex::scoped_lock lock (mutex_);
+
+	Entry& entry = lookup (argument);
+	if (entry.hasJacobian)
+	  {
+	    ++cacheStats_.hits;
+	    gradient = entry.jacobian.row (functionId);
+	    return;
+	  }
+
+	std::map<size_type, gradient_t>::iterator it =
+	  entry.gradients.find (functionId);
+	if (it != entry.gradients.end ())
+	  {
+	    ++cacheStats_.hits;
+	    gradient = it->second;
+	    return;
+	  }
+
+	++cacheStats_.misses;
+	if (evaluateJoint (entry, argument))
+	  {
+	    gradient = entry.jacobian.row (functionId);
+	    return;
+	  }
+
+	boost::uint64_t failures = f_->stats ().failures.load ();
+	f_->gradient (gradient, argument, functionId);
+	if (f_->stats ().failures.load () == failures)
+	  entry.gradients[functionId] = gradient;
+      }
+
+      void CachedFunction::impl_jacobian (jacobian_ref jacobian,
+					  const_argument_ref argument)
+	const
+      {
+	StatsTimer timer (stats_.jacobian, stats_.enabled);
+	boost::mutex::scoped_lock lock (mutex_);
+
+	Entry& entry = lookup (argument);
+	if (entry.hasJacobian)
+	  ++cacheStats_.hits;
+	else
+	  {
+	    ++cacheStats_.misses;
+	    if (!evaluateJoint (entry, argument))
+	      evaluateJacobian (entry, argument);
+	  }
+	jacobian = entry.jacobian;
+      }
+
+      std::ostream& CachedFunction::print (std::ostream& o) const
+      {
+	return f_->print (o);
+      }
+
+      CacheStats CachedFunction::cacheStats () const
+      {
+	boost::mutex::scoped_lock lock (mutex_);
+	return cacheStats_;
+      }
+
+      void CachedFunction::resetCacheStats ()
+      {
+	boost::mutex::scoped_lock lock (mutex_);
+	cacheStats_.reset ();
+      }
+
+      void CachedFunction::clearCache ()
+      {
+	boost::mutex::scoped_lock lock (mutex_);
+	index_.clear ();
+	entries_.clear ();
+      }
+
+      size_t CachedFunction::cachedPoints () const
+      {
+	boost::mutex::scoped_lock lock (mutex_);
+	return entries_.size ();
+      }
+
+      NativeFunction::NativeFunction (const boost::shared_ptr<function_t>& f,
+				      bool threadSafe)
+        : function_t (f->inputSize (), f->outputSize (), f->getName ()),
+	  pyFunction_t (f->inputSize (), f->outputSize (), f->getName ()),
+	  f_ (f),
+	  threadSafe_ (threadSafe)
+      {
+      }
+
+      NativeFunction::~NativeFunction ()
+      {
+      }
+
+      void NativeFunction::impl_compute (result_ref result,
+					 const_argument_ref argument)
+	const
+      {
+	StatsTimer timer (stats_.compute, stats_.enabled);
+	(*f_) (result, argument);
+      }
+
+      void NativeFunction::impl_gradient (gradient_ref gradient,
+					  const_argument_ref argument,
+					  size_type functionId)
+	const
+      {
+	StatsTimer timer (stats_.gradient, stats_.enabled);
+	f_->gradient (gradient, argument, functionId);
+      }
+
+      void NativeFunction::impl_jacobian (jacobian_ref jacobian,
+					  const_argument_ref argument)
+	const
+      {
+	StatsTimer timer (stats_.jacobian, stats_.enabled);
+	f_->jacobian (jacobian, argument);
+      }
+
+      std::ostream& NativeFunction::print (std::ostream& o) const
+      {
+	return f_->print (o);
+      }
+
+      FunctionPool::~FunctionPool ()
+      {
+      }
+
+      void FunctionPool::impl_compute (result_ref result, const_argument_ref x) const
+      {
+        StatsTimer timer (stats_.compute, stats_.enabled);
+        pool_.impl_compute (result, x);
+      }
+
+      void FunctionPool::impl_gradient (gradient_ref gradient,
+                                        const_argument_ref x,
+                                        size_type functionId) const
+      {
+        StatsTimer timer (stats_.gradient, stats_.enabled);
+        pool_.impl_gradient (gradient, x, functionId);
+      }
+
+      void FunctionPool::impl_jacobian (jacobian_ref jacobian,
+                                        const_argument_ref x) const
+      {
+        StatsTimer timer (stats_.jacobian, stats_.enabled);
+        pool_.impl_jacobian (jacobian, x);
+      }
+
+      std::ostream& FunctionPool::print (std::ostream& o) const
+      {
+        return pool_.print (o);
+      }
+
+      namespace
+      {
+        /// \brief Size of the .npy headers: the header is rewritten in
+        /// place when the number of rows changes.
+        const std::size_t npyHeaderSize = 128;
+
+        /// \brief Size of the stdio buffer of each column.
+        const std::size_t npyBufferSize = 1 << 20;
+      } // end of unnamed namespace
+
+      NpyColumn::NpyColumn (const std::string& path, std::size_t columns)
+        : file_ (std::fopen (path.c_str (), "w+b")),
+          columns_ (columns),
+          rows_ (0),
+          buffer_ (npyBufferSize)
+      {
+        if (!file_)
+          throw std::runtime_error ("cannot create " + path);
+
+        std::setvbuf (file_, &buffer_[0], _IOFBF, buffer_.size ());
+        writeHeader ();
+      }
+
+      NpyColumn::~NpyColumn ()
+      {
+        flush ();
+        std::fclose (file_);
+      }
+
+      void NpyColumn::append (const double* row)
+      {
+        std::size_t n = std::max<std::size_t> (1, columns_);
+        if (std::fwrite (row, sizeof (double), n, file_) != n)
+          throw std::runtime_error ("failed to write iteration history");
+        ++rows_;
+      }
+
+      void NpyColumn::flush ()
+      {
+        writeHeader ();
+        std::fflush (file_);
+      }
+
+      void NpyColumn::writeHeader ()
+      {
+        const boost::uint16_t one = 1;
+        const bool little = *reinterpret_cast<const char*> (&one) == 1;
+
+        std::ostringstream dict;
+        dict << "{'descr': '" << (little ? '<' : '>') << "f8', "
+             << "'fortran_order': False, 'shape': (" << rows_ << ",";
+        if (columns_ > 0)
+          dict << " " << columns_;
+        dict << "), }";
+
+        // Magic string, version 1.0, header length, then the dictionary
+        // padded with spaces and terminated by a newline.
+        std::string header ("\x93NUMPY\x01\x00", 8);
+        const std::size_t length = npyHeaderSize - 10;
+        header += static_cast<char> (length & 0xff);
+        header += static_cast<char> ((length >> 8) & 0xff);
+        header += dict.str ();
+        header.resize (npyHeaderSize - 1, ' ');
+        header += '\n';
+
+        std::fseek (file_, 0, SEEK_SET);
+        std::fwrite (header.data (), 1, header.size (), file_);
+        std::fseek (file_, 0, SEEK_END);
+      }
+    } // end of namespace python
+  } // end of namespace core
+} // end of namespace roboptim
+
+using roboptim::core::python::Function;
+using roboptim::core::python::DifferentiableFunction;
+using roboptim::core::python::TwiceDifferentiableFunction;
+using roboptim::core::python::SparseDifferentiableFunction;
+using roboptim::core::python::FiniteDifferenceGradient;
+using roboptim::core::python::FunctionPool;
+using roboptim::core::python::CachedFunction;
+using roboptim::core::python::NativeFunction;
+
+namespace detail
+{
+  // See: http://www.boost.org/doc/libs/1_55_0/libs/smart_ptr/sp_techniques.html#static
+  struct null_deleter
+  {
+    void operator () (void const *) const
+    {
+    }
+  };
+
+  struct pyobject_deleter
+  {
+  public:
+
+    pyobject_deleter (PyObject* p): p_ (p)
+    {
+    }
+
+    void operator () (void const *)
+    {
+      // The last owner may not hold the GIL (e.g. a solver thread).
+      ::roboptim::python::GILState gil;
+      Py_DECREF (p_);
+    }
+
+  private:
+    PyObject* p_;
+  };
+
+  template <typename T>
+  boost::shared_ptr<T> to_shared_ptr (T* o, PyObject* py_o)
+  {
+    Py_INCREF (py_o);
+    return boost::shared_ptr<T> (o, pyobject_deleter (py_o));
+  }
+
+  /// \brief Release function of the native objects owning a T.
+  template <typename T>
+  void release (void* ptr)
+  {
+    delete static_cast<T*> (ptr);
+  }
+
+  /// \brief New native object owning ptr (deleted if the object cannot
+  /// be created).
+  /// \return new reference, or 0 on error.
+  template <typename T>
+  PyObject* ownedObject (PyTypeObject* type, T* ptr, const char* tag)
+  {
+    PyObject* obj = rcp::newObject (type, ptr, tag, &release<T>);
+    if (!obj)
+      delete ptr;
+    return obj;
+  }
+
+  /// \brief Tag of the function objects wrapping a T.
+  template <typename T>
+  const char* functionTag ()
+  {
+    return ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME;
+  }
+
+  template <>
+  const char* functionTag<CachedFunction> ()
+  {
+    return ROBOPTIM_CORE_CACHED_FUNCTION_TAG;
+  }
+
+  template <>
+  const char* functionTag<NativeFunction> ()
+  {
+    return ROBOPTIM_CORE_NATIVE_FUNCTION_TAG;
+  }
+
+  template <>
+  const char* functionTag<FunctionPool> ()
+  {
+    return ROBOPTIM_CORE_FUNCTION_POOL_TAG;
+  }
+
+  template <>
+  const char* functionTag<FiniteDifferenceGradient<simplePolicy_t> > ()
+  {
+    return ROBOPTIM_CORE_SIMPLE_FD_FUNCTION_TAG;
+  }
+
+  template <>
+  const char* functionTag<FiniteDifferenceGradient<fivePointsPolicy_t> > ()
+  {
+    return ROBOPTIM_CORE_FIVE_POINTS_FD_FUNCTION_TAG;
+  }
+
+  /// \brief New function object owning a T.
+  /// \return new reference, or 0 on error.
+  template <typename T>
+  PyObject* functionObject (T* function)
+  {
+    return ownedObject<Function> (&rcp::functionType, function,
+				  functionTag<T> ());
+  }
+
+  /// \brief Function wrapped by obj if it is a T, checked with the tag of
+  /// the object.
+  /// \return the function, or 0 (no Python error is set).
+  template <typename T>
+  T* taggedFunction (PyObject* obj)
+  {
+    return static_cast<T*>
+      (static_cast<Function*>
+       (rcp::objectPointer (obj, &rcp::functionType, functionTag<T> ())));
+  }
+
+  /// \brief RobOptim function given to problems for a differentiable
+  /// function. Native functions and expressions are given directly, so that
+  /// solvers see their linear or quadratic structure.
+  boost::shared_ptr< ::roboptim::DifferentiableFunction>
+  denseFunction (DifferentiableFunction* function, PyObject* obj)
+  {
+    if (NativeFunction* native = taggedFunction<NativeFunction> (obj))
+      return native->native ();
+    return to_shared_ptr<DifferentiableFunction> (function, obj);
+  }
+
+  template <>
+  const char* capsuleName<problem_t> ()
+  {
+    return ROBOPTIM_CORE_PROBLEM_CAPSULE_NAME;
+  }
+
+  template <>
+  const char* capsuleName<sparseProblem_t> ()
+  {
+    return ROBOPTIM_CORE_SPARSE_PROBLEM_CAPSULE_NAME;
+  }
+
+  template <>
+  const char* capsuleName<factory_t> ()
+  {
+    return ROBOPTIM_CORE_SOLVER_CAPSULE_NAME;
+  }
+
+  template <>
+  const char* capsuleName<sparseFactory_t> ()
+  {
+    return ROBOPTIM_CORE_SPARSE_SOLVER_CAPSULE_NAME;
+  }
+
+  /// \brief New problem object owning a P.
+  /// \return new reference, or 0 on error.
+  template <typename P>
+  PyObject* problemObject (P* problem)
+  {
+    return ownedObject (&rcp::problemType, problem, capsuleName<P> ());
+  }
+
+  /// \brief New solver object owning an F.
+  /// \return new reference, or 0 on error.
+  template <typename F>
+  PyObject* solverObject (F* factory)
+  {
+    return ownedObject (&rcp::solverType, factory, capsuleName<F> ());
+  }
+
+  bool isSparse (PyObject* args, Py_ssize_t i)
+  {
+    if (!PyTuple_Check (args) || PyTuple_Size (args) <= i)
+      return false;
+
+    PyObject* obj = PyTuple_GetItem (args, i);
+    return rcp::objectPointer (obj, &rcp::problemType,
+			       ROBOPTIM_CORE_SPARSE_PROBLEM_CAPSULE_NAME)
+      || rcp::objectPointer (obj, &rcp::solverType,
+			     ROBOPTIM_CORE_SPARSE_SOLVER_CAPSULE_NAME);
+  }
+
+  /// \brief Types associated with dense and sparse problems.
+  template <typename P>
+  struct ProblemTraits;
+
+  template <>
+  struct ProblemTraits<problem_t>
+  {
+    typedef rcp::DifferentiableFunction function_t;
+    typedef ::factory_t factory_t;
+  };
+
+  template <>
+  struct ProblemTraits<sparseProblem_t>
+  {
+    typedef rcp::SparseDifferentiableFunction function_t;
+    typedef ::sparseFactory_t factory_t;
+  };
+
+  template <>
+  void destructor<rcp::Multiplexer<solver_t> > (PyObject* obj)
+  {
+    rcp::Multiplexer<solver_t>* ptr = static_cast<rcp::Multiplexer<solver_t>*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_CALLBACK_MULTIPLEXER_CAPSULE_NAME));
+    assert (ptr && "failed to retrieve pointer from capsule");
+    if (ptr)
+      delete ptr;
+  }
+
+  template <>
+  void destructor<rcp::SolverCallback<solver_t> > (PyObject* obj)
+  {
+    rcp::SolverCallback<solver_t>* ptr = static_cast<rcp::SolverCallback<solver_t>*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_SOLVER_CALLBACK_CAPSULE_NAME));
+    assert (ptr && "failed to retrieve pointer from capsule");
+    if (ptr)
+      delete ptr;
+  }
+
+  template <>
+  void destructor<logger_t> (PyObject* obj)
+  {
+    logger_t* ptr = static_cast<logger_t*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_OPTIMIZATION_LOGGER_CAPSULE_NAME));
+    assert (ptr && "failed to retrieve pointer from capsule");
+    if (ptr)
+      delete ptr;
+  }
+
+  template <>
+  void destructor<binaryLogger_t> (PyObject* obj)
+  {
+    binaryLogger_t* ptr = static_cast<binaryLogger_t*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_BINARY_LOGGER_CAPSULE_NAME));
+    assert (ptr && "failed to retrieve pointer from capsule");
+    if (ptr)
+      delete ptr;
+  }
+
+  template <>
+  void destructor<stopCallback_t> (PyObject* obj)
+  {
+    stopCallback_t* ptr = static_cast<stopCallback_t*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_STOP_CALLBACK_CAPSULE_NAME));
+    assert (ptr && "failed to retrieve pointer from capsule");
+    if (ptr)
+      delete ptr;
+  }
+
+  template <>
+  void destructor<result_t> (PyObject* obj)
+  {
+    result_t* ptr = static_cast<result_t*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_RESULT_CAPSULE_NAME));
+    assert (ptr && "failed to retrieve pointer from capsule");
+    if (ptr)
+      delete ptr;
+  }
+
+  template <>
+  void destructor<solverError_t> (PyObject* obj)
+  {
+    solverError_t* ptr = static_cast<solverError_t*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_SOLVER_ERROR_CAPSULE_NAME));
+    assert (ptr && "failed to retrieve pointer from capsule");
+    if (ptr)
+      delete ptr;
+  }
+
+  template <>
+  void destructor<Function::vector_t> (PyObject* obj)
+  {
+    Function::vector_t* ptr = static_cast<Function::vector_t*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_VECTOR_CAPSULE_NAME));
+    assert (ptr && "failed to retrieve pointer from capsule");
+    if (ptr)
+      delete ptr;
+  }
+
+  int
+  functionConverter (PyObject* obj, Function** address)
+  {
+    assert (address);
+
+    Function* ptr = static_cast<Function*>
+      (rcp::objectPointer (obj, &rcp::functionType));
+
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "Function object expected but another type was passed");
+	return 0;
+      }
+
+    *address = ptr;
+
+    return 1;
+  }
+
+  /// \brief Downcast a function using its cached kind.
+  /// \return the differentiable function, or 0 if it is not one.
+  inline DifferentiableFunction*
+  toDifferentiable (Function* function)
+  {
+    return (function && function->isDifferentiable ())
+      ? static_cast<DifferentiableFunction*> (function) : 0;
+  }
+
+  /// \brief Downcast a function using its cached kind.
+  /// \return the twice differentiable function, or 0 if it is not one.
+  inline TwiceDifferentiableFunction*
+  toTwiceDifferentiable (Function* function)
+  {
+    return (function
+	    && function->kind () == Function::KIND_TWICE_DIFFERENTIABLE)
+      ? static_cast<TwiceDifferentiableFunction*> (function) : 0;
+  }
+
+  /// \brief Downcast a function using its cached kind.
+  /// \return the sparse differentiable function, or 0 if it is not one.
+  inline SparseDifferentiableFunction*
+  toSparse (Function* function)
+  {
+    return (function
+	    && function->kind () == Function::KIND_SPARSE_DIFFERENTIABLE)
+      ? static_cast<SparseDifferentiableFunction*> (function) : 0;
+  }
+
+  /// \brief Downcast a function to a T using its cached kind.
+  /// \return the function, or 0 if it is not a T.
+  template <typename T>
+  T* kindCast (Function* function);
+
+  template <>
+  DifferentiableFunction* kindCast<DifferentiableFunction> (Function* function)
+  {
+    return toDifferentiable (function);
+  }
+
+  template <>
+  SparseDifferentiableFunction*
+  kindCast<SparseDifferentiableFunction> (Function* function)
+  {
+    return toSparse (function);
+  }
+
+  int
+  functionListConverter (PyObject* obj, FunctionPool::functionList_t** v)
+  {
+    assert (v);
+
+    if (!PyList_CheckExact (obj))
+      {
+	PyErr_SetString (PyExc_TypeError, "Invalid Function list given.");
+	return 0;
+      }
+
+    // For each function
+    for (int i = 0; i < PyList_Size (obj); ++i)
+      {
+	PyObject* fPy = PyList_GetItem (obj, i);
+
+	Function* f = 0;
+	if (!functionConverter (fPy, &f))
+	  return 0;
+
+	DifferentiableFunction* df = detail::toDifferentiable (f);
+
+	if (!df)
+	  {
+	    PyErr_SetString
+	      (PyExc_TypeError,
+	       "DifferentiableFunction object expected but another type was passed");
+	    return 0;
+	  }
+
+	// Convert ptr to shared_ptr
+	(*v)->push_back (detail::to_shared_ptr<DifferentiableFunction> (df, fPy));
+      }
+
+    return 1;
+  }
+
+  template <typename P>
+  int
+  problemConverter (PyObject* obj, P** address)
+  {
+    assert (address);
+    P* ptr = static_cast<P*>
+      (rcp::objectPointer (obj, &rcp::problemType, capsuleName<P> ()));
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "Problem object expected but another type was passed");
+	return 0;
+      }
+    *address = ptr;
+    return 1;
+  }
+
+  template <typename F>
+  int
+  factoryConverter (PyObject* obj, F** address)
+  {
+    assert (address);
+    F* ptr = static_cast<F*>
+      (rcp::objectPointer (obj, &rcp::solverType, capsuleName<F> ()));
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "Solver object expected but another type was passed");
+	return 0;
+      }
+    *address = ptr;
+    return 1;
+  }
+
+  int
+  solverCallbackConverter (PyObject* obj, rcp::SolverCallback<solver_t>** address)
+  {
+    assert (address);
+    rcp::SolverCallback<solver_t>* ptr = static_cast<rcp::SolverCallback<solver_t>*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_SOLVER_CALLBACK_CAPSULE_NAME));
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "Solver callback object expected but another type was passed");
+	return 0;
+      }
+    *address = ptr;
+    return 1;
+  }
+
+  int
+  multiplexerConverter (PyObject* obj, rcp::Multiplexer<solver_t>** address)
+  {
+    assert (address);
+    rcp::Multiplexer<solver_t>* ptr = static_cast<rcp::Multiplexer<solver_t>*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_CALLBACK_MULTIPLEXER_CAPSULE_NAME));
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "Callback multiplexer object expected but another type was passed");
+	return 0;
+      }
+    *address = ptr;
+    return 1;
+  }
+
+  int
+  solverStateConverter (PyObject* obj, solverState_t** address)
+  {
+    assert (address);
+
+    solverState_t* ptr = static_cast<solverState_t*>
+      (rcp::objectPointer (obj, &rcp::solverStateType));
+
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "SolverState object expected but another type was passed");
+	return 0;
+      }
+    *address = ptr;
+    return 1;
+  }
+
+  int
+  resultConverter (PyObject* obj, result_t** address)
+  {
+    assert (address);
+
+    const char* capsule_name = PyCapsule_GetName (obj);
+
+    result_t* ptr = 0;
+
+    if (std::strcmp (capsule_name,
+                     ROBOPTIM_CORE_RESULT_CAPSULE_NAME) == 0)
+      {
+	ptr = static_cast<result_t*>
+	  (PyCapsule_GetPointer
+	   (obj, ROBOPTIM_CORE_RESULT_CAPSULE_NAME));
+      }
+
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "Result object expected but another type was passed");
+	return 0;
+      }
+
+    *address = ptr;
+    return 1;
+  }
+
+  int
+  solverErrorConverter (PyObject* obj, solverError_t** address)
+  {
+    assert (address);
+    solverError_t* ptr = static_cast<solverError_t*>
+      (PyCapsule_GetPointer
+       (obj, ROBOPTIM_CORE_SOLVER_ERROR_CAPSULE_NAME));
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "SolverError object expected but another type was passed");
+	return 0;
+      }
+    *address = ptr;
+    return 1;
+  }
+
+  /// \brief Insert a new reference in a dictionary, and release it (unlike
+  /// PyDict_SetItemString, which does not steal references).
+  /// \return 0 on success, -1 on failure.
+  int setItemSteal (PyObject* dict, const char* key, PyObject* value)
+  {
+    if (!value)
+      return -1;
+    int status = PyDict_SetItemString (dict, key, value);
+    Py_DECREF (value);
+    return status;
+  }
+
+  /// \brief Build a (first, second) tuple from two new references, that
+  /// are released in any case.
+  /// \return new reference, or 0 if an item could not be built.
+  PyObject* pairSteal (PyObject* first, PyObject* second)
+  {
+    PyObject* pair = (first && second) ? PyTuple_Pack (2, first, second) : 0;
+    Py_XDECREF (first);
+    Py_XDECREF (second);
+    return pair;
+  }
+
+  /// \brief NumPy view on a vector owned by a Python object.
+  ///
+  /// The owner (e.g. a result capsule) is the base object of the view, so
+  /// that the vector outlives the view.
+  ///
+  /// \return new reference on the view, or 0 on error.
+  PyObject*
+  ownedVector (const Function::vector_t& v, PyObject* owner)
+  {
+    npy_intp n = static_cast<npy_intp> (v.size ());
+    PyObject* array = PyArray_SimpleNewFromData
+      (1, &n, NPY_DOUBLE, const_cast<double*> (v.data ()));
+    if (!array)
+      return 0;
+
+    Py_INCREF (owner);
+    if (PyArray_SetBaseObject (reinterpret_cast<PyArrayObject*> (array),
+			       owner) < 0)
+      {
+	Py_DECREF (array);
+	return 0;
+      }
+    return array;
+  }
+
+  /// \brief NumPy view on a vector of a solver state.
+  ///
+  /// During an iteration callback, the view is registered in the context
+  /// of the state object, and released (or detached) when the callback
+  /// returns, see releaseStateViews. Views on the same vector are shared.
+  /// Otherwise, the state object becomes the base object of the view.
+  ///
+  /// \return new reference on the view, or 0 on error.
+  PyObject*
+  stateVector (PyObject* state, Function::vector_t& v)
+  {
+    ::roboptim::core::python::stateViews_t* views =
+      static_cast< ::roboptim::core::python::stateViews_t*>
+      (reinterpret_cast<rcp::NativeObject*> (state)->context);
+    if (!views)
+      return ownedVector (v, state);
+
+    for (::roboptim::core::python::stateViews_t::const_iterator
+	   it = views->begin (); it != views->end (); ++it)
+      if (it->second == &v
+	  && PyArray_DATA (it->first) == v.data ()
+	  && PyArray_DIM (it->first, 0) == v.size ())
+	{
+	  Py_INCREF (it->first);
+	  return it->first;
+	}
+
+    npy_intp n = static_cast<npy_intp> (v.size ());
+    PyObject* array = PyArray_SimpleNewFromData (1, &n, NPY_DOUBLE, v.data ());
+    if (!array)
+      return 0;
+
+    // The registry keeps a reference until the callback returns.
+    Py_INCREF (array);
+    views->push_back (std::make_pair (array, &v));
+    return array;
+  }
+
+  struct ParameterValueVisitor : public boost::static_visitor<PyObject*>
+  {
+    PyObject* operator () (const roboptim::Function::value_type& p) const
+    {
+      return PyFloat_FromDouble (p);
+    }
+
+    PyObject* operator () (const int& p) const
+    {
+      return PyInt_FromLong (p);
+    }
+
+    PyObject* operator () (const std::string& p) const
+    {
+      return PyString_FromString (p.c_str ());
+    }
+
+    PyObject* operator () (const char* p) const
+    {
+      return PyString_FromString (p);
+    }
+
+    PyObject* operator () (bool b) const
+    {
+      return PyBool_FromLong (b);
+    }
+
+    PyObject* operator () (roboptim::Function::const_vector_ref v) const
+    {
+      npy_intp n = static_cast<npy_intp> (v.size ());
+
+      return PyArray_SimpleNewFromData
+        (1, &n, NPY_DOUBLE, const_cast<double*> (v.data ()));
+    }
+  };
+
+  parameter_t::parameterValues_t toParameterValue (PyObject* obj)
+  {
+    // Value can be: double, int, or std::string
+
+    // Bool
+    if (PyBool_Check (obj))
+      {
+        return bool (PyObject_RichCompareBool (obj, Py_True, Py_EQ) == 1);
+      }
+    // String
+    else if (PyString_Check (obj))
+      {
+	return std::string (PyString_AsString (obj));
+      }
+    // Unicode string
+    else if (PyUnicode_Check (obj))
+      {
+        PyObject* u = PyUnicode_AsUTF8String (obj);
+        parameter_t::parameterValues_t str = std::string (PyString_AsString (u));
+        Py_DECREF (u);
+        return str;
+      }
+    // Integer
+    else if (PyInt_Check (obj))
+      {
+        return static_cast<int> (PyInt_AsLong (obj));
+      }
+    // Double
+    else if (PyFloat_Check (obj))
+      {
+        return PyFloat_AsDouble (obj);
+      }
+    // NumPy vector
+    else if (PyArray_Check (obj) && PyArray_ISFLOAT (obj)
+             && PyArray_ITEMSIZE (obj) == sizeof (double))
+      {
+	// Directly map Eigen vector to the numpy array data.
+	Eigen::Map<Function::vector_t> vecEigen
+	  (static_cast<double*> (PyArray_DATA (obj)), PyArray_SIZE (obj));
+	return vecEigen;
+      }
+
+    PyErr_SetString
+      (PyExc_TypeError,
+       "invalid parameter value (should be double, int, string, "
+       "bool or NumPy float vector).");
+
+    return 0;
+  }
+
+  struct StateParameterValueVisitor : public boost::static_visitor<PyObject*>
+  {
+    // TODO: inherit from ParameterValueVisitor instead
+    PyObject* operator () (const roboptim::Function::value_type& p) const
+    {
+      return PyFloat_FromDouble (p);
+    }
+
+    PyObject* operator () (const int& p) const
+    {
+      return PyInt_FromLong (p);
+    }
+
+    PyObject* operator () (const std::string& p) const
+    {
+      return PyString_FromString (p.c_str ());
+    }
+
+    PyObject* operator () (const char* p) const
+    {
+      return PyString_FromString (p);
+    }
+
+    PyObject* operator () (bool b) const
+    {
+      return PyBool_FromLong (b);
+    }
+
+    PyObject* operator () (roboptim::Function::const_vector_ref v) const
+    {
+      npy_intp n = static_cast<npy_intp> (v.size ());
+
+      return PyArray_SimpleNewFromData
+        (1, &n, NPY_DOUBLE, const_cast<double*> (v.data ()));
+    }
+  };
+
+  stateParameter_t::stateParameterValues_t toStateParameterValue (PyObject* obj)
+  {
+    // Value can be: double, int, std::string, bool or NumPy vector.
+    // Bool
+    if (PyBool_Check (obj))
+      {
+        return bool (PyObject_RichCompareBool (obj, Py_True, Py_EQ) == 1);
+      }
+    // NumPy vector
+    else if (PyArray_Check (obj) && PyArray_ISFLOAT (obj)
+             && PyArray_ITEMSIZE (obj) == sizeof (double))
+      {
+	// Directly map Eigen vector to the numpy array data.
+	Eigen::Map<Function::vector_t> vecEigen
+	  (static_cast<double*> (PyArray_DATA (obj)), PyArray_SIZE (obj));
+	return vecEigen;
+      }
+    // String, unicode string, integer, double
+    else if (PyString_Check (obj) || PyUnicode_Check (obj) ||
+	     PyInt_Check (obj) || PyFloat_Check (obj))
+      {
+	return toParameterValue (obj);
+      }
+
+    PyErr_SetString
+      (PyExc_TypeError,
+       "invalid parameter value (should be double, int, string, "
+       "bool or NumPy float vector).");
+
+    return 0;
+  }
+
+  /// \brief Get a C-contiguous (N x cols) NumPy array from a batch of points.
+  /// NumPy arrays with the proper layout are used without copy.
+  /// \return new reference (null on failure).
+  PyObject* toBatchInput (PyObject* obj, npy_intp cols)
+  {
+    PyObject* xNumpy = PyArray_FROM_OTF (obj, NPY_DOUBLE, NPY_IN_ARRAY);
+    if (!xNumpy)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "Argument cannot be converted to NumPy object");
+	return 0;
+      }
+
+    if (PyArray_NDIM (xNumpy) != 2 || PyArray_DIM (xNumpy, 1) != cols)
+      {
+	Py_DECREF (xNumpy);
+	PyErr_Format
+	  (PyExc_ValueError,
+	   "points should be stored in a (N x %ld) array", (long)cols);
+	return 0;
+      }
+
+    return xNumpy;
+  }
+
+  /// \brief Check that a batch output can be written without copy.
+  /// \param obj output array.
+  /// \param rows number of points.
+  /// \param size number of elements per point.
+  bool checkBatchOutput (PyObject* obj, npy_intp rows, npy_intp size)
+  {
+    if (!PyArray_Check (obj) || PyArray_TYPE (obj) != NPY_DOUBLE
+	|| !PyArray_ISCARRAY (obj))
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "output should be a writeable C-contiguous NumPy float array");
+	return false;
+      }
+
+    if (PyArray_NDIM (obj) < 1 || PyArray_DIM (obj, 0) != rows
+	|| PyArray_SIZE (obj) != rows * size)
+      {
+	PyErr_Format
+	  (PyExc_ValueError,
+	   "output should store %ld elements for each of the %ld points",
+	   (long)size, (long)rows);
+	return false;
+      }
+
+    return true;
+  }
+
+  /// \brief Multi-start solve: the starting points are shared among worker
+  /// threads, and every start is solved by its own solver.
+  struct MultiStart
+  {
+    typedef std::vector<solver_t::result_t> results_t;
+
+    MultiStart (const std::string& plugin,
+		const problem_t& problem,
+		Function::const_batch_ref startingPoints,
+		const parameters_t& parameters)
+      : plugin_ (plugin),
+	problem_ (problem),
+	startingPoints_ (startingPoints),
+	parameters_ (parameters),
+	results_ (static_cast<size_t> (startingPoints.rows ())),
+	next_ (0)
+    {
+    }
+
+    /// \brief Worker loop: solve starting points until none is left.
+    void run ()
+    {
+      for (;;)
+	{
+	  size_t i = 0;
+	  {
+	    boost::mutex::scoped_lock lock (indexMutex_);
+	    if (next_ >= results_.size ())
+	      return;
+	    i = next_++;
+	  }
+
+	  results_[i] = solve (i);
+	}
+    }
+
+    const results_t& results () const
+    {
+      return results_;
+    }
+
+  private:
+    solver_t::result_t solve (size_t i)
+    {
+      problem_t problem (problem_);
+      problem.startingPoint () = Function::argument_t
+	(startingPoints_.row (static_cast<Function::batch_t::Index> (i))
+	 .transpose ());
+
+      // Loading and unloading plugins is not thread-safe.
+      factory_t* factory = 0;
+      {
+	boost::mutex::scoped_lock lock (pluginMutex_);
+	try
+	  {
+	    factory = new factory_t (plugin_, problem);
+	  }
+	catch (const std::exception& e)
+	  {
+	    return solverError_t (e.what ());
+	  }
+      }
+
+      // The exceptions of the Python callbacks cannot be raised from the
+      // workers: they are reported as solver errors.
+      ::roboptim::python::ErrorScope errors;
+
+      solver_t::result_t result;
+      try
+	{
+	  solver_t& solver = (*factory) ();
+
+	  for (parameters_t::const_iterator iter = parameters_.begin ();
+	       iter != parameters_.end (); ++iter)
+	    solver.parameters ()[iter->first] = iter->second;
+
+	  solver.solve ();
+	  result = solver.minimum ();
+	}
+      catch (const std::exception& e)
+	{
+	  result = solverError_t (e.what ());
+	}
+
+      if (errors.raised ())
+	{
+	  ::roboptim::python::GILState gil;
+	  result = solverError_t (errors.message ());
+	}
+
+      boost::mutex::scoped_lock lock (pluginMutex_);
+      delete factory;
+      return result;
+    }
+
+    const std::string plugin_;
+    const problem_t problem_;
+    Function::const_batch_ref startingPoints_;
+    const parameters_t parameters_;
+
+    results_t results_;
+    size_t next_;
+
+    boost::mutex indexMutex_;
+    boost::mutex pluginMutex_;
+  };
+} // end of namespace detail.
+
+namespace roboptim
+{
+  namespace core
+  {
+    namespace python
+    {
+      void releaseStateViews (stateViews_t& views,
+			      const ::roboptim::Function::vector_t* keep)
+      {
+        stateViews_t kept;
+        for (stateViews_t::iterator it = views.begin ();
+	     it != views.end (); ++it)
+	  {
+	    if (it->second == keep)
+	      {
+		kept.push_back (*it);
+		continue;
+	      }
+
+	    PyArrayObject* array =
+	      reinterpret_cast<PyArrayObject*> (it->first);
+	    ::roboptim::Function::vector_t& v = *it->second;
+
+	    // Slices of the view reference it as their base.
+	    if (Py_REFCNT (it->first) > 1)
+	      {
+		if (PyArray_DATA (array) == v.data ())
+		  {
+		    // Move the buffer viewed by the array to a capsule owned
+		    // by the array, and give the state a copy.
+		    ::roboptim::Function::vector_t* storage =
+		      new ::roboptim::Function::vector_t ();
+		    storage->swap (v);
+		    v = *storage;
+
+		    PyObject* owner = PyCapsule_New
+		      (storage, ROBOPTIM_CORE_VECTOR_CAPSULE_NAME,
+		       &::detail::destructor< ::roboptim::Function::vector_t>);
+		    if (!owner)
+		      {
+			// Give the buffer back to the state.
+			v.swap (*storage);
+			delete storage;
+			PyErr_Clear ();
+		      }
+		    else
+		      PyArray_SetBaseObject (array, owner);
+		  }
+
+		PyArray_CLEARFLAGS (array, NPY_WRITEABLE);
+	      }
+
+	    Py_DECREF (it->first);
+	  }
+        views.swap (kept);
+      }
+    } // end of namespace python
+  } // end of namespace core
+} // end of namespace roboptim
+
+template <typename T>
+static PyObject*
+createFunction (PyObject*, PyObject* args)
+{
+  Function::size_type inSize = 0;
+  Function::size_type outSize = 0;
+  const char* name = 0;
+
+  if (!PyArg_ParseTuple(args, "iis", &inSize, &outSize, &name))
+    return 0;
+
+  std::string name_ = (name) ? name : "";
+  T* function = new T (inSize, outSize, name_);
+  return detail::functionObject (function);
+}
+
+
+template <>
+PyObject*
+createFunction<FunctionPool> (PyObject*, PyObject* args)
+{
+  const char* name = 0;
+  Function* function = 0;
+  FunctionPool::functionList_t functions;
+  FunctionPool::functionList_t* p_functions = &functions;
+
+  if (!PyArg_ParseTuple(args, "O&O&s",
+                        &detail::functionConverter, &function,
+                        &detail::functionListConverter, &p_functions,
+                        &name))
+    return 0;
+
+  // The callback is stored as a RobOptim function: cast it properly rather
+  // than reinterpreting the Python function pointer.
+  DifferentiableFunction* callback = detail::toDifferentiable (function);
+  if (!callback)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a differentiable function object");
+      return 0;
+    }
+
+  std::string name_ = (name) ? name : "";
+  boost::shared_ptr<DifferentiableFunction> p_callback
+    = detail::to_shared_ptr<DifferentiableFunction>
+    (callback, PyTuple_GetItem (args, 0));
+  FunctionPool* pool = new FunctionPool (p_callback, functions, name_);
+  return detail::functionObject (pool);
+}
+
+template <typename T>
+static PyObject*
+createFDWrapper (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  double eps = ::roboptim::finiteDifferenceEpsilon;
+  int nThreads = 1;
+  if (!PyArg_ParseTuple(args, "O&|di", &detail::functionConverter, &function,
+			&eps, &nThreads))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a function object");
+      return 0;
+    }
+
+  T* fdFunction = new T (*function, eps, nThreads);
+  return detail::functionObject (fdFunction);
+}
+
+static PyObject*
+createCachedFunction (PyObject*, PyObject* args)
+{
+  typedef CachedFunction cachedDifferentiableFunction_t;
+
+  Function* function = 0;
+  int cache_size = 10;
+  double tolerance = 0.;
+  PyObject* joint = Py_False;
+
+  if (!PyArg_ParseTuple(args, "O&|idO", &detail::functionConverter, &function,
+			&cache_size, &tolerance, &joint))
+    return 0;
+
+  if (cache_size < 1)
+    {
+      PyErr_SetString (PyExc_ValueError, "cache size must be positive");
+      return 0;
+    }
+
+  if (!(tolerance >= 0.))
+    {
+      PyErr_SetString (PyExc_ValueError, "tolerance must be non-negative");
+      return 0;
+    }
+
+  int isJoint = PyObject_IsTrue (joint);
+  if (isJoint < 0)
+    return 0;
+
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+
+  DifferentiableFunction* dfunction =
+    detail::toDifferentiable (function);
+  if (!dfunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve differentiable function object");
+      return 0;
+    }
+
+  boost::shared_ptr<DifferentiableFunction> dfunction_ptr
+    = detail::to_shared_ptr<DifferentiableFunction> (dfunction, PyTuple_GetItem (args, 0));
+  assert (dfunction_ptr);
+
+  cachedDifferentiableFunction_t* cachedFunction
+    = new cachedDifferentiableFunction_t (dfunction_ptr,
+					  static_cast<size_t> (cache_size),
+					  tolerance, isJoint != 0);
+
+  return detail::functionObject (cachedFunction);
+}
+
+static PyObject*
+inputSize (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  if (!PyArg_ParseTuple(args, "O&", &detail::functionConverter, &function))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a function object");
+      return 0;
+    }
+  return Py_BuildValue("i", function->inputSize ());
+}
+
+static PyObject*
+outputSize (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  if (!PyArg_ParseTuple(args, "O&", &detail::functionConverter, &function))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a function object");
+      return 0;
+    }
+  return Py_BuildValue("i", function->outputSize ());
+}
+
+static PyObject*
+getName (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+
+  if (!PyArg_ParseTuple(args, "O&", &detail::functionConverter, &function))
+    return 0;
+
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a function object");
+      return 0;
+    }
+
+  return Py_BuildValue("s", function->getName ().c_str ());
+}
+
+static PyObject*
+getStorageOrder (PyObject*, PyObject*)
+{
+  char storage_order = (::roboptim::core::python::NPY_STORAGE_ORDER == NPY_F_CONTIGUOUS)? 'F':'C';
+  return Py_BuildValue("c", storage_order);
+}
+
+static PyObject*
+createProblem (PyObject*, PyObject* args)
+{
+  Function* cost = 0;
+  PyObject* sparsePy = Py_False;
+  if (!PyArg_ParseTuple(args, "O&|O", &detail::functionConverter, &cost,
+			&sparsePy))
+    return 0;
+
+  int sparse = PyObject_IsTrue (sparsePy);
+  if (sparse < 0)
+    return 0;
+
+  DifferentiableFunction* dCost = detail::toDifferentiable (cost);
+  SparseDifferentiableFunction* sCost =
+    detail::toSparse (cost);
+
+  if (!dCost && !sCost)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a differentiable function object");
+      return 0;
+    }
+
+  // If we just used a boost::shared_ptr, the cost function would be freed when the
+  // problem disappears, so we use a custom deleter that keeps track of the
+  // Python object's reference counter to prevent that.
+  if (sCost || sparse)
+    {
+      // Dense costs are adapted, e.g. for sparse constraints.
+      boost::shared_ptr<sparseProblem_t::function_t> costPtr = sCost
+	? boost::static_pointer_cast<sparseProblem_t::function_t>
+	(detail::to_shared_ptr<SparseDifferentiableFunction>
+	 (sCost, PyTuple_GetItem (args, 0)))
+	: boost::make_shared<SparseAdapter>
+	(detail::denseFunction (dCost, PyTuple_GetItem (args, 0)));
+      assert (!!costPtr);
+
+      sparseProblem_t* problem = new sparseProblem_t (costPtr);
+
+      return detail::problemObject (problem);
+    }
+
+  // Native functions and expressions are given directly to the problem.
+  boost::shared_ptr< ::roboptim::DifferentiableFunction> costPtr =
+    detail::denseFunction (dCost, PyTuple_GetItem (args, 0));
+  assert (!!costPtr);
+
+  problem_t* problem = new problem_t (costPtr);
+
+  return detail::problemObject (problem);
+}
+
+namespace detail
+{
+  /// \brief Solver plugins kept loaded, by plugin name (null handle if
+  /// the plugin library could not be located).
+  typedef std::map<std::string, void*> pluginHandles_t;
+
+  pluginHandles_t& pluginHandles ()
+  {
+    static pluginHandles_t handles;
+    return handles;
+  }
+
+  boost::mutex& pluginHandlesMutex ()
+  {
+    static boost::mutex mutex;
+    return mutex;
+  }
+
+  /// \brief Keep the plugin of a solver loaded for the lifetime of the
+  /// process.
+  ///
+  /// Each SolverFactory loads its plugin with libltdl and unloads it when
+  /// destroyed, so every new solver would load, relocate and initialize
+  /// the plugin library again. The library of the first solver of each
+  /// plugin is located from the address of the solver virtual table
+  /// (defined in the plugin), and an extra reference on it is kept.
+  template <typename S>
+  void pinPlugin (const std::string& name, const S& solver)
+  {
+    boost::mutex::scoped_lock lock (pluginHandlesMutex ());
+    if (pluginHandles ().count (name))
+      return;
+
+    const void* vtable =
+      *static_cast<const void* const*> (dynamic_cast<const void*> (&solver));
+    void* handle = 0;
+    Dl_info info;
+    if (dladdr (vtable, &info) && info.dli_fname)
+      handle = dlopen (info.dli_fname, RTLD_NOW | RTLD_NOLOAD);
+    pluginHandles ()[name] = handle;
+  }
+} // end of namespace detail.
+
+template <typename P>
+static PyObject*
+createSolver (PyObject*, PyObject* args)
+{
+  typedef typename detail::ProblemTraits<P>::factory_t factory_t;
+
+  char* pluginName = 0;
+  P* problem = 0;
+  PyObject* previousPy = 0;
+  if (!PyArg_ParseTuple (args, "sO&|O",
+			 &pluginName,
+			 &detail::problemConverter<P>, &problem,
+			 &previousPy))
+    return 0;
+
+  // Solver whose parameters are copied (optional).
+  factory_t* previous = 0;
+  if (previousPy && previousPy != Py_None
+      && !detail::factoryConverter<factory_t> (previousPy, &previous))
+    return 0;
+
+  factory_t* factory = 0;
+
+  try
+    {
+      factory = new factory_t (pluginName, *problem);
+      detail::pinPlugin (pluginName, (*factory) ());
+
+      if (previous)
+	(*factory) ().parameters () = (*previous) ().parameters ();
+    }
+  catch (const std::exception& e)
+    {
+      PyErr_SetString (PyExc_RuntimeError, e.what ());
+
+      delete factory;
+      return NULL;
+    }
+
+  return detail::solverObject (factory);
+}
+
+static PyObject*
+createMultiplexer (PyObject*, PyObject* args)
+{
+  factory_t* factory = 0;
+  if (!PyArg_ParseTuple (args, "O&",
+			 &detail::factoryConverter<factory_t>, &factory))
+    return 0;
+
+  ::roboptim::core::python::Multiplexer<solver_t>* multiplexer = 0;
+
+  try
+    {
+      boost::shared_ptr<factory_t> factory_ptr
+        = detail::to_shared_ptr<factory_t> (factory, PyTuple_GetItem (args, 0));
+      assert (factory_ptr);
+      multiplexer = new ::roboptim::core::python::Multiplexer<solver_t> (factory_ptr);
+    }
+  catch (const std::exception& e)
+    {
+      PyErr_SetString (PyExc_RuntimeError, e.what ());
+
+      delete multiplexer;
+      return NULL;
+    }
+
+  PyObject* multiplexerPy =
+    PyCapsule_New (multiplexer, ROBOPTIM_CORE_CALLBACK_MULTIPLEXER_CAPSULE_NAME,
+		   &detail::destructor< ::roboptim::core::python::Multiplexer<solver_t> >);
+  return multiplexerPy;
+}
+
+static PyObject*
+loadedSolverPlugins (PyObject*, PyObject*)
+{
+  boost::mutex::scoped_lock lock (detail::pluginHandlesMutex ());
+
+  PyObject* plugins = PyList_New (0);
+  if (!plugins)
+    return 0;
+
+  for (detail::pluginHandles_t::const_iterator
+	 it = detail::pluginHandles ().begin ();
+       it != detail::pluginHandles ().end (); ++it)
+    {
+      if (!it->second)
+	continue;
+
+      PyObject* name = PyString_FromString (it->first.c_str ());
+      if (!name || PyList_Append (plugins, name) < 0)
+	{
+	  Py_XDECREF (name);
+	  Py_DECREF (plugins);
+	  return 0;
+	}
+      Py_DECREF (name);
+    }
+  return plugins;
+}
+
+static PyObject*
+setMultiplexerSolver (PyObject*, PyObject* args)
+{
+  ::roboptim::core::python::Multiplexer<solver_t>* multiplexer = 0;
+  factory_t* factory = 0;
+  if (!PyArg_ParseTuple (args, "O&O&:setMultiplexerSolver",
+			 &detail::multiplexerConverter, &multiplexer,
+			 &detail::factoryConverter<factory_t>, &factory))
+    return 0;
+
+  try
+    {
+      multiplexer->setFactory
+	(detail::to_shared_ptr<factory_t> (factory, PyTuple_GetItem (args, 1)));
+    }
+  catch (const std::exception& e)
+    {
+      PyErr_SetString (PyExc_RuntimeError, e.what ());
+      return 0;
+    }
+
+  Py_INCREF (Py_None);
+  return Py_None;
+}
+
+template <typename S>
+static PyObject*
+createSolverCallback (PyObject*, PyObject* args)
+{
+  typedef ::roboptim::core::python::SolverCallback<S> solverCallback_t;
+
+  PyObject* problem = 0;
+  if (!PyArg_ParseTuple (args, "O", &problem))
+    return 0;
+
+  solverCallback_t* callback = 0;
+
+  try
+    {
+      callback = new solverCallback_t (problem);
+    }
+  catch (const std::exception& e)
+    {
+      PyErr_SetString (PyExc_RuntimeError, e.what ());
+
+      delete callback;
+      return NULL;
+    }
+
+  PyObject* callbackPy =
+    PyCapsule_New (callback, ROBOPTIM_CORE_SOLVER_CALLBACK_CAPSULE_NAME,
+		   &detail::destructor<solverCallback_t>);
+  return callbackPy;
+}
+
+namespace detail
+{
+  /// \brief Requirements on the arrays used directly by the evaluations.
+  static const int inputRequirements =
+    NPY_ALIGNED | ::roboptim::core::python::NPY_STORAGE_ORDER;
+  static const int outputRequirements = inputRequirements | NPY_WRITEABLE;
+
+  /// \brief Convert an array given to compute, gradient or jacobian.
+  ///
+  /// NumPy arrays of doubles with the expected alignment and storage order
+  /// are used directly. Other arrays are copied: the copy is counted in the
+  /// function statistics, or a ValueError is raised in strict mode. Other
+  /// sequences (lists, tuples...) are always converted.
+  ///
+  /// \param size expected number of elements.
+  /// \return new reference on a NumPy array, or 0 on error.
+  PyObject*
+  evaluationArray (const Function* function, PyObject* obj,
+		   npy_intp size, int requirements, const char* error)
+  {
+    PyObject* array = 0;
+
+    if (PyArray_Check (obj) && PyArray_TYPE (obj) == NPY_DOUBLE
+	&& PyArray_CHKFLAGS (obj, requirements))
+      {
+	Py_INCREF (obj);
+	array = obj;
+      }
+    else if (PyArray_Check (obj) && function->strictArrays ())
+      {
+	PyErr_Format
+	  (PyExc_ValueError,
+	   "%s: an aligned %s-contiguous array of doubles is required in"
+	   " strict mode",
+	   error,
+	   (::roboptim::core::python::NPY_STORAGE_ORDER == NPY_F_CONTIGUOUS)
+	   ? "Fortran" : "C");
+	return 0;
+      }
+    else
+      {
+	array = PyArray_FROM_OTF (obj, NPY_DOUBLE, requirements);
+	if (!array)
+	  {
+	    PyErr_Format
+	      (PyExc_TypeError, "%s cannot be converted to NumPy object",
+	       error);
+	    return 0;
+	  }
+	if (PyArray_Check (obj))
+	  function->recordCopy ();
+      }
+
+    if (PyArray_SIZE (array) != size)
+      {
+	PyErr_Format
+	  (PyExc_ValueError, "%s: %ld elements expected, %ld given", error,
+	   static_cast<long> (size), static_cast<long> (PyArray_SIZE (array)));
+	Py_DECREF (array);
+	return 0;
+      }
+
+    return array;
+  }
+
+  /// \brief Convert the point at which a function is evaluated.
+  /// \return new reference on an input NumPy array, or 0 on error.
+  PyObject*
+  inputArray (const Function* function, PyObject* x)
+  {
+    return evaluationArray (function, x, function->inputSize (),
+			    inputRequirements, "Argument");
+  }
+
+  /// \brief Convert the output buffer of an evaluation.
+  ///
+  /// If None is given, a zeroed array with the given dimensions is
+  /// allocated in the storage order, so that Python wrappers do not need
+  /// to query the sizes and the storage order before each call.
+  ///
+  /// \return new reference on an output NumPy array, or 0 on error.
+  PyObject*
+  outputArray (const Function* function, PyObject* output,
+	       int nd, npy_intp* dims, const char* error)
+  {
+    if (output == Py_None)
+      return PyArray_ZEROS
+	(nd, dims, NPY_DOUBLE,
+	 ::roboptim::core::python::NPY_STORAGE_ORDER == NPY_F_CONTIGUOUS);
+
+    npy_intp size = 1;
+    for (int i = 0; i < nd; ++i)
+      size *= dims[i];
+    return evaluationArray (function, output, size, outputRequirements, error);
+  }
+
+  /// \brief Value returned by the evaluation entry points: the allocated
+  /// array if None was given as output buffer, None otherwise.
+  ///
+  /// If the output buffer had to be copied, the values are written back.
+  /// Steals the reference on outputNumpy.
+  PyObject*
+  evaluationResult (PyObject* output, PyObject* outputNumpy)
+  {
+    if (output == Py_None)
+      return outputNumpy;
+
+    if (output != outputNumpy && PyArray_Check (output)
+	&& PyArray_CopyInto (reinterpret_cast<PyArrayObject*> (output),
+			     reinterpret_cast<PyArrayObject*> (outputNumpy)) < 0)
+      {
+	Py_DECREF (outputNumpy);
+	return 0;
+      }
+
+    Py_DECREF (outputNumpy);
+    Py_INCREF (Py_None);
+    return Py_None;
+  }
+
+  /// \brief Strides of a matrix, in elements, along RobOptim's storage
+  /// order.
+  struct MatrixStrides
+  {
+    Function::size_type outer;
+    Function::size_type inner;
+  };
+
+  /// \brief Strides of a writable (rows x cols) NumPy matrix of doubles
+  /// usable in place, whatever its layout.
+  ///
+  /// \return false if the array must be converted (other type, shape or
+  /// alignment, byte-swapped or negative strides...).
+  bool
+  matrixStrides (PyObject* obj, npy_intp rows, npy_intp cols,
+		 MatrixStrides& strides)
+  {
+    if (!PyArray_Check (obj) || PyArray_TYPE (obj) != NPY_DOUBLE
+	|| PyArray_NDIM (obj) != 2
+	|| PyArray_DIM (obj, 0) != rows || PyArray_DIM (obj, 1) != cols
+	|| !PyArray_CHKFLAGS (obj, NPY_ALIGNED | NPY_WRITEABLE)
+	|| !PyArray_ISNOTSWAPPED (obj))
+      return false;
+
+    const int outerAxis = Function::matrix_t::IsRowMajor ? 0 : 1;
+    const npy_intp sizes[2] = {PyArray_DIM (obj, outerAxis),
+			       PyArray_DIM (obj, 1 - outerAxis)};
+    const npy_intp* s = PyArray_STRIDES (obj);
+    npy_intp bytes[2] = {s[outerAxis], s[1 - outerAxis]};
+
+    // The strides of dimensions of size 1 are arbitrary.
+    if (sizes[1] <= 1)
+      bytes[1] = static_cast<npy_intp> (sizeof (double));
+    if (sizes[0] <= 1)
+      bytes[0] = sizes[1] * bytes[1];
+
+    for (int i = 0; i < 2; ++i)
+      if (bytes[i] <= 0 || bytes[i] % static_cast<npy_intp> (sizeof (double)))
+	return false;
+
+    strides.outer = bytes[0] / static_cast<npy_intp> (sizeof (double));
+    strides.inner = bytes[1] / static_cast<npy_intp> (sizeof (double));
+    return true;
+  }
+
+  /// \brief Evaluate a matrix (Jacobian, Hessian) into a NumPy matrix.
+  ///
+  /// Matrices laid out in the storage order (possibly with a larger outer
+  /// stride) are given to the function directly. Other layouts are mapped
+  /// with runtime strides: the function evaluates into a temporary matrix,
+  /// kept by the function, assigned natively to the NumPy buffer. In both
+  /// cases, the values are written to the caller's array.
+  ///
+  /// \tparam E evaluation, called with the output matrix.
+  template <typename E>
+  void
+  evaluateMatrix (const Function* function, PyObject* array,
+		  Function::size_type rows, Function::size_type cols,
+		  const MatrixStrides& strides, const E& evaluate)
+  {
+    typedef Function::matrix_t matrix_t;
+    double* data = static_cast<double*> (PyArray_DATA (array));
+
+    if (strides.inner == 1)
+      {
+	Eigen::Map<matrix_t, Eigen::Unaligned, Eigen::OuterStride<> > m
+	  (data, rows, cols, Eigen::OuterStride<> (strides.outer));
+	evaluate (m);
+      }
+    else
+      {
+	// A concurrent evaluation of the same function uses its own
+	// temporary (the GIL is released).
+	Function::MatrixBuffer& buffer = function->matrixBuffer ();
+	boost::mutex::scoped_try_lock lock (buffer.mutex);
+	matrix_t local;
+	matrix_t& m = lock.owns_lock () ? buffer.matrix : local;
+	m.resize (rows, cols);
+	evaluate (m);
+	Eigen::Map<matrix_t, Eigen::Unaligned,
+		   Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> >
+	  (data, rows, cols,
+	   Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>
+	   (strides.outer, strides.inner)) = m;
+      }
+  }
+
+  /// \brief Convert the output matrix of a Jacobian or Hessian evaluation.
+  ///
+  /// Writable matrices of doubles are used in place whatever their layout
+  /// (see evaluateMatrix). Other objects are converted by outputArray.
+  ///
+  /// \return new reference on an output NumPy array, or 0 on error.
+  PyObject*
+  outputMatrix (const Function* function, PyObject* output,
+		npy_intp rows, npy_intp cols, MatrixStrides& strides,
+		const char* error)
+  {
+    if (output != Py_None && matrixStrides (output, rows, cols, strides))
+      {
+	Py_INCREF (output);
+	return output;
+      }
+
+    npy_intp dims[2] = {rows, cols};
+    PyObject* array = outputArray (function, output, 2, dims, error);
+    if (!array)
+      return 0;
+
+    // Arrays converted by outputArray follow the storage order, but
+    // (rows x cols) may have been given as a vector.
+    strides.outer = Function::matrix_t::IsRowMajor ? cols : rows;
+    strides.inner = 1;
+    return array;
+  }
+
+  /// \brief Jacobian evaluation, for evaluateMatrix.
+  struct JacobianEvaluation
+  {
+    JacobianEvaluation (DifferentiableFunction* f,
+			Eigen::Map<Function::argument_t>& x)
+      : function (f),
+	argument (x)
+    {}
+
+    template <typename M>
+    void operator() (M& jacobian) const
+    {
+      function->jacobian (jacobian, argument);
+    }
+
+    DifferentiableFunction* function;
+    Eigen::Map<Function::argument_t>& argument;
+  };
+
+  /// \brief Hessian evaluation, for evaluateMatrix.
+  struct HessianEvaluation
+  {
+    HessianEvaluation (TwiceDifferentiableFunction* f,
+		       Eigen::Map<Function::argument_t>& x,
+		       Function::size_type id)
+      : function (f),
+	argument (x),
+	functionId (id)
+    {}
+
+    template <typename M>
+    void operator() (M& hessian) const
+    {
+      function->hessian (hessian, argument, functionId);
+    }
+
+    TwiceDifferentiableFunction* function;
+    Eigen::Map<Function::argument_t>& argument;
+    Function::size_type functionId;
+  };
+
+  PyObject*
+  computeInto (Function* function, PyObject* result, PyObject* x)
+  {
+    npy_intp dims[1] = {function->outputSize ()};
+    PyObject* resultNumpy =
+      outputArray (function, result, 1, dims, "Result");
+    if (!resultNumpy)
+      return 0;
+
+    PyObject* xNumpy = inputArray (function, x);
+    if (!xNumpy)
+      {
+	Py_DECREF (resultNumpy);
+	return 0;
+      }
+
+    // Directly map Eigen vector over Numpy x.
+    Eigen::Map<Function::argument_t> xEigen
+      (static_cast<double*> (PyArray_DATA (xNumpy)), function->inputSize ());
+
+    // Directly map Eigen result to the numpy array data.
+    Eigen::Map<Function::result_t> resultEigen
+      (static_cast<double*>
+       (PyArray_DATA (resultNumpy)), function->outputSize ());
+
+    // Exceptions of the Python callbacks are collected until the
+    // evaluation returns, so that composite functions do not call other
+    // callbacks with an error pending, then raised again.
+    ::roboptim::python::ErrorScope errors (true);
+
+    try
+      {
+	// Python callbacks take the GIL back, and native functions may be
+	// shared with solver threads.
+	::roboptim::python::GILRelease nogil;
+	(*function) (resultEigen, xEigen);
+      }
+    catch (const std::exception& e)
+      {
+	Py_DECREF (xNumpy);
+	Py_DECREF (resultNumpy);
+	if (!errors.restore ())
+	  PyErr_SetString (PyExc_RuntimeError, e.what ());
+	return 0;
+      }
+
+    // Clean up.
+    Py_DECREF (xNumpy);
+
+    if (errors.restore () || PyErr_Occurred ())
+      {
+	Py_DECREF (resultNumpy);
+	return 0;
+      }
+
+    return evaluationResult (result, resultNumpy);
+  }
+
+  PyObject*
+  gradientInto (DifferentiableFunction* dfunction, PyObject* gradient,
+		PyObject* x, Function::size_type functionId)
+  {
+    const Function* function = dfunction;
+    npy_intp dims[1] = {dfunction->gradientSize ()};
+    PyObject* gradientNumpy =
+      outputArray (function, gradient, 1, dims, "Gradient");
+    if (!gradientNumpy)
+      return 0;
+
+    PyObject* xNumpy = inputArray (function, x);
+    if (!xNumpy)
+      {
+	Py_DECREF (gradientNumpy);
+	return 0;
+      }
+
+    // Directly map Eigen vector over NumPy x.
+    Eigen::Map<Function::argument_t> xEigen
+      (static_cast<double*> (PyArray_DATA (xNumpy)), function->inputSize ());
+
+    // Directly map Eigen result to the numpy array data.
+    Eigen::Map<DifferentiableFunction::gradient_t> gradientEigen
+      (static_cast<double*>
+       (PyArray_DATA (gradientNumpy)), dfunction->gradientSize ());
+
+    ::roboptim::python::ErrorScope errors (true);
+
+    try
+      {
+	::roboptim::python::GILRelease nogil;
+	dfunction->gradient (gradientEigen, xEigen, functionId);
+      }
+    catch (const std::exception& e)
+      {
+	Py_DECREF (xNumpy);
+	Py_DECREF (gradientNumpy);
+	if (!errors.restore ())
+	  PyErr_SetString (PyExc_RuntimeError, e.what ());
+	return 0;
+      }
+
+    // Clean up.
+    Py_DECREF (xNumpy);
+
+    if (errors.restore () || PyErr_Occurred ())
+      {
+	Py_DECREF (gradientNumpy);
+	return 0;
+      }
+
+    return evaluationResult (gradient, gradientNumpy);
+  }
+
+  PyObject*
+  jacobianInto (DifferentiableFunction* dfunction, PyObject* jacobian,
+		PyObject* x)
+  {
+    const Function* function = dfunction;
+    MatrixStrides strides;
+    PyObject* jacobianNumpy =
+      outputMatrix (function, jacobian, dfunction->jacobianSize ().first,
+		    dfunction->jacobianSize ().second, strides, "Jacobian");
+    if (!jacobianNumpy)
+      return 0;
+
+    PyObject* xNumpy = inputArray (function, x);
+    if (!xNumpy)
+      {
+	Py_DECREF (jacobianNumpy);
+	return 0;
+      }
+
+    // Directly map Eigen vector over NumPy x.
+    Eigen::Map<Function::argument_t> xEigen
+      (static_cast<double*> (PyArray_DATA (xNumpy)), function->inputSize ());
+
+    ::roboptim::python::ErrorScope errors (true);
+
+    try
+      {
+	::roboptim::python::GILRelease nogil;
+	evaluateMatrix (dfunction, jacobianNumpy,
+			dfunction->jacobianSize ().first,
+			dfunction->jacobianSize ().second, strides,
+			JacobianEvaluation (dfunction, xEigen));
+      }
+    catch (const std::exception& e)
+      {
+	Py_DECREF (xNumpy);
+	Py_DECREF (jacobianNumpy);
+	if (!errors.restore ())
+	  PyErr_SetString (PyExc_RuntimeError, e.what ());
+	return 0;
+      }
+
+    // Clean up.
+    Py_DECREF (xNumpy);
+
+    if (errors.restore () || PyErr_Occurred ())
+      {
+	Py_DECREF (jacobianNumpy);
+	return 0;
+      }
+
+    return evaluationResult (jacobian, jacobianNumpy);
+  }
+
+  int
+  differentiableConverter (PyObject* obj, DifferentiableFunction** address)
+  {
+    Function* function = 0;
+    if (!functionConverter (obj, &function))
+      return 0;
+
+    *address = toDifferentiable (function);
+    if (!*address)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "argument 1 should be a differentiable function object");
+	return 0;
+      }
+    return 1;
+  }
+} // end of namespace detail.
+
+#ifndef ROBOPTIM_CORE_PYTHON_FASTCALL
+static PyObject*
+compute (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* x = 0;
+  PyObject* result = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&OO",
+       detail::functionConverter, &function, &result, &x))
+    return 0;
+
+  return detail::computeInto (function, result, x);
+}
+
+static PyObject*
+gradient (PyObject*, PyObject* args)
+{
+  DifferentiableFunction* dfunction = 0;
+  PyObject* x = 0;
+  PyObject* gradient = 0;
+  Function::size_type functionId = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&OOi",
+       detail::differentiableConverter, &dfunction, &gradient, &x, &functionId))
+    return 0;
+
+  return detail::gradientInto (dfunction, gradient, x, functionId);
+}
+
+static PyObject*
+jacobian (PyObject*, PyObject* args)
+{
+  DifferentiableFunction* dfunction = 0;
+  PyObject* x = 0;
+  PyObject* jacobian = 0;
+
+  if (!PyArg_ParseTuple
+      (args, "O&OO",
+       detail::differentiableConverter, &dfunction, &jacobian, &x))
+    return 0;
+
+  return detail::jacobianInto (dfunction, jacobian, x);
+}
+#else
+// Vectorcall entry points of the hot evaluation functions: the arguments
+// are read directly from the C array, without building an argument tuple
+// and parsing a format string.
+
+namespace detail
+{
+  bool
+  checkArgumentCount (const char* name, Py_ssize_t nargs, Py_ssize_t expected)
+  {
+    if (nargs == expected)
+      return true;
+
+    PyErr_Format (PyExc_TypeError, "%s expected %zd arguments, got %zd",
+		  name, expected, nargs);
+    return false;
+  }
+} // end of namespace detail.
+
+static PyObject*
+computeFast (PyObject*, PyObject* const* args, Py_ssize_t nargs)
+{
+  Function* function = 0;
+  if (!detail::checkArgumentCount ("compute", nargs, 3)
+      || !detail::functionConverter (args[0], &function))
+    return 0;
+
+  return detail::computeInto (function, args[1], args[2]);
+}
+
+static PyObject*
+gradientFast (PyObject*, PyObject* const* args, Py_ssize_t nargs)
+{
+  DifferentiableFunction* dfunction = 0;
+  if (!detail::checkArgumentCount ("gradient", nargs, 4)
+      || !detail::differentiableConverter (args[0], &dfunction))
+    return 0;
+
+  long functionId = PyInt_AsLong (args[3]);
+  if (functionId == -1 && PyErr_Occurred ())
+    return 0;
+
+  return detail::gradientInto
+    (dfunction, args[1], args[2],
+     static_cast<Function::size_type> (functionId));
+}
+
+static PyObject*
+jacobianFast (PyObject*, PyObject* const* args, Py_ssize_t nargs)
+{
+  DifferentiableFunction* dfunction = 0;
+  if (!detail::checkArgumentCount ("jacobian", nargs, 3)
+      || !detail::differentiableConverter (args[0], &dfunction))
+    return 0;
+
+  return detail::jacobianInto (dfunction, args[1], args[2]);
+}
+#endif //! ROBOPTIM_CORE_PYTHON_FASTCALL
+
+// Methods of the function objects: f.compute (result, x) is the same as
+// compute (f, result, x), without converting the function argument.
+
+namespace detail
+{
+  /// \brief Function of a function object (its type is checked by the
+  /// method descriptor).
+  inline Function*
+  selfFunction (PyObject* self)
+  {
+    return static_cast<Function*>
+      (reinterpret_cast<rcp::NativeObject*> (self)->pointer);
+  }
+
+  /// \brief Differentiable function of a function object.
+  /// \return 0 (with a Python exception set) if it is not differentiable.
+  DifferentiableFunction*
+  selfDifferentiable (PyObject* self)
+  {
+    DifferentiableFunction* dfunction = toDifferentiable (selfFunction (self));
+    if (!dfunction)
+      PyErr_SetString (PyExc_TypeError, "function is not differentiable");
+    return dfunction;
+  }
+} // end of namespace detail.
+
+#ifdef ROBOPTIM_CORE_PYTHON_FASTCALL
+static PyObject*
+functionCompute (PyObject* self, PyObject* const* args, Py_ssize_t nargs)
+{
+  if (!detail::checkArgumentCount ("compute", nargs, 2))
+    return 0;
+
+  return detail::computeInto (detail::selfFunction (self), args[0], args[1]);
+}
+
+static PyObject*
+functionGradient (PyObject* self, PyObject* const* args, Py_ssize_t nargs)
+{
+  DifferentiableFunction* dfunction = 0;
+  if (!detail::checkArgumentCount ("gradient", nargs, 3)
+      || !(dfunction = detail::selfDifferentiable (self)))
+    return 0;
+
+  long functionId = PyInt_AsLong (args[2]);
+  if (functionId == -1 && PyErr_Occurred ())
+    return 0;
+
+  return detail::gradientInto
+    (dfunction, args[0], args[1],
+     static_cast<Function::size_type> (functionId));
+}
+
+static PyObject*
+functionJacobian (PyObject* self, PyObject* const* args, Py_ssize_t nargs)
+{
+  DifferentiableFunction* dfunction = 0;
+  if (!detail::checkArgumentCount ("jacobian", nargs, 2)
+      || !(dfunction = detail::selfDifferentiable (self)))
+    return 0;
+
+  return detail::jacobianInto (dfunction, args[0], args[1]);
+}
+#else
+static PyObject*
+functionCompute (PyObject* self, PyObject* args)
+{
+  PyObject* result = 0;
+  PyObject* x = 0;
+  if (!PyArg_ParseTuple (args, "OO", &result, &x))
+    return 0;
+
+  return detail::computeInto (detail::selfFunction (self), result, x);
+}
+
+static PyObject*
+functionGradient (PyObject* self, PyObject* args)
+{
+  PyObject* gradient = 0;
+  PyObject* x = 0;
+  Function::size_type functionId = 0;
+  DifferentiableFunction* dfunction = 0;
+  if (!PyArg_ParseTuple (args, "OOi", &gradient, &x, &functionId)
+      || !(dfunction = detail::selfDifferentiable (self)))
+    return 0;
+
+  return detail::gradientInto (dfunction, gradient, x, functionId);
+}
+
+static PyObject*
+functionJacobian (PyObject* self, PyObject* args)
+{
+  PyObject* jacobian = 0;
+  PyObject* x = 0;
+  DifferentiableFunction* dfunction = 0;
+  if (!PyArg_ParseTuple (args, "OO", &jacobian, &x)
+      || !(dfunction = detail::selfDifferentiable (self)))
+    return 0;
+
+  return detail::jacobianInto (dfunction, jacobian, x);
+}
+#endif //! ROBOPTIM_CORE_PYTHON_FASTCALL
+
+static PyObject*
+hessian (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* x = 0;
+  PyObject* hessian = 0;
+  Function::size_type functionId = 0;
+
+  if (!PyArg_ParseTuple
+      (args, "O&OOi",
+       detail::functionConverter, &function, &hessian, &x, &functionId))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+
+  TwiceDifferentiableFunction* tfunction =
+    detail::toTwiceDifferentiable (function);
+  if (!tfunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a twice differentiable function object");
+      return 0;
+    }
+
+  if (functionId < 0 || functionId >= tfunction->outputSize ())
+    {
+      PyErr_SetString (PyExc_IndexError, "invalid function id");
+      return 0;
+    }
+
+  detail::MatrixStrides strides;
+  PyObject* hessianNumpy =
+    detail::outputMatrix (tfunction, hessian, tfunction->hessianSize ().first,
+			  tfunction->hessianSize ().second, strides,
+			  "Hessian");
+  if (!hessianNumpy)
+    return 0;
+
+  PyObject* xNumpy = detail::inputArray (tfunction, x);
+  if (!xNumpy)
+    {
+      Py_DECREF (hessianNumpy);
+      return 0;
+    }
+
+  // Directly map Eigen vector over NumPy x.
+  Eigen::Map<Function::argument_t> xEigen
+    (static_cast<double*> (PyArray_DATA (xNumpy)), function->inputSize ());
+
+  ::roboptim::python::ErrorScope errors (true);
+
+  try
+    {
+      ::roboptim::python::GILRelease nogil;
+      detail::evaluateMatrix
+	(tfunction, hessianNumpy, tfunction->hessianSize ().first,
+	 tfunction->hessianSize ().second, strides,
+	 detail::HessianEvaluation (tfunction, xEigen, functionId));
+    }
+  catch (const std::exception& e)
+    {
+      Py_DECREF (xNumpy);
+      Py_DECREF (hessianNumpy);
+      if (!errors.restore ())
+	PyErr_SetString (PyExc_RuntimeError, e.what ());
+      return 0;
+    }
+
+  // Clean up.
+  Py_DECREF (xNumpy);
+
+  if (errors.restore () || PyErr_Occurred ())
+    {
+      Py_DECREF (hessianNumpy);
+      return 0;
+    }
+
+  return detail::evaluationResult (hessian, hessianNumpy);
+}
+
+static PyObject*
+computeBatch (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* X = 0;
+  PyObject* values = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&OO:computeBatch",
+       detail::functionConverter, &function, &values, &X))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+
+  PyObject* xNumpy = detail::toBatchInput (X, function->inputSize ());
+  if (!xNumpy)
+    return 0;
+
+  npy_intp n = PyArray_DIM (xNumpy, 0);
+  if (!detail::checkBatchOutput (values, n, function->outputSize ()))
+    {
+      Py_DECREF (xNumpy);
+      return 0;
+    }
+
+  // Directly map Eigen matrices over the NumPy data.
+  Function::const_batch_ref xEigen
+    (static_cast<double*> (PyArray_DATA (xNumpy)), n, function->inputSize ());
+  Function::batch_ref valuesEigen
+    (static_cast<double*> (PyArray_DATA (values)), n, function->outputSize ());
+
+  ::roboptim::python::ErrorScope errors (true);
+
+  try
+    {
+      ::roboptim::python::GILRelease nogil;
+      function->computeBatch (valuesEigen, xEigen);
+    }
+  catch (const std::exception& e)
+    {
+      Py_DECREF (xNumpy);
+      if (!errors.restore ())
+	PyErr_SetString (PyExc_RuntimeError, e.what ());
+      return 0;
+    }
+
+  Py_DECREF (xNumpy);
+
+  if (errors.restore () || PyErr_Occurred ())
+    return 0;
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject*
+gradientBatch (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* X = 0;
+  PyObject* gradients = 0;
+  Function::size_type functionId = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&OOi:gradientBatch",
+       detail::functionConverter, &function, &gradients, &X, &functionId))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+
+  DifferentiableFunction* dfunction =
+    detail::toDifferentiable (function);
+  if (!dfunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a differentiable function object");
+      return 0;
+    }
+
+  PyObject* xNumpy = detail::toBatchInput (X, function->inputSize ());
+  if (!xNumpy)
+    return 0;
+
+  npy_intp n = PyArray_DIM (xNumpy, 0);
+  if (!detail::checkBatchOutput (gradients, n, function->inputSize ()))
+    {
+      Py_DECREF (xNumpy);
+      return 0;
+    }
+
+  // Directly map Eigen matrices over the NumPy data.
+  Function::const_batch_ref xEigen
+    (static_cast<double*> (PyArray_DATA (xNumpy)), n, function->inputSize ());
+  Function::batch_ref gradientsEigen
+    (static_cast<double*> (PyArray_DATA (gradients)), n, function->inputSize ());
+
+  ::roboptim::python::ErrorScope errors (true);
+
+  try
+    {
+      ::roboptim::python::GILRelease nogil;
+      dfunction->gradientBatch (gradientsEigen, xEigen, functionId);
+    }
+  catch (const std::exception& e)
+    {
+      Py_DECREF (xNumpy);
+      if (!errors.restore ())
+	PyErr_SetString (PyExc_RuntimeError, e.what ());
+      return 0;
+    }
+
+  Py_DECREF (xNumpy);
+
+  if (errors.restore () || PyErr_Occurred ())
+    return 0;
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject*
+jacobianBatch (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* X = 0;
+  PyObject* jacobians = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&OO:jacobianBatch",
+       detail::functionConverter, &function, &jacobians, &X))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+
+  DifferentiableFunction* dfunction =
+    detail::toDifferentiable (function);
+  if (!dfunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "argument 1 should be a differentiable function object");
+      return 0;
+    }
+
+  PyObject* xNumpy = detail::toBatchInput (X, function->inputSize ());
+  if (!xNumpy)
+    return 0;
+
+  // Each Jacobian is stored as a row-major (outputSize x inputSize) block.
+  npy_intp n = PyArray_DIM (xNumpy, 0);
+  npy_intp jacobianSize = function->outputSize () * function->inputSize ();
+  if (!detail::checkBatchOutput (jacobians, n, jacobianSize))
+    {
+      Py_DECREF (xNumpy);
+      return 0;
+    }
+
+  // Directly map Eigen matrices over the NumPy data.
+  Function::const_batch_ref xEigen
+    (static_cast<double*> (PyArray_DATA (xNumpy)), n, function->inputSize ());
+  Function::batch_ref jacobiansEigen
+    (static_cast<double*> (PyArray_DATA (jacobians)), n, jacobianSize);
+
+  ::roboptim::python::ErrorScope errors (true);
+
+  try
+    {
+      ::roboptim::python::GILRelease nogil;
+      dfunction->jacobianBatch (jacobiansEigen, xEigen);
+    }
+  catch (const std::exception& e)
+    {
+      Py_DECREF (xNumpy);
+      if (!errors.restore ())
+	PyErr_SetString (PyExc_RuntimeError, e.what ());
+      return 0;
+    }
+
+  Py_DECREF (xNumpy);
+
+  if (errors.restore () || PyErr_Occurred ())
+    return 0;
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+
+namespace detail
+{
+  /// \brief Address stored in a Python integer, or in the buffer of a
+  /// ctypes function pointer.
+  /// \return false (and an exception set) on failure.
+  bool pointerFromPython (PyObject* obj, void** address)
+  {
+    if (PyLong_Check (obj) || PyInt_Check (obj))
+      {
+	*address = PyLong_AsVoidPtr (obj);
+	return !PyErr_Occurred ();
+      }
+
+    Py_buffer view;
+    if (PyObject_GetBuffer (obj, &view, PyBUF_SIMPLE) < 0)
+      return false;
+    bool ok = view.len == static_cast<Py_ssize_t> (sizeof (void*));
+    if (ok)
+      std::memcpy (address, view.buf, sizeof (void*));
+    PyBuffer_Release (&view);
+    if (!ok)
+      PyErr_SetString (PyExc_TypeError, "invalid function pointer");
+    return ok;
+  }
+
+  /// \brief Recognize a native callback: an integer address, a numba
+  /// cfunc (address attribute) or a ctypes function pointer. cffi
+  /// functions can be given as int (ffi.cast ("uintptr_t", f)).
+  ///
+  /// The user data may be None, an integer address or an object
+  /// supporting the buffer protocol (e.g. a NumPy array of parameters),
+  /// which is kept alive while the callback is bound.
+  ///
+  /// \return 1 if the callback is native, 0 if it is a Python callable,
+  /// -1 on error.
+  int nativeCallback (PyObject* callback, PyObject* userdata,
+		      ::roboptim::core::python::NativeCallback& native)
+  {
+    PyObject* address = 0;
+    void* function = 0;
+    if (PyLong_Check (callback) || PyInt_Check (callback))
+      {
+	if (PyBool_Check (callback))
+	  return 0;
+	if (!pointerFromPython (callback, &function))
+	  return -1;
+      }
+    else if (PyObject_HasAttrString (callback, "address")
+	     && PyObject_HasAttrString (callback, "ctypes"))
+      {
+	// numba.cfunc
+	address = PyObject_GetAttrString (callback, "address");
+	bool ok = address && pointerFromPython (address, &function);
+	Py_XDECREF (address);
+	if (!ok)
+	  return -1;
+      }
+    else if (PyObject_HasAttrString (callback, "_restype_")
+	     && PyObject_HasAttrString (callback, "_argtypes_"))
+      {
+	// ctypes function pointer
+	if (!pointerFromPython (callback, &function))
+	  return -1;
+      }
+    else
+      {
+	if (userdata && userdata != Py_None)
+	  {
+	    PyErr_SetString (PyExc_TypeError,
+			     "user data is only given to native callbacks");
+	    return -1;
+	  }
+	return 0;
+      }
+
+    if (!function)
+      {
+	PyErr_SetString (PyExc_ValueError, "null function pointer");
+	return -1;
+      }
+
+    void* data = 0;
+    PyObject* dataOwner = 0;
+    if (userdata && userdata != Py_None)
+      {
+	if (PyLong_Check (userdata) || PyInt_Check (userdata))
+	  {
+	    data = PyLong_AsVoidPtr (userdata);
+	    if (PyErr_Occurred ())
+	      return -1;
+	  }
+	else
+	  {
+	    // The buffer stays valid while its owner is kept alive.
+	    Py_buffer view;
+	    if (PyObject_GetBuffer (userdata, &view, PyBUF_SIMPLE) < 0)
+	      return -1;
+	    data = view.buf;
+	    PyBuffer_Release (&view);
+	    dataOwner = userdata;
+	  }
+      }
+
+    native.function =
+      reinterpret_cast< ::roboptim::core::python::nativeCallback_t>
+      (reinterpret_cast<size_t> (function));
+    native.userdata = data;
+    native.owner = callback;
+    native.userdataOwner = dataOwner;
+    return 1;
+  }
+} // end of namespace detail.
+
+static PyObject*
+bindCompute (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* callback = 0;
+  PyObject* userdata = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&O|O:bindCompute",
+       detail::functionConverter, &function, &callback, &userdata))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+  if (!callback)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve callback object");
+      return 0;
+    }
+
+  ::roboptim::core::python::NativeCallback native;
+  int isNative = detail::nativeCallback (callback, userdata, native);
+  if (isNative < 0)
+    return 0;
+  if (isNative)
+    {
+      function->setNativeComputeCallback (native);
+      Py_INCREF (Py_None);
+      return Py_None;
+    }
+
+  if (!PyCallable_Check (callback))
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "2nd argument must be callable");
+      return 0;
+    }
+
+  function->setComputeCallback (callback);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject*
+bindGradient (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* callback = 0;
+  PyObject* userdata = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&O|O:bindGradient",
+       detail::functionConverter, &function, &callback, &userdata))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
     }
 
-    PyObject* operator () (const char* p) const
-    {
-      return PyString_FromString (p);
-    }
+  DifferentiableFunction* dfunction
+    = detail::toDifferentiable (function);
+
+  if (!dfunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "instance of DifferentiableFunction expected as first argument");
+      return 0;
+    }
+  if (!callback)
+    {
+      PyErr_SetString (PyExc_TypeError, "Failed to retrieve callback object");
+      return 0;
+    }
+
+  ::roboptim::core::python::NativeCallback native;
+  int isNative = detail::nativeCallback (callback, userdata, native);
+  if (isNative < 0)
+    return 0;
+  if (isNative)
+    {
+      dfunction->setNativeGradientCallback (native);
+      Py_INCREF (Py_None);
+      return Py_None;
+    }
+
+  if (!PyCallable_Check (callback))
+    {
+      PyErr_SetString (PyExc_TypeError, "2nd argument must be callable");
+      return 0;
+    }
+
+  dfunction->setGradientCallback (callback);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject*
+bindJacobian (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* callback = 0;
+  PyObject* userdata = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&O|O:bindJacobian",
+       detail::functionConverter, &function, &callback, &userdata))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+
+  DifferentiableFunction* dfunction
+    = detail::toDifferentiable (function);
+  SparseDifferentiableFunction* sfunction
+    = detail::toSparse (function);
+
+  if (!dfunction && !sfunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "instance of DifferentiableFunction expected as first argument");
+      return 0;
+    }
+  if (!callback)
+    {
+      PyErr_SetString (PyExc_TypeError, "Failed to retrieve callback object");
+      return 0;
+    }
+
+  ::roboptim::core::python::NativeCallback native;
+  int isNative = detail::nativeCallback (callback, userdata, native);
+  if (isNative < 0)
+    return 0;
+  if (isNative)
+    {
+      if (sfunction)
+	{
+	  PyErr_SetString
+	    (PyExc_TypeError,
+	     "native callbacks are not supported by sparse Jacobians");
+	  return 0;
+	}
+      dfunction->setNativeJacobianCallback (native);
+      Py_INCREF (Py_None);
+      return Py_None;
+    }
+
+  if (!PyCallable_Check (callback))
+    {
+      PyErr_SetString (PyExc_TypeError, "2nd argument must be callable");
+      return 0;
+    }
+
+  // Sparse Jacobian callbacks receive the (data, indices, indptr, x) buffers.
+  if (sfunction)
+    sfunction->setJacobianCallback (callback);
+  else
+    dfunction->setJacobianCallback (callback);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject*
+bindHessian (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* callback = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&O:bindHessian",
+       detail::functionConverter, &function, &callback))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+
+  TwiceDifferentiableFunction* tfunction
+    = detail::toTwiceDifferentiable (function);
+
+  if (!tfunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "instance of TwiceDifferentiableFunction expected as first argument");
+      return 0;
+    }
+  if (!callback)
+    {
+      PyErr_SetString (PyExc_TypeError, "Failed to retrieve callback object");
+      return 0;
+    }
+  if (!PyCallable_Check (callback))
+    {
+      PyErr_SetString (PyExc_TypeError, "2nd argument must be callable");
+      return 0;
+    }
+
+  tfunction->setHessianCallback (callback);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+/// \brief Bind a batch callback of a differentiable function.
+/// \tparam setter callback setter.
+template <void (DifferentiableFunction::*setter) (PyObject*)>
+static PyObject*
+bindDifferentiableBatch (PyObject* args, const char* format)
+{
+  Function* function = 0;
+  PyObject* callback = 0;
+  if (!PyArg_ParseTuple
+      (args, format,
+       detail::functionConverter, &function, &callback))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+
+  DifferentiableFunction* dfunction
+    = detail::toDifferentiable (function);
+
+  if (!dfunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "instance of DifferentiableFunction expected as first argument");
+      return 0;
+    }
+  if (!callback)
+    {
+      PyErr_SetString (PyExc_TypeError, "Failed to retrieve callback object");
+      return 0;
+    }
+  if (!PyCallable_Check (callback))
+    {
+      PyErr_SetString (PyExc_TypeError, "2nd argument must be callable");
+      return 0;
+    }
+
+  (dfunction->*setter) (callback);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject*
+bindComputeBatch (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* callback = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&O:bindComputeBatch",
+       detail::functionConverter, &function, &callback))
+    return 0;
+  if (!function)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve function object");
+      return 0;
+    }
+  if (!callback)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "Failed to retrieve callback object");
+      return 0;
+    }
+  if (!PyCallable_Check (callback))
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "2nd argument must be callable");
+      return 0;
+    }
+
+  function->setComputeBatchCallback (callback);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject*
+bindValueJacobian (PyObject*, PyObject* args)
+{
+  return bindDifferentiableBatch<&DifferentiableFunction::setValueJacobianCallback>
+    (args, "O&O:bindValueJacobian");
+}
+
+static PyObject*
+bindGradientBatch (PyObject*, PyObject* args)
+{
+  return bindDifferentiableBatch<&DifferentiableFunction::setGradientBatchCallback>
+    (args, "O&O:bindGradientBatch");
+}
+
+static PyObject*
+bindJacobianBatch (PyObject*, PyObject* args)
+{
+  return bindDifferentiableBatch<&DifferentiableFunction::setJacobianBatchCallback>
+    (args, "O&O:bindJacobianBatch");
+}
+
+static PyObject*
+setSparsityPattern (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* rows = 0;
+  PyObject* cols = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&OO:setSparsityPattern",
+       detail::functionConverter, &function, &rows, &cols))
+    return 0;
+
+  PyObject* functionPy = PyTuple_GetItem (args, 0);
+  SparseDifferentiableFunction* sfunction
+    = detail::toSparse (function);
+  FiniteDifferenceGradient<simplePolicy_t>* simpleFunction
+    = detail::taggedFunction<FiniteDifferenceGradient<simplePolicy_t> >
+    (functionPy);
+  FiniteDifferenceGradient<fivePointsPolicy_t>* fivePointsFunction
+    = detail::taggedFunction<FiniteDifferenceGradient<fivePointsPolicy_t> >
+    (functionPy);
+  if (!sfunction && !simpleFunction && !fivePointsFunction)
+    {
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "instance of SparseDifferentiableFunction or FiniteDifferenceGradient"
+	 " expected as first argument");
+      return 0;
+    }
+
+  // Structural non-zeros are given as (row, column) coordinates.
+  PyObject* rowsNumpy = PyArray_FROM_OTF (rows, NPY_LONG, NPY_IN_ARRAY);
+  PyObject* colsNumpy = PyArray_FROM_OTF (cols, NPY_LONG, NPY_IN_ARRAY);
+  if (!rowsNumpy || !colsNumpy)
+    {
+      Py_XDECREF (rowsNumpy);
+      Py_XDECREF (colsNumpy);
+      PyErr_SetString
+	(PyExc_TypeError,
+	 "coordinates cannot be converted to NumPy integer arrays");
+      return 0;
+    }
+
+  npy_intp nnz = PyArray_SIZE (rowsNumpy);
+  if (PyArray_SIZE (colsNumpy) != nnz)
+    {
+      Py_DECREF (rowsNumpy);
+      Py_DECREF (colsNumpy);
+      PyErr_SetString (PyExc_ValueError, "coordinates must have the same size");
+      return 0;
+    }
+
+  typedef SparseDifferentiableFunction::jacobian_t jacobian_t;
+  typedef Eigen::Triplet<Function::value_type> triplet_t;
+
+  const long* r = static_cast<const long*> (PyArray_DATA (rowsNumpy));
+  const long* c = static_cast<const long*> (PyArray_DATA (colsNumpy));
+
+  std::vector<triplet_t> triplets;
+  triplets.reserve (static_cast<size_t> (nnz));
+  for (npy_intp k = 0; k < nnz; ++k)
+    {
+      if (r[k] < 0 || r[k] >= function->outputSize ()
+	  || c[k] < 0 || c[k] >= function->inputSize ())
+	{
+	  Py_DECREF (rowsNumpy);
+	  Py_DECREF (colsNumpy);
+	  PyErr_SetString (PyExc_ValueError, "coordinates out of range");
+	  return 0;
+	}
+      triplets.push_back (triplet_t (static_cast<int> (r[k]),
+				     static_cast<int> (c[k]), 1.));
+    }
+
+  Py_DECREF (rowsNumpy);
+  Py_DECREF (colsNumpy);
+
+  jacobian_t pattern (function->outputSize (), function->inputSize ());
+  pattern.setFromTriplets (triplets.begin (), triplets.end ());
+
+  // Finite differences only use the structure, to color the columns.
+  if (sfunction)
+    sfunction->setSparsityPattern (pattern);
+  else if (simpleFunction)
+    simpleFunction->setSparsityPattern (pattern);
+  else
+    fivePointsFunction->setSparsityPattern (pattern);
+
+  Py_INCREF (Py_None);
+  return Py_None;
+}
+
+namespace detail
+{
+  /// \brief Convert call statistics to a Python dictionary (times in
+  /// seconds).
+  /// \return new reference.
+  PyObject* toPython (const ::roboptim::core::python::CallStats& stats)
+  {
+    double total = static_cast<double> (stats.totalTime.load ()) * 1e-9;
+    double python = static_cast<double> (stats.pythonTime.load ()) * 1e-9;
+    return Py_BuildValue ("{s:K,s:d,s:d,s:d,s:d}",
+			  "calls",
+			  static_cast<unsigned long long> (stats.calls.load ()),
+			  "total", total,
+			  "max",
+			  static_cast<double> (stats.maxTime.load ()) * 1e-9,
+			  "python", python,
+			  "bridge", total - python);
+  }
+} // end of namespace detail.
+
+static PyObject*
+getStats (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:getStats", detail::functionConverter, &function))
+    return 0;
+
+  const ::roboptim::core::python::FunctionStats& stats = function->stats ();
+  return Py_BuildValue ("{s:O,s:N,s:N,s:N,s:K,s:K}",
+			"enabled", stats.enabled ? Py_True : Py_False,
+			"compute", detail::toPython (stats.compute),
+			"gradient", detail::toPython (stats.gradient),
+			"jacobian", detail::toPython (stats.jacobian),
+			"copies",
+			static_cast<unsigned long long> (stats.copies.load ()),
+			"failures",
+			static_cast<unsigned long long> (stats.failures.load ()));
+}
 
-    PyObject* operator () (bool b) const
-    {
-      return PyBool_FromLong (b);
-    }
+static PyObject*
+resetStats (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:resetStats", detail::functionConverter, &function))
+    return 0;
 
-    PyObject* operator () (roboptim::Function::const_vector_ref v) const
-    {
-      npy_intp n = static_cast<npy_intp> (v.size ());
+  function->resetStats ();
 
-      return PyArray_SimpleNewFromData
-        (1, &n, NPY_DOUBLE, const_cast<double*> (v.data ()));
-    }
-  };
+  Py_INCREF (Py_None);
+  return Py_None;
+}
 
-  stateParameter_t::stateParameterValues_t toStateParameterValue (PyObject* obj)
+namespace detail
+{
+  /// \brief Convert a function object to a cached function, using its
+  /// tag.
+  int
+  cachedFunctionConverter (PyObject* obj, CachedFunction** address)
   {
-    // Value can be: double, int, std::string, bool or NumPy vector.
-    // Bool
-    if (PyBool_Check (obj))
-      {
-        return bool (PyObject_RichCompareBool (obj, Py_True, Py_EQ) == 1);
-      }
-    // NumPy vector
-    else if (PyArray_Check (obj) && PyArray_ISFLOAT (obj)
-             && PyArray_ITEMSIZE (obj) == sizeof (double))
-      {
-	// Directly map Eigen vector to the numpy array data.
-	Eigen::Map<Function::vector_t> vecEigen
-	  (static_cast<double*> (PyArray_DATA (obj)), PyArray_SIZE (obj));
-	return vecEigen;
-      }
-    // String, unicode string, integer, double
-    else if (PyString_Check (obj) || PyUnicode_Check (obj) ||
-	     PyInt_Check (obj) || PyFloat_Check (obj))
+    *address = taggedFunction<CachedFunction> (obj);
+    if (!*address)
       {
-	return toParameterValue (obj);
+	PyErr_SetString (PyExc_TypeError, "cached function expected");
+	return 0;
       }
-
-    PyErr_SetString
-      (PyExc_TypeError,
-       "invalid parameter value (should be double, int, string, "
-       "bool or NumPy float vector).");
-
-    return 0;
+    return 1;
   }
 } // end of namespace detail.
 
-template <typename T>
 static PyObject*
-createFunction (PyObject*, PyObject* args)
+getCacheStats (PyObject*, PyObject* args)
 {
-  Function::size_type inSize = 0;
-  Function::size_type outSize = 0;
-  const char* name = 0;
+  CachedFunction* function = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:getCacheStats", detail::cachedFunctionConverter, &function))
+    return 0;
 
-  if (!PyArg_ParseTuple(args, "iis", &inSize, &outSize, &name))
+  const ::roboptim::core::python::CacheStats stats = function->cacheStats ();
+  return Py_BuildValue ("{s:K,s:K,s:K,s:n}",
+			"hits", static_cast<unsigned long long> (stats.hits),
+			"misses", static_cast<unsigned long long> (stats.misses),
+			"evictions",
+			static_cast<unsigned long long> (stats.evictions),
+			"size",
+			static_cast<Py_ssize_t> (function->cachedPoints ()));
+}
+
+static PyObject*
+resetCacheStats (PyObject*, PyObject* args)
+{
+  CachedFunction* function = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:resetCacheStats", detail::cachedFunctionConverter, &function))
     return 0;
 
-  std::string name_ = (name) ? name : "";
-  T* function = new T (inSize, outSize, name_);
+  function->resetCacheStats ();
 
-  PyObject* functionPy =
-    PyCapsule_New (function, ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME,
-		   &detail::destructor<T>);
-  return functionPy;
+  Py_INCREF (Py_None);
+  return Py_None;
 }
 
+static PyObject*
+clearCache (PyObject*, PyObject* args)
+{
+  CachedFunction* function = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:clearCache", detail::cachedFunctionConverter, &function))
+    return 0;
 
-template <>
-PyObject*
-createFunction<FunctionPool> (PyObject*, PyObject* args)
+  function->clearCache ();
+
+  Py_INCREF (Py_None);
+  return Py_None;
+}
+
+namespace detail
 {
-  const char* name = 0;
-  FunctionPool::callback_t* callback = 0;
-  FunctionPool::functionList_t* functions = new FunctionPool::functionList_t ();
+  /// \brief Convert a matrix given to a native function.
+  ///
+  /// NumPy arrays of doubles in RobOptim's storage order are used
+  /// directly, so the only copy is the one stored by the native function.
+  /// \return new reference on a 2-dimensional NumPy array, or 0 on error.
+  PyObject*
+  matrixArray (PyObject* obj, const char* error)
+  {
+    PyObject* array = PyArray_FROM_OTF (obj, NPY_DOUBLE, inputRequirements);
+    if (!array)
+      {
+	PyErr_Format (PyExc_TypeError,
+		      "%s cannot be converted to NumPy object", error);
+	return 0;
+      }
 
-  if (!PyArg_ParseTuple(args, "O&O&s",
-                        &detail::functionConverter, &callback,
-                        &detail::functionListConverter, &functions,
-                        &name))
-    return 0;
+    if (PyArray_NDIM (array) != 2)
+      {
+	PyErr_Format (PyExc_ValueError, "%s must be a matrix", error);
+	Py_DECREF (array);
+	return 0;
+      }
+    return array;
+  }
 
-  std::string name_ = (name) ? name : "";
-  FunctionPool::callback_ptr p_callback
-    = detail::to_shared_ptr<FunctionPool::callback_t>
-    (callback, PyTuple_GetItem (args, 0));
-  FunctionPool* pool = new FunctionPool (p_callback, *functions, name_);
-  delete functions;
+  /// \brief Map a matrix converted by matrixArray.
+  Eigen::Map<const Function::matrix_t>
+  matrixMap (PyObject* array)
+  {
+    return Eigen::Map<const Function::matrix_t>
+      (static_cast<const double*> (PyArray_DATA (array)),
+       PyArray_DIM (array, 0), PyArray_DIM (array, 1));
+  }
 
-  PyObject* poolPy =
-    PyCapsule_New (pool, ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME,
-		   &detail::destructor<FunctionPool>);
+  /// \brief Convert a vector given to a native function (None: zero).
+  bool
+  vectorFromPython (PyObject* obj, npy_intp size, Function::vector_t& v,
+		    const char* error)
+  {
+    v.setZero (size);
+    if (obj == Py_None)
+      return true;
 
-  return poolPy;
-}
+    PyObject* array = PyArray_FROM_OTF (obj, NPY_DOUBLE, NPY_IN_ARRAY);
+    if (!array)
+      {
+	PyErr_Format (PyExc_TypeError,
+		      "%s cannot be converted to NumPy object", error);
+	return false;
+      }
+
+    if (PyArray_SIZE (array) != size)
+      {
+	PyErr_Format
+	  (PyExc_ValueError, "%s: %ld elements expected, %ld given", error,
+	   static_cast<long> (size), static_cast<long> (PyArray_SIZE (array)));
+	Py_DECREF (array);
+	return false;
+      }
+
+    v = Eigen::Map<const Function::vector_t>
+      (static_cast<const double*> (PyArray_DATA (array)), size);
+    Py_DECREF (array);
+    return true;
+  }
+
+  /// \brief Function object of a native function.
+  PyObject*
+  nativeFunctionObject (const boost::shared_ptr<NativeFunction::function_t>& f,
+			bool threadSafe = true)
+  {
+    return functionObject (new NativeFunction (f, threadSafe));
+  }
+} // end of namespace detail.
 
-template <typename T>
 static PyObject*
-createFDWrapper (PyObject*, PyObject* args)
+createLinearFunction (PyObject*, PyObject* args)
 {
-  Function* function = 0;
-  double eps = ::roboptim::finiteDifferenceEpsilon;
-  if (!PyArg_ParseTuple(args, "O&|d", &detail::functionConverter, &function, &eps))
+  PyObject* A = 0;
+  PyObject* b = Py_None;
+  if (!PyArg_ParseTuple (args, "O|O:LinearFunction", &A, &b))
     return 0;
-  if (!function)
+
+  PyObject* ANumpy = detail::matrixArray (A, "A");
+  if (!ANumpy)
+    return 0;
+
+  Function::vector_t bEigen;
+  if (!detail::vectorFromPython (b, PyArray_DIM (ANumpy, 0), bEigen, "b"))
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "argument 1 should be a function object");
+      Py_DECREF (ANumpy);
       return 0;
     }
 
-  T* fdFunction = new T (*function, eps);
+  boost::shared_ptr<NativeFunction::function_t> f;
+  try
+    {
+      f.reset (new ::roboptim::NumericLinearFunction
+	       (detail::matrixMap (ANumpy), bEigen));
+    }
+  catch (const std::exception& e)
+    {
+      Py_DECREF (ANumpy);
+      PyErr_SetString (PyExc_ValueError, e.what ());
+      return 0;
+    }
 
-  PyObject* fdFunctionPy =
-    PyCapsule_New (fdFunction, ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME,
-		   &detail::destructor<T>);
-  return fdFunctionPy;
+  Py_DECREF (ANumpy);
+  return detail::nativeFunctionObject (f);
 }
 
 static PyObject*
-createCachedFunction (PyObject*, PyObject* args)
+createQuadraticFunction (PyObject*, PyObject* args)
 {
-  typedef CachedFunction cachedDifferentiableFunction_t;
-
-  Function* function = 0;
-  size_t cache_size = 10;
+  PyObject* A = 0;
+  PyObject* b = Py_None;
+  PyObject* c = Py_None;
+  if (!PyArg_ParseTuple (args, "O|OO:QuadraticFunction", &A, &b, &c))
+    return 0;
 
-  if (!PyArg_ParseTuple(args, "O&|i", &detail::functionConverter, &function, &cache_size))
+  PyObject* ANumpy = detail::matrixArray (A, "A");
+  if (!ANumpy)
     return 0;
 
-  if (!function)
+  const npy_intp n = PyArray_DIM (ANumpy, 0);
+  if (PyArray_DIM (ANumpy, 1) != n)
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Failed to retrieve function object");
+      PyErr_SetString (PyExc_ValueError, "A must be a square matrix");
+      Py_DECREF (ANumpy);
       return 0;
     }
 
-  PyObject* cachedFunctionPy = 0;
-
-  DifferentiableFunction* dfunction =
-    dynamic_cast<DifferentiableFunction*> (function);
-  if (!dfunction)
+  Function::vector_t bEigen;
+  Function::vector_t cEigen;
+  if (!detail::vectorFromPython (b, n, bEigen, "b")
+      || !detail::vectorFromPython (c, 1, cEigen, "c"))
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Failed to retrieve differentiable function object");
+      Py_DECREF (ANumpy);
       return 0;
     }
 
-  boost::shared_ptr<DifferentiableFunction> dfunction_ptr
-    = detail::to_shared_ptr<DifferentiableFunction> (dfunction, PyTuple_GetItem (args, 0));
-  assert (dfunction_ptr);
-
-  cachedDifferentiableFunction_t* cachedFunction
-    = new cachedDifferentiableFunction_t (dfunction_ptr, cache_size);
-
-  cachedFunctionPy = PyCapsule_New (cachedFunction, ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME,
-				    &detail::destructor<cachedDifferentiableFunction_t>);
+  boost::shared_ptr<NativeFunction::function_t> f;
+  try
+    {
+      f.reset (new ::roboptim::NumericQuadraticFunction
+	       (detail::matrixMap (ANumpy), bEigen, cEigen));
+    }
+  catch (const std::exception& e)
+    {
+      Py_DECREF (ANumpy);
+      PyErr_SetString (PyExc_ValueError, e.what ());
+      return 0;
+    }
 
-  return cachedFunctionPy;
+  Py_DECREF (ANumpy);
+  return detail::nativeFunctionObject (f);
 }
 
 static PyObject*
-inputSize (PyObject*, PyObject* args)
+createConstantFunction (PyObject*, PyObject* args)
 {
-  Function* function = 0;
-  if (!PyArg_ParseTuple(args, "O&", &detail::functionConverter, &function))
+  int inputSize = 0;
+  PyObject* offset = 0;
+  if (!PyArg_ParseTuple (args, "iO:ConstantFunction", &inputSize, &offset))
     return 0;
-  if (!function)
+
+  if (inputSize < 0)
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "argument 1 should be a function object");
+      PyErr_SetString (PyExc_ValueError, "input size must be non-negative");
       return 0;
     }
-  return Py_BuildValue("i", function->inputSize ());
-}
 
-static PyObject*
-outputSize (PyObject*, PyObject* args)
-{
-  Function* function = 0;
-  if (!PyArg_ParseTuple(args, "O&", &detail::functionConverter, &function))
-    return 0;
-  if (!function)
+  PyObject* offsetNumpy = PyArray_FROM_OTF (offset, NPY_DOUBLE, NPY_IN_ARRAY);
+  if (!offsetNumpy)
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "argument 1 should be a function object");
+      PyErr_SetString (PyExc_TypeError,
+		       "offset cannot be converted to NumPy object");
       return 0;
     }
-  return Py_BuildValue("i", function->outputSize ());
+
+  Function::vector_t offsetEigen = Eigen::Map<const Function::vector_t>
+    (static_cast<const double*> (PyArray_DATA (offsetNumpy)),
+     PyArray_SIZE (offsetNumpy));
+  Py_DECREF (offsetNumpy);
+
+  boost::shared_ptr<NativeFunction::function_t> f
+    (new ::roboptim::ConstantFunction (inputSize, offsetEigen));
+  return detail::nativeFunctionObject (f);
 }
 
 static PyObject*
-getName (PyObject*, PyObject* args)
+createIdentityFunction (PyObject*, PyObject* args)
 {
-  Function* function = 0;
-
-  if (!PyArg_ParseTuple(args, "O&", &detail::functionConverter, &function))
+  PyObject* offset = 0;
+  if (!PyArg_ParseTuple (args, "O:IdentityFunction", &offset))
     return 0;
 
-  if (!function)
+  PyObject* offsetNumpy = PyArray_FROM_OTF (offset, NPY_DOUBLE, NPY_IN_ARRAY);
+  if (!offsetNumpy)
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "argument 1 should be a function object");
+      PyErr_SetString (PyExc_TypeError,
+		       "offset cannot be converted to NumPy object");
       return 0;
     }
 
-  return Py_BuildValue("s", function->getName ().c_str ());
+  Function::vector_t offsetEigen = Eigen::Map<const Function::vector_t>
+    (static_cast<const double*> (PyArray_DATA (offsetNumpy)),
+     PyArray_SIZE (offsetNumpy));
+  Py_DECREF (offsetNumpy);
+
+  boost::shared_ptr<NativeFunction::function_t> f
+    (new ::roboptim::IdentityFunction (offsetEigen));
+  return detail::nativeFunctionObject (f);
 }
 
-static PyObject*
-getStorageOrder (PyObject*, PyObject*)
+namespace detail
 {
-  char storage_order = (::roboptim::core::python::NPY_STORAGE_ORDER == NPY_F_CONTIGUOUS)? 'F':'C';
-  return Py_BuildValue("c", storage_order);
-}
+  /// \brief Operand of a native expression.
+  struct ExpressionOperand
+  {
+    ExpressionOperand ()
+      : function (), threadSafe (false)
+    {}
+
+    boost::shared_ptr<NativeFunction::function_t> function;
+    bool threadSafe;
+  };
+
+  /// \brief Convert a function object to an operand of a native
+  /// expression: the RobOptim function of a native function, or the
+  /// differentiable function itself (kept alive by the expression).
+  int
+  expressionOperandConverter (PyObject* obj, ExpressionOperand* operand)
+  {
+    Function* function = 0;
+    if (!functionConverter (obj, &function))
+      return 0;
+
+    if (NativeFunction* native = taggedFunction<NativeFunction> (obj))
+      operand->function = native->native ();
+    else if (DifferentiableFunction* dfunction = toDifferentiable (function))
+      operand->function = to_shared_ptr<DifferentiableFunction>
+	(dfunction, obj);
+    else
+      {
+	PyErr_SetString (PyExc_TypeError,
+			 "operators require dense differentiable functions");
+	return 0;
+      }
+
+    operand->threadSafe = function->threadSafe ();
+    return 1;
+  }
+
+  /// \brief Function object of a native expression.
+  template <typename T>
+  PyObject*
+  expressionObject (const boost::shared_ptr<T>& f, bool threadSafe)
+  {
+    return nativeFunctionObject
+      (boost::static_pointer_cast<NativeFunction::function_t> (f),
+       threadSafe);
+  }
+} // end of namespace detail.
+
+typedef NativeFunction::function_t expressionFunction_t;
 
 static PyObject*
-createProblem (PyObject*, PyObject* args)
+createChain (PyObject*, PyObject* args)
 {
-  Function* cost = 0;
-  if (!PyArg_ParseTuple(args, "O&", &detail::functionConverter, &cost))
+  detail::ExpressionOperand left;
+  detail::ExpressionOperand right;
+  if (!PyArg_ParseTuple (args, "O&O&:Chain",
+			 &detail::expressionOperandConverter, &left,
+			 &detail::expressionOperandConverter, &right))
     return 0;
 
-  DifferentiableFunction* dCost = dynamic_cast<DifferentiableFunction*> (cost);
-
-  if (!dCost)
+  if (left.function->inputSize () != right.function->outputSize ())
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "argument 1 should be a differentiable function object");
+      PyErr_SetString (PyExc_ValueError,
+		       "the input size of f must match the output size of g");
       return 0;
     }
 
-  // If we just used a boost::shared_ptr, the cost function would be freed when the
-  // problem disappears, so we use a custom deleter that keeps track of the
-  // Python object's reference counter to prevent that.
-  boost::shared_ptr<DifferentiableFunction> costPtr
-    = detail::to_shared_ptr<DifferentiableFunction>
-      (dCost, PyTuple_GetItem (args, 0));
-  assert (!!costPtr);
-
-  problem_t* problem = new problem_t
-    (boost::static_pointer_cast< ::roboptim::DifferentiableFunction> (costPtr));
-
-  PyObject* problemPy =
-    PyCapsule_New (problem, ROBOPTIM_CORE_PROBLEM_CAPSULE_NAME,
-		   &detail::destructor<problem_t>);
-
-  return problemPy;
+  return detail::expressionObject
+    (boost::make_shared< ::roboptim::Chain<expressionFunction_t,
+					    expressionFunction_t> >
+     (left.function, right.function),
+     left.threadSafe && right.threadSafe);
 }
 
+template <template <typename, typename> class Op>
 static PyObject*
-createSolver (PyObject*, PyObject* args)
+createSum (PyObject*, PyObject* args)
 {
-  char* pluginName = 0;
-  problem_t* problem = 0;
-  if (!PyArg_ParseTuple (args, "sO&",
-			 &pluginName,
-			 &detail::problemConverter, &problem))
+  detail::ExpressionOperand left;
+  detail::ExpressionOperand right;
+  if (!PyArg_ParseTuple (args, "O&O&",
+			 &detail::expressionOperandConverter, &left,
+			 &detail::expressionOperandConverter, &right))
     return 0;
 
-  factory_t* factory = 0;
-
-  try
+  if (left.function->inputSize () != right.function->inputSize ()
+      || left.function->outputSize () != right.function->outputSize ())
     {
-      factory = new factory_t (pluginName, *problem);
+      PyErr_SetString (PyExc_ValueError, "functions must have the same sizes");
+      return 0;
     }
-  catch (const std::exception& e)
-    {
-      PyErr_SetString (PyExc_RuntimeError, e.what ());
 
-      delete factory;
-      return NULL;
-    }
+  return detail::expressionObject
+    (boost::make_shared<Op<expressionFunction_t, expressionFunction_t> >
+     (left.function, right.function),
+     left.threadSafe && right.threadSafe);
+}
+
+static PyObject*
+createScalar (PyObject*, PyObject* args)
+{
+  detail::ExpressionOperand origin;
+  double scalar = 1.;
+  PyObject* offset = Py_None;
+  if (!PyArg_ParseTuple (args, "O&|dO:Scalar",
+			 &detail::expressionOperandConverter, &origin,
+			 &scalar, &offset))
+    return 0;
 
-  PyObject* solverPy =
-    PyCapsule_New (factory, ROBOPTIM_CORE_SOLVER_CAPSULE_NAME,
-		   &detail::destructor<factory_t>);
-  return solverPy;
+  Function::vector_t offsetEigen;
+  if (!detail::vectorFromPython (offset, origin.function->outputSize (),
+				 offsetEigen, "offset"))
+    return 0;
+
+  return detail::expressionObject
+    (boost::make_shared< ::roboptim::Scalar<expressionFunction_t> >
+     (origin.function, scalar, offsetEigen),
+     origin.threadSafe);
 }
 
 static PyObject*
-createMultiplexer (PyObject*, PyObject* args)
+createSelection (PyObject*, PyObject* args)
 {
-  factory_t* factory = 0;
-  if (!PyArg_ParseTuple (args, "O&",
-			 &detail::factoryConverter, &factory))
+  detail::ExpressionOperand origin;
+  Py_ssize_t start = 0;
+  Py_ssize_t size = 1;
+  if (!PyArg_ParseTuple (args, "O&nn:Selection",
+			 &detail::expressionOperandConverter, &origin,
+			 &start, &size))
     return 0;
 
-  ::roboptim::core::python::Multiplexer<solver_t>* multiplexer = 0;
-
-  try
+  if (start < 0 || size < 1 || start + size > origin.function->outputSize ())
     {
-      boost::shared_ptr<factory_t> factory_ptr
-        = detail::to_shared_ptr<factory_t> (factory, PyTuple_GetItem (args, 0));
-      assert (factory_ptr);
-      multiplexer = new ::roboptim::core::python::Multiplexer<solver_t> (factory_ptr);
-    }
-  catch (const std::exception& e)
-    {
-      PyErr_SetString (PyExc_RuntimeError, e.what ());
-
-      delete multiplexer;
-      return NULL;
+      PyErr_SetString (PyExc_IndexError, "invalid output range");
+      return 0;
     }
 
-  PyObject* multiplexerPy =
-    PyCapsule_New (multiplexer, ROBOPTIM_CORE_CALLBACK_MULTIPLEXER_CAPSULE_NAME,
-		   &detail::destructor< ::roboptim::core::python::Multiplexer<solver_t> >);
-  return multiplexerPy;
+  return detail::expressionObject
+    (boost::make_shared< ::roboptim::Selection<expressionFunction_t> >
+     (origin.function, static_cast<Function::size_type> (start),
+      static_cast<Function::size_type> (size)),
+     origin.threadSafe);
 }
 
-template <typename S>
 static PyObject*
-createSolverCallback (PyObject*, PyObject* args)
+createSplit (PyObject*, PyObject* args)
 {
-  typedef ::roboptim::core::python::SolverCallback<S> solverCallback_t;
-
-  PyObject* problem = 0;
-  if (!PyArg_ParseTuple (args, "O", &problem))
+  detail::ExpressionOperand origin;
+  Py_ssize_t functionId = 0;
+  if (!PyArg_ParseTuple (args, "O&n:Split",
+			 &detail::expressionOperandConverter, &origin,
+			 &functionId))
     return 0;
 
-  solverCallback_t* callback = 0;
-
-  try
-    {
-      callback = new solverCallback_t (problem);
-    }
-  catch (const std::exception& e)
+  if (functionId < 0 || functionId >= origin.function->outputSize ())
     {
-      PyErr_SetString (PyExc_RuntimeError, e.what ());
-
-      delete callback;
-      return NULL;
+      PyErr_SetString (PyExc_IndexError, "invalid output index");
+      return 0;
     }
 
-  PyObject* callbackPy =
-    PyCapsule_New (callback, ROBOPTIM_CORE_SOLVER_CALLBACK_CAPSULE_NAME,
-		   &detail::destructor<solverCallback_t>);
-  return callbackPy;
+  return detail::expressionObject
+    (boost::make_shared< ::roboptim::Split<expressionFunction_t> >
+     (origin.function, static_cast<Function::size_type> (functionId)),
+     origin.threadSafe);
 }
 
 static PyObject*
-compute (PyObject*, PyObject* args)
+createConcatenation (PyObject*, PyObject* args)
 {
-  Function* function = 0;
-  PyObject* x = 0;
-  PyObject* result = 0;
-  if (!PyArg_ParseTuple
-      (args, "O&OO",
-       detail::functionConverter, &function, &result, &x))
+  detail::ExpressionOperand left;
+  detail::ExpressionOperand right;
+  if (!PyArg_ParseTuple (args, "O&O&:Concatenation",
+			 &detail::expressionOperandConverter, &left,
+			 &detail::expressionOperandConverter, &right))
     return 0;
-  if (!function)
+
+  if (left.function->inputSize () != right.function->inputSize ())
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Failed to retrieve function object");
+      PyErr_SetString (PyExc_ValueError,
+		       "functions must have the same input size");
       return 0;
     }
 
-  PyObject* resultNumpy =
-    PyArray_FROM_OTF(result, NPY_DOUBLE, NPY_OUT_ARRAY & ::roboptim::core::python::NPY_STORAGE_ORDER);
+  return detail::expressionObject
+    (boost::make_shared< ::roboptim::Concatenation<expressionFunction_t> >
+     (left.function, right.function),
+     left.threadSafe && right.threadSafe);
+}
+
+static PyObject*
+createBind (PyObject*, PyObject* args)
+{
+  typedef ::roboptim::Bind<expressionFunction_t> bind_t;
+
+  detail::ExpressionOperand origin;
+  PyObject* values = 0;
+  if (!PyArg_ParseTuple (args, "O&O:Bind",
+			 &detail::expressionOperandConverter, &origin,
+			 &values))
+    return 0;
+
+  PyObject* valuesFast =
+    PySequence_Fast (values, "values must be a sequence of floats or None");
+  if (!valuesFast)
+    return 0;
 
-  if (!resultNumpy)
+  if (PySequence_Fast_GET_SIZE (valuesFast) != origin.function->inputSize ())
     {
-      Py_XDECREF (resultNumpy);
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Result cannot be converted to NumPy object");
+      Py_DECREF (valuesFast);
+      PyErr_SetString (PyExc_ValueError,
+		       "one value (or None) is expected per input");
       return 0;
     }
 
-  // Try to build an array type from x.
-  // All types providing a sequence interface are compatible.
-  // Tuples, sequences and Numpy types for instance.
-  PyObject* xNumpy =
-    PyArray_FROM_OTF(x, NPY_DOUBLE, NPY_IN_ARRAY & ::roboptim::core::python::NPY_STORAGE_ORDER);
-  if (!xNumpy)
+  // None keeps the input free, a float binds it.
+  bind_t::boundValues_t bound
+    (static_cast<size_t> (origin.function->inputSize ()));
+  for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE (valuesFast); ++i)
     {
-      Py_XDECREF (xNumpy);
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Argument cannot be converted to NumPy object");
-      return 0;
+      PyObject* value = PySequence_Fast_GET_ITEM (valuesFast, i);
+      if (value == Py_None)
+	continue;
+
+      double v = PyFloat_AsDouble (value);
+      if (v == -1. && PyErr_Occurred ())
+	{
+	  Py_DECREF (valuesFast);
+	  return 0;
+	}
+      bound[i] = v;
     }
+  Py_DECREF (valuesFast);
 
-  // Directly map Eigen vector over Numpy x.
-  Eigen::Map<Function::argument_t> xEigen
-    (static_cast<double*> (PyArray_DATA (xNumpy)), function->inputSize ());
+  return detail::expressionObject
+    (boost::make_shared<bind_t> (origin.function, bound), origin.threadSafe);
+}
 
-  // Directly map Eigen result to the numpy array data.
-  Eigen::Map<Function::result_t> resultEigen
-    (static_cast<double*>
-     (PyArray_DATA (resultNumpy)), function->outputSize ());
+namespace detail
+{
+  /// \brief Convert a function object to a function pool, using its tag.
+  int
+  functionPoolConverter (PyObject* obj, FunctionPool** address)
+  {
+    *address = taggedFunction<FunctionPool> (obj);
+    if (!*address)
+      {
+	PyErr_SetString (PyExc_TypeError, "function pool expected");
+	return 0;
+      }
+    return 1;
+  }
+} // end of namespace detail.
 
-  (*function) (resultEigen, xEigen);
+static PyObject*
+getSkippedEngineCalls (PyObject*, PyObject* args)
+{
+  FunctionPool* pool = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:getSkippedEngineCalls",
+       detail::functionPoolConverter, &pool))
+    return 0;
 
-  // Clean up.
-  Py_DECREF (xNumpy);
-  Py_DECREF (resultNumpy);
+  const ::roboptim::core::python::PoolEngine& engine = pool->engine ();
+  return Py_BuildValue
+    ("{s:K,s:K}",
+     "compute", static_cast<unsigned long long> (engine.skippedComputes ()),
+     "jacobian", static_cast<unsigned long long> (engine.skippedJacobians ()));
+}
 
-  if (PyErr_Occurred ())
+static PyObject*
+resetSkippedEngineCalls (PyObject*, PyObject* args)
+{
+  FunctionPool* pool = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:resetSkippedEngineCalls",
+       detail::functionPoolConverter, &pool))
     return 0;
 
-  Py_INCREF(Py_None);
+  pool->engine ().resetCounters ();
+
+  Py_INCREF (Py_None);
   return Py_None;
 }
 
 static PyObject*
-gradient (PyObject*, PyObject* args)
+invalidateEngine (PyObject*, PyObject* args)
 {
-  Function* function = 0;
-  PyObject* x = 0;
-  PyObject* gradient = 0;
-  Function::size_type functionId = 0;
+  FunctionPool* pool = 0;
   if (!PyArg_ParseTuple
-      (args, "O&OOi",
-       detail::functionConverter, &function, &gradient, &x, &functionId))
+      (args, "O&:invalidateEngine", detail::functionPoolConverter, &pool))
     return 0;
-  if (!function)
-    {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Failed to retrieve function object");
-      return 0;
-    }
-
-  DifferentiableFunction* dfunction =
-    dynamic_cast<DifferentiableFunction*> (function);
-  if (!dfunction)
-    {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "argument 1 should be a differentiable function object");
-      return 0;
-    }
-
-  PyObject* gradientNumpy =
-    PyArray_FROM_OTF(gradient, NPY_DOUBLE, NPY_OUT_ARRAY & ::roboptim::core::python::NPY_STORAGE_ORDER);
 
-  if (!gradientNumpy)
-    {
-      Py_XDECREF (gradientNumpy);
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Gradient cannot be converted to NumPy object");
-      return 0;
-    }
+  pool->engine ().invalidate ();
 
-  // Try to build an array type from x.
-  // All types providing a sequence interface are compatible.
-  // Tuples, sequences and Numpy types for instance.
-  PyObject* xNumpy =
-    PyArray_FROM_OTF(x, NPY_DOUBLE, NPY_IN_ARRAY & ::roboptim::core::python::NPY_STORAGE_ORDER);
-  if (!xNumpy)
-    {
-      Py_XDECREF (xNumpy);
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Argument cannot be converted to NumPy object");
-      return 0;
-    }
+  Py_INCREF (Py_None);
+  return Py_None;
+}
 
-  // Directly map Eigen vector over NumPy x.
-  Eigen::Map<Function::argument_t> xEigen
-    (static_cast<double*> (PyArray_DATA (xNumpy)), function->inputSize ());
+static PyObject*
+enableStats (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* enabled = Py_True;
+  if (!PyArg_ParseTuple
+      (args, "O&|O:enableStats", detail::functionConverter, &function,
+       &enabled))
+    return 0;
 
-  // Directly map Eigen result to the numpy array data.
-  Eigen::Map<DifferentiableFunction::gradient_t> gradientEigen
-    (static_cast<double*>
-     (PyArray_DATA (gradientNumpy)), dfunction->gradientSize ());
+  int flag = PyObject_IsTrue (enabled);
+  if (flag < 0)
+    return 0;
+  function->enableStats (flag != 0);
 
-  dfunction->gradient (gradientEigen, xEigen, functionId);
+  Py_INCREF (Py_None);
+  return Py_None;
+}
 
-  // Clean up.
-  Py_DECREF (xNumpy);
-  Py_DECREF (gradientNumpy);
+static PyObject*
+setStrictArrays (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  PyObject* strict = Py_True;
+  if (!PyArg_ParseTuple
+      (args, "O&|O:setStrictArrays", detail::functionConverter, &function,
+       &strict))
+    return 0;
 
-  if (PyErr_Occurred ())
+  int flag = PyObject_IsTrue (strict);
+  if (flag < 0)
     return 0;
+  function->setStrictArrays (flag != 0);
 
-  Py_INCREF(Py_None);
+  Py_INCREF (Py_None);
   return Py_None;
 }
 
-
 static PyObject*
-jacobian (PyObject*, PyObject* args)
+getStrictArrays (PyObject*, PyObject* args)
 {
   Function* function = 0;
-  PyObject* x = 0;
-  PyObject* jacobian = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:getStrictArrays", detail::functionConverter, &function))
+    return 0;
+
+  return PyBool_FromLong (function->strictArrays ());
+}
 
+static PyObject*
+setErrorMode (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  const char* mode = 0;
   if (!PyArg_ParseTuple
-      (args, "O&OO",
-       detail::functionConverter, &function, &jacobian, &x))
+      (args, "O&s:setErrorMode", detail::functionConverter, &function,
+       &mode))
     return 0;
-  if (!function)
-    {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Failed to retrieve function object");
-      return 0;
-    }
 
-  DifferentiableFunction* dfunction =
-    dynamic_cast<DifferentiableFunction*> (function);
-  if (!dfunction)
+  if (std::strcmp (mode, "raise") == 0)
+    function->setErrorMode (Function::ERROR_RAISE);
+  else if (std::strcmp (mode, "nan") == 0)
+    function->setErrorMode (Function::ERROR_NAN);
+  else
     {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "argument 1 should be a differentiable function object");
+      PyErr_SetString (PyExc_ValueError, "error mode must be 'raise' or 'nan'");
       return 0;
     }
 
-  PyObject* jacobianNumpy =
-    PyArray_FROM_OTF(jacobian, NPY_DOUBLE, NPY_OUT_ARRAY & ::roboptim::core::python::NPY_STORAGE_ORDER);
+  Py_INCREF (Py_None);
+  return Py_None;
+}
+
+static PyObject*
+getErrorMode (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:getErrorMode", detail::functionConverter, &function))
+    return 0;
 
-  if (!jacobianNumpy)
-    {
-      Py_XDECREF (jacobianNumpy);
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Jacobian cannot be converted to NumPy object");
-      return 0;
-    }
+  return Py_BuildValue
+    ("s", function->errorMode () == Function::ERROR_NAN ? "nan" : "raise");
+}
 
-  // Try to build an array type from x.
-  // All types providing a sequence interface are compatible.
-  // Tuples, sequences and Numpy types for instance.
-  PyObject* xNumpy =
-    PyArray_FROM_OTF(x, NPY_DOUBLE, NPY_IN_ARRAY & ::roboptim::core::python::NPY_STORAGE_ORDER);
+static PyObject*
+setJacobianLayout (PyObject*, PyObject* args)
+{
+  DifferentiableFunction* dfunction = 0;
+  const char* layout = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&s:setJacobianLayout", detail::differentiableConverter,
+       &dfunction, &layout))
+    return 0;
 
-  if (!xNumpy)
+  const std::string l (layout);
+  if (l != "C" && l != "F")
     {
-      Py_XDECREF (xNumpy);
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Argument cannot be converted to NumPy object");
+      PyErr_SetString (PyExc_ValueError, "layout must be 'C' or 'F'");
       return 0;
     }
+  dfunction->setJacobianRowMajor (l == "C");
 
-  // Directly map Eigen vector over NumPy x.
-  Eigen::Map<Function::argument_t> xEigen
-    (static_cast<double*> (PyArray_DATA (xNumpy)), function->inputSize ());
-
-  // Directly map Eigen Jacobian to the numpy array data.
-  Eigen::Map<DifferentiableFunction::jacobian_t> jacobianEigen
-    (static_cast<double*> (PyArray_DATA (jacobianNumpy)),
-     dfunction->jacobianSize ().first, dfunction->jacobianSize ().second);
-
-  dfunction->jacobian (jacobianEigen, xEigen);
-
-  // Clean up.
-  Py_DECREF (xNumpy);
-  Py_DECREF (jacobianNumpy);
-
-  if (PyErr_Occurred ())
-    return 0;
-
-  Py_INCREF(Py_None);
+  Py_INCREF (Py_None);
   return Py_None;
 }
 
-
 static PyObject*
-bindCompute (PyObject*, PyObject* args)
+getJacobianLayout (PyObject*, PyObject* args)
 {
-  Function* function = 0;
-  PyObject* callback = 0;
+  DifferentiableFunction* dfunction = 0;
   if (!PyArg_ParseTuple
-      (args, "O&O:bindCompute",
-       detail::functionConverter, &function, &callback))
+      (args, "O&:getJacobianLayout", detail::differentiableConverter,
+       &dfunction))
+    return 0;
+
+  return Py_BuildValue ("s", dfunction->jacobianRowMajor () ? "C" : "F");
+}
+
+static PyObject*
+finiteDifferenceDirections (PyObject*, PyObject* args)
+{
+  Function* function = 0;
+  if (!PyArg_ParseTuple
+      (args, "O&:finiteDifferenceDirections",
+       detail::functionConverter, &function))
     return 0;
-  if (!function)
-    {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Failed to retrieve function object");
-      return 0;
-    }
-  if (!callback)
-    {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Failed to retrieve callback object");
-      return 0;
-    }
-  if (!PyCallable_Check (callback))
-    {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "2nd argument must be callable");
-      return 0;
-    }
 
-  function->setComputeCallback (callback);
+  PyObject* functionPy = PyTuple_GetItem (args, 0);
+  FiniteDifferenceGradient<simplePolicy_t>* simpleFunction
+    = detail::taggedFunction<FiniteDifferenceGradient<simplePolicy_t> >
+    (functionPy);
+  FiniteDifferenceGradient<fivePointsPolicy_t>* fivePointsFunction
+    = detail::taggedFunction<FiniteDifferenceGradient<fivePointsPolicy_t> >
+    (functionPy);
+
+  if (simpleFunction)
+    return PyInt_FromLong (simpleFunction->directions ());
+  if (fivePointsFunction)
+    return PyInt_FromLong (fivePointsFunction->directions ());
+
+  PyErr_SetString
+    (PyExc_TypeError,
+     "instance of FiniteDifferenceGradient expected as first argument");
+  return 0;
+}
 
-  Py_INCREF(Py_None);
-  return Py_None;
+/// \brief Copy the compressed buffers of a sparse matrix to NumPy arrays.
+/// \return new reference to a (data, indices, indptr) tuple.
+static PyObject*
+toCompressedArrays (const SparseDifferentiableFunction::jacobian_t& m)
+{
+  npy_intp nnz = static_cast<npy_intp> (m.nonZeros ());
+  npy_intp outer = static_cast<npy_intp> (m.outerSize () + 1);
+
+  PyObject* data = PyArray_SimpleNew (1, &nnz, NPY_DOUBLE);
+  PyObject* indices = PyArray_SimpleNew (1, &nnz, NPY_INT);
+  PyObject* indptr = PyArray_SimpleNew (1, &outer, NPY_INT);
+
+  std::copy (m.valuePtr (), m.valuePtr () + nnz,
+	     static_cast<double*> (PyArray_DATA (data)));
+  std::copy (m.innerIndexPtr (), m.innerIndexPtr () + nnz,
+	     static_cast<int*> (PyArray_DATA (indices)));
+  std::copy (m.outerIndexPtr (), m.outerIndexPtr () + outer,
+	     static_cast<int*> (PyArray_DATA (indptr)));
+
+  return Py_BuildValue ("(NNN)", data, indices, indptr);
 }
 
 static PyObject*
-bindGradient (PyObject*, PyObject* args)
+getSparsityPattern (PyObject*, PyObject* args)
 {
   Function* function = 0;
-  PyObject* callback = 0;
   if (!PyArg_ParseTuple
-      (args, "O&O:bindGradient",
-       detail::functionConverter, &function, &callback))
+      (args, "O&:getSparsityPattern",
+       detail::functionConverter, &function))
     return 0;
-  if (!function)
-    {
-      PyErr_SetString
-	(PyExc_TypeError,
-	 "Failed to retrieve function object");
-      return 0;
-    }
 
-  DifferentiableFunction* dfunction
-    = dynamic_cast<DifferentiableFunction*> (function);
-
-  if (!dfunction)
+  SparseDifferentiableFunction* sfunction
+    = detail::toSparse (function);
+  if (!sfunction)
     {
       PyErr_SetString
 	(PyExc_TypeError,
-	 "instance of DifferentiableFunction expected as first argument");
-      return 0;
-    }
-  if (!callback)
-    {
-      PyErr_SetString (PyExc_TypeError, "Failed to retrieve callback object");
-      return 0;
-    }
-  if (!PyCallable_Check (callback))
-    {
-      PyErr_SetString (PyExc_TypeError, "2nd argument must be callable");
+	 "instance of SparseDifferentiableFunction expected as first argument");
       return 0;
     }
 
-  dfunction->setGradientCallback (callback);
-
-  Py_INCREF(Py_None);
-  return Py_None;
+  return toCompressedArrays (sfunction->sparsityPattern ());
 }
 
 static PyObject*
-bindJacobian (PyObject*, PyObject* args)
+sparseJacobian (PyObject*, PyObject* args)
 {
   Function* function = 0;
-  PyObject* callback = 0;
+  PyObject* x = 0;
   if (!PyArg_ParseTuple
-      (args, "O&O:bindJacobian",
-       detail::functionConverter, &function, &callback))
+      (args, "O&O:sparseJacobian",
+       detail::functionConverter, &function, &x))
     return 0;
-  if (!function)
+
+  SparseDifferentiableFunction* sfunction
+    = detail::toSparse (function);
+  if (!sfunction)
     {
       PyErr_SetString
 	(PyExc_TypeError,
-	 "Failed to retrieve function object");
+	 "instance of SparseDifferentiableFunction expected as first argument");
       return 0;
     }
 
-  DifferentiableFunction* dfunction
-    = dynamic_cast<DifferentiableFunction*> (function);
-
-  if (!dfunction)
+  PyObject* xNumpy = PyArray_FROM_OTF (x, NPY_DOUBLE, NPY_IN_ARRAY);
+  if (!xNumpy)
     {
       PyErr_SetString
 	(PyExc_TypeError,
-	 "instance of DifferentiableFunction expected as first argument");
+	 "Argument cannot be converted to NumPy object");
       return 0;
     }
-  if (!callback)
+
+  if (PyArray_SIZE (xNumpy) != sfunction->inputSize ())
     {
-      PyErr_SetString (PyExc_TypeError, "Failed to retrieve callback object");
+      Py_DECREF (xNumpy);
+      PyErr_SetString (PyExc_TypeError, "invalid size");
       return 0;
     }
-  if (!PyCallable_Check (callback))
+
+  Eigen::Map<Function::argument_t> xEigen
+    (static_cast<double*> (PyArray_DATA (xNumpy)), sfunction->inputSize ());
+
+  SparseDifferentiableFunction::jacobian_t jac (sfunction->sparsityPattern ());
+
+  ::roboptim::python::ErrorScope errors (true);
+
+  try
     {
-      PyErr_SetString (PyExc_TypeError, "2nd argument must be callable");
+      ::roboptim::python::GILRelease nogil;
+      sfunction->jacobian (jac, xEigen);
+    }
+  catch (const std::exception& e)
+    {
+      Py_DECREF (xNumpy);
+      if (!errors.restore ())
+	PyErr_SetString (PyExc_RuntimeError, e.what ());
       return 0;
     }
 
-  dfunction->setJacobianCallback (callback);
+  Py_DECREF (xNumpy);
 
-  Py_INCREF(Py_None);
-  return Py_None;
+  if (errors.restore () || PyErr_Occurred ())
+    return 0;
+
+  jac.makeCompressed ();
+  return toCompressedArrays (jac);
+}
+
+/// \brief Whether the cost and all the constraints of a problem are twice
+/// differentiable. Problems are not specialized on the function type:
+/// solvers find the Hessians through the function flags, and only use
+/// them if all the functions have one (dense functions adapted to sparse
+/// problems do not).
+template <typename P>
+static PyObject*
+problemHasHessian (PyObject*, PyObject* args)
+{
+  typedef ::roboptim::GenericTwiceDifferentiableFunction
+    <typename P::function_t::traits_t> twiceDifferentiable_t;
+
+  P* problem = 0;
+  if (!PyArg_ParseTuple (args, "O&", &detail::problemConverter<P>, &problem))
+    return 0;
+  if (!problem)
+    {
+      PyErr_SetString (PyExc_TypeError, "1st argument must be a problem");
+      return 0;
+    }
+
+  bool hasHessian =
+    problem->function ().template asType<twiceDifferentiable_t> ();
+  for (size_t i = 0; hasHessian && i < problem->constraints ().size (); ++i)
+    hasHessian =
+      problem->constraints ()[i]->template asType<twiceDifferentiable_t> ();
+  return PyBool_FromLong (hasHessian);
 }
 
+template <typename P>
 static PyObject*
 getStartingPoint (PyObject*, PyObject* args)
 {
-  problem_t* problem = 0;
-  if (!PyArg_ParseTuple (args, "O&", &detail::problemConverter, &problem))
+  P* problem = 0;
+  if (!PyArg_ParseTuple (args, "O&", &detail::problemConverter<P>, &problem))
     return 0;
   if (!problem)
     {
@@ -1624,13 +5712,14 @@ getStartingPoint (PyObject*, PyObject* args)
   return startingPoint;
 }
 
+template <typename P>
 static PyObject*
 setStartingPoint (PyObject*, PyObject* args)
 {
-  problem_t* problem = 0;
+  P* problem = 0;
   PyObject* startingPoint = 0;
   if (!PyArg_ParseTuple
-      (args, "O&O", &detail::problemConverter, &problem, &startingPoint))
+      (args, "O&O", &detail::problemConverter<P>, &problem, &startingPoint))
     return 0;
   if (!problem)
     {
@@ -1669,11 +5758,12 @@ setStartingPoint (PyObject*, PyObject* args)
   return Py_None;
 }
 
+template <typename P>
 static PyObject*
 getArgumentBounds (PyObject*, PyObject* args)
 {
-  problem_t* problem = 0;
-  if (!PyArg_ParseTuple (args, "O&", &detail::problemConverter, &problem))
+  P* problem = 0;
+  if (!PyArg_ParseTuple (args, "O&", &detail::problemConverter<P>, &problem))
     return 0;
   if (!problem)
     {
@@ -1700,13 +5790,14 @@ getArgumentBounds (PyObject*, PyObject* args)
   return bounds;
 }
 
+template <typename P>
 static PyObject*
 setArgumentBounds (PyObject*, PyObject* args)
 {
-  problem_t* problem = 0;
+  P* problem = 0;
   PyObject* bounds = 0;
   if (!PyArg_ParseTuple
-      (args, "O&O", &detail::problemConverter, &problem, &bounds))
+      (args, "O&O", &detail::problemConverter<P>, &problem, &bounds))
     return 0;
   if (!problem)
     {
@@ -1755,11 +5846,12 @@ setArgumentBounds (PyObject*, PyObject* args)
   return Py_None;
 }
 
+template <typename P>
 static PyObject*
 getArgumentScaling (PyObject*, PyObject* args)
 {
-  problem_t* problem = 0;
-  if (!PyArg_ParseTuple (args, "O&", &detail::problemConverter, &problem))
+  P* problem = 0;
+  if (!PyArg_ParseTuple (args, "O&", &detail::problemConverter<P>, &problem))
     return 0;
   if (!problem)
     {
@@ -1780,13 +5872,14 @@ getArgumentScaling (PyObject*, PyObject* args)
   return scalingNumpy;
 }
 
+template <typename P>
 static PyObject*
 setArgumentScaling (PyObject*, PyObject* args)
 {
-  problem_t* problem = 0;
+  P* problem = 0;
   PyObject* scaling = 0;
   if (!PyArg_ParseTuple
-      (args, "O&O", &detail::problemConverter, &problem, &scaling))
+      (args, "O&O", &detail::problemConverter<P>, &problem, &scaling))
     return 0;
   if (!problem)
     {
@@ -1825,17 +5918,157 @@ setArgumentScaling (PyObject*, PyObject* args)
 }
 
 
+namespace detail
+{
+  /// \brief Constraint given to a problem for a Python-side function.
+  template <typename P>
+  boost::shared_ptr<typename P::function_t>
+  pythonConstraint (Function* function, PyObject* obj)
+  {
+    typedef typename ProblemTraits<P>::function_t pyFunction_t;
+
+    pyFunction_t* dfunction = kindCast<pyFunction_t> (function);
+    if (!dfunction)
+      {
+	PyErr_SetString (PyExc_TypeError,
+			 "constraints must be differentiable functions");
+	return boost::shared_ptr<typename P::function_t> ();
+      }
+
+    // If we just used a boost::shared_ptr, the constraint would be freed
+    // when the problem disappears, so we use a custom deleter that keeps
+    // track of the Python object's reference counter to prevent that.
+    return boost::static_pointer_cast<typename P::function_t>
+      (to_shared_ptr<pyFunction_t> (dfunction, obj));
+  }
+
+  /// \brief Constraint given to a problem for a function object.
+  /// \return null pointer on error (with a Python exception set).
+  template <typename P>
+  boost::shared_ptr<typename P::function_t>
+  constraintFunction (Function* function, PyObject* obj)
+  {
+    return pythonConstraint<P> (function, obj);
+  }
+
+  template <>
+  boost::shared_ptr<problem_t::function_t>
+  constraintFunction<problem_t> (Function* function, PyObject* obj)
+  {
+    if (DifferentiableFunction* dfunction = toDifferentiable (function))
+      return denseFunction (dfunction, obj);
+
+    PyErr_SetString (PyExc_TypeError,
+		     toSparse (function)
+		     ? "sparse constraints need a sparse problem"
+		     " (PyProblem (cost, sparse = True))"
+		     : "constraints must be differentiable functions");
+    return boost::shared_ptr<problem_t::function_t> ();
+  }
+
+  template <>
+  boost::shared_ptr<sparseProblem_t::function_t>
+  constraintFunction<sparseProblem_t> (Function* function, PyObject* obj)
+  {
+    // Dense constraints are adapted.
+    if (DifferentiableFunction* dfunction = toDifferentiable (function))
+      return boost::make_shared<SparseAdapter> (denseFunction (dfunction, obj));
+    return pythonConstraint<sparseProblem_t> (function, obj);
+  }
+
+  /// \brief Convert the bounds and scaling of m constraint outputs.
+  ///
+  /// bounds is a (m x 2) array, or a pair if m = 1. scaling is None, a
+  /// float, or a sequence of m floats. Both are converted to contiguous
+  /// arrays of doubles at once, instead of being read element by element.
+  ///
+  /// \param boundsNumpy new reference on the (m x 2) bounds.
+  /// \param scalingNumpy new reference on the scaling, or 0 if None.
+  /// \return false on error (with a Python exception set).
+  bool
+  constraintArrays (PyObject* py_bounds, PyObject* py_scaling, npy_intp m,
+		    PyObject*& boundsNumpy, PyObject*& scalingNumpy)
+  {
+    boundsNumpy = PyArray_FROM_OTF (py_bounds, NPY_DOUBLE, NPY_IN_ARRAY);
+    scalingNumpy = 0;
+    if (!boundsNumpy)
+      {
+	PyErr_SetString (PyExc_TypeError,
+			 "bounds must be a (n x 2) NumPy array or a list of"
+			 " size 2.");
+	return false;
+      }
+
+    bool is_matrix = PyArray_NDIM (boundsNumpy) == 2
+      && PyArray_DIM (boundsNumpy, 0) == m
+      && PyArray_DIM (boundsNumpy, 1) == 2;
+    bool is_pair = m == 1 && PyArray_NDIM (boundsNumpy) == 1
+      && PyArray_DIM (boundsNumpy, 0) == 2;
+    if (!is_matrix && !is_pair)
+      {
+	PyErr_SetString (PyExc_TypeError,
+			 "bounds' size must match the constraints' output"
+			 " size.");
+	Py_DECREF (boundsNumpy);
+	boundsNumpy = 0;
+	return false;
+      }
+
+    if (py_scaling == Py_None)
+      return true;
+
+    scalingNumpy = PyArray_FROM_OTF (py_scaling, NPY_DOUBLE, NPY_IN_ARRAY);
+    if (!scalingNumpy || PyArray_SIZE (scalingNumpy) != m)
+      {
+	PyErr_Clear ();
+	PyErr_SetString (PyExc_TypeError,
+			 "scaling should be a float or a list of floats"
+			 " matching the constraints' output size.");
+	Py_XDECREF (scalingNumpy);
+	Py_DECREF (boundsNumpy);
+	boundsNumpy = scalingNumpy = 0;
+	return false;
+      }
+    return true;
+  }
+
+  /// \brief Bounds and scaling of the m outputs of a constraint, starting
+  /// at the given row of the arrays converted by constraintArrays.
+  template <typename P>
+  void
+  constraintBounds (PyObject* boundsNumpy, PyObject* scalingNumpy,
+		    npy_intp row, npy_intp m,
+		    typename P::intervals_t& bounds,
+		    typename P::scaling_t& scaling)
+  {
+    const double* b =
+      static_cast<const double*> (PyArray_DATA (boundsNumpy)) + 2 * row;
+    bounds.resize (static_cast<size_t> (m));
+    for (npy_intp i = 0; i < m; ++i)
+      bounds[i] = Function::makeInterval (b[2 * i], b[2 * i + 1]);
+
+    scaling.assign (static_cast<size_t> (m), 1.);
+    if (scalingNumpy)
+      {
+	const double* s =
+	  static_cast<const double*> (PyArray_DATA (scalingNumpy)) + row;
+	std::copy (s, s + m, scaling.begin ());
+      }
+  }
+} // end of namespace detail.
+
+template <typename P>
 static PyObject*
 addConstraint (PyObject*, PyObject* args)
 {
-  problem_t* problem = 0;
+  P* problem = 0;
   Function* function = 0;
   PyObject* py_bounds = 0;
   PyObject* py_scaling = 0;
 
   if (!PyArg_ParseTuple
       (args, "O&O&OO",
-       &detail::problemConverter, &problem,
+       &detail::problemConverter<P>, &problem,
        &detail::functionConverter, &function,
        &py_bounds, &py_scaling))
     return 0;
@@ -1852,158 +6085,181 @@ addConstraint (PyObject*, PyObject* args)
       return 0;
     }
 
-  DifferentiableFunction* dfunction =
-    dynamic_cast<DifferentiableFunction*> (function);
+  boost::shared_ptr<typename P::function_t> constraint =
+    detail::constraintFunction<P> (function, PyTuple_GetItem (args, 1));
+  if (!constraint)
+    return 0;
 
-  if (!dfunction)
+  const npy_intp m = constraint->outputSize ();
+  PyObject* boundsNumpy = 0;
+  PyObject* scalingNumpy = 0;
+  if (!detail::constraintArrays (py_bounds, py_scaling, m,
+				 boundsNumpy, scalingNumpy))
+    return 0;
+
+  typename P::intervals_t bounds;
+  typename P::scaling_t scaling;
+  detail::constraintBounds<P> (boundsNumpy, scalingNumpy, 0, m,
+			       bounds, scaling);
+  Py_DECREF (boundsNumpy);
+  Py_XDECREF (scalingNumpy);
+
+  try
     {
-      PyErr_SetString (PyExc_TypeError,
-		       "2nd argument must be a differentiable function");
-      return 0;
+      problem->addConstraint (constraint, bounds, scaling);
     }
-
-  if (!py_bounds)
+  catch (const std::exception& e)
     {
-      PyErr_SetString (PyExc_TypeError, "3rd argument is invalid.");
+      PyErr_SetString (PyExc_ValueError, e.what ());
       return 0;
     }
 
-  bool is_pair = (PyList_Check (py_bounds) && (PyList_Size (py_bounds) == 2));
-  bool is_np_array = (PyArray_Check (py_bounds) && (PyArray_NDIM (py_bounds) == 2));
+  Py_INCREF (Py_None);
+  return Py_None;
+}
+
+/// \brief Add several constraints at once: the bounds (and scaling) of
+/// all their outputs are stacked in a single (m x 2) array (and a single
+/// array of size m).
+template <typename P>
+static PyObject*
+addConstraints (PyObject*, PyObject* args)
+{
+  P* problem = 0;
+  PyObject* py_functions = 0;
+  PyObject* py_bounds = 0;
+  PyObject* py_scaling = Py_None;
+
+  if (!PyArg_ParseTuple
+      (args, "O&OO|O:addConstraints",
+       &detail::problemConverter<P>, &problem,
+       &py_functions, &py_bounds, &py_scaling))
+    return 0;
 
-  if (!is_pair && !is_np_array)
+  if (!problem)
     {
-      PyErr_SetString (PyExc_TypeError,
-                       "3rd argument must be a (n x 2) NumPy array or a list of size 2.");
+      PyErr_SetString (PyExc_TypeError, "1st argument must be a problem");
       return 0;
     }
 
-  // If we just used a boost::shared_ptr, the constraint would be freed when the
-  // problem disappears, so we use a custom deleter that keeps track of the
-  // Python object's reference counter to prevent that.
-  boost::shared_ptr<DifferentiableFunction> constraint
-    = detail::to_shared_ptr<DifferentiableFunction>
-    (dfunction, PyTuple_GetItem (args, 1));
-
+  PyObject* functions =
+    PySequence_Fast (py_functions, "2nd argument must be a list of functions");
+  if (!functions)
+    return 0;
 
-  // Bounds = pair
-  if (is_pair && constraint->outputSize () == 1)
+  // Check all the constraints before modifying the problem.
+  typedef boost::shared_ptr<typename P::function_t> constraint_t;
+  std::vector<constraint_t> constraints;
+  npy_intp m = 0;
+  for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE (functions); ++i)
     {
-      PyObject* py_min = PyList_GetItem (py_bounds, 0);
-      PyObject* py_max = PyList_GetItem (py_bounds, 1);
-
-      if (!py_min || !py_max || !PyFloat_Check (py_min) || !PyFloat_Check (py_max))
+      PyObject* obj = PySequence_Fast_GET_ITEM (functions, i);
+      Function* function = 0;
+      if (!detail::functionConverter (obj, &function))
 	{
-	  PyErr_SetString (PyExc_TypeError,
-			   "bounds should be floats.");
+	  Py_DECREF (functions);
 	  return 0;
 	}
 
-      double scaling = 1.;
-      if (py_scaling != Py_None)
+      constraint_t constraint = detail::constraintFunction<P> (function, obj);
+      if (!constraint)
 	{
-	  if (PyFloat_Check (py_scaling))
-	    {
-	      scaling = PyFloat_AsDouble (py_scaling);
-	    }
-	  else if (PyList_Check (py_scaling)
-		   && (PyList_Size (py_scaling) == 1)
-		   && (PyFloat_Check (PyList_GetItem (py_scaling, 0))))
-	    {
-	      PyObject* tmp = PyList_GetItem (py_scaling, 0);
-	      scaling = PyFloat_AsDouble (tmp);
-	    }
-	  else
-	    {
-	      PyErr_SetString (PyExc_TypeError,
-			       "scaling should be a float or a list of floats.");
-	      return 0;
-	    }
+	  Py_DECREF (functions);
+	  return 0;
 	}
-
-      problem->addConstraint (boost::static_pointer_cast< ::roboptim::DifferentiableFunction>(constraint),
-			      Function::makeInterval (PyFloat_AsDouble (py_min),
-						      PyFloat_AsDouble (py_max)),
-			      scaling);
+      m += constraint->outputSize ();
+      constraints.push_back (constraint);
     }
-  // Bounds = vector of pairs
-  else if (is_np_array
-           && PyArray_DIMS (py_bounds)[0] == constraint->outputSize ()
-           && PyArray_DIMS (py_bounds)[1] == 2)
-    {
-      typedef problem_t::intervals_t intervals_t;
-      typedef problem_t::scaling_t    scaling_t;
-
-      scaling_t scaling (constraint->outputSize (), 1.);
-      intervals_t bounds (constraint->outputSize ());
+  Py_DECREF (functions);
 
-      if (py_scaling != Py_None)
-	{
-	  if (PyList_Check (py_scaling)
-	      && (PyList_Size (py_scaling) == constraint->outputSize ()))
-	    {
-	      for (int i = 0; i < constraint->outputSize (); ++i)
-		{
-		  PyObject* tmp = PyList_GetItem (py_scaling, i);
-		  if (PyFloat_Check (tmp))
-		    {
-		      scaling[i] = PyFloat_AsDouble (tmp);
-		    }
-		}
-	    }
-	  else
-	    {
-	      PyErr_SetString (PyExc_TypeError,
-			       "scaling should be a list of floats.");
-	      return 0;
-	    }
-	}
+  PyObject* boundsNumpy = 0;
+  PyObject* scalingNumpy = 0;
+  if (!detail::constraintArrays (py_bounds, py_scaling, m,
+				 boundsNumpy, scalingNumpy))
+    return 0;
 
-      for (Function::size_type i = 0; i < constraint->outputSize (); ++i)
+  typename P::intervals_t bounds;
+  typename P::scaling_t scaling;
+  npy_intp row = 0;
+  try
+    {
+      for (size_t i = 0; i < constraints.size (); ++i)
 	{
-	  // TODO: check array type
-	  bounds[i].first = * (double*) (PyArray_GETPTR2 (py_bounds, i, 0));
-	  bounds[i].second = * (double*) (PyArray_GETPTR2 (py_bounds, i, 1));
+	  const npy_intp size = constraints[i]->outputSize ();
+	  detail::constraintBounds<P> (boundsNumpy, scalingNumpy, row, size,
+				       bounds, scaling);
+	  problem->addConstraint (constraints[i], bounds, scaling);
+	  row += size;
 	}
-
-      problem->addConstraint (boost::static_pointer_cast< ::roboptim::DifferentiableFunction>(constraint),
-                              bounds, scaling);
     }
-  else
+  catch (const std::exception& e)
     {
-      PyErr_SetString (PyExc_TypeError,
-                       "3rd argument's size must match the constraint's output size.");
+      Py_DECREF (boundsNumpy);
+      Py_XDECREF (scalingNumpy);
+      PyErr_SetString (PyExc_ValueError, e.what ());
       return 0;
     }
 
+  Py_DECREF (boundsNumpy);
+  Py_XDECREF (scalingNumpy);
+
   Py_INCREF (Py_None);
   return Py_None;
 }
 
 
+template <typename F>
 static PyObject*
-solve (PyObject*, PyObject* args)
+isSolved (PyObject*, PyObject* args)
 {
-  factory_t* factory = 0;
+  F* factory = 0;
   if (!PyArg_ParseTuple (args, "O&",
-			 &detail::factoryConverter, &factory))
+			 &detail::factoryConverter<F>, &factory))
     return 0;
 
-  (*factory) ().solve ();
-  Py_INCREF (Py_None);
-  return Py_None;
+  return PyBool_FromLong
+    ((*factory) ().minimum ().which () != F::solver_t::SOLVER_NO_SOLUTION);
 }
 
+template <typename F>
 static PyObject*
-minimum (PyObject*, PyObject* args)
+solve (PyObject*, PyObject* args)
 {
-  factory_t* factory = 0;
+  F* factory = 0;
   if (!PyArg_ParseTuple (args, "O&",
-			 &detail::factoryConverter, &factory))
+			 &detail::factoryConverter<F>, &factory))
+    return 0;
+
+  // Exceptions of the Python callbacks are raised once the solver
+  // returned, with their original traceback.
+  ::roboptim::python::ErrorScope errors;
+
+  try
+    {
+      // Python callbacks take the GIL back when needed, which lets native
+      // problems be solved in parallel from several Python threads.
+      ::roboptim::python::GILRelease nogil;
+      (*factory) ().solve ();
+    }
+  catch (const std::exception& e)
+    {
+      if (!errors.restore ())
+	PyErr_SetString (PyExc_RuntimeError, e.what ());
+      return 0;
+    }
+
+  // Some solvers catch the exceptions thrown by the callbacks.
+  if (errors.restore () || PyErr_Occurred ())
     return 0;
 
-  solver_t::result_t result = (*factory) ().minimum ();
+  // Number of failed evaluations, and first recoverable exception.
+  return Py_BuildValue ("(kN)", errors.failures (), errors.exception ());
+}
 
+/// \brief Convert a solver result to a (capsule name, capsule) tuple.
+static PyObject*
+toPython (const solver_t::result_t& result)
+{
   switch (result.which ())
     {
       // should never happen
@@ -2036,22 +6292,116 @@ minimum (PyObject*, PyObject* args)
   return Py_None;
 }
 
+template <typename F>
+static PyObject*
+minimum (PyObject*, PyObject* args)
+{
+  F* factory = 0;
+  if (!PyArg_ParseTuple (args, "O&",
+			 &detail::factoryConverter<F>, &factory))
+    return 0;
+
+  return toPython ((*factory) ().minimum ());
+}
+
+static PyObject*
+solveMultiStart (PyObject*, PyObject* args)
+{
+  char* pluginName = 0;
+  problem_t* problem = 0;
+  PyObject* startingPoints = 0;
+  int nThreads = 0;
+  factory_t* factory = 0;
+  if (!PyArg_ParseTuple (args, "sO&O|iO&:solveMultiStart",
+			 &pluginName,
+			 &detail::problemConverter<problem_t>, &problem,
+			 &startingPoints, &nThreads,
+			 &detail::factoryConverter<factory_t>, &factory))
+    return 0;
+
+  PyObject* startingPointsNumpy = detail::toBatchInput
+    (startingPoints, problem->function ().inputSize ());
+  if (!startingPointsNumpy)
+    return 0;
+
+  npy_intp k = PyArray_DIM (startingPointsNumpy, 0);
+  Function::const_batch_ref startingPointsEigen
+    (static_cast<double*> (PyArray_DATA (startingPointsNumpy)),
+     k, problem->function ().inputSize ());
+
+  // Solver parameters are copied from the optional solver.
+  parameters_t parameters;
+  if (factory)
+    parameters = (*factory) ().parameters ();
+
+  if (nThreads <= 0)
+    nThreads = static_cast<int> (boost::thread::hardware_concurrency ());
+  nThreads = std::max (1, std::min (nThreads, static_cast<int> (k)));
+
+  detail::MultiStart multiStart
+    (pluginName, *problem, startingPointsEigen, parameters);
+
+  {
+    // Python functions take the GIL back when evaluated.
+    ::roboptim::python::GILRelease nogil;
+
+    boost::thread_group workers;
+    for (int i = 0; i < nThreads; ++i)
+      workers.create_thread (boost::bind (&detail::MultiStart::run,
+					  &multiStart));
+    workers.join_all ();
+  }
+
+  Py_DECREF (startingPointsNumpy);
+
+  // Gather the results, and look for the best solution.
+  PyObject* resultsPy = PyList_New (k);
+  long best = -1;
+  double bestValue = 0.;
+
+  const detail::MultiStart::results_t& results = multiStart.results ();
+  for (npy_intp i = 0; i < k; ++i)
+    {
+      const solver_t::result_t& result = results[static_cast<size_t> (i)];
+
+      PyObject* resultPy = toPython (result);
+      if (!resultPy)
+	{
+	  Py_DECREF (resultsPy);
+	  return 0;
+	}
+      PyList_SET_ITEM (resultsPy, i, resultPy);
+
+      if (result.which () == solver_t::SOLVER_VALUE)
+	{
+	  double value = boost::get<result_t> (result).value[0];
+	  if (best < 0 || value < bestValue)
+	    {
+	      best = static_cast<long> (i);
+	      bestValue = value;
+	    }
+	}
+    }
+
+  return Py_BuildValue ("(Nl)", resultsPy, best);
+}
+
 static PyObject*
 getParameter (const parameter_t& parameter)
 {
   PyObject* description = PyString_FromString (parameter.description.c_str ());
   PyObject* value = boost::apply_visitor (detail::ParameterValueVisitor (),
                                           parameter.value);
-
-  return PyTuple_Pack (2, description, value);
+  return detail::pairSteal (description, value);
 }
 
+template <typename F>
 static PyObject*
 getSolverParameters (PyObject*, PyObject* args)
 {
-  factory_t* factory = 0;
+  F* factory = 0;
   if (!PyArg_ParseTuple (args, "O&",
-			 &detail::factoryConverter, &factory))
+			 &detail::factoryConverter<F>, &factory))
     return 0;
 
   if (!factory)
@@ -2060,7 +6410,7 @@ getSolverParameters (PyObject*, PyObject* args)
       return 0;
     }
 
-  solver_t& solver = (*factory) ();
+  typename F::solver_t& solver = (*factory) ();
 
   // In C++, parameters are: std::map<std::string, Parameter>
   PyObject* parameters = PyDict_New ();
@@ -2069,21 +6419,26 @@ getSolverParameters (PyObject*, PyObject* args)
        iter != solver.parameters ().end (); iter++)
     {
       // Insert object to Python dictionary
-      PyDict_SetItemString (parameters, (iter->first).c_str (),
-                            getParameter (iter->second));
+      if (detail::setItemSteal (parameters, (iter->first).c_str (),
+				getParameter (iter->second)) < 0)
+	{
+	  Py_DECREF (parameters);
+	  return 0;
+	}
     }
 
-  return Py_BuildValue ("O", parameters);
+  return parameters;
 }
 
+template <typename F>
 static PyObject*
 setSolverParameters (PyObject*, PyObject* args)
 {
-  factory_t* factory = 0;
+  F* factory = 0;
   PyObject* py_parameters = 0;
 
   if (!PyArg_ParseTuple (args, "O&O",
-			 &detail::factoryConverter, &factory, &py_parameters))
+			 &detail::factoryConverter<F>, &factory, &py_parameters))
     return 0;
 
   if (!factory)
@@ -2098,7 +6453,7 @@ setSolverParameters (PyObject*, PyObject* args)
       return 0;
     }
 
-  solver_t& solver = (*factory) ();
+  typename F::solver_t& solver = (*factory) ();
 
   // In C++, parameters are: std::map<std::string, Parameter>
   parameters_t& parameters = solver.parameters ();
@@ -2151,16 +6506,17 @@ setSolverParameters (PyObject*, PyObject* args)
   return Py_None;
 }
 
+template <typename F>
 static PyObject*
 setSolverParameter (PyObject*, PyObject* args)
 {
-  factory_t* factory = 0;
+  F* factory = 0;
   PyObject* key = 0;
   PyObject* value = 0;
   PyObject* desc = 0;
 
   if (!PyArg_ParseTuple (args, "O&OOO",
-			 &detail::factoryConverter, &factory, &key, &value, &desc))
+			 &detail::factoryConverter<F>, &factory, &key, &value, &desc))
     return 0;
 
   if (!factory)
@@ -2169,7 +6525,7 @@ setSolverParameter (PyObject*, PyObject* args)
       return 0;
     }
 
-  solver_t& solver = (*factory) ();
+  typename F::solver_t& solver = (*factory) ();
 
   parameter_t parameter;
 
@@ -2206,15 +6562,29 @@ addIterationCallback (PyObject*, PyObject* args)
 {
   ::roboptim::core::python::Multiplexer<solver_t>* multiplexer = 0;
   ::roboptim::core::python::SolverCallback<solver_t>* callback_wrapper = 0;
+  ::roboptim::core::python::IterationFilter filter;
+  PyObject* onImprovement = Py_False;
 
   if (!PyArg_ParseTuple
-      (args, "O&O&:addIterationCallback",
+      (args, "O&O&|iOd:addIterationCallback",
        &detail::multiplexerConverter, &multiplexer,
-       &detail::solverCallbackConverter, &callback_wrapper))
+       &detail::solverCallbackConverter, &callback_wrapper,
+       &filter.every, &onImprovement, &filter.interval))
+    return 0;
+
+  if (filter.every < 1)
+    {
+      PyErr_SetString (PyExc_ValueError, "every must be positive");
+      return 0;
+    }
+
+  int flag = PyObject_IsTrue (onImprovement);
+  if (flag < 0)
     return 0;
+  filter.onImprovement = (flag != 0);
 
   multiplexer->add (detail::to_shared_ptr< ::roboptim::core::python::SolverCallback<solver_t> >
-                    (callback_wrapper, PyTuple_GetItem (args, 1)));
+                    (callback_wrapper, PyTuple_GetItem (args, 1)), filter);
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -2288,7 +6658,7 @@ addOptimizationLogger (PyObject*, PyObject* args)
 
   if (!PyArg_ParseTuple
       (args, "O&O&s:addOptimizationLogger",
-       &detail::factoryConverter, &factory,
+       &detail::factoryConverter<factory_t>, &factory,
        &detail::multiplexerConverter, &multiplexer,
        &log_dir))
     return 0;
@@ -2309,6 +6679,226 @@ addOptimizationLogger (PyObject*, PyObject* args)
     ("(s,N)", ROBOPTIM_CORE_OPTIMIZATION_LOGGER_CAPSULE_NAME, loggerPy);
 }
 
+static PyObject*
+removeOptimizationLoggers (PyObject*, PyObject* args)
+{
+  ::roboptim::core::python::Multiplexer<solver_t>* multiplexer = 0;
+
+  if (!PyArg_ParseTuple
+      (args, "O&:removeOptimizationLoggers",
+       &detail::multiplexerConverter, &multiplexer))
+    return 0;
+
+  multiplexer->removeLoggers ();
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject*
+addBinaryLogger (PyObject*, PyObject* args)
+{
+  factory_t* factory = 0;
+  ::roboptim::core::python::Multiplexer<solver_t>* multiplexer = 0;
+  const char* directory = 0;
+  PyObject* parametersPy = 0;
+
+  if (!PyArg_ParseTuple
+      (args, "O&O&sO!:addBinaryLogger",
+       &detail::factoryConverter<factory_t>, &factory,
+       &detail::multiplexerConverter, &multiplexer,
+       &directory, &PyList_Type, &parametersPy))
+    return 0;
+
+  std::vector<std::string> parameters;
+  for (Py_ssize_t i = 0; i < PyList_Size (parametersPy); ++i)
+    {
+      std::string name = ::roboptim::python::toString
+	(PyList_GetItem (parametersPy, i));
+      if (PyErr_Occurred ())
+	return 0;
+      parameters.push_back (name);
+    }
+
+  binaryLogger_t* logger = 0;
+  try
+    {
+      logger = new binaryLogger_t
+	(directory,
+	 static_cast<std::size_t>
+	 ((*factory) ().problem ().function ().inputSize ()),
+	 parameters);
+    }
+  catch (const std::exception& e)
+    {
+      PyErr_SetString (PyExc_IOError, e.what ());
+      return 0;
+    }
+
+  PyObject* loggerPy =
+    PyCapsule_New (logger, ROBOPTIM_CORE_BINARY_LOGGER_CAPSULE_NAME,
+		   &detail::destructor<binaryLogger_t>);
+
+  // Register the callback to the multiplexer
+  multiplexer->add (detail::to_shared_ptr<binaryLogger_t> (logger, loggerPy));
+
+  return Py_BuildValue
+    ("(s,N)", ROBOPTIM_CORE_BINARY_LOGGER_CAPSULE_NAME, loggerPy);
+}
+
+static PyObject*
+flushBinaryLogger (PyObject*, PyObject* args)
+{
+  PyObject* loggerPy = 0;
+  if (!PyArg_ParseTuple (args, "O:flushBinaryLogger", &loggerPy))
+    return 0;
+
+  binaryLogger_t* logger = static_cast<binaryLogger_t*>
+    (PyCapsule_GetPointer (loggerPy, ROBOPTIM_CORE_BINARY_LOGGER_CAPSULE_NAME));
+  if (!logger)
+    return 0;
+
+  try
+    {
+      logger->flush ();
+    }
+  catch (const std::exception& e)
+    {
+      PyErr_SetString (PyExc_IOError, e.what ());
+      return 0;
+    }
+
+  // (name, path) of each logged quantity.
+  const std::vector<std::string>& paths = logger->paths ();
+  const char* names[] = {"x", "cost", "constraint_violation"};
+  PyObject* result = PyList_New (static_cast<Py_ssize_t> (paths.size ()));
+  if (!result)
+    return 0;
+
+  for (std::size_t i = 0; i < paths.size (); ++i)
+    {
+      const char* name =
+	(i < 3) ? names[i] : logger->parameters ()[i - 3].c_str ();
+      PyObject* item = Py_BuildValue ("(ss)", name, paths[i].c_str ());
+      if (!item)
+	{
+	  Py_DECREF (result);
+	  return 0;
+	}
+      PyList_SET_ITEM (result, static_cast<Py_ssize_t> (i), item);
+    }
+  return result;
+}
+
+
+static PyObject*
+addStopCallback (PyObject*, PyObject* args)
+{
+  ::roboptim::core::python::Multiplexer<solver_t>* multiplexer = 0;
+
+  if (!PyArg_ParseTuple
+      (args, "O&:addStopCallback",
+       &detail::multiplexerConverter, &multiplexer))
+    return 0;
+
+  stopCallback_t* callback = new stopCallback_t ();
+  PyObject* callbackPy =
+    PyCapsule_New (callback, ROBOPTIM_CORE_STOP_CALLBACK_CAPSULE_NAME,
+		   &detail::destructor<stopCallback_t>);
+  if (!callbackPy)
+    return 0;
+
+  // Register the callback to the multiplexer
+  multiplexer->add (detail::to_shared_ptr<stopCallback_t>
+		    (callback, callbackPy));
+
+  return callbackPy;
+}
+
+namespace detail
+{
+  int
+  stopCallbackConverter (PyObject* obj, stopCallback_t** address)
+  {
+    assert (address);
+    stopCallback_t* ptr = static_cast<stopCallback_t*>
+      (PyCapsule_GetPointer (obj, ROBOPTIM_CORE_STOP_CALLBACK_CAPSULE_NAME));
+    if (!ptr)
+      {
+	PyErr_SetString
+	  (PyExc_TypeError,
+	   "Stop callback object expected but another type was passed");
+	return 0;
+      }
+    *address = ptr;
+    return 1;
+  }
+} // end of namespace detail.
+
+static PyObject*
+requestStop (PyObject*, PyObject* args)
+{
+  stopCallback_t* callback = 0;
+  if (!PyArg_ParseTuple (args, "O&:requestStop",
+			 &detail::stopCallbackConverter, &callback))
+    return 0;
+
+  callback->requestStop ();
+
+  Py_INCREF (Py_None);
+  return Py_None;
+}
+
+static PyObject*
+setStopDeadline (PyObject*, PyObject* args)
+{
+  stopCallback_t* callback = 0;
+  double timeout = 0.;
+  if (!PyArg_ParseTuple (args, "O&d:setStopDeadline",
+			 &detail::stopCallbackConverter, &callback, &timeout))
+    return 0;
+
+  // The deadline is given in seconds from now (<= 0: no deadline).
+  boost::uint64_t deadline = 0;
+  if (timeout > 0.)
+    deadline = ::roboptim::core::python::clockNanoseconds ()
+      + static_cast<boost::uint64_t> (timeout * 1e9);
+  callback->setDeadline (deadline);
+
+  Py_INCREF (Py_None);
+  return Py_None;
+}
+
+static PyObject*
+resetStopCallback (PyObject*, PyObject* args)
+{
+  stopCallback_t* callback = 0;
+  if (!PyArg_ParseTuple (args, "O&:resetStopCallback",
+			 &detail::stopCallbackConverter, &callback))
+    return 0;
+
+  callback->reset ();
+
+  Py_INCREF (Py_None);
+  return Py_None;
+}
+
+static PyObject*
+getStopProgress (PyObject*, PyObject* args)
+{
+  stopCallback_t* callback = 0;
+  if (!PyArg_ParseTuple (args, "O&:getStopProgress",
+			 &detail::stopCallbackConverter, &callback))
+    return 0;
+
+  const stopCallback_t::Progress progress = callback->progress ();
+  return Py_BuildValue
+    ("{s:K,s:d,s:d,s:O}",
+     "iterations", static_cast<unsigned long long> (progress.iterations),
+     "cost", progress.cost,
+     "constraintViolation", progress.constraintViolation,
+     "stopped", progress.stopped ? Py_True : Py_False);
+}
 
 static PyObject*
 getStateParameter (const stateParameter_t& parameter)
@@ -2316,16 +6906,16 @@ getStateParameter (const stateParameter_t& parameter)
   PyObject* description = PyString_FromString (parameter.description.c_str ());
   PyObject* value = boost::apply_visitor (detail::StateParameterValueVisitor (),
                                           parameter.value);
-
-  return PyTuple_Pack (2, description, value);
+  return detail::pairSteal (description, value);
 }
 
 static PyObject*
 getSolverStateParameters (PyObject*, PyObject* args)
 {
+  PyObject* statePy = 0;
   solverState_t* state = 0;
-  if (!PyArg_ParseTuple (args, "O&",
-			 &detail::solverStateConverter, &state))
+  if (!PyArg_ParseTuple (args, "O", &statePy)
+      || !detail::solverStateConverter (statePy, &state))
     return 0;
 
   if (!state)
@@ -2337,25 +6927,39 @@ getSolverStateParameters (PyObject*, PyObject* args)
   // In C++, parameters are: std::map<std::string, Parameter>
   PyObject* parameters = PyDict_New ();
 
-  for (stateParameters_t::const_iterator iter = state->parameters ().begin ();
+  for (stateParameters_t::iterator iter = state->parameters ().begin ();
        iter != state->parameters ().end (); iter++)
     {
+      // Vectors are viewed like x.
+      Function::vector_t* v =
+	boost::get<Function::vector_t> (&iter->second.value);
+      PyObject* parameter = v
+	? detail::pairSteal (PyString_FromString
+			     (iter->second.description.c_str ()),
+			     detail::stateVector (statePy, *v))
+	: getStateParameter (iter->second);
+
       // Insert object to Python dictionary
-      PyDict_SetItemString (parameters, (iter->first).c_str (),
-                            getStateParameter (iter->second));
+      if (detail::setItemSteal (parameters, (iter->first).c_str (),
+				parameter) < 0)
+	{
+	  Py_DECREF (parameters);
+	  return 0;
+	}
     }
 
-  return Py_BuildValue ("O", parameters);
+  return parameters;
 }
 
 static PyObject*
 setSolverStateParameters (PyObject*, PyObject* args)
 {
+  PyObject* statePy = 0;
   solverState_t* state = 0;
   PyObject* py_parameters = 0;
 
-  if (!PyArg_ParseTuple (args, "O&O",
-			 &detail::solverStateConverter, &state, &py_parameters))
+  if (!PyArg_ParseTuple (args, "OO", &statePy, &py_parameters)
+      || !detail::solverStateConverter (statePy, &state))
     return 0;
 
   if (!state)
@@ -2370,6 +6974,15 @@ setSolverStateParameters (PyObject*, PyObject* args)
       return 0;
     }
 
+  // The views on the vector parameters are released before their vectors
+  // are destroyed.
+  ::roboptim::core::python::stateViews_t* views =
+    static_cast< ::roboptim::core::python::stateViews_t*>
+    (reinterpret_cast< ::roboptim::core::python::NativeObject*>
+     (statePy)->context);
+  if (views)
+    ::roboptim::core::python::releaseStateViews (*views, &state->x ());
+
   // In C++, parameters are: std::map<std::string, Parameter>
   stateParameters_t& parameters = state->parameters ();
   parameters.clear ();
@@ -2424,9 +7037,10 @@ setSolverStateParameters (PyObject*, PyObject* args)
 static PyObject*
 getSolverStateX (PyObject*, PyObject* args)
 {
+  PyObject* statePy = 0;
   solverState_t* state = 0;
-  if (!PyArg_ParseTuple (args, "O&",
-			 &detail::solverStateConverter, &state))
+  if (!PyArg_ParseTuple (args, "O", &statePy)
+      || !detail::solverStateConverter (statePy, &state))
     return 0;
 
   if (!state)
@@ -2435,9 +7049,8 @@ getSolverStateX (PyObject*, PyObject* args)
       return 0;
     }
 
-  npy_intp n = static_cast<npy_intp> (state->x ().size ());
-  PyObject* vec = PyArray_SimpleNewFromData (1, &n,
-                                             NPY_DOUBLE, state->x ().data ());
+  // View on the state, valid until the iteration callback returns.
+  PyObject* vec = detail::stateVector (statePy, state->x ());
   if (!vec)
     {
       PyErr_SetString (PyExc_TypeError, "cannot convert state.x");
@@ -2591,80 +7204,74 @@ setSolverStateConstraintViolation (PyObject*, PyObject* args)
 }
 
 
+namespace detail
+{
+  /// \brief Attributes of a result, see resultAttribute.
+  static const char* resultAttributes[] =
+    {"inputSize", "outputSize", "x", "value", "constraints",
+     "constraint_violation", "lambda", "warnings", 0};
+
+  /// \brief Convert one attribute of a result.
+  ///
+  /// Vectors are views on the result, whose owner is the base object.
+  ///
+  /// \return new reference, or 0 on error (KeyError for unknown names).
+  PyObject*
+  resultAttribute (const result_t& result, const std::string& name,
+		   PyObject* owner)
+  {
+    if (name == "inputSize")
+      return PyInt_FromLong (static_cast<long> (result.inputSize));
+    if (name == "outputSize")
+      return PyInt_FromLong (static_cast<long> (result.outputSize));
+    if (name == "x")
+      return ownedVector (result.x, owner);
+    if (name == "value")
+      return ownedVector (result.value, owner);
+    if (name == "constraints")
+      return ownedVector (result.constraints, owner);
+    if (name == "constraint_violation")
+      return PyFloat_FromDouble (result.constraint_violation);
+    if (name == "lambda")
+      return ownedVector (result.lambda, owner);
+    if (name == "warnings")
+      {
+	// Warnings stored as a list
+	PyObject* warnings = PyList_New (result.warnings.size ());
+	for (size_t i = 0; i < result.warnings.size (); ++i)
+	  {
+	    PyList_SetItem (warnings, i,
+			    PyString_FromString (result.warnings[i].what ()));
+	  }
+	return warnings;
+      }
+
+    PyErr_Format (PyExc_KeyError, "unknown result attribute: %s",
+		  name.c_str ());
+    return 0;
+  }
+} // end of namespace detail.
+
 template <typename T>
 PyObject*
-toDict (T& obj);
+toDict (T& obj, PyObject* owner);
 
 template <>
 PyObject*
-toDict<result_t> (result_t& result)
+toDict<result_t> (result_t& result, PyObject* owner)
 {
-  // In C++, parameters are: std::map<std::string, Parameter>
   PyObject* dict_result = PyDict_New ();
 
-  PyDict_SetItemString (dict_result, "inputSize",
-                        PyInt_FromLong (result.inputSize));
-  PyDict_SetItemString (dict_result, "outputSize",
-                        PyInt_FromLong (result.outputSize));
-
-
-  npy_intp npy_size = static_cast<npy_intp> (result.x.size ());
-  PyObject* xNumpy =
-    PyArray_SimpleNewFromData (1, &npy_size,
-			       NPY_DOUBLE, result.x.data ());
-  if (!xNumpy)
-    {
-      PyErr_SetString (PyExc_TypeError, "cannot convert result.x");
-      return 0;
-    }
-  PyDict_SetItemString (dict_result, "x", xNumpy);
-
-  npy_size = static_cast<npy_intp> (result.value.size ());
-  PyObject* valueNumpy =
-    PyArray_SimpleNewFromData (1, &npy_size,
-			       NPY_DOUBLE, result.value.data ());
-  if (!valueNumpy)
-    {
-      PyErr_SetString (PyExc_TypeError, "cannot convert result.value");
-      return 0;
-    }
-  PyDict_SetItemString (dict_result, "value", valueNumpy);
-
-  npy_size = static_cast<npy_intp> (result.constraints.size ());
-  PyObject* constraintsNumpy =
-    PyArray_SimpleNewFromData (1, &npy_size,
-			       NPY_DOUBLE, result.constraints.data ());
-  if (!constraintsNumpy)
-    {
-      PyErr_SetString (PyExc_TypeError, "cannot convert result.constraints");
-      return 0;
-    }
-  PyDict_SetItemString (dict_result, "constraints", constraintsNumpy);
-
-  PyDict_SetItemString (dict_result, "constraint_violation",
-                        PyFloat_FromDouble (result.constraint_violation));
-
-  npy_size = static_cast<npy_intp> (result.lambda.size ());
-  PyObject* lambdaNumpy =
-    PyArray_SimpleNewFromData (1, &npy_size,
-			       NPY_DOUBLE, result.lambda.data ());
-  if (!lambdaNumpy)
-    {
-      PyErr_SetString (PyExc_TypeError, "cannot convert result.lambda");
-      return 0;
-    }
-  PyDict_SetItemString (dict_result, "lambda", lambdaNumpy);
-
-  // Warnings stored as a list
-  PyObject* warnings = PyList_New (result.warnings.size ());
-  for (size_t i = 0; i < result.warnings.size (); ++i)
-    {
-      PyList_SetItem (warnings, i,
-                      PyString_FromString (result.warnings[i].what ()));
-    }
-  PyDict_SetItemString (dict_result, "warnings", warnings);
+  for (const char** name = detail::resultAttributes; *name; ++name)
+    if (detail::setItemSteal
+	(dict_result, *name,
+	 detail::resultAttribute (result, *name, owner)) < 0)
+      {
+	Py_DECREF (dict_result);
+	return 0;
+      }
 
-  return Py_BuildValue ("O", dict_result);
+  return dict_result;
 }
 
 
@@ -2676,10 +7283,11 @@ template <>
 PyObject*
 toDict<result_t> (PyObject*, PyObject* args)
 {
+  PyObject* resultPy = 0;
   result_t* result = 0;
 
-  if (!PyArg_ParseTuple (args, "O&",
-			 &detail::resultConverter, &result))
+  if (!PyArg_ParseTuple (args, "O", &resultPy)
+      || !detail::resultConverter (resultPy, &result))
     return 0;
 
   if (!result)
@@ -2688,17 +7296,18 @@ toDict<result_t> (PyObject*, PyObject* args)
       return 0;
     }
 
-  return toDict<result_t> (*result);
+  return toDict<result_t> (*result, resultPy);
 }
 
 template <>
 PyObject*
 toDict<solverError_t> (PyObject*, PyObject* args)
 {
+  PyObject* errorPy = 0;
   solverError_t* error = 0;
 
-  if (!PyArg_ParseTuple (args, "O&",
-			 &detail::solverErrorConverter, &error))
+  if (!PyArg_ParseTuple (args, "O", &errorPy)
+      || !detail::solverErrorConverter (errorPy, &error))
     return 0;
 
   if (!error)
@@ -2710,16 +7319,72 @@ toDict<solverError_t> (PyObject*, PyObject* args)
 
   PyObject* dict_error = PyDict_New ();
 
-  PyDict_SetItemString (dict_error, "error",
-                        PyString_FromString (error->what ()));
+  detail::setItemSteal (dict_error, "error",
+			PyString_FromString (error->what ()));
 
   if (error->lastState ())
     {
-      PyObject* lastState = toDict<result_t> (*(error->lastState ()));
-      PyDict_SetItemString (dict_error, "lastState", lastState);
+      PyObject* lastState = toDict<result_t> (*(error->lastState ()),
+					      errorPy);
+      if (!lastState)
+	{
+	  Py_DECREF (dict_error);
+	  return 0;
+	}
+      detail::setItemSteal (dict_error, "lastState", lastState);
+    }
+
+  return dict_error;
+}
+
+/// \brief Get one attribute of a result or solver error, without
+/// converting the others.
+///
+/// Result attributes: inputSize, outputSize, x, value, constraints,
+/// constraint_violation, lambda and warnings (vectors are views on the
+/// result). Solver error attributes: error (message) and lastState (dict
+/// of the last result attributes, or None).
+static PyObject*
+getResultAttribute (PyObject*, PyObject* args)
+{
+  PyObject* obj = 0;
+  const char* name = 0;
+  if (!PyArg_ParseTuple (args, "Os:getResultAttribute", &obj, &name))
+    return 0;
+
+  if (PyCapsule_IsValid (obj, ROBOPTIM_CORE_SOLVER_ERROR_CAPSULE_NAME))
+    {
+      solverError_t* error = 0;
+      if (!detail::solverErrorConverter (obj, &error))
+	return 0;
+
+      const std::string attribute (name);
+      if (attribute == "error")
+	return PyString_FromString (error->what ());
+      if (attribute == "lastState")
+	{
+	  if (error->lastState ())
+	    return toDict<result_t> (*(error->lastState ()), obj);
+	  Py_INCREF (Py_None);
+	  return Py_None;
+	}
+
+      PyErr_Format (PyExc_KeyError, "unknown solver error attribute: %s",
+		    name);
+      return 0;
+    }
+
+  result_t* result = 0;
+  if (!PyCapsule_IsValid (obj, ROBOPTIM_CORE_RESULT_CAPSULE_NAME))
+    {
+      PyErr_SetString (PyExc_TypeError,
+		       "1st argument must be a result or a solver error.");
+      return 0;
     }
+  if (!detail::resultConverter (obj, &result))
+    return 0;
 
-  return Py_BuildValue ("O", dict_error);
+  return detail::resultAttribute (*result, name, obj);
 }
 
 
@@ -2727,13 +7392,13 @@ template <typename T>
 PyObject*
 print (PyObject*, PyObject* args);
 
-template <>
-PyObject*
-print<problem_t> (PyObject*, PyObject* args)
+template <typename P>
+static PyObject*
+printProblem (PyObject*, PyObject* args)
 {
-  problem_t* obj = 0;
+  P* obj = 0;
   if (!PyArg_ParseTuple
-      (args, "O&", &detail::problemConverter, &obj))
+      (args, "O&", &detail::problemConverter<P>, &obj))
     return 0;
   if (!obj)
     {
@@ -2747,13 +7412,13 @@ print<problem_t> (PyObject*, PyObject* args)
   return Py_BuildValue ("s", ss.str ().c_str ());
 }
 
-template <>
-PyObject*
-print<factory_t> (PyObject*, PyObject* args)
+template <typename F>
+static PyObject*
+printSolver (PyObject*, PyObject* args)
 {
-  factory_t* obj = 0;
+  F* obj = 0;
   if (!PyArg_ParseTuple
-      (args, "O&", &detail::factoryConverter, &obj))
+      (args, "O&", &detail::factoryConverter<F>, &obj))
     return 0;
   if (!obj)
     {
@@ -2847,6 +7512,130 @@ print (PyObject*, PyObject* args)
   return Py_BuildValue ("s", ss.str ().c_str ());
 }
 
+// Define a module function dispatching to its dense or sparse version,
+// depending on the problem/solver given as ARG-th argument.
+#define DEFINE_SPARSE_DISPATCH(NAME, DENSE, SPARSE, ARG)	\
+  static PyObject*						\
+  NAME (PyObject* self, PyObject* args)				\
+  {								\
+    if (detail::isSparse (args, ARG))				\
+      return NAME<SPARSE> (self, args);				\
+    return NAME<DENSE> (self, args);				\
+  }
+
+DEFINE_SPARSE_DISPATCH (createSolver, problem_t, sparseProblem_t, 1)
+DEFINE_SPARSE_DISPATCH (problemHasHessian, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (getStartingPoint, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (setStartingPoint, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (getArgumentBounds, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (setArgumentBounds, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (getArgumentScaling, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (setArgumentScaling, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (addConstraint, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (addConstraints, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (printProblem, problem_t, sparseProblem_t, 0)
+DEFINE_SPARSE_DISPATCH (isSolved, factory_t, sparseFactory_t, 0)
+DEFINE_SPARSE_DISPATCH (solve, factory_t, sparseFactory_t, 0)
+DEFINE_SPARSE_DISPATCH (minimum, factory_t, sparseFactory_t, 0)
+DEFINE_SPARSE_DISPATCH (getSolverParameters, factory_t, sparseFactory_t, 0)
+DEFINE_SPARSE_DISPATCH (setSolverParameters, factory_t, sparseFactory_t, 0)
+DEFINE_SPARSE_DISPATCH (setSolverParameter, factory_t, sparseFactory_t, 0)
+DEFINE_SPARSE_DISPATCH (printSolver, factory_t, sparseFactory_t, 0)
+
+namespace roboptim
+{
+  namespace core
+  {
+    namespace python
+    {
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+      // Set up when the module is initialized, see detail::addType.
+      PyTypeObject functionType = {PyVarObject_HEAD_INIT (0, 0)};
+      PyTypeObject problemType = {PyVarObject_HEAD_INIT (0, 0)};
+      PyTypeObject solverType = {PyVarObject_HEAD_INIT (0, 0)};
+      PyTypeObject solverStateType = {PyVarObject_HEAD_INIT (0, 0)};
+# pragma GCC diagnostic pop
+
+      PyObject* newObject (PyTypeObject* type, void* pointer, const char* tag,
+                           void (*release) (void*))
+      {
+        NativeObject* object = PyObject_New (NativeObject, type);
+        if (!object)
+          return 0;
+
+        object->pointer = pointer;
+        object->tag = tag;
+        object->release = release;
+        object->context = 0;
+        return reinterpret_cast<PyObject*> (object);
+      }
+    } // end of namespace python
+  } // end of namespace core
+} // end of namespace roboptim
+
+namespace detail
+{
+  void
+  deallocObject (PyObject* obj)
+  {
+    rcp::NativeObject* object = reinterpret_cast<rcp::NativeObject*> (obj);
+    if (object->release && object->pointer)
+      object->release (object->pointer);
+    PyObject_Del (obj);
+  }
+
+  PyMethodDef functionMethods[] =
+    {
+#ifdef ROBOPTIM_CORE_PYTHON_FASTCALL
+      {"compute", reinterpret_cast<PyCFunction> (functionCompute),
+       METH_FASTCALL,
+       "compute (result, x): evaluate the function (output allocated if"
+       " None)."},
+      {"gradient", reinterpret_cast<PyCFunction> (functionGradient),
+       METH_FASTCALL,
+       "gradient (result, x, functionId): evaluate a gradient (output"
+       " allocated if None)."},
+      {"jacobian", reinterpret_cast<PyCFunction> (functionJacobian),
+       METH_FASTCALL,
+       "jacobian (result, x): evaluate the Jacobian (output allocated if"
+       " None)."},
+#else
+      {"compute", functionCompute, METH_VARARGS,
+       "compute (result, x): evaluate the function (output allocated if"
+       " None)."},
+      {"gradient", functionGradient, METH_VARARGS,
+       "gradient (result, x, functionId): evaluate a gradient (output"
+       " allocated if None)."},
+      {"jacobian", functionJacobian, METH_VARARGS,
+       "jacobian (result, x): evaluate the Jacobian (output allocated if"
+       " None)."},
+#endif //! ROBOPTIM_CORE_PYTHON_FASTCALL
+      {0, 0, 0, 0}
+    };
+
+  /// \brief Set up the type of a native object, and add it to the module.
+  /// The type cannot be instantiated or subclassed from Python.
+  /// \return false on error.
+  bool
+  addType (PyObject* module, PyTypeObject& type, const char* name,
+	   const char* doc, PyMethodDef* methods = 0)
+  {
+    type.tp_name = name;
+    type.tp_basicsize = sizeof (rcp::NativeObject);
+    type.tp_dealloc = &deallocObject;
+    type.tp_flags = Py_TPFLAGS_DEFAULT;
+    type.tp_doc = doc;
+    type.tp_methods = methods;
+    if (PyType_Ready (&type) < 0)
+      return false;
+
+    Py_INCREF (&type);
+    return PyModule_AddObject (module, std::strrchr (name, '.') + 1,
+			       reinterpret_cast<PyObject*> (&type)) == 0;
+  }
+} // end of namespace detail.
+
 static PyMethodDef RobOptimCoreMethods[] =
   {
     {"Function", createFunction<Function>, METH_VARARGS,
@@ -2862,25 +7651,94 @@ static PyMethodDef RobOptimCoreMethods[] =
 
     {"DifferentiableFunction", createFunction<DifferentiableFunction>,
      METH_VARARGS, "Create a DifferentiableFunction object."},
+    {"SparseDifferentiableFunction", createFunction<SparseDifferentiableFunction>,
+     METH_VARARGS, "Create a differentiable function with a sparse Jacobian."},
     {"TwiceDifferentiableFunction", createFunction<TwiceDifferentiableFunction>,
      METH_VARARGS, "Create a TwiceDifferentiableFunction object."},
     {"Problem", createProblem, METH_VARARGS,
      "Create a Problem object."},
     {"Solver", createSolver, METH_VARARGS,
-     "Create a Solver object through the solver factory."},
+     "Create a Solver object through the solver factory, optionally copying"
+     " the parameters of another solver."},
+#ifdef ROBOPTIM_CORE_PYTHON_FASTCALL
+    {"compute", reinterpret_cast<PyCFunction> (computeFast), METH_FASTCALL,
+     "Evaluate a function (output allocated if None)."},
+    {"gradient", reinterpret_cast<PyCFunction> (gradientFast), METH_FASTCALL,
+     "Evaluate a function gradient (output allocated if None)."},
+    {"jacobian", reinterpret_cast<PyCFunction> (jacobianFast), METH_FASTCALL,
+     "Evaluate a function Jacobian (output allocated if None)."},
+#else
     {"compute", compute, METH_VARARGS,
-     "Evaluate a function."},
+     "Evaluate a function (output allocated if None)."},
     {"gradient", gradient, METH_VARARGS,
-     "Evaluate a function gradient."},
+     "Evaluate a function gradient (output allocated if None)."},
     {"jacobian", jacobian, METH_VARARGS,
-     "Evaluate a function Jacobian."},
+     "Evaluate a function Jacobian (output allocated if None)."},
+#endif //! ROBOPTIM_CORE_PYTHON_FASTCALL
+    {"hessian", hessian, METH_VARARGS,
+     "Evaluate a function Hessian."},
+    {"computeBatch", computeBatch, METH_VARARGS,
+     "Evaluate a function over a batch of points."},
+    {"gradientBatch", gradientBatch, METH_VARARGS,
+     "Evaluate a function gradient over a batch of points."},
+    {"jacobianBatch", jacobianBatch, METH_VARARGS,
+     "Evaluate a function Jacobian over a batch of points."},
     {"bindCompute", bindCompute, METH_VARARGS,
-     "Bind a Python function to function computation."},
+     "Bind a Python function or a native function pointer (with optional"
+     " user data) to function computation."},
     {"bindGradient", bindGradient, METH_VARARGS,
-     "Bind a Python function to gradient computation."},
+     "Bind a Python function or a native function pointer (with optional"
+     " user data) to gradient computation."},
     {"bindJacobian", bindJacobian, METH_VARARGS,
-     "Bind a Python function to Jacobian computation."},
-
+     "Bind a Python function or a native function pointer (with optional"
+     " user data) to Jacobian computation."},
+    {"bindHessian", bindHessian, METH_VARARGS,
+     "Bind a Python function to Hessian computation."},
+    {"setSparsityPattern", setSparsityPattern, METH_VARARGS,
+     "Set the Jacobian sparsity pattern of a sparse or finite-difference function."},
+    {"getStats", getStats, METH_VARARGS,
+     "Get the evaluation statistics of a function."},
+    {"resetStats", resetStats, METH_VARARGS,
+     "Reset the evaluation statistics of a function."},
+    {"getCacheStats", getCacheStats, METH_VARARGS,
+     "Get the hit, miss and eviction counters of a cached function."},
+    {"resetCacheStats", resetCacheStats, METH_VARARGS,
+     "Reset the counters of a cached function."},
+    {"clearCache", clearCache, METH_VARARGS,
+     "Drop the entries of a cached function."},
+    {"enableStats", enableStats, METH_VARARGS,
+     "Enable or disable the evaluation statistics of a function."},
+    {"setStrictArrays", setStrictArrays, METH_VARARGS,
+     "Raise instead of copying arrays given to evaluations of a function."},
+    {"getStrictArrays", getStrictArrays, METH_VARARGS,
+     "Whether the strict array mode of a function is enabled."},
+    {"setErrorMode", setErrorMode, METH_VARARGS,
+     "Set how the errors of the callbacks of a function are reported to"
+     " solvers ('raise' or 'nan')."},
+    {"getErrorMode", getErrorMode, METH_VARARGS,
+     "Get how the errors of the callbacks of a function are reported to"
+     " solvers."},
+    {"setJacobianLayout", setJacobianLayout, METH_VARARGS,
+     "Set the layout ('C' or 'F') written by the Jacobian callbacks."},
+    {"getJacobianLayout", getJacobianLayout, METH_VARARGS,
+     "Get the layout ('C' or 'F') written by the Jacobian callbacks."},
+    {"finiteDifferenceDirections", finiteDifferenceDirections, METH_VARARGS,
+     "Get the number of perturbation directions of a finite-difference function."},
+    {"getSparsityPattern", getSparsityPattern, METH_VARARGS,
+     "Get the Jacobian sparsity pattern of a sparse function."},
+    {"sparseJacobian", sparseJacobian, METH_VARARGS,
+     "Evaluate a sparse Jacobian as (data, indices, indptr) arrays."},
+    {"bindComputeBatch", bindComputeBatch, METH_VARARGS,
+     "Bind a Python function to batch function computation."},
+    {"bindGradientBatch", bindGradientBatch, METH_VARARGS,
+     "Bind a Python function to batch gradient computation."},
+    {"bindJacobianBatch", bindJacobianBatch, METH_VARARGS,
+     "Bind a Python function to batch Jacobian computation."},
+    {"bindValueJacobian", bindValueJacobian, METH_VARARGS,
+     "Bind a Python function computing the value and the Jacobian together."},
+
+    {"problemHasHessian", problemHasHessian, METH_VARARGS,
+     "Whether the problem functions are all twice differentiable."},
     {"getStartingPoint", getStartingPoint, METH_VARARGS,
      "Get the problem starting point."},
     {"setStartingPoint", setStartingPoint, METH_VARARGS,
@@ -2895,14 +7753,27 @@ static PyMethodDef RobOptimCoreMethods[] =
      "Set the problem scaling."},
     {"addConstraint", addConstraint, METH_VARARGS,
      "Add a constraint to the problem."},
+    {"addConstraints", addConstraints, METH_VARARGS,
+     "Add several constraints to the problem, with stacked bounds and"
+     " scaling arrays."},
 
     // FunctionPool functions
     {"FunctionPool", createFunction<FunctionPool>,
      METH_VARARGS, "Create a FunctionPool object."},
+    {"getSkippedEngineCalls", getSkippedEngineCalls, METH_VARARGS,
+     "Get the number of engine evaluations skipped by a function pool."},
+    {"resetSkippedEngineCalls", resetSkippedEngineCalls, METH_VARARGS,
+     "Reset the counters of skipped engine evaluations of a function pool."},
+    {"invalidateEngine", invalidateEngine, METH_VARARGS,
+     "Evaluate the engine of a function pool again on the next calls."},
 
     // Solver functions
+    {"isSolved", isSolved, METH_VARARGS,
+     "Whether the solver has a result (solution or error)."},
     {"solve", solve, METH_VARARGS,
      "Solve the optimization problem."},
+    {"solveMultiStart", solveMultiStart, METH_VARARGS,
+     "Solve an optimization problem from several starting points in parallel."},
     {"minimum", minimum, METH_VARARGS,
      "Retrieve the optimization result."},
     {"getSolverParameters", getSolverParameters, METH_VARARGS,
@@ -2912,11 +7783,29 @@ static PyMethodDef RobOptimCoreMethods[] =
     {"setSolverParameter", setSolverParameter, METH_VARARGS,
      "Set a solver parameter."},
     {"addIterationCallback", addIterationCallback, METH_VARARGS,
-     "Add a solver iteration callback."},
+     "Add a solver iteration callback, optionally filtered (every k"
+     " iterations, on cost improvement, at most every interval seconds)."},
     {"removeIterationCallback", removeIterationCallback, METH_VARARGS,
      "Remove a solver iteration callback."},
+    {"addBinaryLogger", addBinaryLogger, METH_VARARGS,
+     "Log the iterations of a solver to .npy files."},
+    {"flushBinaryLogger", flushBinaryLogger, METH_VARARGS,
+     "Flush a binary logger, and return the (name, path) of its files."},
     {"addOptimizationLogger", addOptimizationLogger, METH_VARARGS,
      "Add an optimization logger."},
+    {"removeOptimizationLoggers", removeOptimizationLoggers, METH_VARARGS,
+     "Remove the optimization loggers, which completes their logs."},
+    {"addStopCallback", addStopCallback, METH_VARARGS,
+     "Add a native callback stopping the solver on request or deadline."},
+    {"requestStop", requestStop, METH_VARARGS,
+     "Stop the solver at the next iteration."},
+    {"setStopDeadline", setStopDeadline, METH_VARARGS,
+     "Stop the solver at the first iteration after a timeout (seconds,"
+     " <= 0: none)."},
+    {"resetStopCallback", resetStopCallback, METH_VARARGS,
+     "Clear the stop request and the progress of a stop callback."},
+    {"getStopProgress", getStopProgress, METH_VARARGS,
+     "Get the progress of the solve watched by a stop callback."},
 
     // SolverState functions
     {"getSolverStateX", getSolverStateX, METH_VARARGS,
@@ -2939,6 +7828,10 @@ static PyMethodDef RobOptimCoreMethods[] =
      "Set the solver state parameters."},
 
     // Solver callback
+    {"setMultiplexerSolver", setMultiplexerSolver, METH_VARARGS,
+     "Register the callbacks of a multiplexer to another solver."},
+    {"loadedSolverPlugins", loadedSolverPlugins, METH_NOARGS,
+     "Names of the solver plugins kept loaded by the plugin cache."},
     {"Multiplexer", createMultiplexer, METH_VARARGS,
      "Create a solver callback multiplexer."},
     {"SolverCallback", createSolverCallback<solver_t>, METH_VARARGS,
@@ -2949,6 +7842,8 @@ static PyMethodDef RobOptimCoreMethods[] =
     // Result functions
     {"resultToDict", toDict<result_t>, METH_VARARGS,
      "Convert a Result object to a Python dictionary."},
+    {"getResultAttribute", getResultAttribute, METH_VARARGS,
+     "Get one attribute of a Result or SolverError object."},
     {"solverErrorToDict", toDict<solverError_t>, METH_VARARGS,
      "Convert a SolverError object to a Python dictionary."},
 
@@ -2962,14 +7857,40 @@ static PyMethodDef RobOptimCoreMethods[] =
 
     // Decorators
     {"CachedFunction", createCachedFunction, METH_VARARGS,
-     "Create a cached function."},
+     "Create a cached function (cache size, argument tolerance, joint"
+     " value/Jacobian evaluation)."},
+    {"LinearFunction", createLinearFunction, METH_VARARGS,
+     "Create a native linear function f(x) = A x + b."},
+    {"QuadraticFunction", createQuadraticFunction, METH_VARARGS,
+     "Create a native quadratic function f(x) = 1/2 x^T A x + b^T x + c."},
+    {"ConstantFunction", createConstantFunction, METH_VARARGS,
+     "Create a native constant function (input size, offset)."},
+    {"IdentityFunction", createIdentityFunction, METH_VARARGS,
+     "Create a native identity function f(x) = x + offset."},
+    {"Chain", createChain, METH_VARARGS,
+     "Create the native composition f(g(x))."},
+    {"Plus", createSum< ::roboptim::Plus>, METH_VARARGS,
+     "Create the native sum f(x) + g(x)."},
+    {"Minus", createSum< ::roboptim::Minus>, METH_VARARGS,
+     "Create the native difference f(x) - g(x)."},
+    {"Scalar", createScalar, METH_VARARGS,
+     "Create the native function scalar * f(x) + offset."},
+    {"Selection", createSelection, METH_VARARGS,
+     "Create the native selection of the outputs [start, start + size) of"
+     " f."},
+    {"Split", createSplit, METH_VARARGS,
+     "Create the native selection of one output of f."},
+    {"Concatenation", createConcatenation, METH_VARARGS,
+     "Create the native function stacking the outputs of f and g."},
+    {"Bind", createBind, METH_VARARGS,
+     "Create the native function binding some inputs of f (None: free)."},
 
     // Print functions
     {"strFunction", print<Function>, METH_VARARGS,
      "Print a function as a Python string."},
-    {"strProblem", print<problem_t>, METH_VARARGS,
+    {"strProblem", printProblem, METH_VARARGS,
      "Print a problem as a Python string."},
-    {"strSolver", print<factory_t>, METH_VARARGS,
+    {"strSolver", printSolver, METH_VARARGS,
      "Print a solver as a Python string."},
     {"strSolverState", print<solverState_t>, METH_VARARGS,
      "Print a solver state as a Python string."},
@@ -3025,9 +7946,30 @@ namespace {
     // Initialize numpy.
     init_numpy ();
 
+#if PY_VERSION_HEX < 0x03070000
+    // Required to use the GIL from solver threads.
+    PyEval_InitThreads ();
+#endif //! PY_VERSION_HEX
+
     if (m == 0)
       return NULL;
 
+    namespace rcp = ::roboptim::core::python;
+    if (!detail::addType (m, rcp::functionType,
+			  "roboptim.core.wrap.FunctionType",
+			  "RobOptim function.", detail::functionMethods)
+	|| !detail::addType (m, rcp::problemType,
+			     "roboptim.core.wrap.ProblemType",
+			     "RobOptim problem (dense or sparse).")
+	|| !detail::addType (m, rcp::solverType,
+			     "roboptim.core.wrap.SolverType",
+			     "RobOptim solver (dense or sparse).")
+	|| !detail::addType (m, rcp::solverStateType,
+			     "roboptim.core.wrap.SolverStateType",
+			     "State of a solver, valid during an iteration"
+			     " callback."))
+      return NULL;
+
     return m;
   }
 } // end of namespace
@@ -1,14 +1,36 @@
 #ifndef ROBOPTIM_CORE_PYTHON_WRAP_HH
 # define ROBOPTIM_CORE_PYTHON_WRAP_HH
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/variant.hpp>
 #include <boost/mpl/vector.hpp>
 #include <boost/utility/enable_if.hpp>
 #include <boost/type_traits/is_same.hpp>
 #include <boost/type_traits/is_base_of.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
 
 #include <Python.h>
 
@@ -29,10 +51,10 @@
 
 #include <roboptim/core/callback/multiplexer.hh>
 
-#include <roboptim/core/decorator/cached-function.hh>
-
 #include <roboptim/core/detail/utility.hh>
 
+#include "common.hh"
+
 
 #define FORWARD_TYPEDEFS_(X)				\
   ROBOPTIM_DIFFERENTIABLE_FUNCTION_FWD_TYPEDEFS_ (X)
@@ -40,13 +62,18 @@
 #define FORWARD_TYPEDEFS(X)				\
   ROBOPTIM_DIFFERENTIABLE_FUNCTION_FWD_TYPEDEFS (X)
 
-// Capsule names
+// Capsule names. Functions, problems, solvers and solver states are native
+// objects (see NativeObject), whose tags are these names.
 static const char* ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME =
   "roboptim_core_function";
 static const char* ROBOPTIM_CORE_PROBLEM_CAPSULE_NAME =
   "roboptim_core_problem";
 static const char* ROBOPTIM_CORE_SOLVER_CAPSULE_NAME =
   "roboptim_core_solver";
+static const char* ROBOPTIM_CORE_SPARSE_PROBLEM_CAPSULE_NAME =
+  "roboptim_core_sparse_problem";
+static const char* ROBOPTIM_CORE_SPARSE_SOLVER_CAPSULE_NAME =
+  "roboptim_core_sparse_solver";
 static const char* ROBOPTIM_CORE_SOLVER_CALLBACK_CAPSULE_NAME =
   "roboptim_core_solver_callback";
 static const char* ROBOPTIM_CORE_CALLBACK_MULTIPLEXER_CAPSULE_NAME =
@@ -55,10 +82,29 @@ static const char* ROBOPTIM_CORE_SOLVER_STATE_CAPSULE_NAME =
   "roboptim_core_solver_state";
 static const char* ROBOPTIM_CORE_OPTIMIZATION_LOGGER_CAPSULE_NAME =
   "roboptim_core_optimization_logger";
+static const char* ROBOPTIM_CORE_BINARY_LOGGER_CAPSULE_NAME =
+  "roboptim_core_binary_logger";
+static const char* ROBOPTIM_CORE_STOP_CALLBACK_CAPSULE_NAME =
+  "roboptim_core_stop_callback";
 static const char* ROBOPTIM_CORE_RESULT_CAPSULE_NAME =
   "roboptim_core_result";
 static const char* ROBOPTIM_CORE_SOLVER_ERROR_CAPSULE_NAME =
   "roboptim_core_solver_error";
+static const char* ROBOPTIM_CORE_VECTOR_CAPSULE_NAME =
+  "roboptim_core_vector";
+
+// Tags of the function objects wrapping specific C++ types (the other
+// functions are tagged ROBOPTIM_CORE_FUNCTION_CAPSULE_NAME).
+static const char* ROBOPTIM_CORE_CACHED_FUNCTION_TAG =
+  "roboptim_core_cached_function";
+static const char* ROBOPTIM_CORE_NATIVE_FUNCTION_TAG =
+  "roboptim_core_native_function";
+static const char* ROBOPTIM_CORE_FUNCTION_POOL_TAG =
+  "roboptim_core_function_pool";
+static const char* ROBOPTIM_CORE_SIMPLE_FD_FUNCTION_TAG =
+  "roboptim_core_simple_fd_function";
+static const char* ROBOPTIM_CORE_FIVE_POINTS_FD_FUNCTION_TAG =
+  "roboptim_core_five_points_fd_function";
 
 
 namespace roboptim
@@ -67,9 +113,260 @@ namespace roboptim
   {
     namespace python
     {
+      /// \brief NumPy array viewing a C++ buffer, reused across calls.
+      ///
+      /// Solvers usually hand over the same buffers at every evaluation, so
+      /// the NumPy object is only rebuilt when the address, the shape or the
+      /// strides of the buffer change.
+      class NumpyView
+      {
+      public:
+        /// \param writable whether Python may write to the views (false
+        /// for arguments, so that callbacks cannot modify the iterate).
+        explicit NumpyView (bool writable = true);
+        ~NumpyView ();
+
+        /// \brief Get a view of a vector.
+        /// \param data vector data.
+        /// \param size vector size.
+        /// \return borrowed reference to the view (null on failure).
+        PyObject* vector (double* data, npy_intp size);
+
+        /// \brief Get a view of a matrix (by default stored with RobOptim's
+        /// storage order).
+        /// \param data matrix data.
+        /// \param rows number of rows.
+        /// \param cols number of columns.
+        /// \param outerStride outer stride (number of elements).
+        /// \param rowMajor whether the matrix is stored in row-major order.
+        /// \return borrowed reference to the view (null on failure).
+        PyObject* matrix (double* data, npy_intp rows, npy_intp cols,
+                          npy_intp outerStride,
+                          bool rowMajor
+                          = ::roboptim::StorageOrder == Eigen::RowMajor);
+
+        /// \brief Get a view of an index vector (e.g. sparse matrix indices).
+        /// \param data vector data.
+        /// \param size vector size.
+        /// \return borrowed reference to the view (null on failure).
+        PyObject* vector (int* data, npy_intp size);
+
+        /// \brief Get a view of a C-contiguous array.
+        /// \param data array data.
+        /// \param nd number of dimensions.
+        /// \param dims dimensions.
+        /// \return borrowed reference to the view (null on failure).
+        PyObject* array (double* data, int nd, npy_intp* dims);
+
+        /// \brief Release the cached view.
+        void reset ();
+
+      private:
+        NumpyView (const NumpyView&);
+        NumpyView& operator= (const NumpyView&);
+
+        PyObject* update (void* data, int type, int nd,
+                          npy_intp* dims, npy_intp* strides);
+
+        /// \brief Cached NumPy array.
+        PyObject* array_;
+
+        /// \brief Whether the views are writable.
+        bool writable_;
+      };
+
+      /// \brief Monotonic clock.
+      /// \return current time in nanoseconds.
+      inline boost::uint64_t clockNanoseconds ()
+      {
+        return static_cast<boost::uint64_t>
+          (boost::chrono::duration_cast<boost::chrono::nanoseconds>
+           (boost::chrono::steady_clock::now ().time_since_epoch ()).count ());
+      }
+
+      /// \brief Statistics of one kind of evaluation (e.g. gradient).
+      ///
+      /// Times are in nanoseconds. Counters are updated atomically, since a
+      /// function may be shared by several solver threads.
+      struct CallStats
+      {
+        CallStats ()
+          : calls (0), totalTime (0), maxTime (0), pythonTime (0)
+        {}
+
+        void reset ()
+        {
+          calls = totalTime = maxTime = pythonTime = 0;
+        }
+
+        void record (boost::uint64_t elapsed, boost::uint64_t python)
+        {
+          calls.fetch_add (1, boost::memory_order_relaxed);
+          totalTime.fetch_add (elapsed, boost::memory_order_relaxed);
+          pythonTime.fetch_add (python, boost::memory_order_relaxed);
+
+          boost::uint64_t current = maxTime.load (boost::memory_order_relaxed);
+          while (elapsed > current
+                 && !maxTime.compare_exchange_weak
+                 (current, elapsed, boost::memory_order_relaxed))
+            ;
+        }
+
+        /// \brief Number of calls.
+        boost::atomic<boost::uint64_t> calls;
+        /// \brief Total wall time.
+        boost::atomic<boost::uint64_t> totalTime;
+        /// \brief Maximum wall time of a call.
+        boost::atomic<boost::uint64_t> maxTime;
+        /// \brief Time spent in Python callbacks. The rest of the total
+        /// time is spent in the bridge (conversions, GIL, RobOptim).
+        boost::atomic<boost::uint64_t> pythonTime;
+      };
+
+      /// \brief Evaluation statistics of a function (disabled by default).
+      struct FunctionStats
+      {
+        FunctionStats ()
+          : enabled (false), compute (), gradient (), jacobian (), copies (0),
+            failures (0)
+        {}
+
+        void reset ()
+        {
+          compute.reset ();
+          gradient.reset ();
+          jacobian.reset ();
+          copies = failures = 0;
+        }
+
+        /// \brief Count an array converted by an evaluation entry point.
+        /// Copies are counted even if the statistics are disabled.
+        void recordCopy ()
+        {
+          copies.fetch_add (1, boost::memory_order_relaxed);
+        }
+
+        /// \brief Count a failed Python callback.
+        /// Failures are counted even if the statistics are disabled.
+        void recordFailure ()
+        {
+          failures.fetch_add (1, boost::memory_order_relaxed);
+        }
+
+        bool enabled;
+        CallStats compute;
+        CallStats gradient;
+        CallStats jacobian;
+        /// \brief Number of NumPy arrays given to compute/gradient/jacobian
+        /// that had to be copied (wrong dtype, alignment or storage order).
+        boost::atomic<boost::uint64_t> copies;
+        /// \brief Number of Python callbacks that raised.
+        boost::atomic<boost::uint64_t> failures;
+      };
+
+      /// \brief Record the duration of a scope, if statistics are enabled.
+      /// Only a branch is added otherwise.
+      class StatsTimer : boost::noncopyable
+      {
+      public:
+        StatsTimer (CallStats& stats, bool enabled)
+          : stats_ (enabled ? &stats : 0),
+            start_ (enabled ? clockNanoseconds () : 0),
+            python_ (0),
+            pythonStart_ (0)
+        {}
+
+        ~StatsTimer ()
+        {
+          if (stats_)
+            stats_->record (clockNanoseconds () - start_, python_);
+        }
+
+        /// \brief Mark the beginning of a Python callback.
+        void beginPython ()
+        {
+          if (stats_)
+            pythonStart_ = clockNanoseconds ();
+        }
+
+        /// \brief Mark the end of a Python callback.
+        void endPython ()
+        {
+          if (stats_)
+            python_ += clockNanoseconds () - pythonStart_;
+        }
+
+      private:
+        CallStats* stats_;
+        boost::uint64_t start_;
+        boost::uint64_t python_;
+        boost::uint64_t pythonStart_;
+      };
+
+      /// \brief Native evaluation callback, e.g. a numba.cfunc, a cffi
+      /// function or a ctypes CFUNCTYPE:
+      /// void (double* out, const double* x, int n, int m, void* userdata)
+      /// where n is the input size and m the output size (the output index
+      /// for gradients).
+      typedef void (*nativeCallback_t) (double*, const double*, int, int,
+                                        void*);
+
+      /// \brief Native callback bound to a function. The Python objects it
+      /// comes from are kept alive while it is bound.
+      struct NativeCallback
+      {
+        NativeCallback ()
+          : function (0), userdata (0), owner (0), userdataOwner (0)
+        {}
+
+        bool bound () const
+        {
+          return function != 0;
+        }
+
+        /// \brief Unbind the callback (requires the GIL).
+        void reset ()
+        {
+          Py_XDECREF (owner);
+          Py_XDECREF (userdataOwner);
+          *this = NativeCallback ();
+        }
+
+        /// \brief Bind a callback, the owners being borrowed references
+        /// (requires the GIL).
+        void set (nativeCallback_t f, void* data,
+                  PyObject* fOwner, PyObject* dataOwner)
+        {
+          Py_XINCREF (fOwner);
+          Py_XINCREF (dataOwner);
+          reset ();
+          function = f;
+          userdata = data;
+          owner = fOwner;
+          userdataOwner = dataOwner;
+        }
+
+        /// \brief Call the callback (without the GIL).
+        void operator() (double* out, const double* x, int n, int m) const
+        {
+          function (out, x, n, m, userdata);
+        }
+
+        nativeCallback_t function;
+        void* userdata;
+        PyObject* owner;
+        PyObject* userdataOwner;
+      };
+
       class Function : public roboptim::Function
       {
       public:
+        /// \brief Row-major matrix storing one point per row.
+        typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic,
+                              Eigen::RowMajor> batch_t;
+        typedef Eigen::Map<batch_t> batch_ref;
+        typedef Eigen::Map<const batch_t> const_batch_ref;
+
         explicit Function (size_type inputSize,
                            size_type outputSize,
                            const std::string& name);
@@ -83,6 +380,135 @@ namespace roboptim
 
         PyObject* getComputeCallback () const;
 
+        /// \brief Bind a native compute callback, called without the GIL.
+        /// It replaces the Python compute callback.
+        void setNativeComputeCallback (const NativeCallback& callback);
+
+        /// \brief Whether a native compute callback was bound.
+        bool hasNativeComputeCallback () const
+        {
+          return nativeCompute_.bound ();
+        }
+
+        /// \brief Evaluate the function over a batch of points.
+        ///
+        /// If a batch callback was bound, it is called once for the whole
+        /// batch. Otherwise, the function is evaluated point by point.
+        ///
+        /// \param values output values (one row per point).
+        /// \param X points (one row per point).
+        /// \return false if a Python error is left pending, so that the
+        /// caller does not need the GIL to check it.
+        virtual bool
+        computeBatch (batch_ref values, const_batch_ref X) const;
+
+        void setComputeBatchCallback (PyObject* callback);
+
+        /// \brief Whether a batch compute callback was bound.
+        bool hasComputeBatchCallback () const;
+
+        /// \brief Whether the function can be evaluated concurrently by
+        /// several threads. Functions relying on Python callbacks cannot.
+        virtual bool threadSafe () const
+        {
+          return nativeCompute_.bound ();
+        }
+
+        /// \brief Kind of binding, cached at construction so that the
+        /// module entry points dispatch without a dynamic_cast.
+        enum kind_t
+        {
+          KIND_FUNCTION,
+          KIND_DIFFERENTIABLE,
+          KIND_TWICE_DIFFERENTIABLE,
+          KIND_SPARSE_DIFFERENTIABLE
+        };
+
+        kind_t kind () const
+        {
+          return kind_;
+        }
+
+        /// \brief Whether this is a (dense) python::DifferentiableFunction.
+        bool isDifferentiable () const
+        {
+          return kind_ == KIND_DIFFERENTIABLE
+            || kind_ == KIND_TWICE_DIFFERENTIABLE;
+        }
+
+        /// \brief Evaluation statistics.
+        const FunctionStats& stats () const
+        {
+          return stats_;
+        }
+
+        /// \brief Enable or disable the evaluation statistics.
+        void enableStats (bool enabled)
+        {
+          stats_.enabled = enabled;
+        }
+
+        /// \brief Reset the evaluation statistics.
+        void resetStats ()
+        {
+          stats_.reset ();
+        }
+
+        /// \brief Record a hidden copy of an array given to an evaluation.
+        void recordCopy () const
+        {
+          stats_.recordCopy ();
+        }
+
+        /// \brief Whether arrays that would be copied are rejected.
+        bool strictArrays () const
+        {
+          return strictArrays_;
+        }
+
+        /// \brief In strict mode, NumPy arrays given to compute, gradient
+        /// and jacobian must have the expected dtype and storage order: a
+        /// ValueError is raised instead of silently copying them.
+        void setStrictArrays (bool strict)
+        {
+          strictArrays_ = strict;
+        }
+
+        /// \brief How the errors raised by the Python callbacks are
+        /// reported to the solvers.
+        enum errorMode_t
+        {
+          /// \brief Abort the solve: a PythonError is thrown through the
+          /// solver, and the Python exception is raised again by solve.
+          ERROR_RAISE,
+          /// \brief Recoverable evaluation failure: the output is filled
+          /// with NaN, that solvers such as Ipopt handle by backtracking.
+          ERROR_NAN
+        };
+
+        errorMode_t errorMode () const
+        {
+          return errorMode_;
+        }
+
+        void setErrorMode (errorMode_t mode)
+        {
+          errorMode_ = mode;
+        }
+
+        /// \brief Temporary of the matrix evaluations (Jacobian, Hessian)
+        /// into arrays with runtime strides, kept between calls.
+        struct MatrixBuffer
+        {
+          boost::mutex mutex;
+          matrix_t matrix;
+        };
+
+        MatrixBuffer& matrixBuffer () const
+        {
+          return matrixBuffer_;
+        }
+
         ROBOPTIM_DEFINE_FLAG_TYPE();
         virtual flag_t getFlags() const
         {
@@ -90,8 +516,44 @@ namespace roboptim
         }
         static const flag_t flags = ::roboptim::Function::flags;
 
+      protected:
+        /// \brief Kind of binding, set by the constructors.
+        kind_t kind_;
+
+        /// \brief Evaluation statistics.
+        mutable FunctionStats stats_;
+
+        /// \brief Strict mode for the arrays given to evaluations.
+        bool strictArrays_;
+
+        /// \brief Error reporting mode of the callbacks.
+        errorMode_t errorMode_;
+
+        /// \brief Report the error raised by a Python callback (if any),
+        /// the GIL being held.
+        ///
+        /// Within an ErrorScope (e.g. during a solve or a direct evaluation),
+        /// the exception is moved to the scope, and a PythonError is thrown
+        /// in ERROR_RAISE mode. Otherwise, the exception is left pending and
+        /// a PythonError is thrown in both modes.
+        ///
+        /// \return whether the output must be filled with NaN.
+        bool checkCallbackError () const;
+
       private:
         PyObject* computeCallback_;
+        PyObject* computeBatchCallback_;
+        NativeCallback nativeCompute_;
+
+        /// \brief Views given to the compute callback.
+        mutable NumpyView resultView_;
+        mutable NumpyView argumentView_;
+
+        /// \brief Views given to the batch compute callback.
+        mutable NumpyView batchResultView_;
+        mutable NumpyView batchArgumentView_;
+
+        mutable MatrixBuffer matrixBuffer_;
       };
 
       class DifferentiableFunction
@@ -134,6 +596,69 @@ namespace roboptim
         void
 	setJacobianCallback (PyObject* callback);
 
+        /// \brief Bind a native gradient callback (m is the output index).
+        void setNativeGradientCallback (const NativeCallback& callback);
+
+        /// \brief Bind a native Jacobian callback: the (m x n) Jacobian is
+        /// written contiguously, in the Jacobian layout (see
+        /// setJacobianRowMajor).
+        void setNativeJacobianCallback (const NativeCallback& callback);
+
+        /// \brief Set the layout written by the Jacobian callbacks.
+        ///
+        /// By default, the Python callback receives a view of the solver
+        /// buffer and native callbacks write it directly, in RobOptim's
+        /// storage order. If the other layout is declared, the callbacks
+        /// write a contiguous buffer in that layout instead, which is then
+        /// assigned natively to the solver buffer, so that kernels producing
+        /// the other layout do not need to transpose their output.
+        ///
+        /// \param rowMajor whether callbacks write row-major Jacobians.
+        void setJacobianRowMajor (bool rowMajor);
+
+        /// \brief Whether the Jacobian callbacks write row-major Jacobians.
+        bool jacobianRowMajor () const;
+
+        /// \brief Native functions are thread-safe if no Python callback is
+        /// used for the value and the derivatives.
+        virtual bool threadSafe () const;
+
+        /// \brief Evaluate a gradient over a batch of points.
+        /// \param gradients output gradients (one row per point).
+        /// \param X points (one row per point).
+        /// \param functionId output index.
+        virtual void
+        gradientBatch (batch_ref gradients, const_batch_ref X,
+                       size_type functionId) const;
+
+        /// \brief Evaluate the Jacobian over a batch of points.
+        /// \param jacobians output Jacobians: each row stores a row-major
+        /// (outputSize x inputSize) Jacobian.
+        /// \param X points (one row per point).
+        virtual void
+        jacobianBatch (batch_ref jacobians, const_batch_ref X) const;
+
+        void
+	setGradientBatchCallback (PyObject* callback);
+
+        void
+	setJacobianBatchCallback (PyObject* callback);
+
+        /// \brief Bind a callback evaluating the value and the Jacobian in
+        /// one call, as callback (result, jacobian, x).
+        void setValueJacobianCallback (PyObject* callback);
+
+        /// \brief Whether a value and Jacobian callback was bound.
+        bool hasValueJacobianCallback () const
+        {
+          return valueJacobianCallback_ != 0;
+        }
+
+        /// \brief Evaluate the value and the Jacobian, in one call of the
+        /// value and Jacobian callback if it was bound.
+        void valueJacobian (result_ref result, jacobian_ref jacobian,
+                            const_argument_ref argument) const;
+
         ROBOPTIM_DEFINE_FLAG_TYPE();
         virtual flag_t getFlags() const
         {
@@ -144,6 +669,45 @@ namespace roboptim
       private:
         PyObject* gradientCallback_;
         PyObject* jacobianCallback_;
+        PyObject* gradientBatchCallback_;
+        PyObject* jacobianBatchCallback_;
+        PyObject* valueJacobianCallback_;
+        NativeCallback nativeGradient_;
+        NativeCallback nativeJacobian_;
+
+        /// \brief Jacobian in the other storage order.
+        typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic,
+                              jacobian_t::IsRowMajor
+                              ? Eigen::ColMajor : Eigen::RowMajor>
+        otherOrderJacobian_t;
+
+        /// \brief Declared layout of the Jacobian callbacks.
+        bool jacobianRowMajor_;
+
+        /// \brief Whether the Jacobian callbacks write a buffer in the other
+        /// storage order.
+        bool jacobianOtherOrder_;
+
+        /// \brief Buffer of the Python Jacobian callback in the other
+        /// storage order (protected by the GIL).
+        mutable otherOrderJacobian_t otherOrderJacobian_;
+
+        /// \brief Views given to the gradient callback.
+        mutable NumpyView gradientView_;
+        mutable NumpyView gradientArgumentView_;
+
+        /// \brief Views given to the Jacobian callback.
+        mutable NumpyView jacobianView_;
+        mutable NumpyView jacobianArgumentView_;
+
+        /// \brief View of the value given to the value and Jacobian
+        /// callback (which shares the Jacobian views).
+        mutable NumpyView valueJacobianResultView_;
+
+        /// \brief Views given to the batch callbacks.
+        mutable NumpyView batchGradientView_;
+        mutable NumpyView batchJacobianView_;
+        mutable NumpyView batchDerivativeArgumentView_;
       };
 
       class TwiceDifferentiableFunction
@@ -169,9 +733,12 @@ namespace roboptim
 
 
         virtual void
-	impl_hessian (hessian_ref /*hessian*/,
-		      const_argument_ref /*argument*/,
-		      size_type /*functionId*/) const;
+	impl_hessian (hessian_ref hessian,
+		      const_argument_ref argument,
+		      size_type functionId) const;
+
+        void
+	setHessianCallback (PyObject* callback);
 
         ROBOPTIM_DEFINE_FLAG_TYPE();
         virtual flag_t getFlags() const
@@ -182,8 +749,251 @@ namespace roboptim
 
       private:
         PyObject* hessianCallback_;
+
+        /// \brief Views given to the Hessian callback.
+        mutable NumpyView hessianView_;
+        mutable NumpyView hessianArgumentView_;
+      };
+
+      /// \brief Differentiable function with a sparse Jacobian.
+      ///
+      /// The sparsity pattern is given up front and the Jacobian structure
+      /// never changes: the Python callback receives NumPy views of the
+      /// compressed buffers (CSC, or CSR for a row-major storage order) and
+      /// fills the values in place.
+      class SparseDifferentiableFunction
+        : virtual public ::roboptim::DifferentiableSparseFunction,
+	  public ::roboptim::core::python::Function
+      {
+      public:
+        FORWARD_TYPEDEFS (::roboptim::DifferentiableSparseFunction);
+
+        explicit SparseDifferentiableFunction (size_type inputSize,
+                                               size_type outputSize,
+                                               const std::string& name);
+
+        virtual ~SparseDifferentiableFunction ();
+
+        size_type inputSize () const;
+
+        size_type outputSize () const;
+
+        const std::string& getName () const;
+
+        virtual void impl_compute (result_ref result, const_argument_ref argument)
+          const;
+
+        virtual void impl_gradient (gradient_ref gradient,
+                                    const_argument_ref argument,
+                                    size_type functionId)
+          const;
+
+        virtual void impl_jacobian (jacobian_ref jacobian,
+                                    const_argument_ref argument)
+          const;
+
+        virtual std::ostream& print (std::ostream& o) const;
+
+        /// \brief Set the Jacobian sparsity pattern.
+        /// \param pattern matrix storing the structural non-zeros.
+        void setSparsityPattern (const jacobian_t& pattern);
+
+        const jacobian_t& sparsityPattern () const;
+
+        void
+	setJacobianCallback (PyObject* callback);
+
+        ROBOPTIM_DEFINE_FLAG_TYPE();
+        virtual flag_t getFlags() const
+        {
+          return flags;
+        }
+        static const flag_t flags = ::roboptim::DifferentiableSparseFunction::flags;
+
+      private:
+        /// \brief Evaluate the Jacobian callback.
+        /// \return whether the evaluation succeeded.
+        bool evaluateJacobian (jacobian_ref jacobian,
+                               const_argument_ref argument) const;
+
+        PyObject* jacobianCallback_;
+
+        /// \brief Sparsity pattern (compressed, with zero values).
+        jacobian_t pattern_;
+
+        /// \brief Last Jacobian evaluated for the gradients, and its
+        /// argument: solvers usually ask for the gradients of all the
+        /// outputs at the same point.
+        mutable jacobian_t gradientJacobian_;
+        mutable vector_t gradientX_;
+        mutable bool hasGradientJacobian_;
+        mutable boost::mutex gradientMutex_;
+
+        /// \brief Views given to the Jacobian callback.
+        mutable NumpyView dataView_;
+        mutable NumpyView indicesView_;
+        mutable NumpyView indptrView_;
+        mutable NumpyView jacobianArgumentView_;
+      };
+
+      /// \brief Dense differentiable function seen as a sparse one, so that
+      /// dense costs and constraints can be used in sparse problems.
+      class SparseAdapter : public ::roboptim::DifferentiableSparseFunction
+      {
+      public:
+        typedef ::roboptim::DifferentiableFunction dense_t;
+        typedef boost::shared_ptr<dense_t> dense_ptr;
+
+        explicit SparseAdapter (const dense_ptr& function);
+
+        virtual ~SparseAdapter ();
+
+      protected:
+        virtual void impl_compute (result_ref result, const_argument_ref x)
+          const;
+
+        virtual void impl_gradient (gradient_ref gradient,
+                                    const_argument_ref x,
+                                    size_type functionId = 0) const;
+
+        virtual void impl_jacobian (jacobian_ref jacobian,
+                                    const_argument_ref x) const;
+
+      private:
+        /// \brief Values of a full Jacobian in the sparse storage order.
+        typedef Eigen::Matrix<value_type, Eigen::Dynamic, Eigen::Dynamic,
+                              jacobian_t::IsRowMajor
+                              ? Eigen::RowMajor : Eigen::ColMajor>
+        values_t;
+
+        dense_ptr function_;
+
+        /// \brief Full structures, given to the outputs once so that
+        /// solvers fixing the structure on the first evaluation (e.g.
+        /// Ipopt) always see the same one. Only the values are written
+        /// afterwards.
+        jacobian_t pattern_;
+        gradient_t gradientPattern_;
+
+        /// \brief Dense Jacobian, if its storage order differs from the
+        /// sparse one.
+        mutable dense_t::jacobian_t jacobian_;
+        mutable boost::mutex mutex_;
+      };
+
+      /// \brief Finite-difference stencil of a RobOptim policy: column j
+      /// of the Jacobian is
+      /// (sum_k weight(k) f(x + offset(k) h e_j) + center f(x)) / (factor h).
+      template <typename FdgPolicy>
+      struct FiniteDifferenceStencil;
+
+      template <>
+      struct FiniteDifferenceStencil
+      < ::roboptim::finiteDifferenceGradientPolicies::Simple
+	< ::roboptim::EigenMatrixDense> >
+      {
+        static const int points = 1;
+        static double offset (int) { return 1.; }
+        static double weight (int) { return 1.; }
+        static double center () { return -1.; }
+        static double factor () { return 1.; }
+      };
+
+      template <>
+      struct FiniteDifferenceStencil
+      < ::roboptim::finiteDifferenceGradientPolicies::FivePointsRule
+	< ::roboptim::EigenMatrixDense> >
+      {
+        static const int points = 4;
+        static double offset (int k)
+        {
+          static const double offsets[points] = {2., 1., -1., -2.};
+          return offsets[k];
+        }
+        static double weight (int k)
+        {
+          static const double weights[points] = {-1., 8., -8., 1.};
+          return weights[k];
+        }
+        static double center () { return 0.; }
+        static double factor () { return 12.; }
+      };
+
+      /// \brief Greedy (Curtis-Powell-Reid) colouring of the columns of a
+      /// sparsity pattern: columns sharing a color have no row in common.
+      /// \param columnRows rows of the structural non-zeros of each column.
+      /// \param rows number of rows.
+      /// \param colors color of each column.
+      /// \return number of colors.
+      int colorColumns (const std::vector<std::vector<int> >& columnRows,
+                        int rows, std::vector<int>& colors);
+
+      /// \brief Persistent pool of threads splitting a task over a range
+      /// of indices.
+      ///
+      /// The threads are started once, and wait for the next task between
+      /// two runs. Only one task is run at a time.
+      class WorkerPool : private boost::noncopyable
+      {
+      public:
+        /// \brief Task evaluated on [begin, end).
+        typedef boost::function<void (int, int)> task_t;
+
+        /// \param nThreads number of threads.
+        explicit WorkerPool (int nThreads);
+
+        /// \brief Stop and join the threads.
+        ~WorkerPool ();
+
+        /// \brief Run a task on [0, n), split in one chunk per thread, and
+        /// wait for all the chunks.
+        ///
+        /// If a chunk throws, the first exception is thrown again in the
+        /// calling thread, with its original type.
+        void run (const task_t& task, int n);
+
+        /// \brief Number of threads.
+        int size () const
+        {
+          return nThreads_;
+        }
+
+      private:
+        /// \brief Loop of the thread evaluating the chunk index.
+        void work (int index);
+
+        int nThreads_;
+        boost::thread_group threads_;
+
+        boost::mutex mutex_;
+        boost::condition_variable start_;
+        boost::condition_variable done_;
+
+        /// \brief Current task, its range size and its number.
+        task_t task_;
+        int size_;
+        unsigned long generation_;
+
+        /// \brief Chunks of the current task still running.
+        int pending_;
+        bool stop_;
+
+        /// \brief First exception thrown by the current task.
+        boost::exception_ptr error_;
       };
 
+      /// \brief Finite-difference gradient of a Python-side function.
+      ///
+      /// If the adaptee has a batch compute callback, all the perturbed
+      /// points are evaluated in a single call. If it is thread-safe (native
+      /// function) and several threads are requested, the points are
+      /// evaluated in parallel by a pool of threads owned by the function,
+      /// started on the first evaluation.
+      ///
+      /// If a sparsity pattern is given, structurally independent columns
+      /// are perturbed together (one group per color).
+      ///
+      /// Otherwise, RobOptim's implementation is used.
       template <typename FdgPolicy>
       class FiniteDifferenceGradient
 	: virtual public ::roboptim::GenericFiniteDifferenceGradient
@@ -199,35 +1009,283 @@ namespace roboptim
 
         typedef ::roboptim::DifferentiableFunction outFunction_t;
 
+        typedef FiniteDifferenceStencil<FdgPolicy> stencil_t;
+
         FORWARD_TYPEDEFS_ (fd_t);
 
+        typedef inPyFunction_t::batch_t batch_t;
+
+        /// \param f adaptee.
+        /// \param e epsilon.
+        /// \param nThreads number of threads used for thread-safe adaptees
+        /// (0: hardware concurrency).
         explicit FiniteDifferenceGradient (const inPyFunction_t& f,
-                                           typename fd_t::value_type e = ::roboptim::finiteDifferenceEpsilon)
+                                           typename fd_t::value_type e = ::roboptim::finiteDifferenceEpsilon,
+                                           int nThreads = 1)
           : fd_t (f, e),
 	    outFunction_t (f.inputSize (), f.outputSize (), f.getName ()),
-	    outPyFunction_t (f.inputSize (), f.outputSize (), f.getName ())
+	    outPyFunction_t (f.inputSize (), f.outputSize (), f.getName ()),
+	    adaptee_ (f),
+	    epsilon_ (e),
+	    nThreads_ (nThreads > 0
+		       ? nThreads
+		       : static_cast<int> (boost::thread::hardware_concurrency ())),
+	    nColors_ (0)
         {
-          setComputeCallback (f.getComputeCallback ());
         }
 
         virtual ~FiniteDifferenceGradient () {}
 
+        /// \brief Evaluate the adaptee, which may be a native function
+        /// (e.g. a FunctionPool) without any Python compute callback.
+        virtual void impl_compute (result_ref result,
+                                   const_argument_ref argument)
+          const
+	{
+	  StatsTimer timer (stats_.compute, stats_.enabled);
+	  fd_t::impl_compute (result, argument);
+	}
+
         virtual void impl_gradient (gradient_ref gradient,
                                     const_argument_ref argument,
                                     size_type functionId)
           const
 	{
-	  fd_t::impl_gradient (gradient, argument, functionId);
+	  StatsTimer timer (stats_.gradient, stats_.enabled);
+	  boost::mutex::scoped_lock lock (mutex_);
+	  if (!batched () && columnRows_.empty ())
+	    {
+	      fd_t::impl_gradient (gradient, argument, functionId);
+	      return;
+	    }
+
+	  if (!evaluateStencil (argument))
+	    return;
+	  for (size_type j = 0; j < argument.size (); ++j)
+	    gradient[j] = hasEntry (functionId, j)
+	      ? differences_ (color (j), functionId) : 0.;
 	}
 
         virtual void impl_jacobian (jacobian_ref jacobian,
                                     const_argument_ref argument)
           const
 	{
-	  fd_t::impl_jacobian (jacobian, argument);
+	  StatsTimer timer (stats_.jacobian, stats_.enabled);
+	  boost::mutex::scoped_lock lock (mutex_);
+	  if (!batched () && columnRows_.empty ())
+	    {
+	      fd_t::impl_jacobian (jacobian, argument);
+	      return;
+	    }
+
+	  if (!evaluateStencil (argument))
+	    return;
+
+	  if (columnRows_.empty ())
+	    {
+	      for (size_type j = 0; j < argument.size (); ++j)
+		jacobian.col (j) = differences_.row (j).transpose ();
+	      return;
+	    }
+
+	  jacobian.setZero ();
+	  for (size_type j = 0; j < argument.size (); ++j)
+	    for (std::vector<int>::const_iterator
+		   it = columnRows_[j].begin (); it != columnRows_[j].end (); ++it)
+	      jacobian (*it, j) = differences_ (colors_[j], *it);
 	}
+
+        /// \brief Set the Jacobian sparsity pattern of the adaptee, and
+        /// color its columns.
+        /// \param pattern structural non-zeros (values are ignored).
+        template <typename S>
+        void setSparsityPattern (const S& pattern)
+        {
+          boost::mutex::scoped_lock lock (mutex_);
+
+          columnRows_.assign (static_cast<size_t> (pattern.cols ()),
+                              std::vector<int> ());
+          for (int o = 0; o < pattern.outerSize (); ++o)
+            for (typename S::InnerIterator it (pattern, o); it; ++it)
+              columnRows_[static_cast<size_t> (it.col ())].push_back
+                (static_cast<int> (it.row ()));
+          for (size_t j = 0; j < columnRows_.size (); ++j)
+            std::sort (columnRows_[j].begin (), columnRows_[j].end ());
+
+          nColors_ = colorColumns (columnRows_,
+                                   static_cast<int> (pattern.rows ()), colors_);
+        }
+
+        /// \brief Number of perturbation directions (colors, or one per
+        /// column without sparsity pattern).
+        int directions () const
+        {
+          return columnRows_.empty () ? static_cast<int> (inputSize ())
+            : nColors_;
+        }
+
+      private:
+        /// \brief Whether the perturbed points are evaluated all at once.
+        bool batched () const
+        {
+          return adaptee_.hasComputeBatchCallback ()
+            || (adaptee_.threadSafe () && nThreads_ > 1);
+        }
+
+        /// \brief Perturbation direction of column j.
+        int color (size_type j) const
+        {
+          return columnRows_.empty () ? static_cast<int> (j)
+            : colors_[static_cast<size_t> (j)];
+        }
+
+        /// \brief Whether (i, j) is a structural non-zero.
+        bool hasEntry (size_type i, size_type j) const
+        {
+          if (columnRows_.empty ())
+            return true;
+          const std::vector<int>& rows = columnRows_[static_cast<size_t> (j)];
+          return std::binary_search (rows.begin (), rows.end (),
+                                     static_cast<int> (i));
+        }
+
+        /// \brief Build and evaluate all the perturbed points of the
+        /// stencil, then compute the differences along each direction.
+        /// Rows g * points + k are the perturbed points, the last row is x.
+        /// \return false if the evaluation failed.
+        bool evaluateStencil (const_argument_ref x) const
+        {
+          size_type n = x.size ();
+          int nDirections = directions ();
+          int rows = nDirections * stencil_t::points + 1;
+
+          points_.resize (rows, n);
+          values_.resize (rows, adaptee_.outputSize ());
+          for (int row = 0; row < rows; ++row)
+            points_.row (row) = x.transpose ();
+          for (size_type j = 0; j < n; ++j)
+            for (int k = 0; k < stencil_t::points; ++k)
+              points_ (color (j) * stencil_t::points + k, j)
+                += stencil_t::offset (k) * epsilon_;
+
+          if (adaptee_.hasComputeBatchCallback ())
+            {
+              inPyFunction_t::batch_ref values
+                (values_.data (), values_.rows (), values_.cols ());
+              inPyFunction_t::const_batch_ref X
+                (points_.data (), points_.rows (), points_.cols ());
+              if (!adaptee_.computeBatch (values, X))
+                return false;
+            }
+          else if (adaptee_.threadSafe () && nThreads_ > 1)
+            {
+              // Thread-safe adaptee: split the points between the
+              // threads. Native functions cannot raise Python errors.
+              if (!workers_)
+                workers_.reset (new WorkerPool (nThreads_));
+              workers_->run
+                (boost::bind (&FiniteDifferenceGradient::evaluateRows,
+                              this, _1, _2), rows);
+            }
+          else
+            {
+              // Python adaptees get the GIL once for all the points.
+              const bool python = !adaptee_.threadSafe ();
+              ::roboptim::python::GILState gil (python);
+              evaluateRows (0, rows);
+              if (python && PyErr_Occurred ())
+                return false;
+            }
+
+          differences_.resize (nDirections, values_.cols ());
+          for (int g = 0; g < nDirections; ++g)
+            {
+              differences_.row (g) = stencil_t::center ()
+                * values_.row (rows - 1);
+              for (int k = 0; k < stencil_t::points; ++k)
+                differences_.row (g) += stencil_t::weight (k)
+                  * values_.row (g * stencil_t::points + k);
+            }
+          differences_ /= stencil_t::factor () * epsilon_;
+          return true;
+        }
+
+        /// \brief Evaluate the adaptee on rows [begin, end) of the points.
+        void evaluateRows (int begin, int end) const
+        {
+          for (int i = begin; i < end; ++i)
+            {
+              Eigen::Map<const argument_t> x
+                (points_.row (i).data (), points_.cols ());
+              Eigen::Map<result_t> result
+                (values_.row (i).data (), values_.cols ());
+              adaptee_ (result, x);
+            }
+        }
+
+        /// \brief Adaptee.
+        const inPyFunction_t& adaptee_;
+
+        /// \brief Finite-difference step.
+        value_type epsilon_;
+
+        /// \brief Number of threads for thread-safe adaptees.
+        int nThreads_;
+
+        /// \brief Perturbed points and values (one per row).
+        mutable batch_t points_;
+        mutable batch_t values_;
+
+        /// \brief Differences along each direction (one per row).
+        mutable batch_t differences_;
+
+        /// \brief Rows of the structural non-zeros of each column (empty
+        /// without sparsity pattern).
+        std::vector<std::vector<int> > columnRows_;
+
+        /// \brief Color of each column, and number of colors.
+        std::vector<int> colors_;
+        int nColors_;
+
+        /// \brief Threads evaluating thread-safe adaptees (null until
+        /// the first parallel evaluation).
+        mutable boost::scoped_ptr<WorkerPool> workers_;
+
+        /// \brief Protect the finite-difference buffers, since the function
+        /// may be shared by several solver threads.
+        mutable boost::mutex mutex_;
+      };
+
+      /// \brief Counters of a function cache.
+      struct CacheStats
+      {
+        CacheStats ()
+          : hits (0), misses (0), evictions (0)
+        {}
+
+        void reset ()
+        {
+          hits = misses = evictions = 0;
+        }
+
+        /// \brief Evaluations served from the cache.
+        boost::uint64_t hits;
+        /// \brief Evaluations forwarded to the adaptee.
+        boost::uint64_t misses;
+        /// \brief Entries dropped to respect the cache size.
+        boost::uint64_t evictions;
       };
 
+      /// \brief Least-recently-used cache of the evaluations of a
+      /// differentiable function.
+      ///
+      /// The value, the gradients and the Jacobian at a point share one
+      /// entry, looked up by a hash of the argument. If a tolerance is
+      /// given, the argument is quantized first, so that points that only
+      /// differ by floating-point noise share the same entry. Gradients are
+      /// also served from a cached Jacobian. In joint mode, if the adaptee
+      /// has a value and Jacobian callback, a miss fills both at once;
+      /// otherwise each part is only evaluated on its own miss.
       class CachedFunction
 	: virtual public ::roboptim::DifferentiableFunction,
 	  public ::roboptim::core::python::DifferentiableFunction
@@ -236,11 +1294,19 @@ namespace roboptim
         typedef ::roboptim::DifferentiableFunction function_t;
         typedef DifferentiableFunction pyFunction_t;
 
-        typedef ::roboptim::CachedFunction<function_t> cache_t;
-
-        FORWARD_TYPEDEFS_ (cache_t);
+        FORWARD_TYPEDEFS_ (function_t);
 
-        explicit CachedFunction (boost::shared_ptr<pyFunction_t> f, size_t cache_size);
+        /// \param f adaptee.
+        /// \param cache_size maximum number of cached points.
+        /// \param tolerance quantization step of the arguments (0: exact
+        /// match). Coordinates are rounded to the nearest multiple of the
+        /// step, so nearby points across a rounding boundary still miss.
+        /// \param joint evaluate the value and the Jacobian together with
+        /// the value and Jacobian callback of the adaptee.
+        explicit CachedFunction (boost::shared_ptr<pyFunction_t> f,
+                                 size_t cache_size,
+                                 value_type tolerance = 0.,
+                                 bool joint = false);
 
         virtual ~CachedFunction ();
 
@@ -259,10 +1325,251 @@ namespace roboptim
 
         virtual std::ostream& print (std::ostream& o) const;
 
+        /// \brief Copy of the cache counters.
+        CacheStats cacheStats () const;
+
+        /// \brief Reset the cache counters.
+        void resetCacheStats ();
+
+        /// \brief Drop all the cached entries.
+        void clearCache ();
+
+        /// \brief Number of cached points.
+        size_t cachedPoints () const;
+
+      private:
+        typedef std::vector<boost::int64_t> cacheKey_t;
+
+        struct Entry
+        {
+          cacheKey_t key;
+          bool hasValue;
+          vector_t value;
+          bool hasJacobian;
+          jacobian_t jacobian;
+          std::map<size_type, gradient_t> gradients;
+        };
+
+        typedef std::list<Entry> entries_t;
+        typedef boost::unordered_map<cacheKey_t, entries_t::iterator,
+                                     boost::hash<cacheKey_t> > index_t;
+
+        /// \brief Key of an argument.
+        void makeKey (cacheKey_t& key, const_argument_ref argument) const;
+
+        /// \brief Entry of an argument, moved to the front of the LRU
+        /// list. A new entry is created (and the least recently used one
+        /// evicted) if the argument is not cached.
+        Entry& lookup (const_argument_ref argument) const;
+
+        void evaluateValue (Entry& entry, const_argument_ref argument) const;
+        void evaluateJacobian (Entry& entry, const_argument_ref argument) const;
+
+        /// \brief In joint mode, evaluate the value and the Jacobian with
+        /// the value and Jacobian callback of the adaptee.
+        /// \return false if there is no such callback (nothing evaluated).
+        bool evaluateJoint (Entry& entry, const_argument_ref argument) const;
+
+        boost::shared_ptr<pyFunction_t> f_;
+        size_t cacheSize_;
+        value_type tolerance_;
+        bool joint_;
+
+        /// \brief Entries, the most recently used first.
+        mutable entries_t entries_;
+        mutable index_t index_;
+        mutable cacheKey_t key_;
+        mutable CacheStats cacheStats_;
+
+	/// \brief Protect the cache from concurrent solver threads.
+	mutable boost::mutex mutex_;
+      };
+
+      /// \brief Binding of a function implemented by RobOptim (linear,
+      /// quadratic, constant or identity function, or an expression built
+      /// with RobOptim operators).
+      ///
+      /// Problems are given the native function itself, so that solvers
+      /// see its linear or quadratic structure. Evaluations only enter
+      /// Python for the Python functions used in an expression.
+      class NativeFunction
+	: virtual public ::roboptim::DifferentiableFunction,
+	  public ::roboptim::core::python::DifferentiableFunction
+      {
+      public:
+        typedef ::roboptim::DifferentiableFunction function_t;
+        typedef DifferentiableFunction pyFunction_t;
+
+        FORWARD_TYPEDEFS_ (function_t);
+
+        /// \param f RobOptim function.
+        /// \param threadSafe whether f can be evaluated concurrently, i.e.
+        /// whether all the functions of an expression are native.
+        explicit NativeFunction (const boost::shared_ptr<function_t>& f,
+                                 bool threadSafe = true);
+
+        virtual ~NativeFunction ();
+
+        virtual void impl_compute (result_ref result,
+                                   const_argument_ref argument)
+          const;
+
+        virtual void impl_gradient (gradient_ref gradient,
+                                    const_argument_ref argument,
+                                    size_type functionId)
+          const;
+
+        virtual void impl_jacobian (jacobian_ref jacobian,
+                                    const_argument_ref argument)
+          const;
+
+        virtual std::ostream& print (std::ostream& o) const;
+
+        virtual bool threadSafe () const
+        {
+          return threadSafe_;
+        }
+
+        /// \brief Wrapped RobOptim function, given to problems.
+        const boost::shared_ptr<function_t>& native () const
+        {
+          return f_;
+        }
+
+      private:
+        boost::shared_ptr<function_t> f_;
+        bool threadSafe_;
+      };
+
+
+      /// \brief Filter applied to an iteration callback before the GIL is
+      /// taken, so that filtered iterations do not enter Python.
+      ///
+      /// All the conditions must be met for the callback to be called.
+      struct IterationFilter
+      {
+        IterationFilter ()
+          : every (1), onImprovement (false), interval (0.)
+        {}
+
+        /// \brief Whether every iteration is accepted.
+        bool trivial () const
+        {
+          return every <= 1 && !onImprovement && interval <= 0.;
+        }
+
+        /// \brief Call the callback every k iterations.
+        int every;
+        /// \brief Only call the callback if the cost is lower than the
+        /// cost of the previous call.
+        bool onImprovement;
+        /// \brief Minimum wall-clock time between two calls (seconds).
+        double interval;
+      };
+
+      /// \brief Iteration callback wrapper applying an IterationFilter.
+      /// \tparam F wrapped callback function type.
+      template <typename F>
+      class FilteredCallback
+      {
+      public:
+        FilteredCallback (const F& callback, const IterationFilter& filter);
+
+        template <typename P, typename T>
+        void operator () (const P& pb, T& state);
+
       private:
-	boost::shared_ptr<cache_t> cached_f_;
+        /// \brief Filter state, shared by the copies of the functor.
+        struct state_t
+        {
+          state_t ()
+            : iteration (0), hasCost (false), cost (0.), last (0)
+          {}
+
+          int iteration;
+          bool hasCost;
+          double cost;
+          boost::uint64_t last;
+        };
+
+        F callback_;
+        IterationFilter filter_;
+        boost::shared_ptr<state_t> state_;
+      };
+
+      /// \brief Python object wrapping a function, a problem, a solver or a
+      /// solver state.
+      ///
+      /// Unlike capsules, each kind of object has its own Python type, and
+      /// the tag identifies the C++ type of the object: the entry points
+      /// check them with pointer comparisons, without string comparison or
+      /// dynamic_cast. Functions are stored as Function pointers.
+      struct NativeObject
+      {
+        PyObject_HEAD
+
+        /// \brief Wrapped object.
+        void* pointer;
+
+        /// \brief C++ type of the object (capsule name or type tag).
+        const char* tag;
+
+        /// \brief Destroy the object (null if it is not owned).
+        void (*release) (void*);
+
+        /// \brief Data attached to the object (e.g. a solver state
+        /// exporting views).
+        void* context;
       };
 
+      /// \brief Python types of the native objects.
+      extern PyTypeObject functionType;
+      extern PyTypeObject problemType;
+      extern PyTypeObject solverType;
+      extern PyTypeObject solverStateType;
+
+      /// \brief Create a native object.
+      /// \return new reference, or 0 on error.
+      PyObject* newObject (PyTypeObject* type, void* pointer, const char* tag,
+                           void (*release) (void*));
+
+      /// \brief Object wrapped by obj, if it has the given type and tag.
+      /// \param tag expected tag (any tag if null).
+      /// \return wrapped object, or 0 (no Python error is set).
+      inline void* objectPointer (PyObject* obj, PyTypeObject* type,
+                                  const char* tag = 0)
+      {
+        if (!obj || Py_TYPE (obj) != type)
+          return 0;
+
+        // Tags are compared by address first, since they are the same
+        // constants.
+        NativeObject* object = reinterpret_cast<NativeObject*> (obj);
+        if (tag && object->tag != tag && std::strcmp (object->tag, tag) != 0)
+          return 0;
+        return object->pointer;
+      }
+
+      /// \brief NumPy views on the vectors of a solver state (x, vector
+      /// parameters), exported during an iteration callback, with the
+      /// viewed vectors.
+      typedef std::vector<std::pair<PyObject*,
+                                    ::roboptim::Function::vector_t*> >
+      stateViews_t;
+
+      /// \brief Release the state views when the iteration callback
+      /// returns.
+      ///
+      /// Views still referenced from Python (directly or through slices)
+      /// are detached: the state buffer is moved to them, so that they keep
+      /// the values of the iteration, and they become read-only. The state
+      /// gets a copy of the values. Views released by the callback (the
+      /// usual monitoring case) are never copied.
+      ///
+      /// \param keep vector whose views stay registered (e.g. x when only
+      /// the parameters are replaced).
+      void releaseStateViews
+      (stateViews_t& views, const ::roboptim::Function::vector_t* keep = 0);
 
       template <typename S>
       class SolverCallback
@@ -290,6 +1597,163 @@ namespace roboptim
       private:
         PyObject* callback_;
         PyObject* pb_;
+
+        /// \brief State capsule, reused across iterations. Its context
+        /// points to stateViews_.
+        PyObject* statePy_;
+
+        /// \brief Views exported from the state during the callback.
+        stateViews_t stateViews_;
+      };
+
+      /// \brief Growing 2-D (or 1-D) float64 array stored in a .npy file.
+      ///
+      /// Rows are appended through a large stdio buffer, and the header
+      /// (which holds the number of rows) is rewritten on flush, so that the
+      /// file can be memory-mapped by numpy.load (path, mmap_mode = "r").
+      class NpyColumn : boost::noncopyable
+      {
+      public:
+        /// \param path file path.
+        /// \param columns row size, or 0 for a 1-D array of scalars.
+        /// \throw std::runtime_error if the file cannot be created.
+        NpyColumn (const std::string& path, std::size_t columns);
+        ~NpyColumn ();
+
+        /// \brief Append a row of max (1, columns) values.
+        void append (const double* row);
+
+        /// \brief Write the buffered rows and update the header.
+        void flush ();
+
+        std::size_t rows () const
+        {
+          return rows_;
+        }
+
+      private:
+        void writeHeader ();
+
+        std::FILE* file_;
+        const std::size_t columns_;
+        std::size_t rows_;
+        std::vector<char> buffer_;
+      };
+
+      /// \brief Iteration logger writing one .npy file per logged quantity:
+      /// x, cost, constraint violation (NaN when unknown) and the selected
+      /// numerical state parameters.
+      /// \tparam S solver type.
+      template <typename S>
+      class BinaryLogger : boost::noncopyable
+      {
+      public:
+        typedef S solver_t;
+        typedef typename solver_t::callback_t callback_t;
+        typedef typename solver_t::problem_t problem_t;
+        typedef typename solver_t::solverState_t solverState_t;
+
+        /// \param directory existing output directory.
+        /// \param inputSize size of x.
+        /// \param parameters names of the state parameters to log.
+        /// \throw std::runtime_error if a file cannot be created.
+        BinaryLogger (const std::string& directory, std::size_t inputSize,
+                      const std::vector<std::string>& parameters);
+
+        callback_t callback ();
+
+        /// \brief Flush all the files: they can then be read while the
+        /// logger keeps running.
+        void flush ();
+
+        /// \brief Number of logged iterations.
+        std::size_t iterations () const;
+
+        /// \brief Names of the logged state parameters.
+        const std::vector<std::string>& parameters () const
+        {
+          return parameters_;
+        }
+
+        /// \brief Output file of each logged quantity: x, cost, constraint
+        /// violation, then the state parameters.
+        const std::vector<std::string>& paths () const
+        {
+          return paths_;
+        }
+
+      protected:
+        void log (const problem_t& pb, solverState_t& state);
+
+      private:
+        const std::vector<std::string> parameters_;
+        std::vector<std::string> paths_;
+        std::vector<boost::shared_ptr<NpyColumn> > columns_;
+        std::vector<double> values_;
+      };
+
+      /// \brief Iteration callback stopping a solve on request or after a
+      /// deadline, at the next iteration boundary.
+      ///
+      /// The stop is signalled through the "<solver>.stop" boolean state
+      /// parameters (e.g. "ipopt.stop"). The callback never enters Python:
+      /// stops can be requested and the progress read from any thread
+      /// while the solver runs.
+      /// \tparam S solver type.
+      template <typename S>
+      class StopCallback : boost::noncopyable
+      {
+      public:
+        typedef S solver_t;
+        typedef typename solver_t::callback_t callback_t;
+        typedef typename solver_t::problem_t problem_t;
+        typedef typename solver_t::solverState_t solverState_t;
+
+        /// \brief Progress of the current solve.
+        struct Progress
+        {
+          /// \brief Number of iterations.
+          boost::uint64_t iterations;
+          /// \brief Cost and constraint violation of the last iteration
+          /// (NaN when unknown).
+          double cost;
+          double constraintViolation;
+          /// \brief Whether a stop was signalled to the solver.
+          bool stopped;
+        };
+
+        StopCallback ();
+
+        callback_t callback ();
+
+        /// \brief Request a stop at the next iteration.
+        void requestStop ()
+        {
+          stopRequested_.store (true);
+        }
+
+        /// \brief Stop at the first iteration after the given time (see
+        /// clockNanoseconds), 0 for no deadline.
+        void setDeadline (boost::uint64_t deadline);
+
+        /// \brief Clear the stop request and the progress, before a new
+        /// solve.
+        void reset ();
+
+        /// \brief Copy of the progress.
+        Progress progress () const;
+
+      protected:
+        void check (const problem_t& pb, solverState_t& state);
+
+      private:
+        boost::atomic<bool> stopRequested_;
+        /// \brief Deadline, guarded by the mutex.
+        boost::uint64_t deadline_;
+
+        /// \brief Progress, read concurrently by other threads.
+        Progress progress_;
+        mutable boost::mutex mutex_;
       };
 
       /// \brief Iteration callback multiplexer.
@@ -306,12 +1770,18 @@ namespace roboptim
 
         typedef SolverCallback<solver_t> callbackWrapper_t;
         typedef roboptim::OptimizationLogger<solver_t> logger_t;
+        typedef BinaryLogger<solver_t> binaryLogger_t;
+        typedef StopCallback<solver_t> stopCallback_t;
 
         // TODO: do not treat logger separately
         /// \brief Allowed types for callbacks:
         ///   - Python callback
         ///   - Optimization logger
-        typedef boost::mpl::vector<callbackWrapper_t, logger_t> callback_t;
+        ///   - Binary (.npy) logger
+        ///   - Stop callback
+        typedef boost::mpl::vector<callbackWrapper_t, logger_t, binaryLogger_t,
+                                   stopCallback_t>
+          callback_t;
         typedef typename roboptim::detail::shared_ptr_variant<callback_t>::type callback_ptr;
 
         typedef std::vector<callback_ptr> callbacks_t;
@@ -324,16 +1794,115 @@ namespace roboptim
         Multiplexer (factory_ptr factory);
         virtual ~Multiplexer ();
 
-        void add (callback_ptr callback);
+        /// \brief Add a callback, called on the iterations accepted by
+        /// the filter.
+        void add (callback_ptr callback,
+                  const IterationFilter& filter = IterationFilter ());
         void remove (size_t i);
 
+        /// \brief Remove the optimization loggers, which completes their
+        /// logs.
+        void removeLoggers ();
+
+        /// \brief Register the callbacks to the solver of another factory,
+        /// e.g. when a problem is solved again with new data.
+        ///
+        /// Optimization loggers are bound to their solver and cannot be
+        /// registered again: a std::runtime_error is thrown, and nothing
+        /// is changed, if some are left (see removeLoggers).
+        void setFactory (factory_ptr factory);
+
       private:
+        /// \brief Register a callback to the RobOptim multiplexer.
+        void registerCallback (const callback_ptr& callback,
+                               const IterationFilter& filter);
+
         factory_ptr   factory_;
-        multiplexer_t multiplexer_;
+        boost::shared_ptr<multiplexer_t> multiplexer_;
         callbacks_t   callbacks_;
+        std::vector<IterationFilter> filters_;
       };
 
 
+      /// \brief Engine (callback) of a function pool, only evaluated
+      /// again when its argument changes.
+      ///
+      /// Solvers often evaluate the pool several times at the same point;
+      /// the last argument is tracked separately for the value and for the
+      /// Jacobian, and the engine calls that are skipped are counted.
+      ///
+      /// The engine state is kept under a mutex, which is not held while
+      /// the engine is evaluated (it may need the GIL). An evaluation is only
+      /// kept if no callback of the engine failed in the meantime.
+      class PoolEngine : public ::roboptim::DifferentiableFunction
+      {
+      public:
+        typedef ::roboptim::DifferentiableFunction function_t;
+        typedef boost::shared_ptr<function_t> function_ptr;
+
+        typedef ::roboptim::core::python::DifferentiableFunction pyFunction_t;
+
+        explicit PoolEngine (const boost::shared_ptr<pyFunction_t>& engine);
+
+        virtual ~PoolEngine ();
+
+        /// \brief Evaluate the engine again on the next calls, e.g. if its
+        /// state was modified from outside of the pool.
+        void invalidate ();
+
+        /// \brief Number of skipped value evaluations.
+        boost::uint64_t skippedComputes () const
+        {
+          boost::mutex::scoped_lock lock (mutex_);
+          return skippedComputes_;
+        }
+
+        /// \brief Number of skipped Jacobian evaluations.
+        boost::uint64_t skippedJacobians () const
+        {
+          boost::mutex::scoped_lock lock (mutex_);
+          return skippedJacobians_;
+        }
+
+        void resetCounters ()
+        {
+          boost::mutex::scoped_lock lock (mutex_);
+          skippedComputes_ = skippedJacobians_ = 0;
+        }
+
+      protected:
+        virtual void impl_compute (result_ref result, const_argument_ref x)
+          const;
+
+        virtual void impl_gradient (gradient_ref gradient,
+                                    const_argument_ref x,
+                                    size_type functionId = 0) const;
+
+        virtual void impl_jacobian (jacobian_ref jacobian,
+                                    const_argument_ref x) const;
+
+      private:
+        function_ptr engine_;
+
+        /// \brief Statistics of the engine, counting its failed callbacks.
+        const FunctionStats& engineStats_;
+
+        /// \brief Last argument, and engine output at this argument.
+        mutable bool hasValue_;
+        mutable vector_t valueX_;
+        mutable vector_t value_;
+
+        mutable bool hasJacobian_;
+        mutable vector_t jacobianX_;
+        mutable jacobian_t jacobian_;
+
+        mutable boost::uint64_t skippedComputes_;
+        mutable boost::uint64_t skippedJacobians_;
+
+        /// \brief Protect the engine state and the counters.
+        mutable boost::mutex mutex_;
+      };
+
       class FunctionPool : virtual public ::roboptim::DifferentiableFunction,
 			   public ::roboptim::core::python::DifferentiableFunction
       {
@@ -349,7 +1918,7 @@ namespace roboptim
         typedef pool_t::callback_ptr callback_ptr;
         typedef pool_t::functionList_t functionList_t;
 
-        explicit FunctionPool (const callback_ptr callback,
+        explicit FunctionPool (const boost::shared_ptr<pyFunction_t>& callback,
                                const functionList_t& functions,
                                const std::string& name);
 
@@ -366,7 +1935,14 @@ namespace roboptim
 
         virtual std::ostream& print (std::ostream&) const;
 
+        /// \brief Engine, with the counters of skipped calls.
+        PoolEngine& engine ()
+        {
+          return *engine_;
+        }
+
       private:
+	boost::shared_ptr<PoolEngine> engine_;
 	pool_t pool_;
       };
     } // end of namespace python.
@@ -377,7 +1953,13 @@ typedef roboptim::Problem< ::roboptim::EigenMatrixDense> problem_t;
 typedef roboptim::Solver< ::roboptim::EigenMatrixDense> solver_t;
 
 typedef roboptim::SolverFactory<solver_t> factory_t;
+
+typedef roboptim::Problem< ::roboptim::EigenMatrixSparse> sparseProblem_t;
+typedef roboptim::Solver< ::roboptim::EigenMatrixSparse> sparseSolver_t;
+typedef roboptim::SolverFactory<sparseSolver_t> sparseFactory_t;
 typedef roboptim::OptimizationLogger<solver_t> logger_t;
+typedef roboptim::core::python::BinaryLogger<solver_t> binaryLogger_t;
+typedef roboptim::core::python::StopCallback<solver_t> stopCallback_t;
 typedef roboptim::callback::Multiplexer<solver_t> multiplexer_t;
 
 typedef roboptim::Result result_t;
@@ -402,8 +1984,20 @@ namespace detail
 
   int functionConverter (PyObject* obj, rcp::Function** address);
   int functionListConverter (PyObject* obj, rcp::FunctionPool::functionList_t** address);
-  int problemConverter (PyObject* obj, problem_t** address);
-  int factoryConverter (PyObject* obj, factory_t** address);
+  /// \brief Capsule name of a problem or solver type.
+  template <typename T>
+  const char* capsuleName ();
+
+  /// \brief Whether the i-th argument is a sparse problem or solver.
+  bool isSparse (PyObject* args, Py_ssize_t i = 0);
+
+  template <typename P>
+  struct ProblemTraits;
+
+  template <typename P>
+  int problemConverter (PyObject* obj, P** address);
+  template <typename F>
+  int factoryConverter (PyObject* obj, F** address);
   int solverCallbackConverter (PyObject* obj, rcp::SolverCallback<solver_t>** address);
   int multiplexerConverter (PyObject* obj, rcp::Multiplexer<solver_t>** address);
   int solverStateConverter (PyObject* obj, solverState_t** address);
@@ -414,6 +2008,7 @@ namespace detail
   struct StateParameterValueVisitor;
   struct null_deleter;
   struct pyobject_deleter;
+  struct MultiStart;
 
   template <typename T>
   boost::shared_ptr<T> to_shared_ptr (T* o, PyObject* py_o);
@@ -23,13 +23,232 @@ namespace roboptim
             return callback->callback ();
           }
         };
+
+        /// \brief Value of a numerical state parameter (NaN otherwise).
+        struct NumericalParameterVisitor : public boost::static_visitor<double>
+        {
+          double operator () (const double& p) const
+          {
+            return p;
+          }
+
+          double operator () (const int& p) const
+          {
+            return static_cast<double> (p);
+          }
+
+          double operator () (const bool& p) const
+          {
+            return p ? 1. : 0.;
+          }
+
+          template <typename T>
+          double operator () (const T&) const
+          {
+            return std::numeric_limits<double>::quiet_NaN ();
+          }
+        };
       } // end of unnamed namespace
 
+      template <typename S>
+      BinaryLogger<S>::BinaryLogger (const std::string& directory,
+                                     std::size_t inputSize,
+                                     const std::vector<std::string>& parameters)
+      : parameters_ (parameters),
+        paths_ (),
+        columns_ (),
+        values_ (inputSize)
+      {
+        paths_.push_back (directory + "/x.npy");
+        paths_.push_back (directory + "/cost.npy");
+        paths_.push_back (directory + "/constraint_violation.npy");
+        for (std::size_t i = 0; i < parameters_.size (); ++i)
+          {
+            // Parameter names are used as file names.
+            std::string name = parameters_[i];
+            std::replace (name.begin (), name.end (), '/', '_');
+            paths_.push_back (directory + "/" + name + ".npy");
+          }
+
+        for (std::size_t i = 0; i < paths_.size (); ++i)
+          columns_.push_back (boost::make_shared<NpyColumn>
+                              (paths_[i], (i == 0) ? inputSize : 0));
+      }
+
+      template <typename S>
+      typename BinaryLogger<S>::callback_t
+      BinaryLogger<S>::callback ()
+      {
+        return boost::bind (&BinaryLogger<S>::log, this, _1, _2);
+      }
+
+      template <typename S>
+      void BinaryLogger<S>::flush ()
+      {
+        for (std::size_t i = 0; i < columns_.size (); ++i)
+          columns_[i]->flush ();
+      }
+
+      template <typename S>
+      std::size_t BinaryLogger<S>::iterations () const
+      {
+        return columns_[0]->rows ();
+      }
+
+      template <typename S>
+      void BinaryLogger<S>::log (const problem_t&, solverState_t& state)
+      {
+        const double nan = std::numeric_limits<double>::quiet_NaN ();
+
+        // Rows always have the size given at construction.
+        std::size_t n = std::min (values_.size (),
+                                  static_cast<std::size_t> (state.x ().size ()));
+        std::fill (values_.begin (), values_.end (), nan);
+        std::copy (state.x ().data (), state.x ().data () + n, values_.begin ());
+        columns_[0]->append (values_.empty () ? &nan : &values_[0]);
+
+        double value = state.cost () ? *(state.cost ()) : nan;
+        columns_[1]->append (&value);
+
+        value = state.constraintViolation () ?
+          *(state.constraintViolation ()) : nan;
+        columns_[2]->append (&value);
+
+        for (std::size_t i = 0; i < parameters_.size (); ++i)
+          {
+            typename solverState_t::parameters_t::const_iterator
+              it = state.parameters ().find (parameters_[i]);
+            value = (it == state.parameters ().end ()) ? nan
+              : boost::apply_visitor (NumericalParameterVisitor (),
+                                      it->second.value);
+            columns_[3 + i]->append (&value);
+          }
+      }
+
+      template <typename S>
+      StopCallback<S>::StopCallback ()
+      : stopRequested_ (false),
+        deadline_ (0),
+        progress_ (),
+        mutex_ ()
+      {
+        reset ();
+      }
+
+      template <typename S>
+      typename StopCallback<S>::callback_t
+      StopCallback<S>::callback ()
+      {
+        return boost::bind (&StopCallback<S>::check, this, _1, _2);
+      }
+
+      template <typename S>
+      void StopCallback<S>::setDeadline (boost::uint64_t deadline)
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        deadline_ = deadline;
+      }
+
+      template <typename S>
+      void StopCallback<S>::reset ()
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        stopRequested_.store (false);
+        progress_.iterations = 0;
+        progress_.cost = std::numeric_limits<double>::quiet_NaN ();
+        progress_.constraintViolation =
+          std::numeric_limits<double>::quiet_NaN ();
+        progress_.stopped = false;
+      }
+
+      template <typename S>
+      typename StopCallback<S>::Progress StopCallback<S>::progress () const
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        return progress_;
+      }
+
+      template <typename S>
+      void StopCallback<S>::check (const problem_t&, solverState_t& state)
+      {
+        const double nan = std::numeric_limits<double>::quiet_NaN ();
+
+        boost::mutex::scoped_lock lock (mutex_);
+        ++progress_.iterations;
+        progress_.cost = state.cost () ? *(state.cost ()) : nan;
+        progress_.constraintViolation = state.constraintViolation () ?
+          *(state.constraintViolation ()) : nan;
+
+        bool stop = stopRequested_.load ()
+          || (deadline_ != 0 && clockNanoseconds () >= deadline_);
+        if (!stop)
+          return;
+
+        // Solvers read their own stop parameter, e.g. "ipopt.stop".
+        static const std::string suffix = ".stop";
+        for (typename solverState_t::parameters_t::iterator
+               it = state.parameters ().begin ();
+             it != state.parameters ().end (); ++it)
+          {
+            const std::string& key = it->first;
+            if (key.size () >= suffix.size ()
+                && key.compare (key.size () - suffix.size (), suffix.size (),
+                                suffix) == 0
+                && boost::get<bool> (&it->second.value))
+              {
+                it->second.value = true;
+                progress_.stopped = true;
+              }
+          }
+      }
+
+      template <typename F>
+      FilteredCallback<F>::FilteredCallback (const F& callback,
+                                             const IterationFilter& filter)
+      : callback_ (callback),
+        filter_ (filter),
+        state_ (boost::make_shared<state_t> ())
+      {
+      }
+
+      template <typename F>
+      template <typename P, typename T>
+      void FilteredCallback<F>::operator () (const P& pb, T& state)
+      {
+        state_t& s = *state_;
+
+        if (filter_.every > 1 && (s.iteration++ % filter_.every) != 0)
+          return;
+
+        if (filter_.onImprovement)
+          {
+            if (!state.cost ())
+              return;
+            double cost = *(state.cost ());
+            if (s.hasCost && !(cost < s.cost))
+              return;
+            s.hasCost = true;
+            s.cost = cost;
+          }
+
+        if (filter_.interval > 0.)
+          {
+            boost::uint64_t now = clockNanoseconds ();
+            if (s.last != 0
+                && static_cast<double> (now - s.last) * 1e-9 < filter_.interval)
+              return;
+            s.last = now;
+          }
+
+        callback_ (pb, state);
+      }
+
       template <typename S>
       Multiplexer<S>::Multiplexer (factory_ptr factory)
       : factory_ (factory),
-        multiplexer_ ((*factory)()),
-        callbacks_ ()
+        multiplexer_ (boost::make_shared<multiplexer_t> ((*factory)())),
+        callbacks_ (),
+        filters_ ()
       {
       }
 
@@ -40,25 +259,70 @@ namespace roboptim
       }
 
       template <typename S>
-      void Multiplexer<S>::add (callback_ptr callback)
+      void Multiplexer<S>::registerCallback (const callback_ptr& callback,
+                                             const IterationFilter& filter)
+      {
+        callbackFunction_t f =
+          boost::apply_visitor (MultiplexerCallbackVisitor<S> (), callback);
+
+        // Unfiltered callbacks are called directly.
+        if (!filter.trivial ())
+          f = FilteredCallback<callbackFunction_t> (f, filter);
+
+        multiplexer_->callbacks ().push_back
+          (boost::make_shared<callback::Wrapper<solver_t> > (f));
+      }
+
+      template <typename S>
+      void Multiplexer<S>::add (callback_ptr callback,
+                                const IterationFilter& filter)
       {
+        registerCallback (callback, filter);
         callbacks_.push_back (callback);
-        multiplexer_.callbacks ().push_back
-          (boost::make_shared<callback::Wrapper<solver_t> >
-           (boost::apply_visitor (MultiplexerCallbackVisitor<S> (),
-                                  callback)));
+        filters_.push_back (filter);
       }
 
       template <typename S>
       void Multiplexer<S>::remove (size_t i)
       {
-        multiplexer_.callbacks ().erase (multiplexer_.callbacks ().begin () + i);
+        multiplexer_->callbacks ().erase (multiplexer_->callbacks ().begin () + i);
         callbacks_.erase (callbacks_.begin () + i);
+        filters_.erase (filters_.begin () + i);
+      }
+
+      template <typename S>
+      void Multiplexer<S>::removeLoggers ()
+      {
+        for (size_t i = callbacks_.size (); i-- > 0;)
+          if (boost::get<boost::shared_ptr<logger_t> > (&callbacks_[i]))
+            remove (i);
+      }
+
+      template <typename S>
+      void Multiplexer<S>::setFactory (factory_ptr factory)
+      {
+        for (size_t i = 0; i < callbacks_.size (); ++i)
+          if (boost::get<boost::shared_ptr<logger_t> > (&callbacks_[i]))
+            throw std::runtime_error
+              ("optimization loggers are bound to their solver: remove them"
+               " before changing the solver");
+
+        // The previous solver is still alive while its multiplexer is
+        // released.
+        boost::shared_ptr<multiplexer_t> multiplexer =
+          boost::make_shared<multiplexer_t> ((*factory)());
+        multiplexer_ = multiplexer;
+        factory_ = factory;
+
+        for (size_t i = 0; i < callbacks_.size (); ++i)
+          registerCallback (callbacks_[i], filters_[i]);
       }
 
       template <typename S>
       SolverCallback<S>::SolverCallback (PyObject* pb)
-	: callback_ (0)
+	: callback_ (0),
+	  statePy_ (0),
+	  stateViews_ ()
       {
         Py_XINCREF (pb);
         pb_ = pb;
@@ -78,6 +342,10 @@ namespace roboptim
 	    Py_DECREF (pb_);
 	    pb_ = 0;
 	  }
+
+        releaseStateViews (stateViews_);
+        Py_XDECREF (statePy_);
+        statePy_ = 0;
       }
 
       template <typename S>
@@ -105,6 +373,9 @@ namespace roboptim
       void SolverCallback<S>::wrappedCallback (const problem_t& /*pb*/,
                                                solverState_t& state)
       {
+        // The solver runs without the GIL.
+        ::roboptim::python::GILState gil;
+
         if (!callback_)
 	  {
 	    PyErr_SetString
@@ -121,22 +392,27 @@ namespace roboptim
 	    return;
 	  }
 
-        // TODO: need to make sure that pb_ == pb.
-        PyObject* statePy =
-          PyCapsule_New (&state, ROBOPTIM_CORE_SOLVER_STATE_CAPSULE_NAME, NULL);
+        // The state object is only allocated once: solvers call the
+        // callbacks at every iteration, usually with the same state.
+        if (!statePy_)
+          {
+            statePy_ = newObject (&solverStateType, &state,
+                                  ROBOPTIM_CORE_SOLVER_STATE_CAPSULE_NAME, 0);
+            if (!statePy_)
+              return;
+          }
 
-        PyObject* arglist = Py_BuildValue ("(OO)", pb_, statePy);
-        if (!arglist)
-	  {
-	    Py_DECREF (arglist);
-	    PyErr_SetString
-	      (PyExc_TypeError, "failed to build argument list");
-	    return;
-	  }
+        NativeObject* stateObject = reinterpret_cast<NativeObject*> (statePy_);
+        stateObject->pointer = &state;
+        // Lets the state accessors register the views they export.
+        stateObject->context = &stateViews_;
+
+        // TODO: need to make sure that pb_ == pb.
+        PyObject* resultPy = ::roboptim::python::call (callback_, pb_, statePy_);
+        Py_XDECREF (resultPy);
 
-        PyEval_CallObject (callback_, arglist);
-        Py_DECREF (arglist);
-        Py_XDECREF (statePy);
+        // The state is only valid during the callback.
+        releaseStateViews (stateViews_);
 
         return;
       }
@@ -0,0 +1,215 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""
+Benchmark of the binding overhead.
+
+Measure the per-call latency of compute/gradient/jacobian for several
+input sizes and function wrappers, and the end-to-end solve time of some
+Schittkowski problems. Results are written as JSON (default:
+benchmark.json in the current directory, or the file given as first
+argument). It is not part of the test suite: run it with `make benchmark'.
+
+Environment variables:
+  ROBOPTIM_BENCHMARK_SIZES   comma-separated input sizes (default: 2,10,100)
+  ROBOPTIM_BENCHMARK_CALLS   number of calls per measure (default: 200)
+  ROBOPTIM_BENCHMARK_REPEAT  number of measures, the best is kept (default: 3)
+"""
+from __future__ import \
+    print_function, unicode_literals, absolute_import, division
+
+import json
+import os
+import platform
+import sys
+import timeit
+
+import numpy
+import roboptim.core
+
+import schittkowski
+
+
+class SumSquares (roboptim.core.PyDifferentiableFunction):
+    def __init__ (self, n):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, n, 1, "sum of squares")
+
+    def impl_compute (self, result, x):
+        result[0] = numpy.dot (x, x)
+
+    def impl_gradient (self, result, x, functionId):
+        result[:] = 2. * x
+
+
+class ComputeOnly (roboptim.core.PyDifferentiableFunction):
+    """
+    Sum of squares without gradient, for finite differences.
+    """
+    def __init__ (self, n):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, n, 1, "sum of squares (compute only)")
+
+    def impl_compute (self, result, x):
+        result[0] = numpy.dot (x, x)
+
+    def impl_gradient (self, result, x, functionId):
+        raise NotImplementedError
+
+
+class Engine (roboptim.core.PyDifferentiableFunction):
+    """
+    Pool callback: compute the squares of x and their derivatives.
+    """
+    def __init__ (self, n):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, n, n, "engine")
+        self.data = numpy.zeros (n)
+        self.jac = numpy.zeros (n)
+
+    def impl_compute (self, result, x):
+        self.data[:] = x * x
+
+    def impl_gradient (self, result, x, functionId):
+        raise NotImplementedError
+
+    def impl_jacobian (self, result, x):
+        self.jac[:] = 2. * x
+
+    def jacobian (self, x):
+        self.impl_jacobian (None, x)
+
+
+class EngineSquare (roboptim.core.PyDifferentiableFunction):
+    def __init__ (self, engine, idx):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, engine.inputSize (), 1, "x²")
+        self.engine = engine
+        self.idx = idx
+
+    def impl_compute (self, result, x):
+        result[0] = self.engine.data[self.idx]
+
+    def impl_gradient (self, result, x, functionId):
+        result.fill (0.)
+        result[self.idx] = self.engine.jac[self.idx]
+
+
+def functions (n):
+    """
+    Functions to benchmark for an input size n, by name.
+    """
+    engine = Engine (n)
+    squares = [EngineSquare (engine, i) for i in range (n)]
+    return [
+        ("python", SumSquares (n)),
+        ("cached", roboptim.core.PyCachedFunction (SumSquares (n), 10)),
+        ("fd_simple", roboptim.core.PyFiniteDifference
+         (ComputeOnly (n), rule = roboptim.core.FiniteDifferenceRule.SIMPLE)),
+        ("fd_five_points", roboptim.core.PyFiniteDifference
+         (ComputeOnly (n),
+          rule = roboptim.core.FiniteDifferenceRule.FIVE_POINTS)),
+        ("pool_serial", roboptim.core.PyFunctionPool
+         (engine, squares, "serial pool")),
+        ("pool_parallel", roboptim.core.PyFunctionPool
+         (engine, squares, "parallel pool", n_proc = 2)),
+    ]
+
+
+def latency (f, calls, repeat):
+    """
+    Best per-call latency (in seconds) of f over repeat measures.
+    """
+    f ()
+    return min (timeit.repeat (f, number = calls, repeat = repeat)) / calls
+
+
+def benchmarkFunctions (sizes, calls, repeat):
+    results = list ()
+    for n in sizes:
+        x = numpy.linspace (-1., 1., n)
+        for name, f in functions (n):
+            # Parallel evaluations are much slower: use fewer calls.
+            c = max (1, calls // 20) if name == "pool_parallel" else calls
+            entry = dict (function = name, inputSize = n,
+                          outputSize = f.outputSize ())
+            entry["compute"] = latency (lambda: f (x), c, repeat)
+            # The parallel pool only implements compute and jacobian.
+            entry["gradient"] = None if name == "pool_parallel" \
+                                else latency (lambda: f.gradient (x, 0),
+                                              c, repeat)
+            entry["jacobian"] = latency (lambda: f.jacobian (x), c, repeat)
+            results.append (entry)
+            print ("%-16s n=%-5i compute %.3es  gradient %s  jacobian %.3es"
+                   % (name, n, entry["compute"],
+                      "-" if entry["gradient"] is None
+                      else "%.3es" % entry["gradient"],
+                      entry["jacobian"]))
+            if hasattr (f, "close"):
+                f.close ()
+    return results
+
+
+def problem1 ():
+    problem = roboptim.core.PyProblem (schittkowski.Problem1_Cost ())
+    problem.startingPoint = numpy.array ([-2., 1.])
+    problem.argumentBounds = numpy.array ([[float ("-inf"), float ("inf")],
+                                           [-1.5, float ("inf")]])
+    return problem
+
+
+def problem6 ():
+    problem = roboptim.core.PyProblem (schittkowski.Problem6_Cost ())
+    problem.startingPoint = numpy.array ([-1.2, 1.])
+    problem.addConstraint (schittkowski.Problem6_G1 (), [0., 0.])
+    return problem
+
+
+def problem48 ():
+    problem = roboptim.core.PyProblem (schittkowski.Problem48_Cost ())
+    problem.startingPoint = numpy.array ([3., 5., -3., 2., -2.])
+    problem.addConstraint (schittkowski.Problem48_G1 (),
+                           numpy.array ([[5., 5.], [-3., -3.]]))
+    return problem
+
+
+def benchmarkSolves (repeat):
+    results = list ()
+    for name, build in [("schittkowski_1", problem1),
+                        ("schittkowski_6", problem6),
+                        ("schittkowski_48", problem48)]:
+        times = list ()
+        for i in range (repeat):
+            solver = roboptim.core.PySolver ("ipopt", build ())
+            solver.setParameter ("ipopt.print_level", 0)
+            start = timeit.default_timer ()
+            solver.solve ()
+            times.append (timeit.default_timer () - start)
+        results.append (dict (problem = name, solver = "ipopt",
+                              time = min (times),
+                              result = type (solver.minimum ()).__name__))
+        print ("%-16s solve %.3es" % (name, min (times)))
+    return results
+
+
+def main (argv):
+    output = argv[1] if len (argv) > 1 else "benchmark.json"
+    sizes = [int (n) for n in
+             os.environ.get ("ROBOPTIM_BENCHMARK_SIZES", "2,10,100").split (",")]
+    calls = int (os.environ.get ("ROBOPTIM_BENCHMARK_CALLS", "200"))
+    repeat = int (os.environ.get ("ROBOPTIM_BENCHMARK_REPEAT", "3"))
+
+    report = dict (python = platform.python_version (),
+                   numpy = numpy.__version__,
+                   platform = platform.platform (),
+                   calls = calls, repeat = repeat,
+                   functions = benchmarkFunctions (sizes, calls, repeat),
+                   solves = benchmarkSolves (repeat))
+
+    with open (output, "w") as f:
+        json.dump (report, f, indent = 2, sort_keys = True)
+    print ("Results written to %s" % output)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit (main (sys.argv))
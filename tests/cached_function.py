@@ -33,6 +33,26 @@ class Square (roboptim.core.PyDifferentiableFunction):
         result[0,0] = 2. * x[0]
         self.jacobian_counter += 1
 
+class FailingSquare (Square):
+    def __init__ (self):
+        Square.__init__ (self)
+        self.fail = True
+
+    def impl_compute (self, result, x):
+        Square.impl_compute (self, result, x)
+        if self.fail:
+            raise ValueError ("failure")
+
+class JointSquare (Square):
+    def __init__ (self):
+        Square.__init__ (self)
+        self.joint_counter = 0
+
+    def impl_value_jacobian (self, result, jacobian, x):
+        result[0] = x[0] * x[0]
+        jacobian[0,0] = 2. * x[0]
+        self.joint_counter += 1
+
 class TestFiniteDifferences(unittest.TestCase):
 
     def test_counters(self):
@@ -62,6 +82,102 @@ class TestFiniteDifferences(unittest.TestCase):
         numpy.testing.assert_almost_equal (jac2, [[2. * x[0]]], 5)
         assert square.jacobian_counter == 1
 
+    def test_cache_stats(self):
+        square = Square()
+        f = roboptim.core.PyCachedFunction (square, 2)
+
+        x = numpy.array ([4.])
+        f (x)
+        f (x)
+        f.gradient (x, 0)
+        self.assertEqual (f.cacheStats,
+                          dict (hits = 1, misses = 2, evictions = 0, size = 1))
+
+        # The least recently used point is evicted.
+        f (numpy.array ([5.]))
+        f (numpy.array ([6.]))
+        self.assertEqual (f.cacheStats["evictions"], 1)
+        self.assertEqual (f.cacheStats["size"], 2)
+        f (x)
+        assert square.compute_counter == 4
+
+        f.resetCacheStats ()
+        self.assertEqual (f.cacheStats["misses"], 0)
+        f.clearCache ()
+        self.assertEqual (f.cacheStats["size"], 0)
+
+        self.assertRaises (ValueError, roboptim.core.PyCachedFunction,
+                           square, 0)
+        self.assertRaises (ValueError, roboptim.core.PyCachedFunction,
+                           square, 10, -1.)
+
+    def test_tolerance(self):
+        square = Square()
+        f = roboptim.core.PyCachedFunction (square, 10, tolerance = 1e-9)
+
+        x = numpy.array ([0.1 + 0.2])
+        f (x)
+        f (numpy.array ([0.3]))
+        assert square.compute_counter == 1
+
+        # Exact matching
+        square.reset ()
+        f = roboptim.core.PyCachedFunction (square, 10)
+        f (x)
+        f (numpy.array ([0.3]))
+        assert square.compute_counter == 2
+
+    def test_joint(self):
+        square = JointSquare()
+        f = roboptim.core.PyCachedFunction (square, 10, joint = True)
+
+        # One call fills the value and the Jacobian.
+        x = numpy.array ([3.])
+        numpy.testing.assert_almost_equal (f (x), [9.])
+        assert square.joint_counter == 1
+        assert square.compute_counter == 0
+        assert square.jacobian_counter == 0
+
+        # Served from the joint entry
+        numpy.testing.assert_almost_equal (f.jacobian (x), [[6.]])
+        numpy.testing.assert_almost_equal (f.gradient (x, 0), [6.])
+        assert square.joint_counter == 1
+        assert square.gradient_counter == 0
+        self.assertEqual (f.cacheStats["hits"], 2)
+        self.assertEqual (f.cacheStats["misses"], 1)
+
+        # A Jacobian miss also fills the value.
+        x = numpy.array ([4.])
+        numpy.testing.assert_almost_equal (f.jacobian (x), [[8.]])
+        numpy.testing.assert_almost_equal (f (x), [16.])
+        assert square.joint_counter == 2
+        assert square.compute_counter == 0
+
+    def test_joint_fallback(self):
+        # Without impl_value_jacobian, nothing is evaluated speculatively.
+        square = Square()
+        f = roboptim.core.PyCachedFunction (square, 10, joint = True)
+
+        x = numpy.array ([3.])
+        numpy.testing.assert_almost_equal (f (x), [9.])
+        assert square.compute_counter == 1
+        assert square.jacobian_counter == 0
+        numpy.testing.assert_almost_equal (f.jacobian (x), [[6.]])
+        assert square.jacobian_counter == 1
+        self.assertEqual (f.cacheStats["misses"], 2)
+
+    def test_failures(self):
+        square = FailingSquare ()
+        square.errorMode = "nan"
+        f = roboptim.core.PyCachedFunction (square, 10)
+
+        # Failed evaluations are not cached.
+        x = numpy.array ([3.])
+        self.assertRaises (ValueError, f, x)
+        square.fail = False
+        numpy.testing.assert_almost_equal (f (x), [9.])
+        assert square.compute_counter == 2
+        self.assertEqual (f.cacheStats["misses"], 2)
 
 if __name__ == '__main__':
     unittest.main()
@@ -35,6 +35,29 @@ class Problem1_Cost (roboptim.core.PyDifferentiableFunction):
     def impl_gradient (self, result, x, functionId):
         raise NotImplementedError
 
+class VectorizedQuadratic (roboptim.core.PyDifferentiableFunction):
+    """
+    f(x) = (x², sum(x)) with a batch compute hook.
+    """
+    def __init__ (self, n):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, n, n + 1, "vectorized quadratic function")
+        self.compute_counter = 0
+        self.batch_counter = 0
+
+    def impl_compute (self, result, x):
+        self.compute_counter += 1
+        result[:-1] = x * x
+        result[-1] = numpy.sum (x)
+
+    def impl_compute_batch (self, result, X):
+        self.batch_counter += 1
+        result[:,:-1] = X * X
+        result[:,-1] = numpy.sum (X, axis=1)
+
+    def impl_gradient (self, result, x, f_id):
+        raise NotImplementedError
+
 
 class TestFiniteDifferences(unittest.TestCase):
 
@@ -80,6 +103,73 @@ class TestFiniteDifferences(unittest.TestCase):
         numpy.testing.assert_almost_equal (jac, [[2. * x[0]]], 5)
         assert square.compute_counter == 4
 
+    def test_jacobian_batch(self):
+        n = 5
+        x = numpy.arange (1., n + 1.)
+        expected = numpy.vstack ((numpy.diag (2. * x), numpy.ones (n)))
+
+        for fd_rule in [roboptim.core.FiniteDifferenceRule.SIMPLE,
+                        roboptim.core.FiniteDifferenceRule.FIVE_POINTS]:
+            quadratic = VectorizedQuadratic (n)
+            f = roboptim.core.PyFiniteDifference (quadratic, rule = fd_rule)
+
+            # All the perturbed points are evaluated in a single batch call
+            jac = f.jacobian (x)
+            numpy.testing.assert_almost_equal (jac, expected, 5)
+            self.assertEqual (quadratic.batch_counter, 1)
+            self.assertEqual (quadratic.compute_counter, 0)
+
+            grad = f.gradient (x, n)
+            numpy.testing.assert_almost_equal (grad, numpy.ones (n), 5)
+            self.assertEqual (quadratic.batch_counter, 2)
+            self.assertEqual (quadratic.compute_counter, 0)
+
+    def test_jacobian_colored(self):
+        # Block-diagonal Jacobian: 2x2 blocks
+        n = 4
+
+        class Blocks (roboptim.core.PyDifferentiableFunction):
+            def __init__ (self):
+                roboptim.core.PyDifferentiableFunction.__init__ \
+                    (self, 2 * n, 2 * n, "block-diagonal function")
+                self.compute_counter = 0
+
+            def impl_compute (self, result, x):
+                self.compute_counter += 1
+                for i in range (n):
+                    result[2*i] = x[2*i] * x[2*i+1]
+                    result[2*i+1] = x[2*i] + 2. * x[2*i+1]
+
+            def impl_gradient (self, result, x, f_id):
+                raise NotImplementedError
+
+        pattern = numpy.kron (numpy.eye (n), numpy.ones ((2, 2))) > 0
+        x = numpy.arange (1., 2 * n + 1.)
+        expected = numpy.zeros ((2 * n, 2 * n))
+        for i in range (n):
+            expected[2*i:2*i+2, 2*i:2*i+2] = [[x[2*i+1], x[2*i]], [1., 2.]]
+
+        blocks = Blocks ()
+        f = roboptim.core.PyFiniteDifference (blocks, pattern = pattern)
+        self.assertEqual (f.directions, 2)
+
+        jac = f.jacobian (x)
+        numpy.testing.assert_almost_equal (jac, expected, 5)
+        # x, then one point per color
+        self.assertEqual (blocks.compute_counter, 3)
+
+        blocks.compute_counter = 0
+        grad = f.gradient (x, 2)
+        numpy.testing.assert_almost_equal (grad, expected[2], 5)
+        self.assertEqual (blocks.compute_counter, 3)
+
+        # Without sparsity pattern, every column is perturbed
+        blocks.compute_counter = 0
+        f = roboptim.core.PyFiniteDifference (blocks)
+        self.assertEqual (f.directions, 2 * n)
+        numpy.testing.assert_almost_equal (f.jacobian (x), expected, 5)
+        self.assertEqual (blocks.compute_counter, 2 * n + 1)
+
     def test_problem_1(self):
         """
         Schittkowski problem #1
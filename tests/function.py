@@ -8,6 +8,7 @@ import roboptim.core
 import numpy, numpy.testing
 import pickle
 import os
+import threading
 from concurrent.futures import ProcessPoolExecutor, as_completed
 
 class Square (roboptim.core.PyDifferentiableFunction):
@@ -49,6 +50,119 @@ class DoubleSquare (roboptim.core.PyDifferentiableFunction):
     def impl_gradient (self, result, x, f_id):
         result[0] = 2. * x[0]
 
+class Linear (roboptim.core.PyDifferentiableFunction):
+    """
+    f(x) = A x, with a Jacobian written in the declared layout.
+    """
+    A = numpy.array ([[1., 2., 3.], [4., 5., 6.]])
+
+    def __init__ (self, layout = None):
+        self.jacobianLayout = layout
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, 3, 2, "linear function")
+        self.layouts = list ()
+
+    def impl_compute (self, result, x):
+        result[:] = self.A.dot (x)
+
+    def impl_gradient (self, result, x, f_id):
+        result[:] = self.A[f_id]
+
+    def impl_jacobian (self, result, x):
+        self.layouts.append ("C" if result.flags["C_CONTIGUOUS"] else "F")
+        result[:] = self.A
+
+class LogBarrier (roboptim.core.PyDifferentiableFunction):
+    """
+    f(x) = 10 x - log (x), undefined (raising) for x <= 0.
+    """
+    def __init__ (self):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, 1, 1, "log barrier")
+
+    def impl_compute (self, result, x):
+        if x[0] <= 0.:
+            raise ValueError ("x must be positive")
+        result[0] = 10. * x[0] - numpy.log (x[0])
+
+    def impl_gradient (self, result, x, f_id):
+        if x[0] <= 0.:
+            raise ValueError ("x must be positive")
+        result[0] = 10. - 1. / x[0]
+
+class FailingGradients (roboptim.core.PyDifferentiableFunction):
+    """
+    Two outputs, without Jacobian callback: the gradient of the first one
+    raises.
+    """
+    def __init__ (self):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, 2, 2, "failing gradients")
+        self.gradients = list ()
+
+    def impl_compute (self, result, x):
+        result[:] = x
+
+    def impl_gradient (self, result, x, f_id):
+        self.gradients.append (f_id)
+        if f_id == 0:
+            raise ValueError ("gradient failure")
+        result[:] = [0., 1.]
+
+class VectorizedSquare (Square):
+    def __init__ (self):
+        Square.__init__ (self)
+        self.batch_counter = 0
+
+    def impl_compute_batch (self, result, X):
+        self.batch_counter += 1
+        result[:,0] = X[:,0] * X[:,0]
+
+    def impl_jacobian_batch (self, result, X):
+        self.batch_counter += 1
+        result[:,0,0] = 2. * X[:,0]
+
+class SparseSquares (roboptim.core.PySparseDifferentiableFunction):
+    """
+    f(x) = (x_0 - 1)^2 + (x_2 + 2)^2 with a sparse Jacobian: x_1 is unused.
+    """
+    def __init__ (self):
+        roboptim.core.PySparseDifferentiableFunction.__init__ \
+            (self, 3, 1, "sparse squares", numpy.array ([[1., 0., 1.]]))
+
+    def impl_compute (self, result, x):
+        result[0] = (x[0] - 1.)**2 + (x[2] + 2.)**2
+
+    def impl_jacobian (self, result, x):
+        # Fill the solver buffer in place (one entry per column of the pattern)
+        result.data[:] = [2. * (x[0] - 1.), 2. * (x[2] + 2.)]
+
+class DenseSquares (roboptim.core.PyDifferentiableFunction):
+    """
+    Dense version of SparseSquares.
+    """
+    def __init__ (self):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, 3, 1, "dense squares")
+
+    def impl_compute (self, result, x):
+        result[0] = (x[0] - 1.)**2 + (x[2] + 2.)**2
+
+    def impl_gradient (self, result, x, f_id):
+        result[:] = [2. * (x[0] - 1.), 0., 2. * (x[2] + 2.)]
+
+class SparseDiagonal (roboptim.core.PySparseDifferentiableFunction):
+    def __init__ (self):
+        roboptim.core.PySparseDifferentiableFunction.__init__ \
+            (self, 3, 3, "sparse diagonal", numpy.eye (3))
+
+    def impl_compute (self, result, x):
+        result[:] = x * x
+
+    def impl_jacobian (self, result, x):
+        import scipy.sparse
+        return scipy.sparse.diags (2. * x)
+
 def test_function_multiprocess (args):
     f = args[0]
     x = args[1]
@@ -105,6 +219,54 @@ class TestFunctionPy(unittest.TestCase):
         self.assertEqual (f.jacobian (x), 2. * x[0])
         self.assertEqual ("square function (differentiable function)", "%s" % f)
 
+    def test_batch(self):
+        X = numpy.linspace (-2., 2., 11).reshape (11, 1)
+
+        # Point-by-point fallback
+        f = Square ()
+        numpy.testing.assert_almost_equal (f.computeBatch (X), X * X)
+        numpy.testing.assert_almost_equal (f.gradientBatch (X, 0), 2. * X)
+        jac = f.jacobianBatch (X)
+        self.assertEqual (jac.shape, (11, 1, 1))
+        numpy.testing.assert_almost_equal (jac[:,:,0], 2. * X)
+
+        # Vectorized callbacks: one call per batch
+        g = VectorizedSquare ()
+        numpy.testing.assert_almost_equal (g.computeBatch (X), X * X)
+        numpy.testing.assert_almost_equal (g.jacobianBatch (X)[:,:,0], 2. * X)
+        self.assertEqual (g.batch_counter, 2)
+
+        # Output arrays have to be writeable without copy
+        out = numpy.zeros ((11, 1), order='F')[::2]
+        self.assertRaises (TypeError, roboptim.core.computeBatch,
+                           g._function, out, X)
+        self.assertRaises (ValueError, roboptim.core.computeBatch,
+                           g._function, numpy.zeros ((3, 1)), X)
+
+    def test_readonly_arguments(self):
+        class Writer (roboptim.core.PyDifferentiableFunction):
+            def __init__ (self):
+                roboptim.core.PyDifferentiableFunction.__init__ \
+                    (self, 1, 1, "writer")
+                self.flags = list ()
+
+            def impl_compute (self, result, x):
+                self.flags.append (x.flags.writeable)
+                x[0] = 0.
+                result[0] = 1.
+
+            def impl_gradient (self, result, x, f_id):
+                self.flags.append (x.flags.writeable)
+                result[0] = 0.
+
+        # Callbacks cannot modify the argument (e.g. the solver iterate).
+        f = Writer ()
+        x = numpy.array ([3.])
+        self.assertRaises (ValueError, f, x)
+        numpy.testing.assert_array_equal (x, [3.])
+        f.gradient (x, 0)
+        self.assertEqual (f.flags, [False, False])
+
     def test_function_pickle(self):
         f = SquareJacobian ()
         file_name = "test_function_pickle.dump"
@@ -227,6 +389,412 @@ class TestFunctionPy(unittest.TestCase):
 
         print (solver)
 
+    def test_solver_threads(self):
+        # The GIL is released during solve(), and taken back by the Python
+        # callbacks, so several solvers can run in parallel threads.
+        def solve (i, results):
+            problem = roboptim.core.PyProblem (Square ())
+            problem.startingPoint = numpy.array([i + 1.,])
+            problem.argumentBounds = numpy.array([[-5.,5.],])
+            solver = roboptim.core.PySolver ("ipopt", problem)
+            solver.solve ()
+            results[i] = solver.minimum ()
+
+        results = dict()
+        threads = [threading.Thread (target=solve, args=(i, results))
+                   for i in range(4)]
+        for t in threads:
+            t.start ()
+        for t in threads:
+            t.join ()
+
+        self.assertEqual (len(results), 4)
+        for r in results.values ():
+            self.assertIsInstance (r, roboptim.core.PyResult)
+            numpy.testing.assert_almost_equal (r.x, [0.], 5)
+
+    def test_solver_multistart(self):
+        problem = roboptim.core.PyProblem (Square ())
+        problem.argumentBounds = numpy.array([[-5.,5.],])
+        solver = roboptim.core.PySolver ("ipopt", problem)
+
+        startingPoints = numpy.array([[-4.,], [1.,], [3.,]])
+        results, best = solver.solveMultiStart (startingPoints, 2)
+
+        self.assertEqual (len(results), 3)
+        self.assertTrue (0 <= best < 3)
+        for r in results:
+            self.assertIsInstance (r, roboptim.core.PyResult)
+            numpy.testing.assert_almost_equal (r.x, [0.], 5)
+
+        # Starting points must match the problem size
+        self.assertRaises (ValueError, solver.solveMultiStart,
+                           numpy.zeros ((3, 2)))
+
+    def test_stats(self):
+        f = Square ()
+        x = numpy.array ([2.])
+
+        # Disabled by default
+        f (x)
+        self.assertFalse (f.stats["enabled"])
+        self.assertEqual (f.stats["compute"]["calls"], 0)
+
+        f.enableStats ()
+        for i in range (3):
+            f (x)
+        f.gradient (x, 0)
+        stats = f.stats
+        self.assertTrue (stats["enabled"])
+        self.assertEqual (stats["compute"]["calls"], 3)
+        self.assertEqual (stats["gradient"]["calls"], 1)
+        compute = stats["compute"]
+        self.assertGreater (compute["total"], 0.)
+        self.assertLessEqual (compute["max"], compute["total"])
+        self.assertLessEqual (compute["python"], compute["total"])
+        self.assertAlmostEqual (compute["python"] + compute["bridge"],
+                                compute["total"])
+
+        f.resetStats ()
+        self.assertEqual (f.stats["compute"]["calls"], 0)
+
+        # A Jacobian built from the gradients only counts the gradients.
+        f.jacobian (x)
+        self.assertEqual (f.stats["jacobian"]["calls"], 0)
+        self.assertEqual (f.stats["gradient"]["calls"], 1)
+        f.resetStats ()
+
+        # Statistics aggregated per problem after a solve
+        problem = roboptim.core.PyProblem (f)
+        problem.argumentBounds = numpy.array([[-5.,5.],])
+        problem.startingPoint = numpy.array([3.,])
+        problem.enableStats ()
+        solver = roboptim.core.PySolver ("ipopt", problem)
+        solver.solve ()
+        self.assertIn ("cost", solver.stats)
+        self.assertGreater (solver.stats["total"]["compute"]["calls"], 0)
+        self.assertEqual (solver.stats["total"]["compute"]["calls"],
+                          solver.stats["cost"]["compute"]["calls"])
+
+    def test_out_buffers(self):
+        f = DoubleSquare ()
+        x = numpy.array ([3.])
+
+        # Evaluation into caller-provided buffers
+        out = numpy.zeros (2)
+        self.assertIs (f (x, out = out), out)
+        numpy.testing.assert_almost_equal (out, [9., 9.])
+        g = numpy.zeros (1)
+        self.assertIs (f.gradient (x, 0, out = g), g)
+        self.assertEqual (g[0], 6.)
+
+        # Reusable buffers
+        self.assertIsNot (f (x), f (x))
+        f.reuseBuffers ()
+        self.assertIs (f (x), f (x))
+        self.assertIs (f.jacobian (x), f.jacobian (x))
+        f.reuseBuffers (False)
+
+        # Hidden copies are counted, and written back to the output
+        f.resetStats ()
+        strided = numpy.zeros ((2, 2))[:,0]
+        f (numpy.array ([3], dtype = int), out = strided)
+        numpy.testing.assert_almost_equal (strided, [9., 9.])
+        self.assertEqual (f.stats["copies"], 2)
+
+        # Sequences are converted without being counted
+        f ([3.])
+        self.assertEqual (f.stats["copies"], 2)
+
+        # Strict mode rejects the copies
+        f.strict = True
+        self.assertTrue (f.strict)
+        self.assertRaises (ValueError, f, numpy.array ([3], dtype = int))
+        self.assertRaises (ValueError, f, x, strided)
+        numpy.testing.assert_almost_equal (f (x), [9., 9.])
+        self.assertEqual (f.stats["copies"], 2)
+
+        # Wrong sizes are rejected
+        self.assertRaises (ValueError, f, x, numpy.zeros (3))
+        self.assertRaises (ValueError, f, numpy.zeros (2))
+
+    def test_jacobian_layout(self):
+        f = Linear ()
+        x = numpy.array ([1., 1., 1.])
+        f.strict = True
+
+        # Both layouts and strided views are written in place, without copy.
+        for out in (numpy.zeros ((2, 3), order = "C"),
+                    numpy.zeros ((2, 3), order = "F"),
+                    numpy.zeros ((4, 6))[::2, 1::2],
+                    numpy.zeros ((3, 2)).T):
+            self.assertIs (f.jacobian (x, out = out), out)
+            numpy.testing.assert_almost_equal (out, Linear.A)
+        self.assertEqual (f.stats["copies"], 0)
+
+        # Declared callback layouts.
+        storage = numpy.zeros ((2, 2), order = f.order ())
+        self.assertEqual (roboptim.core.getJacobianLayout (f._function),
+                          "C" if storage.flags["C_CONTIGUOUS"] else "F")
+        for layout in ("C", "F"):
+            g = Linear (layout)
+            self.assertEqual (roboptim.core.getJacobianLayout (g._function),
+                              layout)
+            numpy.testing.assert_almost_equal (g.jacobian (x), Linear.A)
+            self.assertEqual (g.layouts, [layout])
+        self.assertRaises (ValueError, roboptim.core.setJacobianLayout,
+                           f._function, "x")
+
+        # The declared layout is kept for vector-shaped Jacobians.
+        h = LogBarrier ()
+        for layout in ("C", "F"):
+            roboptim.core.setJacobianLayout (h._function, layout)
+            self.assertEqual (roboptim.core.getJacobianLayout (h._function),
+                              layout)
+
+        # The temporary of strided outputs is reused between calls.
+        out = numpy.zeros ((4, 6))[::2, 1::2]
+        for i in range (2):
+            self.assertIs (f.jacobian (x, out = out), out)
+            numpy.testing.assert_almost_equal (out, Linear.A)
+
+    def test_error_modes(self):
+        f = LogBarrier ()
+        self.assertEqual (f.errorMode, "raise")
+        self.assertRaises (ValueError, setattr, f, "errorMode", "ignore")
+
+        # Outside of a solve, the original exception is raised.
+        for mode in ("raise", "nan"):
+            f.errorMode = mode
+            self.assertRaises (ValueError, f, numpy.array ([-1.]))
+        self.assertEqual (f.stats["failures"], 2)
+        f.resetStats ()
+
+        problem = roboptim.core.PyProblem (f)
+
+        # "raise": the solve is aborted, and the exception is raised again
+        # with its traceback.
+        f.errorMode = "raise"
+        problem.startingPoint = numpy.array ([-1.])
+        solver = roboptim.core.PySolver ("ipopt", problem)
+        try:
+            solver.solve ()
+            self.fail ("the exception of the callback was not raised")
+        except ValueError as e:
+            self.assertEqual (str (e), "x must be positive")
+            if hasattr (e, "__traceback__"):
+                import traceback
+                frames = traceback.extract_tb (e.__traceback__)
+                self.assertEqual (frames[-1][2], "impl_compute")
+
+        # "nan": failures are reported to the solver, that backtracks. From
+        # x = 5, the first (quasi-Newton) trial step crosses x <= 0.
+        f.errorMode = "nan"
+        f.resetStats ()
+        problem.startingPoint = numpy.array ([5.])
+        solver = roboptim.core.PySolver ("ipopt", problem)
+        solver.solve ()
+        r = solver.minimum ()
+        self.assertIsInstance (r, roboptim.core.PyResult)
+        numpy.testing.assert_almost_equal (r.x, [0.1], 5)
+        self.assertGreater (solver.evaluationFailures, 0)
+        self.assertEqual (solver.evaluationFailures, f.stats["failures"])
+        self.assertIsInstance (solver.evaluationError, ValueError)
+
+    def test_composite_errors(self):
+        # The Jacobian built from the gradients stops at the first failure,
+        # and the original exception is raised.
+        f = FailingGradients ()
+        x = numpy.array ([1., 2.])
+        self.assertRaises (ValueError, f.jacobian, x)
+        self.assertEqual (f.gradients, [0])
+
+        # "nan": the other gradients are evaluated, the exception being
+        # raised once the evaluation returned.
+        f.errorMode = "nan"
+        del f.gradients[:]
+        self.assertRaises (ValueError, f.jacobian, x)
+        self.assertEqual (f.gradients, [0, 1])
+        self.assertEqual (f.stats["failures"], 2)
+
+        # No error is left pending.
+        numpy.testing.assert_almost_equal (f (x), x)
+
+    def test_native_functions(self):
+        x = numpy.array ([1., 2.])
+
+        linear = roboptim.core.PyLinearFunction \
+            (numpy.array ([[1., 2.], [3., 4.], [5., 6.]]), [1., 0., -1.])
+        self.assertEqual (linear.outputSize (), 3)
+        numpy.testing.assert_almost_equal (linear (x), [6., 11., 16.])
+        numpy.testing.assert_almost_equal (linear.gradient (x, 1), [3., 4.])
+        numpy.testing.assert_almost_equal \
+            (linear.jacobian (x), [[1., 2.], [3., 4.], [5., 6.]])
+
+        quadratic = roboptim.core.PyQuadraticFunction \
+            (numpy.array ([[2., 0.], [0., 4.]]), [1., -1.], 3.)
+        numpy.testing.assert_almost_equal (quadratic (x), [11.])
+        numpy.testing.assert_almost_equal (quadratic.gradient (x, 0), [3., 7.])
+
+        constant = roboptim.core.PyConstantFunction (2, [4., 5.])
+        numpy.testing.assert_almost_equal (constant (x), [4., 5.])
+        numpy.testing.assert_almost_equal (constant.jacobian (x),
+                                           numpy.zeros ((2, 2)))
+
+        identity = roboptim.core.PyIdentityFunction ([1., 1.])
+        numpy.testing.assert_almost_equal (identity (x), [2., 3.])
+
+        self.assertRaises (ValueError, roboptim.core.PyLinearFunction,
+                           numpy.ones ((2, 2)), [1., 2., 3.])
+        self.assertRaises (ValueError, roboptim.core.PyQuadraticFunction,
+                           numpy.ones ((2, 3)))
+
+        # Pickled native functions are rebuilt from their arguments
+        g = pickle.loads (pickle.dumps (linear))
+        numpy.testing.assert_almost_equal (g (x), linear (x))
+
+        # Native constraints added at once, with stacked bounds
+        problem = roboptim.core.PyProblem (Square ())
+        problem.startingPoint = numpy.array ([3.,])
+        g1 = roboptim.core.PyLinearFunction (numpy.array ([[1.]]))
+        g2 = roboptim.core.PyIdentityFunction ([0.])
+        problem.addConstraints ([g1, g2], numpy.array ([[1., 5.], [-10., 10.]]),
+                                numpy.array ([1., 0.5]))
+        self.assertEqual (problem.constraints, [g1, g2])
+        self.assertRaises (TypeError, problem.addConstraints,
+                           [g1, g2], numpy.array ([[1., 5.]]))
+
+        solver = roboptim.core.PySolver ("ipopt", problem)
+        solver.setParameter ("ipopt.print_level", 0)
+        solver.solve ()
+        r = solver.minimum ()
+        self.assertIsInstance (r, roboptim.core.PyResult)
+        numpy.testing.assert_almost_equal (r.x, [1.], 5)
+
+    def test_operators(self):
+        x = numpy.array ([3.])
+        f = Square ()
+        A = roboptim.core.PyLinearFunction (numpy.array ([[2.], [-1.]]),
+                                            [1., 0.])
+
+        h = 2. * f + 1.
+        numpy.testing.assert_almost_equal (h (x), [19.])
+        numpy.testing.assert_almost_equal (h.gradient (x, 0), [12.])
+        numpy.testing.assert_almost_equal ((f - f / 2.) (x), [4.5])
+        numpy.testing.assert_almost_equal ((-f) (x), [-9.])
+
+        # Chain rule through a native and a Python function
+        g = f (A[0])
+        self.assertIsInstance (g, roboptim.core.PyChain)
+        numpy.testing.assert_almost_equal (g (x), [49.])
+        numpy.testing.assert_almost_equal (g.jacobian (x), [[28.]])
+        numpy.testing.assert_almost_equal (A[-1] (x), [-3.])
+        numpy.testing.assert_almost_equal (A[0:2] (x), A (x))
+
+        c = roboptim.core.concatenate (f, A, DoubleSquare ())
+        self.assertEqual (c.outputSize (), 5)
+        numpy.testing.assert_almost_equal (c (x), [9., 7., -3., 9., 9.])
+        numpy.testing.assert_almost_equal (c.jacobian (x),
+                                           [[6.], [2.], [-1.], [6.], [6.]])
+
+        b = roboptim.core.PyBind \
+            (roboptim.core.PyLinearFunction (numpy.array ([[1., 2.]])),
+             [None, 3.])
+        self.assertEqual (b.inputSize (), 1)
+        numpy.testing.assert_almost_equal (b (numpy.array ([1.])), [7.])
+
+        self.assertRaises (ValueError, lambda: f + A)
+        self.assertRaises (ValueError, lambda: A (A))
+        self.assertRaises (IndexError, lambda: A[2])
+
+        # Expressions are pickled with their operands
+        numpy.testing.assert_almost_equal (pickle.loads (pickle.dumps (h)) (x),
+                                           h (x))
+
+        # Solvers evaluate the whole expression natively
+        problem = roboptim.core.PyProblem (g)
+        problem.startingPoint = numpy.array ([3.])
+        solver = roboptim.core.PySolver ("ipopt", problem)
+        solver.setParameter ("ipopt.print_level", 0)
+        solver.solve ()
+        r = solver.minimum ()
+        self.assertIsInstance (r, roboptim.core.PyResult)
+        numpy.testing.assert_almost_equal (r.x, [-0.5], 5)
+
+    def test_sparse(self):
+        f = SparseDiagonal ()
+        x = numpy.array ([1., 2., 3.])
+        jac = f.jacobian (x)
+        self.assertEqual (jac.nnz, 3)
+        numpy.testing.assert_almost_equal (jac.toarray (), numpy.diag (2. * x))
+        numpy.testing.assert_almost_equal (f.gradient (x, 1), [0., 4., 0.])
+
+        cost = SparseSquares ()
+        numpy.testing.assert_almost_equal \
+            (cost.jacobian (x).toarray (), [[0., 0., 10.]])
+
+        problem = roboptim.core.PyProblem (cost)
+        self.assertTrue (problem.sparse)
+        problem.startingPoint = numpy.array ([0., 0., 0.])
+        problem.argumentBounds = numpy.array ([[-5., 5.],] * 3)
+        problem.addConstraint (f, numpy.array ([[0., 10.],] * 3))
+
+        solver = roboptim.core.PySolver ("ipopt-sparse", problem)
+        self.assertRaises (NotImplementedError, solver.addIterationCallback,
+                           None)
+        solver.solve ()
+        r = solver.minimum ()
+        self.assertIsInstance (r, roboptim.core.PyResult)
+        numpy.testing.assert_almost_equal (r.x[[0, 2]], [1., -2.], 5)
+
+        # Pickled sparse functions keep their sparsity pattern
+        g = pickle.loads (pickle.dumps (f))
+        self.assertEqual (g.jacobian (x).nnz, 3)
+
+    def test_sparse_structure(self):
+        class Corrupting (SparseDiagonal):
+            def impl_jacobian (self, result, x):
+                result.data[:] = 2. * x
+                result.indices[0] = 2
+
+        # The structure of the solver Jacobian cannot be modified.
+        f = Corrupting ()
+        self.assertRaises (ValueError, f.jacobian, numpy.array ([1., 2., 3.]))
+
+    def test_sparse_problem(self):
+        # Dense costs take sparse constraints in explicitly sparse problems.
+        self.assertRaises (TypeError, roboptim.core.PyProblem (DenseSquares ())
+                           .addConstraint, SparseDiagonal (),
+                           numpy.array ([[0., 10.],] * 3))
+        self.assertRaises (ValueError, roboptim.core.PyProblem,
+                           SparseSquares (), False)
+
+        problem = roboptim.core.PyProblem (DenseSquares (), sparse = True)
+        self.assertTrue (problem.sparse)
+        problem.startingPoint = numpy.array ([0., 0., 0.])
+        problem.argumentBounds = numpy.array ([[-5., 5.],] * 3)
+        problem.addConstraint (SparseDiagonal (), numpy.array ([[0., 10.],] * 3))
+        problem.addConstraint (Linear (), numpy.array ([[-20., 20.],] * 2))
+
+        solver = roboptim.core.PySolver ("ipopt-sparse", problem)
+        solver.solve ()
+        r = solver.minimum ()
+        self.assertIsInstance (r, roboptim.core.PyResult)
+        numpy.testing.assert_almost_equal (r.x[[0, 2]], [1., -2.], 5)
+
+        # Features not supported by sparse problems are rejected.
+        self.assertRaises (NotImplementedError, solver.addIterationCallback,
+                           lambda pb, state: None)
+        self.assertRaises (NotImplementedError, solver.solveMultiStart,
+                           numpy.zeros ((2, 3)))
+        self.assertRaises (NotImplementedError, solver.solveAsync)
+        self.assertRaises (NotImplementedError, roboptim.core.PySolver,
+                           "ipopt-sparse", problem, log_dir = "/tmp")
+        self.assertRaises (NotImplementedError,
+                           roboptim.core.PyFiniteDifference, SparseDiagonal ())
+        self.assertRaises (NotImplementedError, SparseDiagonal ().jacobianBatch,
+                           numpy.zeros ((2, 3)))
+
 
 if __name__ == '__main__':
     unittest.main()
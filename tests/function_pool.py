@@ -55,6 +55,16 @@ class Engine (roboptim.core.PyDifferentiableFunction):
     def getJac (self, idx, var_idx):
         return self.jac[idx, var_idx]
 
+class FailingEngine (Engine):
+    def __init__ (self, n):
+        Engine.__init__ (self, n)
+        self.fail = False
+
+    def computeData (self, x):
+        Engine.computeData (self, x)
+        if self.fail:
+            raise RuntimeError ("engine failure")
+
 class Square (roboptim.core.PyDifferentiableFunction):
     def __init__ (self, engine, idx):
         roboptim.core.PyDifferentiableFunction.__init__ \
@@ -126,6 +136,60 @@ class TestFunctionPoolPy(unittest.TestCase):
         assert engine.jacobian_counter == 1
         engine.reset ()
 
+    def test_pool_dedup(self):
+        n = 3
+        engine = Engine (n)
+        functions = [Square (engine, float(i)) for i in range (n)]
+        pool = roboptim.core.PyFunctionPool (engine, functions, "Dummy pool")
+
+        x = np.array([10., -5., 1., 2., -1., 1.])
+        expected = [xi**2 + yi**2 for xi,yi in x.reshape(engine.n, 2) ]
+
+        # Same x: the engine is only evaluated once.
+        np.testing.assert_almost_equal (pool (x), expected)
+        np.testing.assert_almost_equal (pool (x), expected)
+        pool.jacobian (x)
+        pool.jacobian (x)
+        assert engine.compute_counter == 1
+        assert engine.jacobian_counter == 1
+        self.assertEqual (pool.skippedEngineCalls,
+                          dict (compute = 1, jacobian = 1))
+
+        # New x
+        x2 = 2. * x
+        np.testing.assert_almost_equal (pool (x2), 4. * np.array (expected))
+        assert engine.compute_counter == 2
+
+        # Engine state modified outside of the pool
+        engine (x)
+        pool.invalidateEngine ()
+        np.testing.assert_almost_equal (pool (x2), 4. * np.array (expected))
+        assert engine.compute_counter == 4
+
+        pool.resetSkippedEngineCalls ()
+        self.assertEqual (pool.skippedEngineCalls,
+                          dict (compute = 0, jacobian = 0))
+
+    def test_pool_failure(self):
+        n = 3
+        engine = FailingEngine (n)
+        functions = [Square (engine, float(i)) for i in range (n)]
+        pool = roboptim.core.PyFunctionPool (engine, functions, "Dummy pool")
+        x = np.array([10., -5., 1., 2., -1., 1.])
+
+        # A failed evaluation is not cached: the same x is evaluated again.
+        for mode in ("raise", "nan"):
+            engine.errorMode = mode
+            engine.fail = True
+            self.assertRaises (RuntimeError, pool, x)
+            engine.fail = False
+            np.testing.assert_almost_equal (pool (x),
+                    [xi**2 + yi**2 for xi,yi in x.reshape(engine.n, 2) ])
+            pool.invalidateEngine ()
+        assert engine.compute_counter == 4
+        self.assertEqual (pool.skippedEngineCalls,
+                          dict (compute = 0, jacobian = 0))
+
     def test_pool_fd(self):
         n = 3
         engine = Engine (n)
@@ -173,14 +237,13 @@ class TestFunctionPoolPy(unittest.TestCase):
         x = np.array([10., -5., 1., 2., -1., 1.])
         assert len(x) == 2 * n
 
+        # The engine only runs in the workers, not in this process.
         res = pool (x)
-        np.testing.assert_almost_equal (engine.data,
-                [xi**2 + yi**2 for xi,yi in x.reshape(engine.n, 2) ])
+        np.testing.assert_almost_equal (engine.data, np.zeros (engine.n))
         np.testing.assert_almost_equal (res,
                 [xi**2 + yi**2 for xi,yi in x.reshape(engine.n, 2) ])
-        assert engine.compute_counter == 1
+        assert engine.compute_counter == 0
         assert engine.jacobian_counter == 0
-        engine.reset ()
 
         pool_jac = pool.jacobian (x)
         jac = np.zeros ((engine.n, 2*engine.n))
@@ -189,8 +252,28 @@ class TestFunctionPoolPy(unittest.TestCase):
                 jac[i,2*i+j] = 2. * x[2*i+j]
         np.testing.assert_almost_equal (pool_jac, jac)
         assert engine.compute_counter == 0
-        assert engine.jacobian_counter == 1
-        engine.reset ()
+        assert engine.jacobian_counter == 0
+
+        # Same x: nothing is evaluated again.
+        np.testing.assert_almost_equal (pool (x),
+                [xi**2 + yi**2 for xi,yi in x.reshape(engine.n, 2) ])
+        np.testing.assert_almost_equal (pool.jacobian (x), jac)
+        assert engine.compute_counter == 0
+        assert engine.jacobian_counter == 0
+        self.assertEqual (pool.skippedEngineCalls,
+                          dict (compute = 1, jacobian = 1))
+
+        # Workers are persistent: later evaluations reuse them
+        workers = pool._workers
+        assert workers is not None
+        x2 = 2. * x
+        np.testing.assert_almost_equal (pool (x2),
+                [xi**2 + yi**2 for xi,yi in x2.reshape(engine.n, 2) ])
+        np.testing.assert_almost_equal (pool.jacobian (x2), 2. * jac)
+        assert pool._workers is workers
+
+        pool.close ()
+        assert pool._workers is None
 
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,156 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""
+Memory-growth regression tests.
+
+Repeat direct evaluations and solves while sampling the resident set size
+and the Python allocations (tracemalloc, which also tracks NumPy buffers),
+and fail if the memory grows by more than a threshold per iteration.
+
+The resident set size is only known by pages, and the allocators reserve
+memory by blocks: the RSS growth over the whole run may exceed the
+threshold by a fixed number of pages, which a leak of a few bytes per
+iteration outgrows for the default number of iterations.
+
+Environment variables:
+  ROBOPTIM_MEMORY_CALLS   number of direct evaluations (default: 200000)
+  ROBOPTIM_MEMORY_SOLVES  number of solves (default: 200)
+  ROBOPTIM_MEMORY_BYTES   maximum growth per iteration in bytes (default: 2)
+  ROBOPTIM_MEMORY_PAGES   RSS growth allowed over the threshold, in pages
+                          (default: 64)
+"""
+from __future__ import \
+    print_function, unicode_literals, absolute_import, division
+
+import gc
+import os
+import resource
+import unittest
+
+import numpy
+import roboptim.core
+
+import schittkowski
+
+try:
+    import tracemalloc
+except ImportError:
+    tracemalloc = None
+
+calls = int (os.environ.get ("ROBOPTIM_MEMORY_CALLS", "200000"))
+solves = int (os.environ.get ("ROBOPTIM_MEMORY_SOLVES", "200"))
+threshold = float (os.environ.get ("ROBOPTIM_MEMORY_BYTES", "2"))
+pages = int (os.environ.get ("ROBOPTIM_MEMORY_PAGES", "64"))
+
+
+def rss ():
+    """
+    Current resident set size in bytes (peak RSS if /proc is unavailable).
+    """
+    try:
+        with open ("/proc/self/statm") as f:
+            return int (f.read ().split ()[1]) * resource.getpagesize ()
+    except (IOError, OSError):
+        return resource.getrusage (resource.RUSAGE_SELF).ru_maxrss * 1024
+
+
+class Counter (roboptim.core.PySolverCallback):
+    def __init__ (self, pb):
+        roboptim.core.PySolverCallback.__init__ (self, pb)
+        self.iterations = 0
+
+    def callback (self, pb, state):
+        # Access the state parameters to exercise the conversions.
+        state.parameters
+        self.iterations += 1
+
+
+class TestMemory (unittest.TestCase):
+
+    def measure (self, name, step, iterations):
+        """
+        Run step () iterations times (after a warm-up, to fill caches and
+        allocator pools), and return the total growth in bytes.
+        """
+        warmup = max (1, iterations // 10)
+        for i in range (warmup):
+            step ()
+        gc.collect ()
+
+        if tracemalloc:
+            tracemalloc.start ()
+            traced = tracemalloc.get_traced_memory ()[0]
+        start = rss ()
+
+        for i in range (iterations):
+            step ()
+        gc.collect ()
+
+        rssGrowth = rss () - start
+        tracedGrowth = 0
+        if tracemalloc:
+            tracedGrowth = tracemalloc.get_traced_memory ()[0] - traced
+            tracemalloc.stop ()
+
+        print ("%-24s %8i iterations: RSS %+.3f B/iter, traced %+.3f B/iter"
+               % (name, iterations, rssGrowth / iterations,
+                  tracedGrowth / iterations))
+        return rssGrowth, tracedGrowth
+
+    def check (self, name, step, iterations, factor = 1):
+        """
+        Check that the memory grows by less than factor * threshold bytes
+        per iteration. The RSS may grow by a fixed number of pages more,
+        the traced allocations (known to the byte) by a single one.
+        """
+        rssGrowth, tracedGrowth = self.measure (name, step, iterations)
+        pageSize = resource.getpagesize ()
+        bound = factor * threshold * iterations
+        self.assertLessEqual (rssGrowth, bound + pages * pageSize,
+                              "%s: RSS grows by %.3f B/iter"
+                              % (name, rssGrowth / iterations))
+        self.assertLessEqual (tracedGrowth, bound + pageSize,
+                              "%s: Python allocations grow by %.3f B/iter"
+                              % (name, tracedGrowth / iterations))
+
+    def test_evaluations (self):
+        f = schittkowski.Problem48_Cost ()
+        g = schittkowski.Problem48_G1 ()
+        x = numpy.array ([3., 5., -3., 2., -2.])
+        value = numpy.zeros (1)
+        grad = numpy.zeros (5)
+        jac = numpy.zeros ((2, 5), order = g.order ())
+
+        self.check ("compute",
+                    lambda: roboptim.core.compute (f._function, value, x),
+                    calls)
+        self.check ("gradient",
+                    lambda: roboptim.core.gradient (f._function, grad, x, 0),
+                    calls)
+        self.check ("jacobian",
+                    lambda: roboptim.core.jacobian (g._function, jac, x),
+                    calls)
+
+    def test_solves (self):
+        def solve ():
+            problem = roboptim.core.PyProblem (schittkowski.Problem48_Cost ())
+            problem.startingPoint = numpy.array ([3., 5., -3., 2., -2.])
+            problem.addConstraint (schittkowski.Problem48_G1 (),
+                                   numpy.array ([[5., 5.], [-3., -3.]]))
+            solver = roboptim.core.PySolver ("ipopt", problem)
+            solver.setParameter ("ipopt.print_level", 0)
+            solver.addIterationCallback (Counter (problem))
+            solver.solve ()
+            r = solver.minimum ()
+            # Result conversions
+            r.x, r.value, r.constraints, r.lagrange
+            solver.parameters
+
+        # A solve performs many allocations: allow more growth per solve,
+        # while still catching leaks of a whole problem or per-iteration
+        # state capsules.
+        self.check ("solve", solve, solves, factor = 64)
+
+
+if __name__ == '__main__':
+    unittest.main ()
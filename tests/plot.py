@@ -19,8 +19,55 @@ class F(roboptim.core.PyFunction):
     def impl_compute (self, result, x):
         result[0] = x[0] * x[1]
 
+class G(roboptim.core.PyFunction):
+    """
+    Function of 4 variables with a vectorized implementation.
+    """
+    def __init__ (self):
+        roboptim.core.PyFunction.__init__ (self, 4, 2, "dummy function")
+        self.batches = 0
+
+    def impl_compute (self, result, x):
+        result[0] = x[0] * x[2] + x[3]
+        result[1] = x[1]
+
+    def impl_compute_batch (self, result, X):
+        self.batches += 1
+        result[:,0] = X[:,0] * X[:,2] + X[:,3]
+        result[:,1] = X[:,1]
+
 class TestPlot(unittest.TestCase):
 
+    def test_compute_z(self):
+        g = G()
+        point = [0., 5., 0., 1.]
+        plotter = Plotter2D([-1,1],[-2,2], point = point, axes = (0, 2))
+        x = numpy.linspace(-1, 1, 7)
+        y = numpy.linspace(-2, 2, 5)
+        X, Y = numpy.meshgrid(x, y)
+
+        # A single batch call for the whole grid.
+        Z = plotter.compute_z(g, X, Y)
+        self.assertEqual(g.batches, 1)
+        numpy.testing.assert_almost_equal(Z, X * Y + 1.)
+
+        plotter.output = 1
+        numpy.testing.assert_almost_equal(plotter.compute_z(g, X, Y),
+                                          5. * numpy.ones(X.shape))
+
+        # Chunks evaluated in parallel
+        plotter.output = 0
+        for backend in ["threads", "processes"]:
+            plotter.n_jobs = 3
+            plotter.backend = backend
+            numpy.testing.assert_almost_equal(plotter.compute_z(g, X, Y),
+                                              X * Y + 1.)
+
+        # Plain Python callables
+        plotter = Plotter2D([-1,1],[-2,2])
+        numpy.testing.assert_almost_equal \
+            (plotter.compute_z(lambda x: x[0] - x[1], X, Y), X - Y)
+
     def test_2d_plot(self):
         f = F()
         plotter = Plotter2D([-10,10],[-10,10])
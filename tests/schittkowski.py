@@ -22,6 +22,27 @@ class Problem1_Cost (roboptim.core.PyDifferentiableFunction):
         result[1] = 200. * (x[1] - x[0]**2)
 
 
+class Problem1_TwiceCost (roboptim.core.PyTwiceDifferentiableFunction):
+    def __init__ (self):
+        roboptim.core.PyTwiceDifferentiableFunction.__init__ \
+            (self, 2, 1, "100 (x₁ - x₀²)² + (1 - x₀)²")
+        self.hessian_counter = 0
+
+    def impl_compute (self, result, x):
+        result[0] = 100. * (x[1] - x[0]**2)**2 + (1. - x[0])**2
+
+    def impl_gradient (self, result, x, functionId):
+        result[0] = -400. * x[0] * (x[1] - x[0] ** 2) - 2. * (1. - x[0])
+        result[1] = 200. * (x[1] - x[0]**2)
+
+    def impl_hessian (self, result, x, functionId):
+        self.hessian_counter += 1
+        result[0,0] = 1200. * x[0]**2 - 400. * x[1] + 2.
+        result[0,1] = -400. * x[0]
+        result[1,0] = -400. * x[0]
+        result[1,1] = 200.
+
+
 class Problem6_Cost (roboptim.core.PyDifferentiableFunction):
     def __init__ (self):
         roboptim.core.PyDifferentiableFunction.__init__ \
@@ -150,6 +171,41 @@ class TestFunctionPy(unittest.TestCase):
         numpy.testing.assert_almost_equal (r.value, [0.])
         numpy.testing.assert_almost_equal (r.x, [1., 1.])
 
+    def test_problem_1_hessian(self):
+        """
+        Schittkowski problem #1, with and without exact Hessian
+        """
+        cost = Problem1_TwiceCost ()
+        numpy.testing.assert_almost_equal (cost.hessian ([-2., 1.]),
+                                           [[4402., 800.], [800., 200.]])
+
+        # Only twice differentiable problems expose a Hessian.
+        self.assertFalse (roboptim.core.PyProblem (Problem1_Cost ()).hasHessian)
+        self.assertFalse (roboptim.core.PyProblem (cost, sparse = True).hasHessian)
+        problem = roboptim.core.PyProblem (cost)
+        self.assertTrue (problem.hasHessian)
+        problem.addConstraint (Problem6_G1 (), [0., float("inf")])
+        self.assertFalse (problem.hasHessian)
+
+        calls = dict ()
+        for approximation in ["exact", "limited-memory"]:
+            problem = roboptim.core.PyProblem (cost)
+            problem.startingPoint = numpy.array([-2., 1., ])
+            problem.argumentBounds = numpy.array([[float("-inf"), float("inf")],
+                                                  [-1.5, float("inf")], ])
+
+            cost.hessian_counter = 0
+            solver = roboptim.core.PySolver ("ipopt", problem)
+            solver.setParameter("ipopt.hessian_approximation", approximation)
+            solver.solve ()
+            r = solver.minimum ()
+            numpy.testing.assert_almost_equal (r.x, [1., 1.], 5)
+            calls[approximation] = cost.hessian_counter
+
+        # The solver evaluates the Hessian callback only if asked to.
+        self.assertGreater (calls["exact"], 0)
+        self.assertEqual (calls["limited-memory"], 0)
+
     def test_problem_2(self):
         """
         Schittkowski problem #2
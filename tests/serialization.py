@@ -0,0 +1,134 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+from __future__ import \
+    print_function, unicode_literals, absolute_import, division
+
+import pickle
+import unittest
+import roboptim.core
+import roboptim.core.serialization as serialization
+import numpy, numpy.testing
+
+import schittkowski
+
+class Shifted (roboptim.core.PyDifferentiableFunction):
+    """
+    Python-backed function rebuilt from its serialization arguments.
+    """
+    def __init__ (self, shift):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, 2, 1, "(x₀ - shift)² + x₁²")
+        self.shift = shift
+
+    def serializationArguments (self):
+        return (self.shift,)
+
+    def impl_compute (self, result, x):
+        result[0] = (x[0] - self.shift)**2 + x[1]**2
+
+    def impl_gradient (self, result, x, functionId):
+        result[0] = 2. * (x[0] - self.shift)
+        result[1] = 2. * x[1]
+
+def problem48 ():
+    problem = roboptim.core.PyProblem (schittkowski.Problem48_Cost ())
+    problem.startingPoint = numpy.array ([3., 5., -3., 2., -2.])
+    # Same constraint as Problem48_G1, implemented natively.
+    A = numpy.array ([[1., 1., 1., 1., 1.], [0., 0., 1., -2., -2.]])
+    problem.addConstraint (roboptim.core.PyLinearFunction (A),
+                           numpy.array ([[5., 5.], [-3., -3.]]))
+    return problem
+
+class TestSerialization (unittest.TestCase):
+
+    def test_values (self):
+        value = dict (a = None, b = [True, False, 1, 2.5, "é", b"\x00"],
+                      c = (numpy.arange (6.).reshape (2, 3),
+                           numpy.array ([1, 2]), numpy.array ([True])))
+        result = serialization.loads (serialization.dumps (value))
+        self.assertEqual (result["a"], None)
+        self.assertEqual (result["b"], value["b"])
+        self.assertIsInstance (result["c"], tuple)
+        for expected, array in zip (value["c"], result["c"]):
+            numpy.testing.assert_array_equal (expected, array)
+            self.assertEqual (expected.dtype.kind, array.dtype.kind)
+        # Decoded arrays are writable.
+        result["c"][0][0, 0] = 1.
+
+        self.assertRaises (ValueError, serialization.loads, b"invalid")
+        self.assertRaises (ValueError, serialization.loads,
+                           serialization.dumps ([1., 2.])[:-1])
+        self.assertRaises (TypeError, serialization.dumps, object ())
+
+    def test_problem (self):
+        problem = problem48 ()
+        problem.argumentScaling = numpy.full (5, 2.)
+        problem.addConstraints ([roboptim.core.PyIdentityFunction
+                                 (numpy.zeros (5))[0:2],
+                                 schittkowski.Problem48_G1 ()],
+                                numpy.array ([[-10., 10.]] * 4),
+                                numpy.array ([1., 1., 0.5, 0.5]))
+
+        blob = serialization.dumpProblem (problem)
+        loaded = serialization.loadProblem (blob)
+        self.assertIsInstance (loaded.cost, schittkowski.Problem48_Cost)
+        numpy.testing.assert_array_equal (loaded.startingPoint,
+                                          problem.startingPoint)
+        numpy.testing.assert_array_equal (loaded.argumentBounds,
+                                          problem.argumentBounds)
+        numpy.testing.assert_array_equal (loaded.argumentScaling,
+                                          problem.argumentScaling)
+        self.assertEqual ([type (c) for c in loaded.constraints],
+                          [type (c) for c in problem.constraints])
+        for (b1, s1), (b2, s2) in zip (loaded.constraintBounds,
+                                       problem.constraintBounds):
+            numpy.testing.assert_array_equal (b1, b2)
+            numpy.testing.assert_array_equal (s1, s2)
+
+        # Native functions are rebuilt natively.
+        x = numpy.array ([1., 2., 3., 4., 5.])
+        for c1, c2 in zip (loaded.constraints, problem.constraints):
+            numpy.testing.assert_almost_equal (c1 (x), c2 (x))
+            numpy.testing.assert_almost_equal (c1.jacobian (x),
+                                               c2.jacobian (x))
+
+        # Pickling uses the binary format.
+        loaded = pickle.loads (pickle.dumps (problem))
+        self.assertEqual (len (loaded.constraints), 3)
+
+    def test_python_arguments (self):
+        problem = roboptim.core.PyProblem (Shifted (3.))
+        problem.startingPoint = numpy.array ([0., 1.])
+        loaded = serialization.loadProblem (serialization.dumpProblem (problem))
+        self.assertEqual (loaded.cost.shift, 3.)
+        self.assertEqual (loaded.cost (numpy.array ([3., 2.]))[0], 4.)
+
+    def test_dispatch (self):
+        solvers = list ()
+        for start in ([3., 5., -3., 2., -2.], [0., 0., 0., 0., 0.]):
+            problem = problem48 ()
+            problem.startingPoint = numpy.array (start)
+            solver = roboptim.core.PySolver ("ipopt", problem)
+            solver.setParameter ("ipopt.print_level", 0)
+            solvers.append (solver)
+
+        job = serialization.loadJob (serialization.dumpJob (solvers[0]))
+        self.assertEqual (job.parameters["ipopt.print_level"][1], 0)
+
+        results = serialization.dispatch (solvers, max_workers = 2)
+        self.assertEqual (len (results), 2)
+        for r in results:
+            self.assertIsInstance (r, roboptim.core.PyResult)
+            numpy.testing.assert_almost_equal (r.x, [1.] * 5, 5)
+            numpy.testing.assert_almost_equal (r.value, [0.], 5)
+
+        # Results are returned in the same binary form.
+        solvers[0].solve ()
+        local = solvers[0].minimum ()
+        remote = serialization.loadResult (serialization.dumpResult (local))
+        numpy.testing.assert_array_equal (remote.x, local.x)
+        numpy.testing.assert_array_equal (remote.lagrange, local.lagrange)
+        self.assertEqual (remote.warnings, local.warnings)
+
+if __name__ == '__main__':
+    unittest.main ()
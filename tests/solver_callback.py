@@ -4,7 +4,9 @@ from __future__ import \
     print_function, unicode_literals, absolute_import, division
 
 import unittest
+import concurrent.futures
 import os
+import threading
 import numpy, numpy.testing
 
 import roboptim.core
@@ -39,6 +41,60 @@ class IterCallback (roboptim.core.PySolverCallback):
         print("[iter %i]\n%s\n" % (self.iter, state))
         self.iter += 1
 
+class Rosenbrock (roboptim.core.PyDifferentiableFunction):
+    def __init__ (self):
+        roboptim.core.PyDifferentiableFunction.__init__ \
+            (self, 2, 1, "Rosenbrock")
+
+    def impl_compute (self, result, x):
+        result[0] = (1. - x[0])**2 + 100. * (x[1] - x[0]**2)**2
+
+    def impl_gradient (self, result, x, functionId):
+        result[0] = -2. * (1. - x[0]) - 400. * x[0] * (x[1] - x[0]**2)
+        result[1] = 200. * (x[1] - x[0]**2)
+
+class CostRecorder (roboptim.core.PySolverCallback):
+    def __init__ (self, pb):
+        roboptim.core.PySolverCallback.__init__ (self, pb)
+        self.costs = list ()
+
+    def callback (self, pb, state):
+        self.costs.append (state.cost)
+
+class StateRecorder (roboptim.core.PySolverCallback):
+    """
+    Keep the views on x, and copies of their values.
+    """
+    def __init__ (self, pb):
+        roboptim.core.PySolverCallback.__init__ (self, pb)
+        self.views = list ()
+        self.values = list ()
+
+    def callback (self, pb, state):
+        x = state.x
+        self.writable = x.flags.writeable
+        self.views.append (x)
+        self.values.append (numpy.array (x))
+
+class Canceller (roboptim.core.PySolverCallback):
+    """
+    Cancel a future at a given iteration, and wait for the release event
+    (if any) at each iteration.
+    """
+    def __init__ (self, pb, iteration):
+        roboptim.core.PySolverCallback.__init__ (self, pb)
+        self.iteration = iteration
+        self.iterations = 0
+        self.future = None
+        self.release = None
+
+    def callback (self, pb, state):
+        if self.release is not None:
+            self.release.wait ()
+        self.iterations += 1
+        if self.iterations == self.iteration:
+            self.future.cancel ()
+
 class TestSolverCallbackPy(unittest.TestCase):
 
     def test_callback(self):
@@ -77,5 +133,211 @@ class TestSolverCallbackPy(unittest.TestCase):
         self.assertTrue(os.path.isdir(log_dir))
         self.assertTrue(os.path.isdir(os.path.join(log_dir, 'iteration-0')))
 
+    def test_callback_filters(self):
+        problem = roboptim.core.PyProblem (Rosenbrock ())
+        problem.startingPoint = numpy.array([-1.2, 1.])
+
+        every = CostRecorder (problem)
+        improvement = CostRecorder (problem)
+        throttled = CostRecorder (problem)
+        unfiltered = CostRecorder (problem)
+
+        solver = roboptim.core.PySolver (nlp_solver, problem)
+        solver.setParameter ("ipopt.print_level", 0)
+        solver.addIterationCallback (unfiltered)
+        solver.addIterationCallback (every, every = 3)
+        solver.addIterationCallback (improvement, onImprovement = True)
+        solver.addIterationCallback (throttled, interval = 3600.)
+        self.assertRaises (ValueError, solver.addIterationCallback,
+                           CostRecorder (problem), every = 0)
+        solver.solve ()
+
+        n = len (unfiltered.costs)
+        self.assertGreater (n, 3)
+        self.assertEqual (every.costs, unfiltered.costs[::3])
+        self.assertEqual (throttled.costs, unfiltered.costs[:1])
+
+        # Strictly decreasing costs, all seen by the unfiltered callback
+        improving = improvement.costs
+        self.assertGreater (len (improving), 0)
+        self.assertLessEqual (len (improving), n)
+        for a, b in zip (improving, improving[1:]):
+            self.assertLess (b, a)
+        for c in improving:
+            self.assertIn (c, unfiltered.costs)
+
+    def test_state_views(self):
+        problem = roboptim.core.PyProblem (Rosenbrock ())
+        problem.startingPoint = numpy.array([-1.2, 1.])
+
+        recorder = StateRecorder (problem)
+        monitor = CostRecorder (problem)
+        solver = roboptim.core.PySolver (nlp_solver, problem)
+        solver.setParameter ("ipopt.print_level", 0)
+        solver.addIterationCallback (monitor)
+        solver.addIterationCallback (recorder)
+        solver.solve ()
+        r = solver.minimum ()
+        self.assertGreater (len (recorder.views), 3)
+
+        # Views kept after the callback are detached: they keep the values
+        # of their iteration, and are read-only.
+        self.assertTrue (recorder.writable)
+        for view, value in zip (recorder.views, recorder.values):
+            numpy.testing.assert_array_equal (view, value)
+            self.assertFalse (view.flags.writeable)
+
+        # Result views keep the result alive.
+        x = r.x
+        lagrange = r.lagrange
+        del r, solver, recorder
+        numpy.testing.assert_almost_equal (x, [1., 1.], 4)
+        self.assertEqual (lagrange.dtype, numpy.float64)
+
+    def test_history(self):
+        problem = roboptim.core.PyProblem (Rosenbrock ())
+        problem.startingPoint = numpy.array([-1.2, 1.])
+
+        history_dir = "/tmp/roboptim-core-python/test_history"
+        solver = roboptim.core.PySolver (nlp_solver, problem,
+                                         history_dir = history_dir,
+                                         history_parameters = ["missing"])
+        solver.setParameter ("ipopt.print_level", 0)
+        recorder = CostRecorder (problem)
+        solver.addIterationCallback (recorder)
+        solver.solve ()
+
+        history = solver.history
+        self.assertEqual (set (history.keys ()),
+                          set (["x", "cost", "constraint_violation",
+                                "missing"]))
+        n = len (recorder.costs)
+        self.assertEqual (history["x"].shape, (n, 2))
+        self.assertIsInstance (history["cost"], numpy.memmap)
+        numpy.testing.assert_almost_equal (history["cost"], recorder.costs)
+        self.assertTrue (numpy.all (numpy.isnan (history["missing"])))
+        for name in history:
+            self.assertTrue (os.path.isfile (os.path.join (history_dir,
+                                                           name + ".npy")))
+
+        # Without history
+        solver = roboptim.core.PySolver (nlp_solver, problem)
+        self.assertIsNone (solver.history)
+
+    def test_resolve(self):
+        problem = roboptim.core.PyProblem (Rosenbrock ())
+        problem.startingPoint = numpy.array([-1.2, 1.])
+
+        solver = roboptim.core.PySolver (nlp_solver, problem)
+        solver.setParameter ("ipopt.print_level", 0)
+        recorder = CostRecorder (problem)
+        solver.addIterationCallback (recorder)
+        solver.solve ()
+        r = solver.minimum ()
+        numpy.testing.assert_almost_equal (r.x, [1., 1.], 4)
+        self.assertIn (nlp_solver, roboptim.core.loadedSolverPlugins ())
+        n = len (recorder.costs)
+
+        # Warm start from the last solution: few iterations are needed.
+        r = solver.resolve ()
+        numpy.testing.assert_almost_equal (r.x, [1., 1.], 4)
+        self.assertGreater (len (recorder.costs), n)
+        self.assertLess (len (recorder.costs) - n, n)
+        self.assertIn ("ipopt.print_level", solver.parameters)
+
+        # New starting point and bounds
+        r = solver.resolve (numpy.array([0., 0.]),
+                            numpy.array([[float("-inf"), 0.5],
+                                         [float("-inf"), float("inf")]]))
+        self.assertAlmostEqual (r.x[0], 0.5, 4)
+        self.assertAlmostEqual (r.x[1], 0.25, 4)
+
+        # Not solved yet: the problem starting point is used.
+        problem.argumentBounds = numpy.array([[float("-inf"), float("inf")],
+                                              [float("-inf"), float("inf")]])
+        log_dir = "/tmp/roboptim-core-python/test_resolve"
+        solver = roboptim.core.PySolver (nlp_solver, problem,
+                                         log_dir = log_dir)
+        solver.setParameter ("ipopt.print_level", 0)
+        self.assertFalse (roboptim.core.isSolved (solver._solver))
+        r = solver.resolve ()
+        self.assertTrue (roboptim.core.isSolved (solver._solver))
+        numpy.testing.assert_almost_equal (r.x, [1., 1.], 4)
+
+        # Loggers are bound to one solve, and do not prevent a new solve.
+        r = solver.resolve ()
+        numpy.testing.assert_almost_equal (r.x, [1., 1.], 4)
+
+    def test_solve_async(self):
+        problem = roboptim.core.PyProblem (Rosenbrock ())
+        problem.startingPoint = numpy.array([-1.2, 1.])
+
+        solver = roboptim.core.PySolver (nlp_solver, problem)
+        solver.setParameter ("ipopt.print_level", 0)
+        canceller = Canceller (problem, 0)
+        solver.addIterationCallback (canceller)
+
+        future = solver.solveAsync ()
+        self.assertIsInstance (future, concurrent.futures.Future)
+        r = future.result (timeout = 60)
+        numpy.testing.assert_almost_equal (r.x, [1., 1.], 4)
+        # Too late: the result is kept.
+        self.assertFalse (future.cancel ())
+        self.assertFalse (future.cancelled ())
+        progress = future.progress
+        self.assertEqual (progress["iterations"], canceller.iterations)
+        self.assertFalse (progress["stopped"])
+        self.assertAlmostEqual (progress["cost"], 0., 6)
+        n = canceller.iterations
+
+        # Cancel a running solve: it stops at the next iteration boundary.
+        canceller.iterations = 0
+        canceller.iteration = 3
+        future = solver.solveAsync ()
+        canceller.future = future
+        self.assertRaises (concurrent.futures.CancelledError,
+                           future.result, 60)
+        self.assertIsInstance (future.exception (),
+                               concurrent.futures.CancelledError)
+        # Running futures cannot be cancelled: the error marks the stop.
+        self.assertFalse (future.cancelled ())
+        self.assertFalse (future.cancel ())
+        self.assertTrue (future.progress["stopped"])
+        self.assertLessEqual (future.progress["iterations"], 4)
+        self.assertLess (canceller.iterations, n)
+
+        # One solve at a time
+        canceller.release = threading.Event ()
+        future = solver.solveAsync ()
+        self.assertRaises (RuntimeError, solver.solveAsync)
+        self.assertRaises (RuntimeError, solver.solve)
+        canceller.release.set ()
+        future.result (timeout = 60)
+        canceller.release = None
+
+        # Deadline
+        canceller.iteration = 0
+        future = solver.solveAsync (deadline = 1e-9)
+        future.result (timeout = 60)
+        self.assertTrue (future.progress["stopped"])
+        self.assertLessEqual (future.progress["iterations"], 2)
+
+        # A later synchronous solve is not stopped.
+        solver.solve ()
+        numpy.testing.assert_almost_equal (solver.minimum ().x, [1., 1.], 4)
+
+        # Coroutines wait for the solve through asyncio.
+        try:
+            import asyncio
+        except ImportError:
+            return
+        loop = asyncio.new_event_loop ()
+        try:
+            r = loop.run_until_complete \
+                (asyncio.wrap_future (solver.solveAsync (), loop = loop))
+        finally:
+            loop.close ()
+        numpy.testing.assert_almost_equal (r.x, [1., 1.], 4)
+
 if __name__ == '__main__':
     unittest.main()
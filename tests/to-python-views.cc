@@ -0,0 +1,55 @@
+// Copyright (C) 2015 by Benjamin Chrétien, CNRS-LIRMM.
+//
+// This file is part of roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "shared-tests/fixture.hh"
+
+#include <sstream>
+
+#include <Eigen/Core>
+
+#include <roboptim/core/python/to-python.hh>
+
+using namespace roboptim;
+using namespace roboptim::python;
+
+// NumPy cannot be imported again after Py_Finalize, so this test gets its
+// own process.
+BOOST_AUTO_TEST_SUITE (to_python_views)
+
+BOOST_AUTO_TEST_CASE (views)
+{
+  ToPython tp;
+
+  Eigen::VectorXd v (3);
+  v << 1., 2., 3.;
+
+  // No copy: changes of v are seen by Python.
+  tp.set ("v", v);
+  tp << "print(v.sum())";
+  v[0] = 4.;
+  tp << "print(v.sum())";
+
+  // Read-only view
+  BOOST_CHECK_THROW (tp << "v[0] = 0.", std::runtime_error);
+
+  std::stringstream output;
+  tp >> output;
+  BOOST_CHECK_EQUAL (output.str (), "6.0\n9.0\n");
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -18,6 +18,10 @@
 #include "shared-tests/fixture.hh"
 
 #include <iostream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <roboptim/core/python/to-python.hh>
 
@@ -77,4 +81,65 @@ BOOST_AUTO_TEST_CASE (simultaneous)
   BOOST_CHECK (output->match_pattern ());
 }
 
+void increment (const ToPython* tp, int n)
+{
+  for (int i = 0; i < n; ++i)
+    (*tp) << "counter += 1";
+}
+
+BOOST_AUTO_TEST_CASE (threads)
+{
+  ToPython tp;
+  tp << "counter = 0";
+
+  boost::thread_group threads;
+  for (int i = 0; i < 4; ++i)
+    threads.create_thread (boost::bind (&increment, &tp, 1000));
+  threads.join_all ();
+
+  tp << "print(counter)";
+
+  std::stringstream output;
+  tp >> output;
+  BOOST_CHECK_EQUAL (output.str (), "4000\n");
+}
+
+void destroy (ToPython* tp)
+{
+  delete tp;
+}
+
+BOOST_AUTO_TEST_CASE (finalize_other_thread)
+{
+  ToPython* tp = new ToPython;
+  (*tp) << "x = 1";
+
+  // The last instance is destroyed by another thread.
+  boost::thread thread (boost::bind (&destroy, tp));
+  thread.join ();
+
+  // The interpreter can be initialized again.
+  ToPython tp2;
+  tp2 << "print(2)";
+
+  std::stringstream output;
+  tp2 >> output;
+  BOOST_CHECK_EQUAL (output.str (), "2\n");
+}
+
+BOOST_AUTO_TEST_CASE (bounded_output)
+{
+  ToPython::setBufferCapacity (4);
+
+  ToPython tp;
+  tp << "print('abcdefgh')";
+
+  // Only the last characters are kept.
+  std::stringstream output;
+  tp >> output;
+  BOOST_CHECK_EQUAL (output.str (), "fgh\n");
+
+  ToPython::setBufferCapacity (1 << 20);
+}
+
 BOOST_AUTO_TEST_SUITE_END ()
@@ -2,6 +2,7 @@
 from __future__ import \
     print_function, unicode_literals, absolute_import, division
 
+import ctypes
 import os
 import unittest
 import shutil
@@ -74,6 +75,40 @@ class TestFunction(unittest.TestCase):
         self.assertEqual (x, [15.,])
         self.assertEqual (result, [30.,])
 
+    def test_native_types(self):
+        def compute(result, x):
+            result[0] = x[0] * x[0]
+        def gradient(result, x, functionId):
+            result[0] = 2 * x[0]
+
+        f = roboptim.core.DifferentiableFunction (1, 1, "x * x")
+        self.assertIsInstance (f, roboptim.core.FunctionType)
+        roboptim.core.bindCompute(f, compute)
+        roboptim.core.bindGradient(f, gradient)
+
+        # Methods of the function objects
+        numpy.testing.assert_almost_equal (f.compute (None, [3.,]), [9.,])
+        numpy.testing.assert_almost_equal (f.gradient (None, [3.,], 0), [6.,])
+        result = numpy.zeros ((1, 1))
+        f.jacobian (result, [3.,])
+        numpy.testing.assert_almost_equal (result, [[6.,]])
+        self.assertRaises (TypeError, f.compute, None)
+
+        g = roboptim.core.Function (1, 1, "x * x")
+        roboptim.core.bindCompute(g, compute)
+        self.assertRaises (TypeError, g.jacobian, None, [3.,])
+
+        problem = roboptim.core.Problem (f)
+        self.assertIsInstance (problem, roboptim.core.ProblemType)
+        self.assertRaises (TypeError, roboptim.core.compute,
+                           problem, None, [3.,])
+        self.assertRaises (TypeError, roboptim.core.FunctionType)
+
+        # Tags of the wrapper types
+        cached = roboptim.core.CachedFunction (f)
+        roboptim.core.getCacheStats (cached)
+        self.assertRaises (TypeError, roboptim.core.getCacheStats, f)
+
     def test_badcompute(self):
         def badcallback():
             pass
@@ -111,9 +146,22 @@ class TestFunction(unittest.TestCase):
 
         x = [15.,]
         gradient = numpy.array([0.,])
-        roboptim.core.gradient (f, gradient, x, 0)
+        self.assertIsNone (roboptim.core.gradient (f, gradient, x, 0))
         self.assertEqual (gradient, [30.,])
 
+        # The output is allocated when None is given.
+        numpy.testing.assert_almost_equal \
+            (roboptim.core.gradient (f, None, x, 0), [30.,])
+        numpy.testing.assert_almost_equal \
+            (roboptim.core.compute (f, None, x), [225.,])
+
+        # Non-differentiable functions are rejected.
+        g = roboptim.core.Function (1, 1, "x * x")
+        roboptim.core.bindCompute(g, compute)
+        self.assertRaises (TypeError, roboptim.core.gradient, g, None, x, 0)
+        self.assertRaises (TypeError, roboptim.core.jacobian, g, None, x)
+        self.assertRaises (TypeError, roboptim.core.gradient, f, None, x)
+
     def test_jacobian(self):
         def compute(result, x):
             result[0] = x[0] + x[1]
@@ -152,6 +200,10 @@ class TestFunction(unittest.TestCase):
         expected_jacobian = numpy.array([[1., 1.], [1., -1.], [10., 15.]])
         numpy.testing.assert_almost_equal (jacobian, expected_jacobian)
 
+        jacobian = roboptim.core.jacobian (f, None, x)
+        self.assertEqual (jacobian.shape, (outputSize, inputSize))
+        numpy.testing.assert_almost_equal (jacobian, expected_jacobian)
+
     def test_finite_differences(self):
         def compute(result, x):
             result[0] = x[0] * x[0]
@@ -225,6 +277,56 @@ class TestFunction(unittest.TestCase):
         self.assertEqual (gradient2, [20.,])
 
 
+    def test_native_callbacks(self):
+        NativeCallback = roboptim.core.NativeCallback
+
+        # a (x0^2 + x1^2), with a given as user data
+        @NativeCallback
+        def compute(out, x, n, m, userdata):
+            a = ctypes.cast (userdata, ctypes.POINTER (ctypes.c_double))[0]
+            out[0] = a * (x[0] * x[0] + x[1] * x[1])
+        @NativeCallback
+        def gradient(out, x, n, functionId, userdata):
+            a = ctypes.cast (userdata, ctypes.POINTER (ctypes.c_double))[0]
+            for i in range (n):
+                out[i] = 2. * a * x[i]
+
+        a = numpy.array ([3.])
+        f = roboptim.core.DifferentiableFunction (2, 1, "a (x0^2 + x1^2)")
+        roboptim.core.bindCompute (f, compute, a)
+        roboptim.core.bindGradient (f, gradient, a)
+
+        x = numpy.array ([1., 2.])
+        numpy.testing.assert_almost_equal (roboptim.core.compute (f, None, x),
+                                           [15.])
+        numpy.testing.assert_almost_equal \
+            (roboptim.core.gradient (f, None, x, 0), [6., 12.])
+        # Built from the native gradient
+        numpy.testing.assert_almost_equal (roboptim.core.jacobian (f, None, x),
+                                           [[6., 12.]])
+
+        # The user data is read at each evaluation.
+        a[0] = 1.
+        numpy.testing.assert_almost_equal (roboptim.core.compute (f, None, x),
+                                           [5.])
+
+        # Integer addresses
+        address = ctypes.cast (compute, ctypes.c_void_p).value
+        roboptim.core.bindCompute (f, address, a.ctypes.data)
+        numpy.testing.assert_almost_equal (roboptim.core.compute (f, None, x),
+                                           [5.])
+
+        # Back to a Python callback
+        def pyCompute(result, x):
+            result[0] = 0.
+        roboptim.core.bindCompute (f, pyCompute)
+        numpy.testing.assert_almost_equal (roboptim.core.compute (f, None, x),
+                                           [0.])
+
+        self.assertRaises (TypeError, roboptim.core.bindCompute, f, pyCompute,
+                           a)
+        self.assertRaises (ValueError, roboptim.core.bindCompute, f, 0)
+
     def test_function_pool(self):
         data = numpy.zeros(2)
 